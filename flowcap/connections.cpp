@@ -0,0 +1,258 @@
+
+#include "connections.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#include <pthread.h>
+#include <unistd.h>
+
+
+// Parse the connection option at argv[i], advancing i past its
+// value. Returns 1 if the option was parsed, 0 if it is not a
+// connection option, or -1 if its value is invalid.
+int
+parse_connection_option(int argc, char* argv[], int& i, Connection_options& opts)
+{
+  std::string opt = argv[i];
+  if (opt != "--connections" && opt != "--threads" && opt != "--partition")
+    return 0;
+  if (i + 1 == argc)
+    return -1;
+  std::string val = argv[++i];
+  if (opt == "--partition") {
+    if (val == "flow")
+      opts.partition = flow_partition;
+    else if (val == "round-robin")
+      opts.partition = round_robin_partition;
+    else
+      return -1;
+    return 1;
+  }
+  int n = std::atoi(val.c_str());
+  if (n <= 0)
+    return -1;
+  (opt == "--connections" ? opts.connections : opts.threads) = n;
+  return 1;
+}
+
+
+// Parse a comma separated list of ports.
+bool
+parse_ports(std::string const& s, std::vector<std::uint16_t>& ports)
+{
+  std::stringstream ss(s);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    char* end;
+    long n = std::strtol(item.c_str(), &end, 10);
+    if (*end || n <= 0 || n > 65535)
+      return false;
+    ports.push_back(n);
+  }
+  return !ports.empty();
+}
+
+
+namespace
+{
+
+// Accumulates an FNV-1a hash. The low bits of FNV-1a are weak when
+// fields repeat bytes (e.g., an address and a port that both follow
+// the flow number), so the value is finished with a mixing step
+// before it is reduced to a connection number.
+struct Fnv
+{
+  void add(std::uint8_t const* p, int n)
+  {
+    for (int i = 0; i < n; ++i)
+      h = (h ^ p[i]) * 16777619u;
+  }
+
+  std::uint32_t value() const
+  {
+    std::uint32_t x = h;
+    x ^= x >> 16;
+    x *= 0x85ebca6bu;
+    x ^= x >> 13;
+    x *= 0xc2b2ae35u;
+    x ^= x >> 16;
+    return x;
+  }
+
+  std::uint32_t h = 2166136261u;
+};
+
+} // namespace
+
+
+// Returns a hash of the addresses, protocol and ports of an Ethernet
+// frame carrying IPv4 or IPv6, so that the packets of a flow hash
+// alike. VLAN tags are skipped. Fragments are hashed without ports,
+// and other frames by their MAC addresses.
+std::uint32_t
+flow_hash(std::uint8_t const* p, int n)
+{
+  Fnv h;
+  if (n < 14) {
+    h.add(p, n);
+    return h.value();
+  }
+  int off = 14;
+  int type = (p[12] << 8) | p[13];
+  while ((type == 0x8100 || type == 0x88a8) && off + 4 <= n) {
+    type = (p[off + 2] << 8) | p[off + 3];
+    off += 4;
+  }
+
+  std::uint8_t const* ip = p + off;
+  if (type == 0x0800 && off + 20 <= n) {
+    int ihl = (ip[0] & 0xf) * 4;
+    std::uint8_t proto = ip[9];
+    bool fragment = ((ip[6] & 0x3f) | ip[7]) != 0;
+    h.add(ip + 12, 8);
+    h.add(&proto, 1);
+    if (!fragment && (proto == 6 || proto == 17) && off + ihl + 4 <= n)
+      h.add(ip + ihl, 4);
+  } else if (type == 0x86dd && off + 40 <= n) {
+    std::uint8_t next = ip[6];
+    h.add(ip + 8, 32);
+    h.add(&next, 1);
+    if ((next == 6 || next == 17) && off + 44 <= n)
+      h.add(ip + 40, 4);
+  } else {
+    h.add(p, 12);
+  }
+  return h.value();
+}
+
+
+// Divide the packets of a capture among the connections, leaving room
+// for a trailer of the given size after each.
+void
+partition_capture(ff::cap::Stream& cap, std::vector<Connection>& conns, Partition how,
+                  std::size_t trailer)
+{
+  ff::cap::Packet p;
+  std::uint64_t n = 0;
+  while (cap.get(p)) {
+    std::size_t i;
+    if (how == flow_partition)
+      i = flow_hash(p.data(), p.captured_size()) % conns.size();
+    else
+      i = n++ % conns.size();
+    conns[i].frames.add(p.data(), p.captured_size(), p.time(), trailer);
+  }
+}
+
+
+// Connect each connection to the host, spreading them over the
+// ports. Returns false if any connection fails.
+bool
+connect_all(ff::Ipv4_address addr, std::vector<std::uint16_t> const& ports,
+            std::vector<Connection>& conns)
+{
+  for (std::size_t i = 0; i < conns.size(); ++i) {
+    Connection& c = conns[i];
+    c.port = ports[i % ports.size()];
+    if (!c.sock.connect({addr, c.port}))
+      return false;
+  }
+  return true;
+}
+
+
+namespace
+{
+
+struct Thread_args
+{
+  int                      id;
+  std::vector<Connection*> conns;
+  Connection_work          work;
+  void*                    data;
+};
+
+
+void
+thread_main(Thread_args* args)
+{
+  args->work(args->id, args->conns, args->data);
+}
+
+} // namespace
+
+
+// Returns the number of threads that run_connections() starts for
+// the requested number, which is 0 for one per connection, up to
+// the CPU count. There are never more threads than connections.
+int
+connection_threads(int requested, std::size_t conns)
+{
+  int n = requested;
+  if (n <= 0)
+    n = std::min<int>(conns, sysconf(_SC_NPROCESSORS_ONLN));
+  return std::max(1, std::min<int>(n, conns));
+}
+
+
+// Run the work on the given number of threads, each pinned to a CPU
+// and given every nth connection. Returns when all threads are
+// done.
+void
+run_connections(std::vector<Connection>& conns, int nthreads, Connection_work work, void* data)
+{
+  int ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+  nthreads = connection_threads(nthreads, conns.size());
+
+  std::vector<Thread_args> args(nthreads);
+  for (int i = 0; i < nthreads; ++i)
+    args[i] = {i, {}, work, data};
+  for (std::size_t i = 0; i < conns.size(); ++i)
+    args[i % nthreads].conns.push_back(&conns[i]);
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < nthreads; ++i) {
+    threads.emplace_back(thread_main, &args[i]);
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(i % ncpus, &set);
+    pthread_setaffinity_np(threads.back().native_handle(), sizeof(set), &set);
+#endif
+  }
+  for (std::thread& t : threads)
+    t.join();
+}
+
+
+// Print the rate of each connection, when there are several, and
+// the aggregate rate over the given time.
+void
+report_connections(std::ostream& os, std::vector<Connection> const& conns, double s)
+{
+  std::uint64_t n = 0;
+  std::uint64_t b = 0;
+  for (std::size_t i = 0; i < conns.size(); ++i) {
+    Connection const& c = conns[i];
+    n += c.packets;
+    b += c.bytes;
+    if (conns.size() == 1)
+      continue;
+    double cs = c.seconds > 0 ? c.seconds : s;
+    os << "connection " << i << " (port " << c.port << "): sent "
+       << c.packets << " packets, " << c.bytes << " bytes in " << cs << " seconds ("
+       << (std::uint64_t)(c.packets / cs) << " Pps, "
+       << c.bytes * 8 / 1e6 / cs << " Mbps)\n";
+  }
+
+  double Mbps = b * 8 / 1e6 / s;
+  std::uint64_t Pps = n / s;
+  os << "sent " << n << " packets in "
+     << s << " seconds (" << Pps << " Pps)\n";
+  os << "sent " << b << " bytes in "
+     << s << " seconds (" << Mbps << " Mbps)\n";
+}
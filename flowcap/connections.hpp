@@ -0,0 +1,76 @@
+
+#ifndef FLOWCAP_CONNECTIONS_HPP
+#define FLOWCAP_CONNECTIONS_HPP
+
+// Support for sending a capture over several connections from
+// several threads, so that one flowcap can load a dataplane with
+// many ports or cores. The capture is partitioned across the
+// connections, either by flow, so that each flow stays on one
+// connection and in order, or round-robin. The connections are
+// divided among threads, each pinned to a CPU.
+//
+// The options shared by the sending commands are:
+//
+//    --connections n       connections to open (default 1)
+//    --threads n           sending threads (default one per
+//                          connection, up to the CPU count)
+//    --partition how       'flow' or 'round-robin' (default flow)
+//
+// The port argument of those commands may be a comma separated
+// list, in which case the connections are spread over the ports.
+
+#include "frames.hpp"
+
+#include <freeflow/ip.hpp>
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+
+enum Partition
+{
+  flow_partition,
+  round_robin_partition,
+};
+
+
+struct Connection_options
+{
+  int       connections = 1;
+  int       threads = 0;
+  Partition partition = flow_partition;
+};
+
+
+// A connection, the part of the capture sent on it, and what was
+// sent.
+struct Connection
+{
+  ff::Ipv4_stream_socket sock;
+  std::uint16_t          port;
+  Frames                 frames;
+  std::uint64_t          packets = 0;
+  std::uint64_t          bytes = 0;
+  std::uint64_t          stamps = 0;   // Stamped packets sent
+  double                 seconds = 0;
+};
+
+
+// The work of a sending thread, given its index and connections.
+using Connection_work = void (*)(int, std::vector<Connection*>&, void*);
+
+
+int  parse_connection_option(int, char*[], int&, Connection_options&);
+bool parse_ports(std::string const&, std::vector<std::uint16_t>&);
+
+std::uint32_t flow_hash(std::uint8_t const*, int);
+
+void partition_capture(ff::cap::Stream&, std::vector<Connection>&, Partition, std::size_t = 0);
+bool connect_all(ff::Ipv4_address, std::vector<std::uint16_t> const&, std::vector<Connection>&);
+int  connection_threads(int, std::size_t);
+void run_connections(std::vector<Connection>&, int, Connection_work, void* = nullptr);
+void report_connections(std::ostream&, std::vector<Connection> const&, double);
+
+
+#endif
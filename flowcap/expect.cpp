@@ -3,7 +3,8 @@
 #include <freeflow/ip.hpp>
 #include <freeflow/capture.hpp>
 
-#include <cassert>
+#include "receive.hpp"
+
 #include <sstream>
 #include <iostream>
 #include <iomanip>
@@ -17,6 +18,10 @@ using namespace ff;
 extern int usage(std::ostream&);
 
 
+// Accepts a connection and receives a capture from it, checking that
+// each packet arrives intact. With stamp options, the packets' stamps
+// are checked instead (see receive.hpp).
+//
 // TODO: Add options for IP versions, TCP and UDP.
 int
 expect(int argc, char* argv[])
@@ -33,9 +38,22 @@ expect(int argc, char* argv[])
   std::string port = argv[4];
 
 
+  int first_option = 5;
   int iterations = 1;
-  if (argc > 5)
+  if (argc > 5 && argv[5][0] != '-') {
     iterations = std::stoi(argv[5]);
+    first_option = 6;
+  }
+
+  // Parse the stamp options.
+  Stamp_options stamps;
+  for (int i = first_option; i < argc; ++i) {
+    std::string opt = argv[i];
+    if (parse_stamp_option(argc, argv, i, stamps) <= 0) {
+      std::cerr << "error: invalid option '" << opt << "'\n";
+      return usage(std::cerr);
+    }
+  }
 
   // Convert the host name to an address.
   Ipv4_address addr;
@@ -63,74 +81,10 @@ expect(int argc, char* argv[])
     return -1;
   }
 
-  // Open an offline stream capture.
-  cap::Stream cap(cap::offline(argv[2]));
-  if (cap.link_type() != cap::ethernet_link) {
-    std::cerr << "error: input is not ethernet\n";
-    return 1;
-  }
-
   // Block until a client accepts the connection.
   Ipv4_stream_socket client = sock.accept();
 
-  // Iterate over each packet and and send each packet to the
-  // connected host.
-  std::uint64_t n = 0;
-  std::uint64_t b = 0;
-  cap::Packet p;
-  
-  // Records the start time.
-  Time start;
-  bool started = false;
-
-  while (cap.get(p)) {
-    // FIXME: This is broken. We know exactly how many bytes are expected 
-    // in a packet. We should receive exactly that many.
-    char buf[4096];
-    assert(p.captured_size() < 4096);
-    for (int i = 0; i < iterations; i++) {
-      int k = client.recv(buf, p.captured_size() + 4);
-      // int k = client.recv(buf, p.captured_size());
-      if (k <= 0) {
-        if (k < 0) {
-          std::cerr << "error: " << std::strerror(errno) << '\n';
-          return 1;
-        }
-        break;
-      }
-      assert(k == p.captured_size() + 4);
-
-      // Record the start time after receiving the first packet.
-      if (!started) {
-        start = now();
-        started = true;
-      }
-
-      // TODO: Verify that the content captured actually matches the content
-      // sent. That seems like a good idea.
-
-      ++n;
-      b += p.captured_size();
-    }
-  }
-  Time stop = now();
-
-  // Make some measurements.
-  Fp_seconds dur = stop - start;
-  double s = dur.count();
-  double Mb = double(b * 8) / (1 << 20);
-  double Mbps = Mb / s;
-  std::uint64_t Pps = n / s;
-
-  // FIXME: Make this pretty.
-  // std::cout.imbue(std::locale(""));
-  std::cout << "received " << n << " packets in " << s << " seconds (" << Pps << " Pps)\n";
-  std::cout.precision(6);
-  std::cout << "received " << b << " bytes";
-  std::cout.precision(1);
-  std::cout << " in " << s << " (";
-  std::cout.precision(6);
-  std::cout << Mbps << " Mbps)\n";
-
-  return 0;
+  // Receive the packets and check them against the capture, or
+  // their stamps.
+  return receive(client.fd(), argv[2], iterations, stamps);
 }
@@ -4,7 +4,8 @@
 #include <freeflow/select.hpp>
 #include <freeflow/capture.hpp>
 
-#include <cassert>
+#include "receive.hpp"
+
 #include <sstream>
 #include <iostream>
 #include <iomanip>
@@ -38,9 +39,22 @@ fetch(int argc, char* argv[])
   std::string port = argv[4];
 
 
+  int first_option = 5;
   int iterations = 1;
-  if (argc > 5)
+  if (argc > 5 && argv[5][0] != '-') {
     iterations = std::stoi(argv[5]);
+    first_option = 6;
+  }
+
+  // Parse the stamp options.
+  Stamp_options stamps;
+  for (int i = first_option; i < argc; ++i) {
+    std::string opt = argv[i];
+    if (parse_stamp_option(argc, argv, i, stamps) <= 0) {
+      std::cerr << "error: invalid option '" << opt << "'\n";
+      return usage(std::cerr);
+    }
+  }
 
   // Convert the host name to an address.
   Ipv4_address addr;
@@ -68,68 +82,9 @@ fetch(int argc, char* argv[])
     return -1;
   }
 
-  // Open an offline stream capture.
-  cap::Stream cap(cap::offline(argv[2]));
-  if (cap.link_type() != cap::ethernet_link) {
-    std::cerr << "error: input is not ethernet\n";
-    return 1;
-  }
-
-  // Iterate over each packet and and send each packet to the
-  // connected host.
-  std::uint64_t n = 0;
-  std::uint64_t b = 0;
-
-  // Records the start time.
-  Time start;
-  bool started = false;
-
-  cap::Packet p;
-  while (cap.get(p)) {
-    // FIXME: This is broken. We know exactly how many bytes are expected 
-    // in a packet. We should receive exactly that many.
-    char buf[4096];
-    assert(p.captured_size() < 4096);
-    for (int i = 0; i < iterations; i++) {
-      int k = sock.recv(buf, p.captured_size() + 4);
-      // int k = sock.recv(buf, p.captured_size());
-      if (k <= 0) {
-        if (k < 0) {
-          std::cerr << "error: " << std::strerror(errno) << '\n';
-          return 1;
-        }
-        return 0;
-      }
-      // assert(k == p.captured_size() + 4);
-
-      // Start the timer on receipt of the first packet.
-      if (!started) {
-        start = now();
-        started = true;
-      }
-
-      // TODO: Verify that the content captured actually matches the content
-      // sent. That seems like a good idea.
-
-      ++n;
-      b += p.captured_size();
-    }
-  }
-  Time stop = now();
+  // Receive the packets and check them against the capture, or
+  // their stamps.
+  int status = receive(sock.fd(), argv[2], iterations, stamps);
   sock.close();
-  // Make some measurements.
-  Fp_seconds dur = stop - start;
-  double s = dur.count();
-  double Mb = double(b * 8) / (1 << 20);
-  double Mbps = Mb / s;
-  std::uint64_t Pps = n / s;
-
-  // FIXME: Make this pretty.
-  // std::cout.imbue(std::locale(""));
-  std::cout << "received " << n << " packets in " 
-            << s << " seconds (" << Pps << " Pps)\n";
-  std::cout << "received " << b << " bytes in " 
-            << s << " seconds (" << Mbps << " Mbps)\n";
-
-  return 0;
+  return status;
 }
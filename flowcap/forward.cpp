@@ -3,6 +3,10 @@
 #include <freeflow/ip.hpp>
 #include <freeflow/capture.hpp>
 
+#include "connections.hpp"
+#include "stamp.hpp"
+
+#include <atomic>
 #include <sstream>
 #include <iostream>
 #include <iomanip>
@@ -16,6 +20,65 @@ using namespace ff;
 extern int usage(std::ostream&);
 
 
+namespace
+{
+
+struct Forward_args
+{
+  int              iterations;
+  Stamp_options    stamps;
+  std::atomic<int> errors;
+};
+
+
+// Send each connection's part of the capture the given number of
+// times over, interleaving batches of writes to the connections.
+void
+forward_work(int, std::vector<Connection*>& conns, void* data)
+{
+  Forward_args& args = *(Forward_args*)data;
+  Time start = now();
+  Stamp_options const* stamps = args.stamps.enabled ? &args.stamps : nullptr;
+  std::vector<Frame_writer> writers;
+  for (Connection* c : conns)
+    writers.emplace_back(c->sock.fd(), c->frames, args.iterations, stamps);
+
+  bool active = true;
+  while (active) {
+    active = false;
+    for (std::size_t i = 0; i < writers.size(); ++i) {
+      Frame_writer& w = writers[i];
+      if (w.done())
+        continue;
+      if (w.write() < 0) {
+        std::cerr << "send error: " << std::strerror(errno) << '\n';
+        ++args.errors;
+      }
+      if (w.done())
+        conns[i]->seconds = Fp_seconds(now() - start).count();
+      else
+        active = true;
+    }
+  }
+
+  // Count the copies of the capture that were sent in full.
+  for (std::size_t i = 0; i < writers.size(); ++i) {
+    Connection& c = *conns[i];
+    c.packets = writers[i].copies() * c.frames.packets();
+    c.bytes = writers[i].copies() * c.frames.bytes();
+  }
+}
+
+} // namespace
+
+
+// Sends a capture to a host as fast as possible, the given number of
+// times over. The capture is loaded into memory before sending, so
+// that the sender is not limited by reading it. With several
+// connections, each sends its part of the capture that many times.
+// With stamp options, each packet carries a stamp for measuring
+// latency and loss at the receiver (see stamp.hpp).
+//
 // TODO: Add options for IP versions, TCP and UDP.
 int
 forward(int argc, char* argv[])
@@ -29,86 +92,77 @@ forward(int argc, char* argv[])
   std::string host = argv[3];
   std::string port = argv[4];
 
+  int first_option = 5;
   int iterations = 1;
-  if (argc > 5)
+  if (argc > 5 && argv[5][0] != '-') {
     iterations = std::stoi(argv[5]);
+    first_option = 6;
+  }
 
   // Convert the host name to an address.
   Ipv4_address addr;
   try {
     addr = host;
-  } 
+  }
   catch (std::runtime_error& err) {
     std::cerr << "error: " << err.what() << '\n';
     return 1;
   }
 
-  // Convert the port number.
-  std::uint16_t portnum;
-  std::stringstream ss(port);
-  ss >> portnum;
-  if (ss.fail() && !ss.eof()) {
+  // Convert the port numbers.
+  std::vector<std::uint16_t> ports;
+  if (!parse_ports(port, ports)) {
     std::cerr << "error: invalid port '" << port << "'\n";
     return 1;
   }
 
-
-  // Build and connect.
-  Ipv4_stream_socket sock;
-  if (!sock.connect({addr, portnum})) {
-    std::cerr << "error: could not connect to host\n";
-    return -1;
+  // Parse the connection and stamp options.
+  Connection_options opts;
+  Stamp_options stamps;
+  for (int i = first_option; i < argc; ++i) {
+    std::string opt = argv[i];
+    int parsed = parse_connection_option(argc, argv, i, opts);
+    if (parsed == 0)
+      parsed = parse_stamp_option(argc, argv, i, stamps);
+    if (parsed <= 0) {
+      std::cerr << "error: invalid option '" << opt << "'\n";
+      return usage(std::cerr);
+    }
   }
 
-  // Open an offline stream capture.
+  // Open an offline stream capture and load it, divided among the
+  // connections.
   cap::Stream cap(cap::offline(argv[2]));
   if (cap.link_type() != cap::ethernet_link) {
     std::cerr << "error: input is not ethernet\n";
     return 1;
   }
+  std::vector<Connection> conns(opts.connections);
+  partition_capture(cap, conns, opts.partition, stamps.trailer());
+  if (stamps.enabled)
+    for (Connection& c : conns)
+      prepare_stamps(c.frames, stamps);
 
-  // Iterate over each packet and send each packet to the
-  // connected host.
-  std::uint64_t n = 0;
-  std::uint64_t b = 0;
-  cap::Packet p;
+  // Build and connect.
+  if (!connect_all(addr, ports, conns)) {
+    std::cerr << "error: could not connect to host\n";
+    return -1;
+  }
 
+  Forward_args args;
+  args.iterations = iterations;
+  args.stamps = stamps;
+  args.errors = 0;
   Time start = now();
-  while (cap.get(p)) {
-    std::uint8_t buf[4096];
-    std::uint32_t hdr = htonl(p.captured_size());
-    std::memcpy(&buf[0], &hdr, 4);
-    std::memcpy(&buf[4], p.data(), p.captured_size());
-    for (int i = 0; i < iterations; i++) {
-      int k = sock.send(buf, p.captured_size() + 4);
-      if (k <= 0) {
-        if (k < 0) {
-          std::cerr << "send error: " << std::strerror(errno) << '\n';
-          return 1;
-        }
-        break;
-      }
-      ++n;
-      b += p.captured_size();
-    }
-  }
+  run_connections(conns, opts.threads, forward_work, &args);
   Time stop = now();
-  
-  sock.close();
-  
+
+  for (Connection& c : conns)
+    c.sock.close();
+
   // Make some measurements.
   Fp_seconds dur = stop - start;
-  double s = dur.count();
-  double Mb = double(b * 8) / (1 << 20);
-  double Mbps = Mb / s;
-  std::uint64_t Pps = n / s;
-
-  // FIXME: Make this pretty.
-  // std::cout.imbue(std::locale(""));
-  std::cout << "sent " << n << " packets in " 
-            << s << " seconds (" << Pps << " Pps)\n";
-  std::cout << "sent " << b << " bytes in " 
-            << s << " seconds (" << Mbps << " Mbps)\n";
-
-  return 0;
+  report_connections(std::cout, conns, dur.count());
+
+  return args.errors ? 1 : 0;
 }
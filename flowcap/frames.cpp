@@ -0,0 +1,189 @@
+
+#include "frames.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+
+// The maximum number of copies of the frames written by a single
+// call to writev.
+static constexpr int max_iov = 64;
+
+
+// Append a packet of n bytes, captured at the given time, followed
+// by a zeroed trailer of the given size.
+void
+Frames::add(std::uint8_t const* p, int n, std::uint64_t time, std::size_t trailer)
+{
+  std::memcpy(extend(n, time, trailer), p, n);
+}
+
+
+// Append a zeroed packet of n bytes and a trailer, returning the
+// packet so that it can be written in place.
+std::uint8_t*
+Frames::extend(int n, std::uint64_t time, std::size_t trailer)
+{
+  std::size_t at = buf_.size();
+  offsets_.push_back(at);
+  times_.push_back(time);
+  buf_.resize(at + 4 + n + trailer);
+  std::uint32_t hdr = htonl(n + trailer);
+  std::memcpy(&buf_[at], &hdr, 4);
+  bytes_ += n;
+  return &buf_[at + 4];
+}
+
+
+// Append every remaining packet of a capture, each with a trailer of
+// the given size.
+void
+Frames::load(ff::cap::Stream& cap, std::size_t trailer)
+{
+  ff::cap::Packet p;
+  while (cap.get(p))
+    add(p.data(), p.captured_size(), p.time(), trailer);
+}
+
+
+// Remove every packet, keeping the memory for reuse.
+void
+Frames::clear()
+{
+  buf_.clear();
+  offsets_.clear();
+  times_.clear();
+  bytes_ = 0;
+}
+
+
+// Write the next batch of copies of the frames. Each call to writev
+// sends many copies of the buffer, so the cost of a system call is
+// shared by many packets. Returns 1 if there is more to write, 0 if
+// the writer is done, or -1 on error, after which it is also done.
+int
+Frame_writer::write()
+{
+  if (done())
+    return 0;
+  if (stamps_ && sent_ == stamped_)
+    stamp();
+
+  // Start with the rest of a partially written copy. When stamping,
+  // only the stamped frames may be written.
+  std::size_t size = frames_->size();
+  std::uint64_t pos = sent_ % size;
+  std::uint64_t left = (stamps_ ? stamped_ : total_) - sent_;
+  iovec iov[max_iov];
+  int k = 0;
+  while (k < max_iov && left) {
+    std::size_t len = std::min<std::uint64_t>(size - pos, left);
+    iov[k].iov_base = (void*)(frames_->data() + pos);
+    iov[k].iov_len = len;
+    left -= len;
+    pos = 0;
+    ++k;
+  }
+
+  ssize_t r = ::writev(fd_, iov, k);
+  if (r < 0 && errno == EINTR)
+    return 1;
+  if (r <= 0) {
+    closed_ = true;
+    return r < 0 ? -1 : 0;
+  }
+  sent_ += r;
+  return done() ? 0 : 1;
+}
+
+
+// Stamp the next batch of frames of the current copy. The frames of a
+// batch share the time at which it is stamped.
+void
+Frame_writer::stamp()
+{
+  std::size_t packets = frames_->packets();
+  std::size_t first = next_;
+  std::size_t last = std::min<std::size_t>(first + max_iov, packets);
+  std::uint64_t now = monotonic_ns();
+  for (std::size_t i = first; i < last; ++i)
+    if (stamp_frame(*frames_, i, seq_, now, *stamps_))
+      ++seq_;
+
+  std::size_t begin = frames_->frame(first) - frames_->data();
+  std::size_t end = last < packets ? frames_->frame(last) - frames_->data() : frames_->size();
+  stamped_ += end - begin;
+  next_ = last < packets ? last : 0;
+}
+
+
+std::uint64_t
+Frame_writer::copies() const
+{
+  return frames_->size() ? sent_ / frames_->size() : 0;
+}
+
+
+// Write the framed packet i to a socket. Returns false if the
+// connection was closed or an error occurred.
+bool
+write_frame(int fd, Frames const& f, std::size_t i)
+{
+  std::uint8_t const* p = f.frame(i);
+  std::size_t n = f.frame_size(i);
+  while (n) {
+    ssize_t r = ::send(fd, p, n, 0);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      return false;
+    p += r;
+    n -= r;
+  }
+  return true;
+}
+
+
+// Read the next frame, setting p to its packet and n to the packet's
+// size. The packet is valid until the next call. Returns 1 if a frame
+// was read, 0 if the connection was closed, or -1 on error.
+int
+Frame_reader::next(std::uint8_t const*& p, std::size_t& n)
+{
+  while (true) {
+    std::size_t avail = end_ - begin_;
+    std::size_t need = 4;
+    if (avail >= 4) {
+      std::uint32_t len;
+      std::memcpy(&len, &buf_[begin_], 4);
+      need += ntohl(len);
+      if (avail >= need) {
+        p = &buf_[begin_ + 4];
+        n = need - 4;
+        begin_ += need;
+        return 1;
+      }
+    }
+
+    // Move the partial frame to the front of the buffer, making room
+    // for all of it, and read more.
+    if (begin_) {
+      std::memmove(buf_.data(), buf_.data() + begin_, avail);
+      begin_ = 0;
+      end_ = avail;
+    }
+    if (need > buf_.size())
+      buf_.resize(need);
+    ssize_t r = ::recv(fd_, &buf_[end_], buf_.size() - end_, 0);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      return r < 0 ? -1 : 0;
+    end_ += r;
+  }
+}
@@ -0,0 +1,139 @@
+
+#ifndef FLOWCAP_FRAMES_HPP
+#define FLOWCAP_FRAMES_HPP
+
+// A capture loaded into memory in the form in which it is sent to a
+// host: each packet is preceded by its captured length, as a 4 byte
+// integer in network byte order. Sending the capture is then a
+// matter of writing one contiguous buffer, with no per-packet work.
+//
+// The offset and capture time of each packet are kept, so that
+// packets can also be sent one at a time, on a schedule. Packets may
+// be loaded with room for a trailer, which counts as part of the
+// packet when it is sent.
+
+#include "stamp.hpp"
+
+#include <freeflow/capture.hpp>
+
+#include <cstdint>
+#include <vector>
+
+
+class Frames
+{
+public:
+  Frames()
+    : bytes_(0)
+  { }
+
+  void          add(std::uint8_t const*, int, std::uint64_t = 0, std::size_t = 0);
+  std::uint8_t* extend(int, std::uint64_t = 0, std::size_t = 0);
+  void          load(ff::cap::Stream&, std::size_t = 0);
+  void          clear();
+
+  // Returns the framed data and its size in bytes, including the
+  // length headers.
+  std::uint8_t const* data() const { return buf_.data(); }
+  std::size_t         size() const { return buf_.size(); }
+
+  // Returns the number of packets, and the number of captured bytes
+  // in them, excluding the length headers and trailers.
+  std::uint64_t packets() const { return offsets_.size(); }
+  std::uint64_t bytes() const { return bytes_; }
+
+  // Returns the framed packet i and its size, including its length
+  // header.
+  std::uint8_t*       frame(std::size_t i)       { return &buf_[offsets_[i]]; }
+  std::uint8_t const* frame(std::size_t i) const { return &buf_[offsets_[i]]; }
+  std::size_t         frame_size(std::size_t i) const;
+
+  // Returns the capture time of packet i in nanoseconds.
+  std::uint64_t time(std::size_t i) const { return times_[i]; }
+
+private:
+  std::vector<std::uint8_t>  buf_;
+  std::vector<std::size_t>   offsets_;
+  std::vector<std::uint64_t> times_;
+  std::uint64_t              bytes_;
+};
+
+
+inline std::size_t
+Frames::frame_size(std::size_t i) const
+{
+  std::size_t end = i + 1 < offsets_.size() ? offsets_[i + 1] : buf_.size();
+  return end - offsets_[i];
+}
+
+
+// Writes copies of frames to a socket, a batch at a time, so that
+// one thread can interleave writes to several sockets. When given
+// stamp options, the writer stamps each batch of frames just before
+// writing it, so stamps are numbered in order across the copies,
+// starting from the given sequence number.
+class Frame_writer
+{
+public:
+  Frame_writer(int fd, Frames& f, std::uint64_t copies,
+               Stamp_options const* stamps = nullptr, std::uint64_t seq = 0)
+    : fd_(fd), frames_(&f), stamps_(stamps), total_(f.size() * copies), sent_(0),
+      stamped_(0), next_(0), seq_(seq), closed_(false)
+  { }
+
+  int write();
+
+  // Returns true when every copy has been written, or the connection
+  // was closed.
+  bool done() const { return closed_ || sent_ == total_; }
+
+  // Returns true if the connection was closed, or an error occurred.
+  bool closed() const { return closed_; }
+
+  // Returns the sequence number of the next stamp.
+  std::uint64_t seq() const { return seq_; }
+
+  // Returns the number of bytes written.
+  std::uint64_t sent() const { return sent_; }
+
+  // Returns the number of copies written in full.
+  std::uint64_t copies() const;
+
+private:
+  void stamp();
+
+  int                  fd_;
+  Frames*              frames_;
+  Stamp_options const* stamps_;
+  std::uint64_t        total_;
+  std::uint64_t        sent_;
+  std::uint64_t        stamped_;   // Bytes stamped, at least sent_
+  std::size_t          next_;      // The next frame to stamp
+  std::uint64_t        seq_;       // The next sequence number
+  bool                 closed_;
+};
+
+
+// Reads frames from a socket through a buffer, so that small frames
+// cost much less than a system call each.
+class Frame_reader
+{
+public:
+  explicit Frame_reader(int fd)
+    : fd_(fd), buf_(1 << 18), begin_(0), end_(0)
+  { }
+
+  int next(std::uint8_t const*&, std::size_t&);
+
+private:
+  int                       fd_;
+  std::vector<std::uint8_t> buf_;
+  std::size_t               begin_;
+  std::size_t               end_;
+};
+
+
+bool write_frame(int, Frames const&, std::size_t);
+
+
+#endif
@@ -0,0 +1,358 @@
+
+#include "generator.hpp"
+#include "frames.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include <arpa/inet.h>
+
+
+namespace
+{
+
+constexpr int eth_size = 14;
+constexpr int udp_proto = 17;
+constexpr int tcp_proto = 6;
+
+
+inline void
+put16(std::uint8_t* p, std::uint16_t x)
+{
+  p[0] = x >> 8;
+  p[1] = x;
+}
+
+
+inline void
+put32(std::uint8_t* p, std::uint32_t x)
+{
+  p[0] = x >> 24;
+  p[1] = x >> 16;
+  p[2] = x >> 8;
+  p[3] = x;
+}
+
+
+// Returns the sum of the big-endian 16 bit words of n bytes, where n
+// is even.
+std::uint32_t
+sum16(std::uint8_t const* p, int n)
+{
+  std::uint32_t s = 0;
+  for (int i = 0; i < n; i += 2)
+    s += (p[i] << 8) | p[i + 1];
+  return s;
+}
+
+
+// Fold a sum into a 16 bit ones' complement sum.
+inline std::uint16_t
+fold(std::uint32_t s)
+{
+  s = (s & 0xffff) + (s >> 16);
+  s = (s & 0xffff) + (s >> 16);
+  return s;
+}
+
+
+// Write an IPv4 address, or an IPv6 address in fd00::/96 with the
+// given low 32 bits. Returns the size of the address.
+int
+put_address(std::uint8_t* p, int ip, std::uint32_t a)
+{
+  if (ip == 4) {
+    put32(p, a);
+    return 4;
+  }
+  std::memset(p, 0, 16);
+  p[0] = 0xfd;
+  put32(p + 12, a);
+  return 16;
+}
+
+
+// Parse n[-n] with values of at most max.
+bool
+parse_range(std::string const& s, Range& r, std::uint32_t max)
+{
+  char* end;
+  unsigned long lo = std::strtoul(s.c_str(), &end, 10);
+  unsigned long hi = lo;
+  if (*end == '-')
+    hi = std::strtoul(end + 1, &end, 10);
+  if (*end || lo > hi || hi > max)
+    return false;
+  r = {(std::uint32_t)lo, (std::uint32_t)hi};
+  return true;
+}
+
+
+// Parse a.b.c.d[-a.b.c.d].
+bool
+parse_address_range(std::string const& s, Range& r)
+{
+  std::size_t dash = s.find('-');
+  std::string lo = s.substr(0, dash);
+  std::string hi = dash == std::string::npos ? lo : s.substr(dash + 1);
+  in_addr a, b;
+  if (inet_pton(AF_INET, lo.c_str(), &a) != 1 || inet_pton(AF_INET, hi.c_str(), &b) != 1)
+    return false;
+  r = {ntohl(a.s_addr), ntohl(b.s_addr)};
+  return r.lo <= r.hi;
+}
+
+
+// Parse a size spec: a number, 'imix', or a file of 'size weight'
+// lines, where '#' starts a comment.
+bool
+parse_sizes(std::string const& s, Synth_options& opts)
+{
+  opts.sizes.clear();
+  opts.weights.clear();
+  if (s == "imix") {
+    opts.sizes = {60, 590, 1514};
+    opts.weights = {7, 4, 1};
+    return true;
+  }
+
+  char* end;
+  long n = std::strtol(s.c_str(), &end, 10);
+  if (!*end) {
+    opts.sizes = {(int)n};
+    opts.weights = {1};
+    return n > 0;
+  }
+
+  std::ifstream in(s);
+  std::string line;
+  while (std::getline(in, line)) {
+    line = line.substr(0, line.find('#'));
+    std::stringstream ss(line);
+    int size;
+    double weight;
+    if (!(ss >> size))
+      continue;
+    if (!(ss >> weight) || size <= 0 || weight < 0)
+      return false;
+    opts.sizes.push_back(size);
+    opts.weights.push_back(weight);
+  }
+  return !opts.sizes.empty();
+}
+
+} // namespace
+
+
+// Build the table for the given weights, which need not sum to 1.
+void
+Alias_table::build(std::vector<double> const& weights)
+{
+  size_ = weights.size();
+  threshold_.assign(size_, 0xffffffff);
+  alias_.resize(size_);
+  double total = 0;
+  for (double w : weights)
+    total += w;
+
+  // Scale the probabilities so that their mean is 1, and pair each
+  // below the mean with one above it.
+  std::vector<double> p(size_);
+  std::vector<std::uint32_t> small;
+  std::vector<std::uint32_t> large;
+  for (std::uint32_t i = 0; i < size_; ++i) {
+    alias_[i] = i;
+    p[i] = total > 0 ? weights[i] * size_ / total : 1;
+    (p[i] < 1 ? small : large).push_back(i);
+  }
+  while (!small.empty() && !large.empty()) {
+    std::uint32_t s = small.back();
+    std::uint32_t l = large.back();
+    small.pop_back();
+    threshold_[s] = p[s] * 4294967296.0;
+    alias_[s] = l;
+    p[l] -= 1 - p[s];
+    if (p[l] < 1) {
+      large.pop_back();
+      small.push_back(l);
+    }
+  }
+}
+
+
+// Create a generator of the flows numbered part, part + parts, and
+// so on, so that several generators can divide the flows.
+Generator::Generator(Synth_options const& opts, int part, int parts)
+  : ip_(opts.ip), proto_(opts.proto),
+    ip_size_(opts.ip == 4 ? 20 : 40),
+    header_size_(eth_size + ip_size_ + (opts.proto == tcp_proto ? 20 : 8)),
+    state_(opts.seed * 0x9e3779b97f4a7c15 + part)
+{
+  int h = header_size_;
+  std::vector<double> popularity;
+  for (std::uint64_t f = part; f < (std::uint64_t)opts.flows; f += parts) {
+    // Number the flow through the ranges.
+    std::uint64_t k = f;
+    std::uint32_t src = opts.src_addr.lo + k % opts.src_addr.size();
+    k /= opts.src_addr.size();
+    std::uint32_t sport = opts.src_port.lo + k % opts.src_port.size();
+    k /= opts.src_port.size();
+    std::uint32_t dst = opts.dst_addr.lo + k % opts.dst_addr.size();
+    k /= opts.dst_addr.size();
+    std::uint32_t dport = opts.dst_port.lo + k % opts.dst_port.size();
+
+    std::size_t at = templates_.size();
+    templates_.resize(at + h);
+    std::uint8_t* p = &templates_[at];
+    std::uint8_t* ip = p + eth_size;
+    std::uint8_t* l4 = ip + ip_size_;
+
+    // Locally administered MAC addresses.
+    p[0] = 0x02;
+    p[5] = 0x02;
+    p[6] = 0x02;
+    p[11] = 0x01;
+    put16(p + 12, ip_ == 4 ? 0x0800 : 0x86dd);
+
+    // The IP header, less its length and checksum.
+    int alen;
+    if (ip_ == 4) {
+      ip[0] = 0x45;
+      put16(ip + 6, 0x4000);
+      ip[8] = 64;
+      ip[9] = proto_;
+      alen = put_address(ip + 12, ip_, src);
+      put_address(ip + 16, ip_, dst);
+      ip_sums_.push_back(sum16(ip, 20));
+    } else {
+      ip[0] = 0x60;
+      ip[6] = proto_;
+      ip[7] = 64;
+      alen = put_address(ip + 8, ip_, src);
+      put_address(ip + 24, ip_, dst);
+      ip_sums_.push_back(0);
+    }
+
+    // The transport header, less its lengths, checksum and sequence
+    // number. The partial checksum covers the pseudo-header.
+    put16(l4, sport);
+    put16(l4 + 2, dport);
+    if (proto_ == tcp_proto) {
+      l4[12] = 5 << 4;
+      l4[13] = 0x10;
+      put16(l4 + 14, 65535);
+    }
+    l4_sums_.push_back(sum16(l4 - 2 * alen, 2 * alen) + proto_ + sum16(l4, h - (l4 - p)));
+    seqs_.push_back(0);
+
+    popularity.push_back(1 / std::pow(f + 1, opts.theta));
+  }
+  flow_table_.build(popularity);
+
+  for (int size : opts.sizes)
+    sizes_.push_back(std::min(std::max(size, h), 65535));
+  size_table_.build(opts.weights);
+}
+
+
+// Returns 64 random bits, by splitmix64.
+inline std::uint64_t
+Generator::random()
+{
+  std::uint64_t z = (state_ += 0x9e3779b97f4a7c15);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+  return z ^ (z >> 31);
+}
+
+
+// Append count packets to the frames, each followed by a trailer of
+// the given size.
+void
+Generator::generate(Frames& f, std::size_t count, std::size_t trailer)
+{
+  int h = header_size_;
+  for (std::size_t k = 0; k < count; ++k) {
+    std::uint32_t i = flow_table_.sample(random());
+    int size = sizes_[size_table_.sample(random())];
+    std::uint8_t* p = f.extend(size, 0, trailer);
+    std::memcpy(p, &templates_[i * h], h);
+
+    std::uint32_t ip_len = size - eth_size;
+    std::uint32_t l4_len = ip_len - ip_size_;
+    std::uint8_t* ip = p + eth_size;
+    std::uint8_t* l4 = ip + ip_size_;
+    if (ip_ == 4) {
+      put16(ip + 2, ip_len);
+      put16(ip + 10, ~fold(ip_sums_[i] + ip_len));
+    } else {
+      put16(ip + 4, l4_len);
+    }
+
+    std::uint32_t s = l4_sums_[i];
+    if (proto_ == udp_proto) {
+      put16(l4 + 4, l4_len);
+      std::uint16_t sum = ~fold(s + 2 * l4_len);
+      put16(l4 + 6, sum ? sum : 0xffff);
+    } else {
+      std::uint32_t seq = seqs_[i];
+      seqs_[i] = seq + l4_len - 20;
+      put32(l4 + 4, seq);
+      put16(l4 + 16, ~fold(s + l4_len + (seq >> 16) + (seq & 0xffff)));
+    }
+  }
+}
+
+
+// Parse the synth option at argv[i], advancing i past its value.
+// Returns 1 if the option was parsed, 0 if it is not a synth option,
+// or -1 if its value is invalid.
+int
+parse_synth_option(int argc, char* argv[], int& i, Synth_options& opts)
+{
+  static char const* names[] = {
+    "--flows", "--ip", "--proto", "--size", "--src-addr", "--dst-addr",
+    "--src-port", "--dst-port", "--zipf", "--seed",
+  };
+  std::string opt = argv[i];
+  if (std::find(std::begin(names), std::end(names), opt) == std::end(names))
+    return 0;
+  if (i + 1 == argc)
+    return -1;
+  std::string val = argv[++i];
+
+  bool ok;
+  char* end;
+  if (opt == "--flows") {
+    long n = std::strtol(val.c_str(), &end, 10);
+    opts.flows = n;
+    ok = !*end && n > 0 && n <= (1 << 30);
+  } else if (opt == "--ip") {
+    opts.ip = std::atoi(val.c_str());
+    ok = val == "4" || val == "6";
+  } else if (opt == "--proto") {
+    opts.proto = val == "tcp" ? tcp_proto : udp_proto;
+    ok = val == "tcp" || val == "udp";
+  } else if (opt == "--size") {
+    ok = parse_sizes(val, opts);
+  } else if (opt == "--src-addr") {
+    ok = parse_address_range(val, opts.src_addr);
+  } else if (opt == "--dst-addr") {
+    ok = parse_address_range(val, opts.dst_addr);
+  } else if (opt == "--src-port") {
+    ok = parse_range(val, opts.src_port, 65535);
+  } else if (opt == "--dst-port") {
+    ok = parse_range(val, opts.dst_port, 65535);
+  } else if (opt == "--zipf") {
+    opts.theta = std::strtod(val.c_str(), &end);
+    ok = !*end && opts.theta >= 0;
+  } else {
+    opts.seed = std::strtoull(val.c_str(), &end, 10);
+    ok = !*end;
+  }
+  return ok ? 1 : -1;
+}
@@ -0,0 +1,124 @@
+
+#ifndef FLOWCAP_GENERATOR_HPP
+#define FLOWCAP_GENERATOR_HPP
+
+// A generator of synthetic traffic. Each flow has a template of its
+// Ethernet, IP and TCP or UDP headers, with partial checksums. To
+// generate a packet, the generator picks a flow and a size, copies
+// the flow's template into place and patches its lengths, checksums
+// and, for TCP, sequence number. Payloads are zeros, so they add
+// nothing to the checksums.
+//
+// The options of the synth command that shape the traffic are:
+//
+//    --flows n             number of flows (default 1000)
+//    --ip 4|6              IP version (default 4)
+//    --proto udp|tcp       transport protocol (default udp)
+//    --size spec           frame sizes: a number of bytes, 'imix'
+//                          (7:4:1 of 60, 590 and 1514 bytes), or a
+//                          file of 'size weight' lines (default 60)
+//    --src-addr range      source addresses, as a.b.c.d[-a.b.c.d]
+//                          (default 10.0.0.1-10.0.255.254)
+//    --dst-addr range      destination addresses (default 10.1.0.1)
+//    --src-port range      source ports, as n[-n] (default 1024-65535)
+//    --dst-port range      destination ports (default 5000)
+//    --zipf theta          flow popularity skew; 0 is uniform, and
+//                          flow 0 is the most popular (default 0)
+//    --seed n              seed for the random choices (default 1)
+//
+// Sizes count the Ethernet header but not the FCS, as captures do,
+// and are raised to the size of the headers if smaller. Flows are
+// numbered through the source addresses first, then the source
+// ports, destination addresses and destination ports, so each flow
+// has its own 5-tuple as long as the ranges allow. IPv6 addresses
+// are in fd00::/96, with the low 32 bits taken from the ranges.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+class Frames;
+
+
+// A table for sampling from a discrete distribution in constant time
+// by Vose's alias method.
+class Alias_table
+{
+public:
+  void build(std::vector<double> const&);
+
+  // Returns an index, given 64 random bits.
+  std::uint32_t sample(std::uint64_t r) const
+  {
+    std::uint32_t i = ((r >> 32) * size_) >> 32;
+    return (std::uint32_t)r < threshold_[i] ? i : alias_[i];
+  }
+
+private:
+  std::uint64_t              size_ = 0;
+  std::vector<std::uint32_t> threshold_;
+  std::vector<std::uint32_t> alias_;
+};
+
+
+struct Range
+{
+  std::uint32_t lo;
+  std::uint32_t hi;
+
+  std::uint64_t size() const { return (std::uint64_t)hi - lo + 1; }
+};
+
+
+struct Synth_options
+{
+  int                 flows = 1000;
+  int                 ip = 4;
+  int                 proto = 17;
+  std::vector<int>    sizes = {60};
+  std::vector<double> weights = {1};
+  Range               src_addr = {0x0a000001, 0x0a00fffe};
+  Range               dst_addr = {0x0a010001, 0x0a010001};
+  Range               src_port = {1024, 65535};
+  Range               dst_port = {5000, 5000};
+  double              theta = 0;
+  std::uint64_t       seed = 1;
+};
+
+
+class Generator
+{
+public:
+  Generator(Synth_options const&, int = 0, int = 1);
+
+  void generate(Frames&, std::size_t, std::size_t = 0);
+
+  // Returns the number of flows of this generator.
+  std::size_t flows() const { return seqs_.size(); }
+
+  // Returns the number of header bytes in each packet.
+  int header_size() const { return header_size_; }
+
+private:
+  std::uint64_t random();
+
+  int                        ip_;
+  int                        proto_;
+  int                        ip_size_;       // IP header
+  int                        header_size_;   // All headers
+  std::vector<std::uint8_t>  templates_;
+  std::vector<std::uint32_t> ip_sums_;
+  std::vector<std::uint32_t> l4_sums_;
+  std::vector<std::uint32_t> seqs_;          // TCP sequence numbers
+  std::vector<int>           sizes_;
+  Alias_table                flow_table_;
+  Alias_table                size_table_;
+  std::uint64_t              state_;
+};
+
+
+int parse_synth_option(int, char*[], int&, Synth_options&);
+
+
+#endif
@@ -22,6 +22,7 @@ extern int forward(int, char**);
 extern int replay(int, char**);
 extern int expect(int, char**);
 extern int fetch(int, char**);
+extern int synth(int, char**);
 
 
 int
@@ -48,6 +49,8 @@ main(int argc, char* argv[])
     return expect(argc, argv);
   else if (cmd == "fetch")
     return fetch(argc, argv);
+  else if (cmd == "synth")
+    return synth(argc, argv);
   else
     return error(argv[1]);
 }
@@ -61,10 +64,38 @@ usage(std::ostream& os)
   os << "    flowcap help [topic]\n";
   os << "    flowcap version\n";
   os << "    flowcap dump <pcap-file>\n";
-  os << "    flowcap forward <pcap-file> <hostname> <port>\n";
-  os << "    flowcap replay <pcap-file> <hostname> <port>\n";
-  os << "    flowcap expect <pcap-file> <hostname> <port>\n";
-  os << "    flowcap fetch <pcap-file> <hostname> <port>\n";
+  os << "    flowcap forward <pcap-file> <hostname> <ports> [iterations] [connection-options]\n";
+  os << "                    [stamp-options]\n";
+  os << "    flowcap replay <pcap-file> <hostname> <ports> [--speed x] [--pps n] [--mbps n]\n";
+  os << "                   [connection-options] [stamp-options]\n";
+  os << "    flowcap expect <pcap-file> <hostname> <port> [iterations] [stamp-options]\n";
+  os << "    flowcap fetch <pcap-file> <hostname> <port> [iterations] [stamp-options]\n";
+  os << "    flowcap synth <hostname> <ports> [synth-options] [connection-options]\n";
+  os << "                  [stamp-options]\n";
+  os << "    flowcap synth --write <pcap-file> [synth-options] [--pps n]\n";
+  os << "\n";
+  os << "connection options\n";
+  os << "    --connections n        open n connections, spread over the ports\n";
+  os << "    --threads n            send from n threads\n";
+  os << "    --partition how        divide packets by 'flow' or 'round-robin'\n";
+  os << "\n";
+  os << "stamp options (the receiver must use the sender's)\n";
+  os << "    --stamp                append a sequence number and timestamp to packets\n";
+  os << "    --stamp-offset n       write them at byte n of packets instead\n";
+  os << "\n";
+  os << "synth options\n";
+  os << "    --packets n            generate n packets (default 1000000)\n";
+  os << "    --flows n              spread them over n flows (default 1000)\n";
+  os << "    --ip 4|6               IP version (default 4)\n";
+  os << "    --proto udp|tcp        transport protocol (default udp)\n";
+  os << "    --size spec            frame size in bytes, 'imix', or a file of\n";
+  os << "                           'size weight' lines (default 60)\n";
+  os << "    --src-addr a[-b]       source address range\n";
+  os << "    --dst-addr a[-b]       destination address range\n";
+  os << "    --src-port n[-m]       source port range\n";
+  os << "    --dst-port n[-m]       destination port range\n";
+  os << "    --zipf theta           skew flow popularity (default 0, uniform)\n";
+  os << "    --seed n               seed the random choices\n";
   return &os == &std::cerr;
 }
 
@@ -0,0 +1,127 @@
+
+#include "pacer.hpp"
+
+#include <chrono>
+#include <thread>
+
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#  include <x86intrin.h>
+#endif
+
+
+namespace
+{
+
+// Returns the time stamp counter, or nanoseconds of CLOCK_MONOTONIC
+// on hosts without one.
+inline std::uint64_t
+read_clock()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (std::uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+
+inline void
+relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  _mm_pause();
+#endif
+}
+
+
+// Returns the number of clock ticks per nanosecond, measured
+// against the monotonic clock over a few milliseconds.
+double
+calibrate()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  using Steady = std::chrono::steady_clock;
+  Steady::time_point t0 = Steady::now();
+  std::uint64_t c0 = read_clock();
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  Steady::time_point t1 = Steady::now();
+  std::uint64_t c1 = read_clock();
+  double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+  return (c1 - c0) / ns;
+#else
+  return 1;
+#endif
+}
+
+} // namespace
+
+
+Pacer::Pacer()
+  : cycles_per_ns_(calibrate()), start_(0), prev_deadline_(0), prev_release_(0),
+    packets_(0), error_sum_(0), late_(0)
+{ }
+
+
+// Start the schedule. Deadlines are relative to this call.
+void
+Pacer::start()
+{
+  start_ = read_clock();
+  prev_deadline_ = 0;
+  prev_release_ = 0;
+  packets_ = 0;
+  error_sum_ = 0;
+  late_ = 0;
+  errors_.clear();
+}
+
+
+// Returns the nanoseconds elapsed since the pacer was started.
+std::uint64_t
+Pacer::now() const
+{
+  return (read_clock() - start_) / cycles_per_ns_;
+}
+
+
+// Wait until the deadline, which is in nanoseconds since the pacer
+// was started. Returns immediately if the deadline has passed.
+void
+Pacer::wait(std::uint64_t deadline)
+{
+  std::uint64_t t = now();
+  if (deadline > t + 2 * sleep_threshold) {
+    std::uint64_t ns = deadline - t - sleep_threshold;
+    timespec ts = {(time_t)(ns / 1000000000), (long)(ns % 1000000000)};
+    nanosleep(&ts, nullptr);
+  }
+  std::uint64_t end = start_ + deadline * cycles_per_ns_;
+  while (read_clock() < end)
+    relax();
+
+  // Record the error of the gap since the previous packet.
+  std::uint64_t released = now();
+  if (released > deadline + 1000)
+    ++late_;
+  if (packets_++) {
+    std::int64_t err = (std::int64_t)(released - prev_release_) -
+                       (std::int64_t)(deadline - prev_deadline_);
+    error_sum_ += err;
+    errors_.record(err < 0 ? -err : err);
+  }
+  prev_deadline_ = deadline;
+  prev_release_ = released;
+}
+
+
+// Returns the mean signed gap error in nanoseconds. A positive mean
+// means that gaps were stretched.
+double
+Pacer::mean_error() const
+{
+  return packets_ > 1 ? (double)error_sum_ / (packets_ - 1) : 0;
+}
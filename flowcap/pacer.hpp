@@ -0,0 +1,61 @@
+
+#ifndef FLOWCAP_PACER_HPP
+#define FLOWCAP_PACER_HPP
+
+// The pacer releases packets at scheduled times. Deadlines are
+// nanoseconds since the pacer was started, and are converted to
+// readings of the CPU's time stamp counter, so that waiting for one
+// costs no system calls. Long waits sleep until shortly before the
+// deadline and then spin, which gives sub-microsecond accuracy
+// without burning a core on gaps of milliseconds.
+//
+// The pacer records the difference between each achieved gap and
+// the scheduled gap, so that a replay can report how faithfully it
+// reproduced its schedule.
+
+#include <freeflow/histogram.hpp>
+
+#include <cstdint>
+
+
+class Pacer
+{
+public:
+  // The scheduler's latency, in nanoseconds. A wait longer than
+  // twice this sleeps until this long before its deadline, and then
+  // spins. Shorter waits only spin.
+  static constexpr std::uint64_t sleep_threshold = 200000;
+
+  Pacer();
+
+  void start();
+  void wait(std::uint64_t);
+
+  // Returns the statistics of the gap errors in nanoseconds, which
+  // are absolute differences between achieved and scheduled gaps.
+  ff::Histogram const& gap_errors() const { return errors_; }
+
+  double mean_error() const;
+
+  // Returns the number of gaps measured.
+  std::uint64_t gaps() const { return packets_ ? packets_ - 1 : 0; }
+
+  // Returns the number of packets released more than a microsecond
+  // after their deadlines, because the sender fell behind.
+  std::uint64_t late() const { return late_; }
+
+private:
+  std::uint64_t now() const;
+
+  double        cycles_per_ns_;
+  std::uint64_t start_;
+  std::uint64_t prev_deadline_;
+  std::uint64_t prev_release_;
+  std::uint64_t packets_;
+  std::int64_t  error_sum_;
+  std::uint64_t late_;
+  ff::Histogram errors_;
+};
+
+
+#endif
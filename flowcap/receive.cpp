@@ -0,0 +1,93 @@
+
+#include "receive.hpp"
+#include "frames.hpp"
+
+#include <freeflow/time.hpp>
+#include <freeflow/capture.hpp>
+
+#include <iostream>
+#include <cstring>
+
+
+using namespace ff;
+
+
+// Receive packets from a connection and report what arrived. Returns
+// 0 if every packet arrived intact, or 1 otherwise.
+int
+receive(int fd, char const* path, int iterations, Stamp_options const& stamps)
+{
+  Frame_reader reader(fd);
+  Stamp_checker checker(stamps);
+  std::uint64_t n = 0;
+  std::uint64_t b = 0;
+  std::uint64_t mismatched = 0;
+  std::uint64_t expected = 0;
+  std::uint8_t const* q;
+  std::size_t k;
+  int r = 1;
+
+  // Records the start time.
+  Time start;
+  bool started = false;
+
+  if (stamps.enabled) {
+    while ((r = reader.next(q, k)) > 0) {
+      if (!started) {
+        start = now();
+        started = true;
+      }
+      checker.check(q, k);
+      ++n;
+      b += k >= stamps.trailer() ? k - stamps.trailer() : k;
+    }
+  } else {
+    // The sender transmits the whole capture once per iteration.
+    cap::File file(path);
+    if (file.link_type() != cap::ethernet_link) {
+      std::cerr << "error: input is not ethernet\n";
+      return 1;
+    }
+    expected = file.size() * iterations;
+    for (int i = 0; i < iterations && r > 0; i++) {
+      for (std::size_t j = 0; j < file.size() && (r = reader.next(q, k)) > 0; ++j) {
+        cap::Packet const& p = file[j];
+        // Record the start time after receiving the first packet.
+        if (!started) {
+          start = now();
+          started = true;
+        }
+        if (k != (std::size_t)p.captured_size() || std::memcmp(q, p.data(), k))
+          ++mismatched;
+        ++n;
+        b += k;
+      }
+    }
+  }
+  Time stop = now();
+  if (r < 0) {
+    std::cerr << "error: " << std::strerror(errno) << '\n';
+    return 1;
+  }
+
+  // Make some measurements.
+  Fp_seconds dur = stop - start;
+  double s = dur.count();
+  double Mbps = b * 8 / 1e6 / s;
+  std::uint64_t Pps = n / s;
+
+  std::cout << "received " << n << " packets in "
+            << s << " seconds (" << Pps << " Pps)\n";
+  std::cout << "received " << b << " bytes in "
+            << s << " seconds (" << Mbps << " Mbps)\n";
+
+  if (stamps.enabled) {
+    checker.report(std::cout);
+    return checker.clean() ? 0 : 1;
+  }
+  // Packets that the sender never sent are missing.
+  std::uint64_t missing = expected - n;
+  std::cout << mismatched << " packets differed from the capture, "
+            << missing << " missing\n";
+  return mismatched || missing ? 1 : 0;
+}
@@ -0,0 +1,21 @@
+
+#ifndef FLOWCAP_RECEIVE_HPP
+#define FLOWCAP_RECEIVE_HPP
+
+// The receiving side of expect and fetch. Packets arrive framed as
+// a sender writes them (see frames.hpp), and are checked in one of
+// two ways:
+//
+//  - without stamps, each packet must equal the next packet of the
+//    capture, which the sender sent the given number of times;
+//  - with stamps, packets are received until the connection closes,
+//    and their stamps measure latency, loss, reordering, duplication
+//    and corruption (see stamp.hpp).
+
+#include "stamp.hpp"
+
+
+int receive(int, char const*, int, Stamp_options const&);
+
+
+#endif
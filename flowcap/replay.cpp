@@ -3,7 +3,16 @@
 #include <freeflow/ip.hpp>
 #include <freeflow/capture.hpp>
 
+#include "connections.hpp"
+#include "pacer.hpp"
+#include "stamp.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
 #include <sstream>
+#include <thread>
 #include <iostream>
 #include <iomanip>
 #include <locale>
@@ -16,6 +25,135 @@ using namespace ff;
 extern int usage(std::ostream&);
 
 
+namespace
+{
+
+// Parse a positive number. Returns 0 if the text is not one.
+double
+to_rate(char const* s)
+{
+  char* end;
+  double x = std::strtod(s, &end);
+  return *end || x <= 0 ? 0 : x;
+}
+
+
+struct Replay_args
+{
+  bool             timed;    // Follow the capture's timing.
+  double           speed;
+  double           pps;      // Per connection.
+  double           mbps;     // Per connection.
+  std::uint64_t    first;    // The capture time of the first packet.
+  Stamp_options    stamps;
+  int              threads;
+  std::atomic<int> started;
+  std::atomic<int> errors;
+
+  // The pacing statistics of all threads.
+  std::mutex       lock;
+  ff::Histogram    gap_errors;
+  double           error_sum;
+  std::uint64_t    gaps;
+  std::uint64_t    late;
+};
+
+
+// Returns the deadline of a connection's next packet, in nanoseconds
+// since the start of the replay.
+std::uint64_t
+deadline(Replay_args const& args, Connection const& c)
+{
+  std::uint64_t d = 0;
+  std::uint64_t ts = c.frames.time(c.packets);
+  if (args.timed && ts > args.first)
+    d = (ts - args.first) / args.speed;
+  if (args.pps)
+    d = std::max(d, (std::uint64_t)(c.packets * 1e9 / args.pps));
+  if (args.mbps)
+    d = std::max(d, (std::uint64_t)(c.bytes * 8 * 1e3 / args.mbps));
+  return d;
+}
+
+
+// Send the packets of the connections in order of their deadlines,
+// waiting for each. The threads start their schedules together.
+void
+replay_work(int, std::vector<Connection*>& conns, void* data)
+{
+  Replay_args& args = *(Replay_args*)data;
+  Pacer pacer;
+  ++args.started;
+  while (args.started < args.threads)
+    std::this_thread::yield();
+
+  Time start = now();
+  pacer.start();
+  std::vector<Connection*> active;
+  for (Connection* c : conns)
+    if (c->frames.packets())
+      active.push_back(c);
+
+  while (!active.empty()) {
+    // Find the connection whose next packet is due first.
+    std::size_t next = 0;
+    std::uint64_t due = deadline(args, *active[0]);
+    for (std::size_t i = 1; i < active.size(); ++i) {
+      std::uint64_t d = deadline(args, *active[i]);
+      if (d < due) {
+        next = i;
+        due = d;
+      }
+    }
+    pacer.wait(due);
+
+    // Stamp the packet and send it, padded with its size.
+    Connection& c = *active[next];
+    if (args.stamps.enabled &&
+        stamp_frame(c.frames, c.packets, c.stamps, monotonic_ns(), args.stamps))
+      ++c.stamps;
+    errno = 0;
+    bool sent = write_frame(c.sock.fd(), c.frames, c.packets);
+    if (sent) {
+      c.bytes += c.frames.frame_size(c.packets) - 4 - args.stamps.trailer();
+      ++c.packets;
+    } else if (errno) {
+      std::cerr << "error: " << std::strerror(errno) << '\n';
+      ++args.errors;
+    }
+    if (!sent || c.packets == c.frames.packets()) {
+      c.seconds = Fp_seconds(now() - start).count();
+      active.erase(active.begin() + next);
+    }
+  }
+
+  std::lock_guard<std::mutex> guard(args.lock);
+  args.gap_errors.merge(pacer.gap_errors());
+  args.error_sum += pacer.mean_error() * pacer.gaps();
+  args.gaps += pacer.gaps();
+  args.late += pacer.late();
+}
+
+} // namespace
+
+
+// Replays a capture to a host, pacing packets to reproduce the gaps
+// between them. The capture is loaded into memory before sending.
+// Options after the port change the schedule:
+//
+//    --speed x   scale the capture's gaps by 1/x, so 2 replays at
+//                twice the captured rate
+//    --pps n     send at most n packets per second
+//    --mbps n    send at most n megabits (10^6 bits) of captured
+//                data per second
+//
+// With --pps or --mbps, the capture's timing is ignored unless
+// --speed is also given. When several limits are given, each packet
+// is sent at the latest of the times they allow. With several
+// connections, the rate limits are divided evenly among them. With
+// stamp options, each packet carries a stamp for measuring latency
+// and loss at the receiver (see stamp.hpp).
+//
 // TODO: Add options for IP versions, TCP and UDP.
 int
 replay(int argc, char* argv[])
@@ -40,82 +178,93 @@ replay(int argc, char* argv[])
     return 1;
   }
 
-  // Convert the port number.
-  std::uint16_t portnum;
-  std::stringstream ss(port);
-  ss >> portnum;
-  if (ss.fail() && !ss.eof()) {
+  // Convert the port numbers.
+  std::vector<std::uint16_t> ports;
+  if (!parse_ports(port, ports)) {
     std::cerr << "error: invalid port '" << port << "'\n";
     return 1;
   }
 
-
-  // Build and connect.
-  Ipv4_stream_socket sock;
-  if (!sock.connect({addr, portnum})) {
-    std::cerr << "error: could not connect to host\n";
-    return -1;
+  // Parse the pacing, connection and stamp options.
+  double speed = 0;
+  double pps = 0;
+  double mbps = 0;
+  Connection_options opts;
+  Stamp_options stamps;
+  for (int i = 5; i < argc; ++i) {
+    std::string opt = argv[i];
+    int parsed = parse_connection_option(argc, argv, i, opts);
+    if (parsed == 0)
+      parsed = parse_stamp_option(argc, argv, i, stamps);
+    if (parsed > 0)
+      continue;
+    double* rate = nullptr;
+    if (opt == "--speed")
+      rate = &speed;
+    else if (opt == "--pps")
+      rate = &pps;
+    else if (opt == "--mbps")
+      rate = &mbps;
+    if (parsed < 0 || !rate || i + 1 == argc || !(*rate = to_rate(argv[++i]))) {
+      std::cerr << "error: invalid option '" << opt << "'\n";
+      return usage(std::cerr);
+    }
   }
 
-  // Open an offline stream capture.
+  // Open an offline stream capture and load it, divided among the
+  // connections.
   cap::Stream cap(cap::offline(argv[2]));
   if (cap.link_type() != cap::ethernet_link) {
     std::cerr << "error: input is not ethernet\n";
     return 1;
   }
+  std::vector<Connection> conns(opts.connections);
+  partition_capture(cap, conns, opts.partition, stamps.trailer());
+  if (stamps.enabled)
+    for (Connection& c : conns)
+      prepare_stamps(c.frames, stamps);
 
-  // Iterate over each packet and and send each packet to the
-  // connected host.
-  Time start = now();
-  std::uint64_t n = 0;
-  std::uint64_t b = 0;
-  cap::Packet p;
-  Microseconds prev = Microseconds::zero();
-  while (cap.get(p)) {
-    timeval ts = p.timestamp();
-    Microseconds cur = to_duration(ts);
-
-    // Sleep until the alotted difference between packets has elapsed.
-    if (prev == Microseconds::zero())
-      prev = cur;
-    Microseconds wait = cur - prev;
-    usleep(wait.count());
-    prev = cur;
-
-    // Send the packet, padded with its size.
-    std::uint8_t buf[4096];
-    std::uint32_t hdr = htonl(p.captured_size());
-    std::memcpy(&buf[0], &hdr, 4);
-    std::memcpy(&buf[4], p.data(), p.captured_size());
-    int k = sock.send(buf, p.captured_size() + 4);
-    if (k <= 0) {
-      if (k < 0) {
-        std::cerr << "error: " << std::strerror(errno) << '\n';
-        return 1;
-      }
-      return 0;
-    }
-    ++n;
-    b += p.captured_size();
+  // Build and connect.
+  if (!connect_all(addr, ports, conns)) {
+    std::cerr << "error: could not connect to host\n";
+    return -1;
   }
+
+  Replay_args args;
+  args.timed = speed > 0 || (pps == 0 && mbps == 0);
+  args.speed = speed > 0 ? speed : 1;
+  args.pps = pps / conns.size();
+  args.mbps = mbps / conns.size();
+  args.first = std::uint64_t(-1);
+  for (Connection const& c : conns)
+    if (c.frames.packets())
+      args.first = std::min(args.first, c.frames.time(0));
+  args.stamps = stamps;
+  args.threads = connection_threads(opts.threads, conns.size());
+  args.started = 0;
+  args.errors = 0;
+  args.error_sum = 0;
+  args.gaps = 0;
+  args.late = 0;
+
+  Time start = now();
+  run_connections(conns, opts.threads, replay_work, &args);
   Time stop = now();
 
   // Make some measurements.
   Fp_seconds dur = stop - start;
-  double s = dur.count();
-  double Mb = double(b * 8) / (1 << 20);
-  double Mbps = Mb / s;
-  double Pps = n / s;
-
-  // FIXME: Make this pretty.
-  std::cout.imbue(std::locale(""));
-  std::cout << "sent " << n << " packets in " << s << " seconds (" << Pps << " Pps)\n";
-  std::cout.precision(6);
-  std::cout << "sent " << b << " bytes";
+  report_connections(std::cout, conns, dur.count());
+
+  // Report how closely the gaps between packets followed the
+  // schedule.
+  ff::Histogram const& err = args.gap_errors;
+  double mean = args.gaps ? args.error_sum / args.gaps : 0;
   std::cout.precision(1);
-  std::cout << " in " << s << " (";
-  std::cout.precision(6);
-  std::cout << Mbps << " Mbps)\n";
+  std::cout << std::fixed << "gap error " << mean << " ns mean, "
+            << err.percentile(0.5) << " ns median, "
+            << err.percentile(0.99) << " ns p99, "
+            << err.max() << " ns max\n";
+  std::cout << args.late << " packets sent more than 1 us late\n";
 
-  return 0;
+  return args.errors ? 1 : 0;
 }
@@ -0,0 +1,278 @@
+
+#include "stamp.hpp"
+#include "frames.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include <endian.h>
+#include <time.h>
+
+
+namespace
+{
+
+constexpr std::uint32_t stamp_magic = 0x46465354; // "FFST"
+
+// The number of sequence numbers below the highest received that are
+// checked for duplicates.
+constexpr std::uint64_t window_bits = 1 << 20;
+
+
+inline void
+put32(std::uint8_t* p, std::uint32_t x)
+{
+  x = htobe32(x);
+  std::memcpy(p, &x, 4);
+}
+
+
+inline void
+put64(std::uint8_t* p, std::uint64_t x)
+{
+  x = htobe64(x);
+  std::memcpy(p, &x, 8);
+}
+
+
+inline std::uint32_t
+get32(std::uint8_t const* p)
+{
+  std::uint32_t x;
+  std::memcpy(&x, p, 4);
+  return be32toh(x);
+}
+
+
+inline std::uint64_t
+get64(std::uint8_t const* p)
+{
+  std::uint64_t x;
+  std::memcpy(&x, p, 8);
+  return be64toh(x);
+}
+
+
+// Returns the stamp in a packet of n bytes, or nullptr if it is too
+// short to hold one.
+inline std::uint8_t const*
+locate(std::uint8_t const* p, std::size_t n, Stamp_options const& opts)
+{
+  if (opts.offset < 0)
+    return n >= stamp_size ? p + n - stamp_size : nullptr;
+  return opts.offset + stamp_size <= n ? p + opts.offset : nullptr;
+}
+
+
+inline std::uint8_t*
+locate(std::uint8_t* p, std::size_t n, Stamp_options const& opts)
+{
+  return const_cast<std::uint8_t*>(locate((std::uint8_t const*)p, n, opts));
+}
+
+
+// Mix n bytes into a hash, 8 at a time.
+std::uint64_t
+mix(std::uint64_t h, std::uint8_t const* p, std::size_t n)
+{
+  constexpr std::uint64_t k = 0x9e3779b97f4a7c15;
+  for (; n >= 8; p += 8, n -= 8) {
+    std::uint64_t w;
+    std::memcpy(&w, p, 8);
+    h = (h ^ le64toh(w)) * k;
+    h ^= h >> 32;
+  }
+  std::uint64_t w = 0;
+  std::memcpy(&w, p, n);
+  h = (h ^ le64toh(w) ^ n) * k;
+  return h ^ (h >> 32);
+}
+
+} // namespace
+
+
+// Parse the stamp option at argv[i], advancing i past its value.
+// Returns 1 if the option was parsed, 0 if it is not a stamp option,
+// or -1 if its value is invalid.
+int
+parse_stamp_option(int argc, char* argv[], int& i, Stamp_options& opts)
+{
+  std::string opt = argv[i];
+  if (opt == "--stamp") {
+    opts.enabled = true;
+    opts.offset = -1;
+    return 1;
+  }
+  if (opt != "--stamp-offset")
+    return 0;
+  if (i + 1 == argc)
+    return -1;
+  char* end;
+  long n = std::strtol(argv[++i], &end, 10);
+  if (*end || n < 0 || n > 65535)
+    return -1;
+  opts.enabled = true;
+  opts.offset = n;
+  return 1;
+}
+
+
+// Returns the time of CLOCK_MONOTONIC in nanoseconds.
+std::uint64_t
+monotonic_ns()
+{
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (std::uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+// Returns a hash of the n bytes of a packet, less its stamp.
+std::uint32_t
+payload_hash(std::uint8_t const* p, std::size_t n, Stamp_options const& opts)
+{
+  std::uint64_t h = 0;
+  std::uint8_t const* s = locate(p, n, opts);
+  if (!s)
+    h = mix(h, p, n);
+  else {
+    h = mix(h, p, s - p);
+    h = mix(h, s + stamp_size, p + n - s - stamp_size);
+  }
+  h ^= h >> 29;
+  h *= 0xbf58476d1ce4e5b9;
+  return h ^ (h >> 32);
+}
+
+
+// Write the magic number and hash of the stamp of each packet. The
+// packets must have been loaded with room for a trailer, if the
+// stamp is one.
+void
+prepare_stamps(Frames& f, Stamp_options const& opts)
+{
+  for (std::size_t i = 0; i < f.packets(); ++i) {
+    std::uint8_t* p = f.frame(i) + 4;
+    std::size_t n = f.frame_size(i) - 4;
+    std::uint8_t* s = locate(p, n, opts);
+    if (!s)
+      continue;
+    put32(s, stamp_magic);
+    put32(s + 4, payload_hash(p, n, opts));
+    put64(s + 8, 0);
+    put64(s + 16, 0);
+  }
+}
+
+
+// Set the sequence number and time of the stamp of packet i. Returns
+// false if the packet has no stamp.
+bool
+stamp_frame(Frames& f, std::size_t i, std::uint64_t seq, std::uint64_t time,
+            Stamp_options const& opts)
+{
+  std::uint8_t* s = locate(f.frame(i) + 4, f.frame_size(i) - 4, opts);
+  if (!s)
+    return false;
+  put64(s + 8, seq);
+  put64(s + 16, time);
+  return true;
+}
+
+
+Stamp_checker::Stamp_checker(Stamp_options const& opts)
+  : opts_(opts), stamped_(0), unstamped_(0), corrupt_(0), duplicates_(0),
+    reordered_(0), early_(0), next_(0), seen_(window_bits / 64)
+{ }
+
+
+// Check the stamp of a received packet of n bytes.
+void
+Stamp_checker::check(std::uint8_t const* p, std::size_t n)
+{
+  std::uint64_t now = monotonic_ns();
+  std::uint8_t const* s = locate(p, n, opts_);
+  if (!s || get32(s) != stamp_magic) {
+    ++unstamped_;
+    return;
+  }
+  if (get32(s + 4) != payload_hash(p, n, opts_)) {
+    ++corrupt_;
+    return;
+  }
+
+  std::uint64_t seq = get64(s + 8);
+  std::uint64_t time = get64(s + 16);
+  if (seen(seq)) {
+    ++duplicates_;
+    return;
+  }
+  ++stamped_;
+  if (seq + 1 < next_)
+    ++reordered_;
+  if (time > now) {
+    ++early_;
+    latency_.record(0);
+  } else {
+    latency_.record(now - time);
+  }
+}
+
+
+// Mark a sequence number as received, returning true if it already
+// was. Sequence numbers that have fallen out of the window cannot be
+// checked, and are taken to be new.
+bool
+Stamp_checker::seen(std::uint64_t seq)
+{
+  if (seq >= next_) {
+    // Clear the bits of the sequence numbers entering the window.
+    if (seq - next_ >= window_bits)
+      std::fill(seen_.begin(), seen_.end(), 0);
+    else
+      for (std::uint64_t i = next_; i <= seq; ++i)
+        seen_[(i % window_bits) / 64] &= ~(std::uint64_t(1) << (i % 64));
+    next_ = seq + 1;
+  } else if (next_ - seq > window_bits) {
+    return false;
+  }
+
+  std::uint64_t& word = seen_[(seq % window_bits) / 64];
+  std::uint64_t bit = std::uint64_t(1) << (seq % 64);
+  bool dup = word & bit;
+  word |= bit;
+  return dup;
+}
+
+
+std::uint64_t
+Stamp_checker::lost() const
+{
+  return next_ > stamped_ ? next_ - stamped_ : 0;
+}
+
+
+// Print the counts of the stamps and the latency percentiles.
+void
+Stamp_checker::report(std::ostream& os) const
+{
+  os << "stamped " << stamped_ << " packets: "
+     << lost() << " lost, "
+     << reordered_ << " reordered, "
+     << duplicates_ << " duplicated, "
+     << corrupt_ << " corrupt, "
+     << unstamped_ << " unstamped\n";
+  if (!stamped_)
+    return;
+  os << "latency " << latency_.min() << " ns min, "
+     << latency_.percentile(0.5) << " ns median, "
+     << latency_.percentile(0.99) << " ns p99, "
+     << latency_.percentile(0.999) << " ns p99.9, "
+     << latency_.max() << " ns max\n";
+  if (early_)
+    os << early_ << " packets stamped later than received; "
+       << "the clocks differ\n";
+}
@@ -0,0 +1,95 @@
+
+#ifndef FLOWCAP_STAMP_HPP
+#define FLOWCAP_STAMP_HPP
+
+// Stamps for measuring a dataplane end to end. A sender writes a
+// stamp into each packet it sends, and a receiver reads it back to
+// measure one-way latency, loss, reordering, duplication and
+// corruption. A stamp is 24 bytes, in network byte order:
+//
+//    magic     4 bytes   identifies a stamp
+//    hash      4 bytes   hash of the packet, less the stamp
+//    sequence  8 bytes   the number of stamps sent before on the
+//                        connection
+//    time      8 bytes   CLOCK_MONOTONIC nanoseconds when sent
+//
+// A stamp is either appended to the packet as a trailer, or written
+// over the packet's bytes at a given offset, which keeps the packet's
+// size. Packets too short to hold a stamp at the offset are sent
+// without one. Latencies are only meaningful when the sender and
+// receiver share a clock, e.g., on one host.
+//
+// The options shared by the sending and receiving commands are:
+//
+//    --stamp               stamp packets with a trailer
+//    --stamp-offset n      stamp packets at byte n
+//
+// The receiver must be given the same option as the sender.
+
+#include <freeflow/histogram.hpp>
+
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+
+class Frames;
+
+
+constexpr std::size_t stamp_size = 24;
+
+
+struct Stamp_options
+{
+  bool enabled = false;
+  int  offset = -1;       // The trailer if negative.
+
+  // Returns the bytes appended to each packet for the stamp.
+  std::size_t trailer() const { return enabled && offset < 0 ? stamp_size : 0; }
+};
+
+
+// Checks the stamps of received packets and accumulates the
+// measurements.
+class Stamp_checker
+{
+public:
+  explicit Stamp_checker(Stamp_options const&);
+
+  void check(std::uint8_t const*, std::size_t);
+  void report(std::ostream&) const;
+
+  // Returns the number of packets received with valid stamps.
+  std::uint64_t stamped() const { return stamped_; }
+
+  // Returns the number of sequence numbers that were never
+  // received, up to the highest one received.
+  std::uint64_t lost() const;
+
+  // Returns true if no stamp was lost, duplicated or corrupted.
+  bool clean() const { return !lost() && !duplicates_ && !corrupt_; }
+
+private:
+  bool seen(std::uint64_t);
+
+  Stamp_options              opts_;
+  std::uint64_t              stamped_;     // Valid stamps
+  std::uint64_t              unstamped_;   // No stamp found
+  std::uint64_t              corrupt_;     // Stamped, hash mismatch
+  std::uint64_t              duplicates_;
+  std::uint64_t              reordered_;   // Arrived after a later one
+  std::uint64_t              early_;       // Stamped in the future
+  std::uint64_t              next_;        // 1 + the highest sequence
+  std::vector<std::uint64_t> seen_;        // Bit set of sequences
+  ff::Histogram              latency_;
+};
+
+
+int           parse_stamp_option(int, char*[], int&, Stamp_options&);
+std::uint64_t monotonic_ns();
+std::uint32_t payload_hash(std::uint8_t const*, std::size_t, Stamp_options const&);
+void          prepare_stamps(Frames&, Stamp_options const&);
+bool          stamp_frame(Frames&, std::size_t, std::uint64_t, std::uint64_t, Stamp_options const&);
+
+
+#endif
@@ -0,0 +1,275 @@
+
+#include <freeflow/time.hpp>
+#include <freeflow/ip.hpp>
+
+#include "connections.hpp"
+#include "generator.hpp"
+#include "stamp.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <cstring>
+
+
+using namespace ff;
+
+
+extern int usage(std::ostream&);
+
+
+namespace
+{
+
+// The number of packets generated at a time, which keeps a batch in
+// cache. Each connection generates its own batches.
+constexpr std::size_t batch_size = 1024;
+
+
+struct Synth_args
+{
+  Stamp_options               stamps;
+  std::vector<Generator>*     generators; // One per connection
+  std::vector<std::uint64_t>* packets;    // Per connection
+  Connection*                 first;
+  std::atomic<int>            errors;
+};
+
+
+// Generate batches of packets for each connection and write each
+// batch as soon as it is made, interleaving the connections.
+void
+synth_work(int, std::vector<Connection*>& conns, void* data)
+{
+  Synth_args& args = *(Synth_args*)data;
+  Stamp_options const* stamps = args.stamps.enabled ? &args.stamps : nullptr;
+  Time start = now();
+  std::vector<Frame_writer> writers;
+  for (Connection* c : conns)
+    writers.emplace_back(c->sock.fd(), c->frames, 0);
+
+  bool active = true;
+  while (active) {
+    active = false;
+    for (std::size_t i = 0; i < conns.size(); ++i) {
+      Connection& c = *conns[i];
+      Frame_writer& w = writers[i];
+      if (w.closed())
+        continue;
+
+      // Count the batch just written, and make the next.
+      if (w.done()) {
+        std::size_t k = &c - args.first;
+        std::uint64_t packets = (*args.packets)[k];
+        c.packets += c.frames.packets();
+        c.bytes += c.frames.bytes();
+        c.frames.clear();
+        if (c.packets == packets) {
+          if (!c.seconds)
+            c.seconds = Fp_seconds(now() - start).count();
+          continue;
+        }
+        Generator& gen = (*args.generators)[k];
+        std::size_t n = std::min<std::uint64_t>(batch_size, packets - c.packets);
+        gen.generate(c.frames, n, args.stamps.trailer());
+        if (stamps)
+          prepare_stamps(c.frames, *stamps);
+        w = Frame_writer(c.sock.fd(), c.frames, 1, stamps, w.seq());
+      }
+
+      if (w.write() < 0) {
+        std::cerr << "send error: " << std::strerror(errno) << '\n';
+        ++args.errors;
+      }
+      active = true;
+    }
+  }
+}
+
+
+// Write the header of a pcap file of Ethernet frames, with
+// microsecond timestamps, in the host's byte order.
+void
+write_pcap_header(std::FILE* f)
+{
+  std::uint32_t magic = 0xa1b2c3d4;
+  std::uint16_t version[2] = {2, 4};
+  std::uint32_t rest[4] = {0, 0, 65535, 1};
+  std::fwrite(&magic, 4, 1, f);
+  std::fwrite(version, 2, 2, f);
+  std::fwrite(rest, 4, 4, f);
+}
+
+
+// Write the packets of the frames to a pcap file, the first being
+// number n of the capture, sent at the given rate.
+void
+write_pcap_packets(std::FILE* f, Frames const& frames, std::uint64_t n, double pps)
+{
+  for (std::size_t i = 0; i < frames.packets(); ++i) {
+    std::uint64_t ns = (n + i) * 1e9 / pps;
+    std::uint32_t size = frames.frame_size(i) - 4;
+    std::uint32_t rec[4] = {
+      std::uint32_t(ns / 1000000000), std::uint32_t(ns % 1000000000 / 1000), size, size
+    };
+    std::fwrite(rec, 4, 4, f);
+    std::fwrite(frames.frame(i) + 4, 1, size, f);
+  }
+}
+
+
+// Parse a positive count, as for --packets and --pps.
+bool
+parse_count(char const* s, double& x)
+{
+  char* end;
+  x = std::strtod(s, &end);
+  return !*end && x >= 1;
+}
+
+} // namespace
+
+
+// Generates synthetic traffic and sends it to a host, or writes it
+// to a capture file:
+//
+//    flowcap synth <hostname> <ports> [options]
+//    flowcap synth --write <pcap-file> [options]
+//
+// Besides the options of the generator (see generator.hpp), these
+// are accepted:
+//
+//    --packets n   packets to generate (default 1000000)
+//    --pps n       packet rate for the timestamps of a written
+//                  capture (default 1000000)
+//
+// Sending also takes the connection and stamp options, and sends as
+// fast as possible, one batch of packets at a time. Each connection
+// generates the traffic of its own share of the flows, so a flow
+// stays on one connection and --partition has no effect. To send
+// synthetic traffic on a schedule, write it and replay the capture.
+int
+synth(int argc, char* argv[])
+{
+  if (argc < 4) {
+    std::cerr << "error: too few arguments to 'synth'\n";
+    return usage(std::cerr);
+  }
+
+  bool writing = std::strcmp(argv[2], "--write") == 0;
+  std::string path = argv[3];
+  std::string host = argv[2];
+  std::string port = argv[3];
+
+  // Parse the options.
+  double packets = 1000000;
+  double pps = 1000000;
+  Synth_options synth_opts;
+  Connection_options opts;
+  Stamp_options stamps;
+  for (int i = 4; i < argc; ++i) {
+    std::string opt = argv[i];
+    int parsed = parse_synth_option(argc, argv, i, synth_opts);
+    if (parsed == 0 && !writing)
+      parsed = parse_connection_option(argc, argv, i, opts);
+    if (parsed == 0 && !writing)
+      parsed = parse_stamp_option(argc, argv, i, stamps);
+    if (parsed == 0 && (opt == "--packets" || opt == "--pps") && i + 1 < argc)
+      parsed = parse_count(argv[++i], opt == "--pps" ? pps : packets) ? 1 : -1;
+    if (parsed <= 0) {
+      std::cerr << "error: invalid option '" << opt << "'\n";
+      return usage(std::cerr);
+    }
+  }
+
+  if (writing) {
+    std::FILE* out = std::fopen(path.c_str(), "wb");
+    if (!out) {
+      std::cerr << "error: " << path << ": " << std::strerror(errno) << '\n';
+      return 1;
+    }
+    write_pcap_header(out);
+
+    // Generate and write the capture a batch at a time, timing only
+    // the generation.
+    Generator gen(synth_opts);
+    Frames frames;
+    std::uint64_t n = 0;
+    std::uint64_t b = 0;
+    Fp_seconds dur(0);
+    while (n < packets) {
+      frames.clear();
+      Time start = now();
+      gen.generate(frames, std::min<std::uint64_t>(batch_size, packets - n));
+      dur += now() - start;
+      write_pcap_packets(out, frames, n, pps);
+      n += frames.packets();
+      b += frames.bytes();
+    }
+    if (std::fclose(out) != 0) {
+      std::cerr << "error: " << path << ": " << std::strerror(errno) << '\n';
+      return 1;
+    }
+
+    double s = dur.count();
+    std::uint64_t Pps = n / s;
+    std::cout << "generated " << n << " packets in "
+              << s << " seconds (" << Pps << " Pps)\n";
+    std::cout << "wrote " << n << " packets, " << b << " bytes to " << path << '\n';
+    return 0;
+  }
+
+  // Convert the host name to an address.
+  Ipv4_address addr;
+  try {
+    addr = host;
+  } catch (std::runtime_error& err) {
+    std::cerr << "error: " << err.what() << '\n';
+    return 1;
+  }
+
+  // Convert the port numbers.
+  std::vector<std::uint16_t> ports;
+  if (!parse_ports(port, ports)) {
+    std::cerr << "error: invalid port '" << port << "'\n";
+    return 1;
+  }
+
+  // Divide the flows and packets among the connections, and build
+  // their generators before connecting.
+  int nconns = std::min(opts.connections, synth_opts.flows);
+  std::vector<Connection> conns(nconns);
+  std::vector<Generator> gens;
+  std::vector<std::uint64_t> shares;
+  std::uint64_t total = packets;
+  for (int i = 0; i < nconns; ++i) {
+    gens.emplace_back(synth_opts, i, nconns);
+    shares.push_back(total / nconns + (std::uint64_t(i) < total % nconns));
+  }
+
+  if (!connect_all(addr, ports, conns)) {
+    std::cerr << "error: could not connect to host\n";
+    return -1;
+  }
+
+  Synth_args args;
+  args.packets = &shares;
+  args.stamps = stamps;
+  args.generators = &gens;
+  args.first = conns.data();
+  args.errors = 0;
+  Time start = now();
+  run_connections(conns, opts.threads, synth_work, &args);
+  Time stop = now();
+
+  for (Connection& c : conns)
+    c.sock.close();
+
+  // Make some measurements.
+  Fp_seconds dur = stop - start;
+  report_connections(std::cout, conns, dur.count());
+
+  return args.errors ? 1 : 0;
+}
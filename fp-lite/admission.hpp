@@ -0,0 +1,106 @@
+#ifndef FP_ADMISSION_HPP
+#define FP_ADMISSION_HPP
+
+// The admission module decides whether ingress may accept a new
+// packet, given the current occupancy of the buffer pool and of
+// the egress queue that the packet is headed for. When either is
+// past its watermark, the dataplane is overloaded and ingress
+// must back off rather than buffer without limit.
+
+#include "buffer.hpp"
+
+#include <cstdint>
+
+
+namespace fp
+{
+
+// Thresholds at which ingress is considered overloaded. Ingress
+// backs off when the number of free buffers in the pool drops to
+// `pool_low`, or when the depth of an egress queue reaches
+// `queue_high`.
+struct Watermarks
+{
+  int pool_low;
+  int queue_high;
+};
+
+
+// The admission controller. Each ingress thread owns one of these,
+// so the counters need no synchronization.
+//
+// There are two overload policies:
+//
+//  - pause: stop reading from the port. The data remains queued
+//    in the kernel socket buffer, which eventually pushes back on
+//    the sender (e.g., by closing the TCP window).
+//
+//  - drop: continue reading from the port, but discard packets
+//    without processing them.
+class Admission
+{
+public:
+  enum Policy { pause, drop };
+  enum Verdict { accept, defer, discard };
+
+  Admission(Policy p, Watermarks w)
+    : policy_(p), marks_(w), paused_(0), dropped_(0)
+  { }
+
+  Verdict check(Pool const&, int) const;
+
+  // Record that ingress was skipped or that n packets were dropped
+  // due to overload.
+  void on_pause() { ++paused_; }
+  void on_drop(std::uint64_t n = 1) { dropped_ += n; }
+
+  // Returns true if either resource is past its watermark.
+  bool overloaded(Pool const&, int) const;
+
+  // Accessors.
+  Policy            policy() const     { return policy_; }
+  Watermarks const& watermarks() const { return marks_; }
+  std::uint64_t     paused() const     { return paused_; }
+  std::uint64_t     dropped() const    { return dropped_; }
+
+private:
+  Policy        policy_;
+  Watermarks    marks_;
+  std::uint64_t paused_;  // Number of times ingress backed off.
+  std::uint64_t dropped_; // Number of packets dropped on overload.
+};
+
+
+// Returns true if the pool has too few free buffers or the egress
+// queue of the given depth is too full to accept another packet.
+inline bool
+Admission::overloaded(Pool const& pool, int depth) const
+{
+  return pool.available() <= marks_.pool_low || depth >= marks_.queue_high;
+}
+
+
+// Determine whether ingress may accept a new packet. Returns accept
+// if the dataplane has room for it. Otherwise, returns defer or
+// discard according to the policy.
+inline Admission::Verdict
+Admission::check(Pool const& pool, int depth) const
+{
+  if (!overloaded(pool, depth))
+    return accept;
+  return policy_ == pause ? defer : discard;
+}
+
+
+// Returns watermarks that reserve 1/16th of the pool and 1/4th
+// of a queue of the given capacity as headroom.
+inline Watermarks
+default_watermarks(Pool const& pool, int capacity)
+{
+  return {pool.capacity() / 16, capacity - capacity / 4};
+}
+
+
+} // end namespace fp
+
+#endif
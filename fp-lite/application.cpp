@@ -64,6 +64,30 @@ lib_require(void* lib, char const* name)
 }
 
 
+#ifdef FP_STATIC_APPLICATION
+
+// Bind the library to the application linked into the program.
+Library::Library(char const* p)
+  : path(p), handle(nullptr)
+{
+  load = ::load;
+  unload = ::unload;
+  start = ::start;
+  stop = ::stop;
+
+  port_added = ::port_added;
+  port_removed = ::port_removed;
+  port_changed = ::port_changed;
+
+  proc = ::process;
+}
+
+
+Library::~Library()
+{ }
+
+#else
+
 Library::Library(char const* p)
   : path(p), handle(lib_open(p))
 {
@@ -85,6 +109,8 @@ Library::~Library()
   lib_close(handle);
 }
 
+#endif
+
 // -------------------------------------------------------------------------- //
 // Application objects objects
 
@@ -197,12 +223,4 @@ Application::port_changed(Port& p)
 }
 
 
-int
-Application::process(Context& cxt)
-{
-  assert(state_ == RUNNING);
-  return lib_.proc(&cxt);
-}
-
-
 } // end namespace fp
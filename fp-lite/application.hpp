@@ -2,6 +2,9 @@
 #define FP_APPLICATION_HPP
 
 #include "port.hpp"
+#include "profile.hpp"
+
+#include <cassert>
 
 namespace fp
 {
@@ -9,8 +12,39 @@ namespace fp
 class Dataplane;
 class Context;
 
+} // end namespace fp
+
+
+// When applications are statically linked into the driver, their
+// entry points are resolved by the linker instead of dlsym. All
+// but process() are optional, so they are declared weak, and their
+// addresses are null when the application does not define them.
+#ifdef FP_STATIC_APPLICATION
+extern "C"
+{
+
+int load(fp::Dataplane*) __attribute__((weak));
+int unload(fp::Dataplane*) __attribute__((weak));
+int start(fp::Dataplane*) __attribute__((weak));
+int stop(fp::Dataplane*) __attribute__((weak));
+
+int port_added(unsigned int) __attribute__((weak));
+int port_removed(unsigned int) __attribute__((weak));
+int port_changed(unsigned int) __attribute__((weak));
+
+int process(fp::Context*);
+
+} // extern "C"
+#endif
+
+
+namespace fp
+{
+
 
 // The Library class represents a dynamically loaded application.
+// In static builds, the library is the application linked into
+// the program, and the path is ignored.
 struct Library
 {
   using Init_fn = int (*)(Dataplane*);
@@ -71,6 +105,23 @@ public:
 };
 
 
+// Run the application's pipeline on the given context. This is
+// called for every packet, so it is defined inline. In static
+// builds, the call goes directly to the application, which allows
+// it to be inlined as well.
+inline int
+Application::process(Context& cxt)
+{
+  assert(state_ == RUNNING);
+  FP_PROFILE_SCOPE(prof_process);
+#ifdef FP_STATIC_APPLICATION
+  return ::process(&cxt);
+#else
+  return lib_.proc(&cxt);
+#endif
+}
+
+
 } // end namespace fp
 
 #endif
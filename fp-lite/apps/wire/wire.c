@@ -103,21 +103,3 @@ process(struct Context* cxt)
   fp_context_set_output_port(cxt, out);
   return 0;
 }
-
-
-// FIXME: What does this actually do/?
-void
-config()
-{
-  puts("[wire] called config");
-  // p1 = fp_get_port("p1");
-}
-
-
-// FIXME: What does this actually do?
-void
-ports(void* ret)
-{
-  puts("[wire] called ports");
-  // *((int*)ret) = 2;
-}
@@ -0,0 +1,89 @@
+// Measures the cost of running an application's pipeline on a
+// packet, as seen by a driver's receive loop. The same source is
+// built against the shared runtime, where the application is loaded
+// with dlopen, and against the static runtime, where the application
+// is compiled into the benchmark with LTO.
+//
+// usage: fp-bench-app [app [iterations]]
+//
+// The application path is ignored by the static builds.
+
+#include "port.hpp"
+#include "context.hpp"
+#include "dataplane.hpp"
+#include "application.hpp"
+#include "cpu.hpp"
+
+#include <freeflow/time.hpp>
+
+#include <cstdlib>
+#include <iostream>
+
+
+using namespace ff;
+using namespace fp;
+
+
+// A port that never sends or receives. The benchmark only needs
+// ports for the application to forward between.
+struct Null_port : Port
+{
+  using Port::Port;
+
+  bool open() { return true; }
+  bool close() { return true; }
+  bool send(Context&) { return true; }
+  bool recv(Context&) { return true; }
+};
+
+
+int
+main(int argc, char* argv[])
+{
+  char const* path = argc >= 2 ? argv[1] : "apps/wire.app";
+  long iterations = argc >= 3 ? std::atol(argv[2]) : 100000000;
+
+  Null_port ports[2] = {{1}, {2}};
+  Dataplane dp("bench");
+  for (Null_port& p : ports)
+    dp.add_port(&p);
+  dp.add_virtual_ports();
+  dp.load_application(path);
+  dp.up();
+
+  Application* app = dp.get_application();
+  for (Null_port& p : ports)
+    app->port_changed(p);
+
+  Byte buf[64] = {};
+  Context cxt(&dp, buf);
+
+  // Accumulate the output ports so that the calls cannot be
+  // optimized away.
+  unsigned long sink = 0;
+  Time start = now();
+  for (long i = 0; i < iterations; ++i) {
+    Port* in = &ports[i & 1];
+    cxt.set_input(in, in, 0);
+    app->process(cxt);
+    sink += cxt.output_port_id();
+  }
+  Fp_seconds dur = now() - start;
+
+  double ns = dur.count() * 1e9 / iterations;
+  print_cpu_dispatch(std::cout);
+  std::cout << "app: " << path
+#ifdef FP_STATIC_APPLICATION
+            << " (static)"
+#else
+            << " (dlopen)"
+#endif
+            << " packets: " << iterations
+            << " ns/packet: " << ns
+            << " Mpps: " << 1e3 / ns
+            << " checksum: " << sink << '\n';
+
+  dp.down();
+  dp.unload_application();
+  return 0;
+}
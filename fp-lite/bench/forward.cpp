@@ -0,0 +1,454 @@
+// Measures end-to-end forwarding through a dataplane. Packets are
+// received from an in-memory source port, processed by an
+// application, and sent to an in-memory sink port by a group of
+// worker threads, each running the receive loop of a driver: take a
+// buffer from the pool, receive, process, apply actions, send, and
+// free the buffer. There are no sockets, so results do not depend on
+// the kernel's network stack or on scheduling between processes.
+//
+// usage: fp-bench-forward [app] [options]
+//
+//    --packets n         packets forwarded by all threads (default 10M)
+//    --duration secs     run for a fixed time instead of a packet count
+//    --warmup n          packets forwarded by each thread before
+//                        measuring (default 100000)
+//    --threads list      comma separated thread counts to sweep
+//                        (default 1, 2, 4, ... up to the CPU count)
+//    --frame-size bytes  size of the UDP frames (default 64)
+//    --flows n           distinct 5-tuples in the frames (default 1024)
+//    --sample-period n   latency sampling period (default 32)
+//    --json path         write the results as JSON
+//
+// The application is apps/wire.app by default. The source is port 1
+// and the sink is port 2.
+
+#include "harness.hpp"
+
+#include "port_memory.hpp"
+#include "dataplane.hpp"
+#include "context.hpp"
+#include "application.hpp"
+#include "buffer.hpp"
+#include "latency.hpp"
+#include "thread.hpp"
+
+#include <freeflow/histogram.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#include <unistd.h>
+
+
+using namespace fp;
+
+
+struct Options
+{
+  std::string      app = "apps/wire.app";
+  long             packets = 10000000;
+  double           duration = 0;
+  long             warmup = 100000;
+  std::vector<int> threads;
+  int              frame_size = 64;
+  int              flows = 1024;
+  int              sample_period = 32;
+  std::string      json;
+};
+
+
+// The measurements of one worker thread.
+struct Thread_result
+{
+  long   packets;
+  Cycles cycles;
+};
+
+
+// The measurements of a run with a given number of threads.
+struct Result
+{
+  int                   threads;
+  long                  packets;
+  double                seconds;  // The longest time of any thread.
+  double                mpps;     // The sum of the threads' rates.
+  double                cycles_per_packet;
+  std::uint64_t         drops;
+  ff::Histogram_summary dwell;    // Ingress to egress, in cycles.
+};
+
+
+// The state shared by the worker threads of a run.
+struct Run
+{
+  Dataplane*                 dp;
+  Port_memory*               source;
+  long                       warmup;
+  long                       packets;  // Per thread; 0 to run until stopped.
+  int                        sample_period;
+  std::atomic<bool>          stop;
+  std::atomic<int>           measuring;
+  Thread::Barrier            warm;
+  Thread::Barrier            go;
+  std::vector<Thread_result> results;
+};
+
+
+// -------------------------------------------------------------------------- //
+// Frames
+
+// Build an Ethernet/IPv4/UDP frame of n bytes whose addresses and
+// ports are determined by the flow number.
+std::vector<Byte>
+make_frame(int n, int flow)
+{
+  std::vector<Byte> f(std::max(n, 42));
+  Byte* p = f.data();
+  Byte const dst[6] = {0x02, 0, 0, 0, 0, 2};
+  Byte const src[6] = {0x02, 0, 0, 0, 0, 1};
+  std::copy(dst, dst + 6, p);
+  std::copy(src, src + 6, p + 6);
+  p[12] = 0x08;
+  p[13] = 0x00;
+
+  Byte* ip = p + 14;
+  int ip_len = f.size() - 14;
+  ip[0] = 0x45;
+  ip[2] = ip_len >> 8;
+  ip[3] = ip_len;
+  ip[8] = 64;
+  ip[9] = 17;
+  Byte const saddr[4] = {10, 0, (Byte)(flow >> 8), (Byte)flow};
+  Byte const daddr[4] = {10, 1, 0, 1};
+  std::copy(saddr, saddr + 4, ip + 12);
+  std::copy(daddr, daddr + 4, ip + 16);
+  unsigned sum = 0;
+  for (int i = 0; i < 20; i += 2)
+    sum += (ip[i] << 8) | ip[i + 1];
+  while (sum >> 16)
+    sum = (sum & 0xffff) + (sum >> 16);
+  ip[10] = ~sum >> 8;
+  ip[11] = ~sum;
+
+  Byte* udp = ip + 20;
+  int udp_len = ip_len - 20;
+  int sport = 1024 + flow % 60000;
+  udp[0] = sport >> 8;
+  udp[1] = sport;
+  udp[2] = 5000 >> 8;
+  udp[3] = 5000 & 0xff;
+  udp[4] = udp_len >> 8;
+  udp[5] = udp_len;
+  return f;
+}
+
+
+// -------------------------------------------------------------------------- //
+// Workers
+
+// Forward one packet. Returns false if no buffer was free.
+inline bool
+forward(Dataplane& dp, Pool& pool, Application& app, Port_memory& src)
+{
+  Buffer* buf = pool.try_alloc();
+  if (!buf) {
+    src.count_drop(drop_no_buffer);
+    return false;
+  }
+  Context& cxt = buf->context();
+  src.recv(cxt);
+  Latency_stats& lat = dp.latency();
+  Cycles t = lat.sample() ? now_cycles() : 0;
+  app.process(cxt);
+  cxt.apply_actions();
+  Port* out = cxt.output_port();
+  if (out && out->is_up()) {
+    out->send(cxt);
+    if (t)
+      lat.record(src.id(), cxt.packet().timestamp(), t, now_cycles());
+  } else {
+    src.count_drop(drop_app);
+  }
+  pool.dealloc(buf->id());
+  return true;
+}
+
+
+// Warm up, wait for the other workers, and then forward packets
+// until the count is reached or the run is stopped. Latency and
+// drops are counted only while measuring.
+void
+work(Thread_group& g, int id)
+{
+  Run& r = *(Run*)g.data();
+  Dataplane& dp = *r.dp;
+  Pool& pool = dp.pool();
+  Application& app = *dp.get_application();
+  Port_memory& src = *r.source;
+
+  for (long i = 0; i < r.warmup; ++i)
+    forward(dp, pool, app, src);
+  Thread_barrier::wait(&r.warm);
+  if (id == 0) {
+    dp.latency().set_sample_period(r.sample_period);
+    src.reset_stats();
+  }
+  Thread_barrier::wait(&r.go);
+  ++r.measuring;
+
+  long n = 0;
+  Cycles start = now_cycles();
+  if (r.packets) {
+    for (; n < r.packets; ++n)
+      forward(dp, pool, app, src);
+  } else {
+    while (!r.stop.load(std::memory_order_relaxed)) {
+      for (int i = 0; i < 64; ++i)
+        forward(dp, pool, app, src);
+      n += 64;
+    }
+  }
+  r.results[id] = {n, now_cycles() - start};
+}
+
+
+// Forward packets with the given number of threads on a fresh
+// dataplane.
+Result
+run(Options const& opts, int nthreads)
+{
+  Port_memory source(1, "source");
+  Port_memory sink(2, "sink");
+  for (int i = 0; i < opts.flows; ++i) {
+    std::vector<Byte> f = make_frame(opts.frame_size, i);
+    source.add_frame(f.data(), f.size());
+  }
+
+  Dataplane dp("bench");
+  dp.set_pool_size(nthreads * 64);
+  dp.add_port(&source);
+  dp.add_port(&sink);
+  dp.add_virtual_ports();
+  dp.load_application(opts.app.c_str());
+  dp.up();
+  dp.get_application()->port_changed(source);
+  dp.get_application()->port_changed(sink);
+  dp.latency().set_sample_period(0);
+
+  Run r;
+  r.dp = &dp;
+  r.source = &source;
+  r.warmup = opts.warmup;
+  r.packets = opts.duration > 0 ? 0 : std::max(1L, opts.packets / nthreads);
+  r.sample_period = opts.sample_period;
+  r.stop = false;
+  r.measuring = 0;
+  r.results.resize(nthreads);
+  Thread_barrier::init(&r.warm, nthreads);
+  Thread_barrier::init(&r.go, nthreads);
+
+  int ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+  std::vector<int> cpus;
+  for (int i = 0; i < nthreads; ++i)
+    cpus.push_back(i % ncpus);
+  dp.threads().set_cpus(cpus);
+  dp.threads().run(work, &r);
+
+  if (opts.duration > 0) {
+    while (r.measuring < nthreads)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    std::this_thread::sleep_for(std::chrono::duration<double>(opts.duration));
+    r.stop = true;
+  }
+  dp.threads().halt();
+  Thread_barrier::destroy(&r.warm);
+  Thread_barrier::destroy(&r.go);
+
+  Result res = {};
+  res.threads = nthreads;
+  Cycles cycles = 0;
+  for (Thread_result const& t : r.results) {
+    double secs = t.cycles / tsc_hz();
+    res.packets += t.packets;
+    res.seconds = std::max(res.seconds, secs);
+    res.mpps += secs > 0 ? t.packets / secs / 1e6 : 0;
+    cycles += t.cycles;
+  }
+  res.cycles_per_packet = res.packets ? (double)cycles / res.packets : 0;
+  Port::Statistics s = source.stats();
+  res.drops = s.total_drops();
+
+  ff::Histogram h;
+  dp.latency().merge(source.id(), lat_dwell, h);
+  res.dwell = ff::Histogram_summary(h);
+
+  dp.down();
+  dp.unload_application();
+  return res;
+}
+
+
+// -------------------------------------------------------------------------- //
+// Reporting
+
+void
+print_header(std::ostream& os)
+{
+  char line[160];
+  std::snprintf(line, sizeof(line), "%8s %12s %9s %9s %10s %9s %9s %9s %8s\n",
+                "threads", "packets", "Mpps", "Mpps/thr", "cyc/pkt",
+                "p50 ns", "p99 ns", "p999 ns", "drops");
+  os << line << std::string(91, '-') << '\n';
+}
+
+
+void
+print_result(std::ostream& os, Result const& r)
+{
+  char line[160];
+  std::snprintf(line, sizeof(line), "%8d %12ld %9.3f %9.3f %10.1f %9lu %9lu %9lu %8lu\n",
+                r.threads, r.packets, r.mpps, r.mpps / r.threads, r.cycles_per_packet,
+                (unsigned long)cycles_to_ns(r.dwell.p50),
+                (unsigned long)cycles_to_ns(r.dwell.p99),
+                (unsigned long)cycles_to_ns(r.dwell.p999),
+                (unsigned long)r.drops);
+  os << line;
+}
+
+
+void
+write_json(std::ostream& os, Options const& opts, std::vector<Result> const& rs)
+{
+  std::string s;
+  ff::json::Writer w(s);
+  w.begin_object();
+  w.key("context").begin_object();
+  write_bench_context(w);
+  w.member("app", opts.app);
+  w.member("frame_size", opts.frame_size);
+  w.member("flows", opts.flows);
+  w.member("warmup", opts.warmup);
+  w.member("duration", opts.duration);
+  w.member("sample_period", opts.sample_period);
+  w.end_object();
+
+  w.key("results").begin_array();
+  for (Result const& r : rs) {
+    w.begin_object();
+    w.member("threads", r.threads);
+    w.member("packets", r.packets);
+    w.member("seconds", r.seconds);
+    w.member("mpps", r.mpps);
+    w.member("mpps_per_thread", r.mpps / r.threads);
+    w.member("cycles_per_packet", r.cycles_per_packet);
+    w.member("ns_per_packet", r.cycles_per_packet * 1e9 / tsc_hz());
+    w.member("drops", r.drops);
+    w.key("latency_ns").begin_object();
+    w.member("samples", r.dwell.count);
+    w.member("p50", cycles_to_ns(r.dwell.p50));
+    w.member("p99", cycles_to_ns(r.dwell.p99));
+    w.member("p999", cycles_to_ns(r.dwell.p999));
+    w.member("max", cycles_to_ns(r.dwell.max));
+    w.end_object();
+    w.end_object();
+  }
+  w.end_array();
+  w.end_object();
+  os << s << '\n';
+}
+
+
+// Parse a comma separated list of positive integers.
+bool
+parse_list(std::string const& s, std::vector<int>& v)
+{
+  std::stringstream ss(s);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    int n = std::atoi(item.c_str());
+    if (n <= 0 || n > max_thread_index)
+      return false;
+    v.push_back(n);
+  }
+  return !v.empty();
+}
+
+
+bool
+parse(int argc, char* argv[], Options& opts)
+{
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool more = i + 1 < argc;
+    if (arg == "--packets" && more)
+      opts.packets = std::atol(argv[++i]);
+    else if (arg == "--duration" && more)
+      opts.duration = std::atof(argv[++i]);
+    else if (arg == "--warmup" && more)
+      opts.warmup = std::atol(argv[++i]);
+    else if (arg == "--threads" && more) {
+      if (!parse_list(argv[++i], opts.threads))
+        return false;
+    }
+    else if (arg == "--frame-size" && more)
+      opts.frame_size = std::atoi(argv[++i]);
+    else if (arg == "--flows" && more)
+      opts.flows = std::max(1, std::atoi(argv[++i]));
+    else if (arg == "--sample-period" && more)
+      opts.sample_period = std::atoi(argv[++i]);
+    else if (arg == "--json" && more)
+      opts.json = argv[++i];
+    else if (arg[0] != '-')
+      opts.app = arg;
+    else
+      return false;
+  }
+  return opts.frame_size <= 2048;
+}
+
+
+int
+main(int argc, char* argv[])
+{
+  Options opts;
+  if (!parse(argc, argv, opts)) {
+    std::cerr << "usage: " << argv[0]
+              << " [app] [--packets n] [--duration secs] [--warmup n]"
+              << " [--threads list] [--frame-size bytes] [--flows n]"
+              << " [--sample-period n] [--json path]\n";
+    return EXIT_FAILURE;
+  }
+  if (opts.threads.empty()) {
+    int ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int n = 1; n <= ncpus && n <= max_thread_index; n *= 2)
+      opts.threads.push_back(n);
+  }
+
+  std::vector<Result> results;
+  for (int n : opts.threads) {
+    recalibrate_tsc();
+    results.push_back(run(opts, n));
+  }
+
+  std::cout << "app: " << opts.app << " frame size: " << opts.frame_size
+            << " flows: " << opts.flows << '\n';
+  print_header(std::cout);
+  for (Result const& r : results)
+    print_result(std::cout, r);
+
+  if (!opts.json.empty()) {
+    std::ofstream f(opts.json);
+    write_json(f, opts, results);
+    if (!f) {
+      std::cerr << "cannot write " << opts.json << '\n';
+      return EXIT_FAILURE;
+    }
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,336 @@
+#include "harness.hpp"
+#include "cpu.hpp"
+
+#include <freeflow/json.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+
+#include <unistd.h>
+
+#ifndef FP_BUILD_TYPE
+#  define FP_BUILD_TYPE ""
+#endif
+
+
+namespace fp
+{
+
+namespace
+{
+
+struct Benchmark
+{
+  std::string    name;
+  Bench_function fn;
+  long           arg;
+};
+
+
+// The times of the runs of a benchmark, in nanoseconds per
+// operation.
+struct Result
+{
+  std::string         name;
+  long                iterations;
+  long                items;
+  std::vector<double> ns;
+
+  double min() const { return *std::min_element(ns.begin(), ns.end()); }
+  double max() const { return *std::max_element(ns.begin(), ns.end()); }
+  double mean() const;
+  double median() const;
+  double stddev() const;
+};
+
+
+double
+Result::mean() const
+{
+  double sum = 0;
+  for (double x : ns)
+    sum += x;
+  return sum / ns.size();
+}
+
+
+double
+Result::median() const
+{
+  std::vector<double> v = ns;
+  std::sort(v.begin(), v.end());
+  std::size_t n = v.size();
+  return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+
+// Returns the sample standard deviation, or 0 for a single run.
+double
+Result::stddev() const
+{
+  if (ns.size() < 2)
+    return 0;
+  double m = mean();
+  double sum = 0;
+  for (double x : ns)
+    sum += (x - m) * (x - m);
+  return std::sqrt(sum / (ns.size() - 1));
+}
+
+
+struct Options
+{
+  std::string filter;
+  double      min_time = 0.2;
+  int         repetitions = 5;
+  std::string json;
+  bool        list = false;
+};
+
+
+// The registered benchmarks, in order of registration.
+std::vector<Benchmark>&
+benchmarks()
+{
+  static std::vector<Benchmark> bs;
+  return bs;
+}
+
+
+// An upper bound on iterations, for operations that the compiler
+// reduces to nothing.
+constexpr long max_iterations = 1L << 34;
+
+
+// Run a benchmark for n iterations. Returns the elapsed time in
+// seconds, or a negative value if the benchmark misused the timer.
+double
+run_once(Benchmark const& b, long n, long& items)
+{
+  Bench_state s(n, b.arg);
+  b.fn(s);
+  if (s.running() || !s.elapsed())
+    return -1;
+  items = s.items();
+  return s.elapsed() / tsc_hz();
+}
+
+
+// Find a number of iterations whose run takes at least the minimum
+// time. Each trial aims past the minimum, growing by at most a
+// factor of 10.
+long
+calibrate(Benchmark const& b, double min_time)
+{
+  long n = 1;
+  for (;;) {
+    long items;
+    double secs = run_once(b, n, items);
+    if (secs < 0)
+      return -1;
+    if (secs >= min_time || n >= max_iterations)
+      return n;
+    double scale = secs > 0 ? 1.4 * min_time / secs : 10;
+    n = std::min(max_iterations, std::max(n + 1, (long)(n * std::min(scale, 10.0))));
+  }
+}
+
+
+bool
+run(Benchmark const& b, Options const& opts, Result& r)
+{
+  r.name = b.name;
+  r.iterations = calibrate(b, opts.min_time);
+  if (r.iterations < 0)
+    return false;
+  for (int i = 0; i < opts.repetitions; ++i) {
+    double secs = run_once(b, r.iterations, r.items);
+    if (secs < 0)
+      return false;
+    r.ns.push_back(secs * 1e9 / ((double)r.iterations * r.items));
+  }
+  return true;
+}
+
+
+void
+print_header(std::ostream& os)
+{
+  char line[128];
+  std::snprintf(line, sizeof(line), "%-40s %14s %10s %10s %7s\n",
+                "benchmark", "operations", "median ns", "min ns", "cv %");
+  os << line << std::string(84, '-') << '\n';
+}
+
+
+void
+print_result(std::ostream& os, Result const& r)
+{
+  char line[128];
+  double med = r.median();
+  double cv = med > 0 ? 100 * r.stddev() / r.mean() : 0;
+  std::snprintf(line, sizeof(line), "%-40s %14ld %10.2f %10.2f %7.2f\n",
+                r.name.c_str(), r.iterations * r.items, med, r.min(), cv);
+  os << line;
+}
+
+
+// Returns the local time in ISO 8601 format.
+std::string
+timestamp()
+{
+  std::time_t t = std::time(nullptr);
+  char buf[32];
+  std::strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S%z", std::localtime(&t));
+  return buf;
+}
+
+
+// Write the results, and a description of the host and build so
+// that runs can be compared.
+void
+write_json(std::ostream& os, std::vector<Result> const& rs, Options const& opts)
+{
+  std::string s;
+  ff::json::Writer w(s);
+  w.begin_object();
+  w.key("context").begin_object();
+  write_bench_context(w);
+  w.member("min_time", opts.min_time);
+  w.member("repetitions", opts.repetitions);
+  w.end_object();
+
+  w.key("benchmarks").begin_array();
+  for (Result const& r : rs) {
+    w.begin_object();
+    w.member("name", r.name);
+    w.member("iterations", r.iterations);
+    w.member("items_per_iteration", r.items);
+    w.member("median_ns", r.median());
+    w.member("mean_ns", r.mean());
+    w.member("min_ns", r.min());
+    w.member("max_ns", r.max());
+    w.member("stddev_ns", r.stddev());
+    w.key("runs_ns").begin_array();
+    for (double x : r.ns)
+      w.value(x);
+    w.end_array();
+    w.end_object();
+  }
+  w.end_array();
+  w.end_object();
+  os << s << '\n';
+}
+
+
+bool
+parse(int argc, char* argv[], Options& opts)
+{
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool more = i + 1 < argc;
+    if (arg == "--filter" && more)
+      opts.filter = argv[++i];
+    else if (arg == "--min-time" && more)
+      opts.min_time = std::atof(argv[++i]);
+    else if (arg == "--repetitions" && more)
+      opts.repetitions = std::max(1, std::atoi(argv[++i]));
+    else if (arg == "--json" && more)
+      opts.json = argv[++i];
+    else if (arg == "--list")
+      opts.list = true;
+    else
+      return false;
+  }
+  return true;
+}
+
+} // namespace
+
+
+// Write the members that describe the host and build: the date, host
+// name, CPU count, instruction set, TSC frequency and build type.
+void
+write_bench_context(ff::json::Writer& w)
+{
+  char host[256] = {};
+  gethostname(host, sizeof(host) - 1);
+  w.member("date", timestamp());
+  w.member("host", host);
+  w.member("cpus", sysconf(_SC_NPROCESSORS_ONLN));
+  w.member("isa", to_string(host_isa()));
+  w.member("tsc_hz", tsc_hz());
+  w.member("build_type", FP_BUILD_TYPE);
+}
+
+
+// Register a benchmark. The argument is passed to each run, so one
+// function can be registered for several sizes.
+void
+add_benchmark(std::string const& name, Bench_function fn, long arg)
+{
+  benchmarks().push_back({name, fn, arg});
+}
+
+
+// Run the registered benchmarks selected by the command line.
+// Returns the program's exit status.
+int
+run_benchmarks(int argc, char* argv[])
+{
+  Options opts;
+  if (!parse(argc, argv, opts)) {
+    std::cerr << "usage: " << argv[0]
+              << " [--filter text] [--min-time secs] [--repetitions n]"
+              << " [--json path] [--list]\n";
+    return EXIT_FAILURE;
+  }
+
+  std::vector<Benchmark const*> selected;
+  for (Benchmark const& b : benchmarks())
+    if (b.name.find(opts.filter) != std::string::npos)
+      selected.push_back(&b);
+
+  if (opts.list) {
+    for (Benchmark const* b : selected)
+      std::cout << b->name << '\n';
+    return EXIT_SUCCESS;
+  }
+
+  // Results go to stderr when the JSON goes to stdout.
+  std::ostream& out = opts.json == "-" ? std::cerr : std::cout;
+  print_header(out);
+  std::vector<Result> results;
+  int status = EXIT_SUCCESS;
+  for (Benchmark const* b : selected) {
+    recalibrate_tsc();
+    Result r;
+    if (!run(*b, opts, r)) {
+      std::cerr << b->name << ": benchmark must start and stop its timer\n";
+      status = EXIT_FAILURE;
+      continue;
+    }
+    print_result(out, r);
+    results.push_back(std::move(r));
+  }
+
+  if (opts.json == "-") {
+    write_json(std::cout, results, opts);
+  } else if (!opts.json.empty()) {
+    std::ofstream f(opts.json);
+    write_json(f, results, opts);
+    if (!f) {
+      std::cerr << "cannot write " << opts.json << '\n';
+      status = EXIT_FAILURE;
+    }
+  }
+  return status;
+}
+
+
+} // namespace fp
@@ -0,0 +1,135 @@
+#ifndef FP_BENCH_HARNESS_HPP
+#define FP_BENCH_HARNESS_HPP
+
+// A small benchmark harness for the runtime's primitives. Each
+// benchmark is a function that runs an operation a given number of
+// times and times only the loop, not its setup:
+//
+//    void bm_alloc(Bench_state& s)
+//    {
+//      Pool pool(4096, nullptr);
+//      s.start();
+//      for (long i = 0; i < s.iterations(); ++i)
+//        pool.dealloc(pool.alloc().id());
+//      s.stop();
+//    }
+//
+// The harness picks the number of iterations so that each run takes
+// at least the minimum time, repeats the run, and reports the time
+// per operation of each benchmark as a table and, optionally, as
+// JSON. Times are measured with the time stamp counter.
+//
+// A benchmark program registers its benchmarks and passes control
+// to run_benchmarks(), which parses the command line:
+//
+//    --filter text       run only benchmarks whose names contain text
+//    --min-time secs     minimum time of each run (default 0.2)
+//    --repetitions n     runs of each benchmark (default 5)
+//    --json path         write the results as JSON ('-' for stdout)
+//    --list              print the names of the benchmarks
+
+#include "time.hpp"
+
+#include <freeflow/json.hpp>
+
+#include <string>
+#include <vector>
+
+
+namespace fp
+{
+
+// The state of a benchmark run.
+class Bench_state
+{
+public:
+  Bench_state(long n, long arg)
+    : iterations_(n), arg_(arg), items_(1), elapsed_(0), started_(0), running_(false)
+  { }
+
+  // Returns the number of times to run the operation.
+  long iterations() const { return iterations_; }
+
+  // Returns the argument the benchmark was registered with.
+  long arg() const { return arg_; }
+
+  // Start and stop timing. Time accumulates over pairs of calls,
+  // so work that is not to be measured can be excluded by stopping
+  // and restarting the timer.
+  void start()
+  {
+    running_ = true;
+    started_ = now_cycles();
+  }
+
+  void stop()
+  {
+    elapsed_ += now_cycles() - started_;
+    running_ = false;
+  }
+
+  // Set the number of operations performed by each iteration, when
+  // an iteration does more than one.
+  void set_items(long n) { items_ = n; }
+
+  long   items() const { return items_; }
+  Cycles elapsed() const { return elapsed_; }
+  bool   running() const { return running_; }
+
+private:
+  long   iterations_;
+  long   arg_;
+  long   items_;
+  Cycles elapsed_;
+  Cycles started_;
+  bool   running_;
+};
+
+
+using Bench_function = void (*)(Bench_state&);
+
+
+void add_benchmark(std::string const&, Bench_function, long = 0);
+int  run_benchmarks(int, char*[]);
+
+void write_bench_context(ff::json::Writer&);
+
+
+// Prevent the compiler from discarding the computation of a value.
+template<typename T>
+inline void
+keep(T const& v)
+{
+  asm volatile("" : : "r,m"(v) : "memory");
+}
+
+
+// Prevent the compiler from assuming that memory is unchanged, or
+// from discarding stores to it.
+inline void
+clobber()
+{
+  asm volatile("" : : : "memory");
+}
+
+
+// Returns the time stamp counter after every earlier instruction has
+// completed, and before any later one starts, so that a single
+// operation can be timed between two readings.
+inline Cycles
+fenced_cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  _mm_lfence();
+  Cycles c = __rdtsc();
+  _mm_lfence();
+  return c;
+#else
+  return now_cycles();
+#endif
+}
+
+
+} // namespace fp
+
+#endif
@@ -0,0 +1,355 @@
+// Microbenchmarks of the runtime's primitives: buffer pool
+// allocation, hash table search and insert, key gathering, context
+// construction, actions, and field bindings. These are the baselines
+// against which changes to the packet path are measured.
+//
+// usage: fp-bench-runtime [options]
+//
+// See harness.hpp for the options.
+
+#include "harness.hpp"
+
+#include "buffer.hpp"
+#include "context.hpp"
+#include "binding.hpp"
+#include "system.hpp"
+#include "table.hpp"
+
+#include <cstdarg>
+#include <random>
+#include <string>
+#include <vector>
+
+
+using namespace fp;
+
+
+// -------------------------------------------------------------------------- //
+// Buffer pool
+
+// Allocate and free one buffer at a time, as the receive loop of a
+// driver does.
+void
+bm_pool_alloc(Bench_state& s)
+{
+  Pool pool(4096, nullptr);
+  s.start();
+  for (long i = 0; i < s.iterations(); ++i) {
+    Buffer* b = pool.try_alloc();
+    keep(b);
+    pool.dealloc(b->id());
+  }
+  s.stop();
+}
+
+
+// Allocate a burst of buffers and then free them all. Each item is
+// one allocation and one deallocation.
+void
+bm_pool_burst(Bench_state& s)
+{
+  Pool pool(4096, nullptr);
+  std::vector<int> ids(s.arg());
+  s.set_items(s.arg());
+  s.start();
+  for (long i = 0; i < s.iterations(); ++i) {
+    for (int& id : ids)
+      id = pool.try_alloc()->id();
+    for (int id : ids)
+      pool.dealloc(id);
+  }
+  s.stop();
+}
+
+
+// -------------------------------------------------------------------------- //
+// Hash table
+
+// The number of distinct keys searched for in a table. Searches
+// cycle through them in a random order.
+constexpr int search_keys = 1 << 16;
+
+
+// Returns n random keys.
+std::vector<Key>
+random_keys(std::size_t n, std::uint64_t seed)
+{
+  std::mt19937_64 gen(seed);
+  std::vector<Key> keys(n);
+  for (Key& k : keys)
+    k = ((Key)gen() << 64) | gen();
+  return keys;
+}
+
+
+// Search a table of arg flows for keys that are in the table.
+void
+bm_hash_search_hit(Bench_state& s)
+{
+  std::vector<Key> keys = random_keys(s.arg(), 1);
+  Hash_table t(1, s.arg(), 16);
+  for (Key k : keys)
+    t.insert(k, Flow());
+  keys.resize(std::min<std::size_t>(keys.size(), search_keys));
+  std::shuffle(keys.begin(), keys.end(), std::mt19937_64(2));
+
+  std::size_t mask = keys.size() - 1;
+  s.start();
+  for (long i = 0; i < s.iterations(); ++i)
+    keep(t.search(keys[i & mask]).egress_);
+  s.stop();
+}
+
+
+// Search a table of arg flows for keys that are not in the table.
+void
+bm_hash_search_miss(Bench_state& s)
+{
+  Hash_table t(1, s.arg(), 16);
+  for (Key k : random_keys(s.arg(), 1))
+    t.insert(k, Flow());
+  std::vector<Key> keys = random_keys(search_keys, 3);
+
+  std::size_t mask = keys.size() - 1;
+  s.start();
+  for (long i = 0; i < s.iterations(); ++i)
+    keep(t.search(keys[i & mask]).egress_);
+  s.stop();
+}
+
+
+// Fill an empty table, sized for them, with arg flows. Each item
+// is one insert.
+void
+bm_hash_insert(Bench_state& s)
+{
+  std::vector<Key> keys = random_keys(s.arg(), 1);
+  s.set_items(s.arg());
+  for (long i = 0; i < s.iterations(); ++i) {
+    Hash_table t(1, s.arg(), 16);
+    s.start();
+    for (Key k : keys)
+      t.insert(k, Flow());
+    s.stop();
+  }
+}
+
+
+// -------------------------------------------------------------------------- //
+// Key gathering
+
+// The lengths of the fields bound in the gather benchmarks. Their
+// sum is the key size, so that every field contributes.
+constexpr std::uint16_t gather_lengths[] = {4, 4, 2, 2, 1, 1, 1, 1};
+
+
+// Gather a key from n of the fields bound in the context, as
+// fp_goto_table does.
+Key
+gather(Context* cxt, int n, ...)
+{
+  va_list args;
+  va_start(args, n);
+  Key k = fp_gather(cxt, 16, n, args);
+  va_end(args);
+  return k;
+}
+
+
+// Gather a key from arg fields.
+void
+bm_gather(Bench_state& s)
+{
+  Byte buf[64] = {};
+  Context cxt(nullptr, buf);
+  std::uint16_t off = 14;
+  for (int i = 0; i < 8; ++i) {
+    cxt.bind_field(i, off, gather_lengths[i]);
+    off += gather_lengths[i];
+  }
+
+  int n = s.arg();
+  s.start();
+  for (long i = 0; i < s.iterations(); ++i) {
+    clobber();
+    keep(gather(&cxt, n, 0, 1, 2, 3, 4, 5, 6, 7));
+  }
+  s.stop();
+}
+
+
+// -------------------------------------------------------------------------- //
+// Contexts
+
+// Construct a context for a packet.
+void
+bm_context_construct(Bench_state& s)
+{
+  Byte buf[64] = {};
+  s.start();
+  for (long i = 0; i < s.iterations(); ++i) {
+    Context cxt(nullptr, buf);
+    keep(cxt);
+  }
+  s.stop();
+}
+
+
+// Reset a context for the next packet by assigning a fresh one,
+// which also releases its actions.
+void
+bm_context_reset(Bench_state& s)
+{
+  Byte buf[64] = {};
+  Context cxt(nullptr, buf);
+  s.start();
+  for (long i = 0; i < s.iterations(); ++i) {
+    cxt = Context(nullptr, buf);
+    keep(cxt);
+  }
+  s.stop();
+}
+
+
+// -------------------------------------------------------------------------- //
+// Actions
+
+// Returns an action of the given type.
+Action
+make_action(Action::Type t)
+{
+  static Byte mac[6] = {0x02, 0, 0, 0, 0, 1};
+  switch (t) {
+  case Action::SET: return Set_action(Packet_memory, 0, 6, mac);
+  case Action::COPY: return Copy_action{{Packet_memory, 0, 6}, 0};
+  case Action::OUTPUT: return Output_action{2};
+  case Action::QUEUE: return Queue_action{1};
+  default: return Group_action{1};
+  }
+}
+
+
+// Apply an action of type arg to a context.
+void
+bm_apply_action(Bench_state& s)
+{
+  Byte buf[64] = {};
+  Context cxt(nullptr, buf);
+  Action a = make_action((Action::Type)s.arg());
+  s.start();
+  for (long i = 0; i < s.iterations(); ++i) {
+    cxt.apply_action(a);
+    clobber();
+  }
+  s.stop();
+}
+
+
+// Write a set of actions to a context, apply them, and clear them,
+// as for each packet whose flow writes actions. Each item is one
+// action.
+void
+bm_action_set(Bench_state& s)
+{
+  Byte buf[64] = {};
+  Context cxt(nullptr, buf);
+  Action set = make_action(Action::SET);
+  Action out = make_action(Action::OUTPUT);
+  s.set_items(2);
+  s.start();
+  for (long i = 0; i < s.iterations(); ++i) {
+    cxt.write_action(set);
+    cxt.write_action(out);
+    cxt.apply_actions();
+    cxt.clear_actions();
+  }
+  s.stop();
+}
+
+
+// -------------------------------------------------------------------------- //
+// Bindings
+
+// Push and pop a field binding.
+void
+bm_binding_push_pop(Bench_state& s)
+{
+  Binding_list l;
+  s.start();
+  for (long i = 0; i < s.iterations(); ++i) {
+    l.push(Binding(i & 0xff, 4));
+    keep(l.top());
+    l.pop();
+  }
+  s.stop();
+}
+
+
+// Bind fields in an environment and then unbind them, as decoding
+// nested headers does. Each item is one push and one pop.
+void
+bm_binding_environment(Bench_state& s)
+{
+  Environment env;
+  s.set_items(Environment::max_fields);
+  s.start();
+  for (long i = 0; i < s.iterations(); ++i) {
+    for (int f = 0; f < Environment::max_fields; ++f)
+      env.push(f, Binding(f, 2));
+    clobber();
+    for (int f = 0; f < Environment::max_fields; ++f)
+      env.pop(f);
+  }
+  s.stop();
+}
+
+
+// Find the innermost binding of a field, as key gathering does.
+void
+bm_binding_lookup(Bench_state& s)
+{
+  Byte buf[64] = {};
+  Context cxt(nullptr, buf);
+  for (int f = 0; f < Environment::max_fields; ++f)
+    cxt.bind_field(f, f, 2);
+  s.start();
+  for (long i = 0; i < s.iterations(); ++i) {
+    clobber();
+    keep(cxt.get_field_binding(i & (Environment::max_fields - 1)));
+  }
+  s.stop();
+}
+
+
+int
+main(int argc, char* argv[])
+{
+  add_benchmark("pool/alloc-dealloc", bm_pool_alloc);
+  add_benchmark("pool/burst/32", bm_pool_burst, 32);
+
+  for (long n : {1L << 10, 1L << 16, 1L << 20}) {
+    std::string size = std::to_string(n);
+    add_benchmark("hash/search-hit/" + size, bm_hash_search_hit, n);
+    add_benchmark("hash/search-miss/" + size, bm_hash_search_miss, n);
+    add_benchmark("hash/insert/" + size, bm_hash_insert, n);
+  }
+
+  for (int n = 1; n <= 8; ++n)
+    add_benchmark("gather/" + std::to_string(n), bm_gather, n);
+
+  add_benchmark("context/construct", bm_context_construct);
+  add_benchmark("context/reset", bm_context_reset);
+
+  add_benchmark("action/set", bm_apply_action, Action::SET);
+  add_benchmark("action/copy", bm_apply_action, Action::COPY);
+  add_benchmark("action/output", bm_apply_action, Action::OUTPUT);
+  add_benchmark("action/queue", bm_apply_action, Action::QUEUE);
+  add_benchmark("action/group", bm_apply_action, Action::GROUP);
+  add_benchmark("action/write-apply-clear", bm_action_set);
+
+  add_benchmark("binding/push-pop", bm_binding_push_pop);
+  add_benchmark("binding/environment", bm_binding_environment);
+  add_benchmark("binding/lookup", bm_binding_lookup);
+
+  return run_benchmarks(argc, argv);
+}
@@ -0,0 +1,646 @@
+// Measures how flow tables scale with the number of flows. Each
+// table type is filled to each size, and then measured for:
+//
+//    - build time, inserting every flow into an empty table;
+//    - memory, as bytes per flow;
+//    - lookup throughput and latency under several access patterns,
+//      with one or more concurrent readers;
+//    - churn, erasing the oldest flow and inserting a new one, as
+//      flow aging does at a steady table size.
+//
+// usage: fp-bench-table [options]
+//
+//    --tables list       table types: hash, shared (default both)
+//    --sizes list        flows in each table (default 1K,10K,100K,1M,10M)
+//    --workloads list    access patterns: uniform, zipf, scan, miss
+//                        (default all)
+//    --readers list      concurrent reader counts (default 1 and the
+//                        CPU count)
+//    --lookups n         lookups by each reader (default 10M)
+//    --churn n           erase and insert pairs (default 1M)
+//    --theta x           skew of the zipf and scan workloads
+//                        (default 0.99)
+//    --sample-period n   time every nth lookup (default 16)
+//    --json path         write the results as JSON
+//
+// Sizes may have a K or M suffix. The access patterns are:
+//
+//    uniform   every flow is equally likely
+//    zipf      the flow of rank i is looked up with a probability
+//              proportional to 1 / i^theta
+//    scan      half of the lookups are zipf, and half sweep through
+//              every flow in turn, as a flow dump or an aging pass
+//              does, evicting the popular flows from the CPU cache
+//    miss      keys that are not in the table, as for new flows
+//
+// Lookups cycle through a pregenerated trace of keys, so the cost of
+// generating them is not measured. Latencies are those of single
+// lookups, timed between fenced reads of the time stamp counter, less
+// the time taken to read it.
+
+#include "harness.hpp"
+
+#include "table.hpp"
+#include "table_shared.hpp"
+#include "thread.hpp"
+
+#include <freeflow/histogram.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+
+#include <unistd.h>
+#if defined(__GLIBC__)
+#  include <malloc.h>
+#endif
+
+
+using namespace fp;
+
+
+struct Options
+{
+  std::vector<std::string> tables = {"hash", "shared"};
+  std::vector<long>        sizes = {1000, 10000, 100000, 1000000, 10000000};
+  std::vector<std::string> workloads = {"uniform", "zipf", "scan", "miss"};
+  std::vector<int>         readers;
+  long                     lookups = 10000000;
+  long                     churn = 1000000;
+  double                   theta = 0.99;
+  int                      sample_period = 16;
+  std::string              json;
+};
+
+
+// The lookup measurements of a workload with a number of readers.
+struct Lookup_result
+{
+  std::string           workload;
+  int                   readers;
+  long                  lookups;  // By all readers.
+  double                mops;     // The sum of the readers' rates.
+  double                ns_per_lookup;
+  ff::Histogram_summary latency;  // In cycles.
+};
+
+
+// The measurements of a table of a given size.
+struct Result
+{
+  std::string                table;
+  long                       size;
+  double                     build_seconds;
+  double                     bytes_per_flow;      // As estimated by the table.
+  double                     rss_bytes_per_flow;  // As measured by the OS.
+  double                     load_factor;
+  std::vector<Lookup_result> lookups;
+  long                       churn;
+  double                     churn_ns;            // Per erase and insert.
+};
+
+
+// The number of keys in a lookup trace. Traces are read in order,
+// so their size affects only how well they represent the workload.
+constexpr std::size_t trace_size = 1 << 20;
+
+
+// -------------------------------------------------------------------------- //
+// Workloads
+
+// Returns n random keys.
+std::vector<Key>
+random_keys(std::size_t n, std::mt19937_64& gen)
+{
+  std::vector<Key> keys(n);
+  for (Key& k : keys)
+    k = ((Key)gen() << 64) | gen();
+  return keys;
+}
+
+
+// Generates ranks in [0, n) with a Zipf distribution, using the
+// method of Gray et al., "Quickly Generating Billion-Record Synthetic
+// Databases". Rank 0 is the most popular.
+class Zipf
+{
+public:
+  Zipf(long n, double theta)
+    : n_(n), theta_(theta), alpha_(1 / (1 - theta))
+  {
+    zetan_ = 0;
+    for (long i = 1; i <= n; ++i)
+      zetan_ += 1 / std::pow((double)i, theta);
+    double zeta2 = 1 + std::pow(0.5, theta);
+    eta_ = (1 - std::pow(2.0 / n, 1 - theta)) / (1 - zeta2 / zetan_);
+    half_ = std::pow(0.5, theta);
+  }
+
+  long operator()(std::mt19937_64& gen)
+  {
+    double u = std::uniform_real_distribution<double>()(gen);
+    double uz = u * zetan_;
+    if (uz < 1)
+      return 0;
+    if (uz < 1 + half_)
+      return std::min(1L, n_ - 1);
+    long r = n_ * std::pow(eta_ * u - eta_ + 1, alpha_);
+    return std::min(r, n_ - 1);
+  }
+
+private:
+  long   n_;
+  double theta_;
+  double alpha_;
+  double zetan_;
+  double eta_;
+  double half_;
+};
+
+
+// Returns a trace of keys to look up in a table holding the given
+// keys. The keys are in random order, so popular ranks are spread
+// over the table.
+std::vector<Key>
+make_trace(std::string const& workload, std::vector<Key> const& keys,
+           double theta, std::mt19937_64& gen)
+{
+  long n = keys.size();
+  std::vector<Key> trace;
+  trace.reserve(trace_size);
+  if (workload == "uniform") {
+    std::uniform_int_distribution<long> pick(0, n - 1);
+    while (trace.size() < trace_size)
+      trace.push_back(keys[pick(gen)]);
+  } else if (workload == "zipf") {
+    Zipf pick(n, theta);
+    while (trace.size() < trace_size)
+      trace.push_back(keys[pick(gen)]);
+  } else if (workload == "scan") {
+    Zipf pick(n, theta);
+    long next = 0;
+    while (trace.size() < trace_size) {
+      trace.push_back(keys[pick(gen)]);
+      trace.push_back(keys[next]);
+      next = (next + 1) % n;
+    }
+  } else {
+    trace = random_keys(trace_size, gen);
+  }
+  return trace;
+}
+
+
+// -------------------------------------------------------------------------- //
+// Tables
+
+// A table and the storage it was created in.
+struct Table_instance
+{
+  std::unique_ptr<Shared_region> region;
+  std::unique_ptr<Table>         table;
+};
+
+
+Table_instance
+make_table(std::string const& type, long n)
+{
+  Table_instance t;
+  if (type == "shared") {
+    // The table has at least twice as many slots as flows, rounded
+    // up to a power of 2.
+    std::size_t slots = 64;
+    while (slots < 2 * (std::size_t)n)
+      slots <<= 1;
+    std::size_t bytes = slots * sizeof(Shared_hash_table::Slot) + (1 << 16);
+    t.region.reset(new Shared_region(bytes));
+    t.table.reset(new Shared_hash_table(*t.region, 1, n, 16));
+  } else {
+    t.table.reset(new Hash_table(1, n, 16));
+  }
+  return t;
+}
+
+
+// Returns the resident set size of the process in bytes.
+std::size_t
+resident_bytes()
+{
+  std::ifstream f("/proc/self/statm");
+  std::size_t size = 0, resident = 0;
+  f >> size >> resident;
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+
+// Return freed memory to the OS, so that the growth of the resident
+// set measures the memory used by the next table.
+void
+release_memory()
+{
+#if defined(__GLIBC__)
+  malloc_trim(0);
+#endif
+}
+
+
+// -------------------------------------------------------------------------- //
+// Lookups
+
+// The measurements of one reader.
+struct Reader_result
+{
+  long          lookups;
+  Cycles        cycles;
+  ff::Histogram latency;
+};
+
+
+// The state shared by the readers of a run. Each reader's results
+// are allocated separately, so that readers do not write to the same
+// cache lines.
+struct Lookup_run
+{
+  Table const*                                table;
+  std::vector<Key> const*                     trace;
+  long                                        lookups;
+  int                                         sample_period;
+  Cycles                                      timer_cost;
+  Thread::Barrier                             go;
+  std::vector<std::unique_ptr<Reader_result>> results;
+};
+
+
+// Returns the median time taken to read the time stamp counter
+// twice, with fences, which is subtracted from the latency of each
+// lookup.
+Cycles
+timer_cost()
+{
+  ff::Histogram h;
+  for (int i = 0; i < 100000; ++i) {
+    Cycles t = fenced_cycles();
+    h.record(fenced_cycles() - t);
+  }
+  return h.percentile(0.5);
+}
+
+
+// Look up keys from the trace, starting at an offset that depends on
+// the reader so that readers do not move in lockstep. A lookup in
+// every sample period is timed on its own; the others are timed
+// together.
+void
+look_up(Thread_group& g, int id)
+{
+  Lookup_run& r = *(Lookup_run*)g.data();
+  Table const& t = *r.table;
+  std::vector<Key> const& trace = *r.trace;
+  std::size_t mask = trace.size() - 1;
+  std::size_t i = (id * trace.size() / g.size()) & ~(std::size_t)7;
+  Reader_result& res = *r.results[id];
+
+  Flow f;
+  Thread_barrier::wait(&r.go);
+  Cycles start = now_cycles();
+  int next_sample = 0;
+  for (long n = 0; n < r.lookups; ++n, i = (i + 1) & mask) {
+    if (next_sample-- == 0) {
+      Cycles t0 = fenced_cycles();
+      t.find(trace[i], f);
+      keep(f.egress_);
+      Cycles d = fenced_cycles() - t0;
+      res.latency.record(d > r.timer_cost ? d - r.timer_cost : 0);
+      next_sample = r.sample_period - 1;
+    } else {
+      t.find(trace[i], f);
+      keep(f.egress_);
+    }
+  }
+  res.cycles = now_cycles() - start;
+  res.lookups = r.lookups;
+}
+
+
+Lookup_result
+measure_lookups(Options const& opts, Table const& t, std::string const& workload,
+                std::vector<Key> const& trace, int readers, Cycles timer)
+{
+  Lookup_run r;
+  r.table = &t;
+  r.trace = &trace;
+  r.lookups = opts.lookups;
+  r.sample_period = opts.sample_period;
+  r.timer_cost = timer;
+  for (int i = 0; i < readers; ++i)
+    r.results.emplace_back(new Reader_result());
+  Thread_barrier::init(&r.go, readers);
+
+  int ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+  std::vector<int> cpus;
+  for (int i = 0; i < readers; ++i)
+    cpus.push_back(i % ncpus);
+  Thread_group g;
+  g.set_cpus(cpus);
+  g.run(look_up, &r);
+  g.halt();
+  Thread_barrier::destroy(&r.go);
+
+  Lookup_result res = {};
+  res.workload = workload;
+  res.readers = readers;
+  ff::Histogram h;
+  Cycles cycles = 0;
+  for (auto const& rr : r.results) {
+    double secs = rr->cycles / tsc_hz();
+    res.lookups += rr->lookups;
+    res.mops += secs > 0 ? rr->lookups / secs / 1e6 : 0;
+    cycles += rr->cycles;
+    h.merge(rr->latency);
+  }
+  res.ns_per_lookup = res.lookups ? cycles_to_ns(cycles) / (double)res.lookups : 0;
+  res.latency = ff::Histogram_summary(h);
+  return res;
+}
+
+
+// -------------------------------------------------------------------------- //
+// Runs
+
+// Build a table of n flows and measure it.
+Result
+run(Options const& opts, std::string const& type, long n, Cycles timer)
+{
+  std::mt19937_64 gen(n);
+  std::vector<Key> keys = random_keys(n, gen);
+
+  Result res = {};
+  res.table = type;
+  res.size = n;
+
+  release_memory();
+  std::size_t rss = resident_bytes();
+  Table_instance inst = make_table(type, n);
+  Table& t = *inst.table;
+  Cycles start = now_cycles();
+  for (Key const& k : keys)
+    t.insert(k, Flow());
+  res.build_seconds = (now_cycles() - start) / tsc_hz();
+  res.bytes_per_flow = (double)t.memory_footprint() / n;
+  res.rss_bytes_per_flow = (double)(resident_bytes() - std::min(rss, resident_bytes())) / n;
+  res.load_factor = t.load_factor();
+
+  for (std::string const& w : opts.workloads) {
+    std::vector<Key> trace = make_trace(w, keys, opts.theta, gen);
+    for (int readers : opts.readers) {
+      recalibrate_tsc();
+      res.lookups.push_back(measure_lookups(opts, t, w, trace, readers, timer));
+    }
+  }
+
+  // Replace the oldest flow with a new one, keeping the size of the
+  // table constant.
+  if (opts.churn > 0) {
+    std::vector<Key> fresh = random_keys(opts.churn, gen);
+    start = now_cycles();
+    for (long i = 0; i < opts.churn; ++i) {
+      Key& oldest = keys[i % n];
+      t.erase(oldest);
+      t.insert(fresh[i], Flow());
+      oldest = fresh[i];
+    }
+    res.churn = opts.churn;
+    res.churn_ns = cycles_to_ns(now_cycles() - start) / (double)opts.churn;
+  }
+  return res;
+}
+
+
+// -------------------------------------------------------------------------- //
+// Reporting
+
+void
+print_result(std::ostream& os, Result const& r)
+{
+  char line[160];
+  std::snprintf(line, sizeof(line),
+                "%s, %ld flows: build %.3f s (%.1f ns/flow), %.1f bytes/flow"
+                " (%.1f resident), load %.2f\n",
+                r.table.c_str(), r.size, r.build_seconds,
+                r.build_seconds * 1e9 / r.size, r.bytes_per_flow,
+                r.rss_bytes_per_flow, r.load_factor);
+  os << line;
+  std::snprintf(line, sizeof(line), "  %-10s %8s %10s %10s %9s %9s %9s %9s\n",
+                "workload", "readers", "Mops", "ns/lookup",
+                "p50 ns", "p99 ns", "p999 ns", "max ns");
+  os << line;
+  for (Lookup_result const& l : r.lookups) {
+    std::snprintf(line, sizeof(line), "  %-10s %8d %10.2f %10.2f %9lu %9lu %9lu %9lu\n",
+                  l.workload.c_str(), l.readers, l.mops, l.ns_per_lookup,
+                  (unsigned long)cycles_to_ns(l.latency.p50),
+                  (unsigned long)cycles_to_ns(l.latency.p99),
+                  (unsigned long)cycles_to_ns(l.latency.p999),
+                  (unsigned long)cycles_to_ns(l.latency.max));
+    os << line;
+  }
+  if (r.churn) {
+    std::snprintf(line, sizeof(line), "  churn: %.1f ns per erase and insert\n", r.churn_ns);
+    os << line;
+  }
+  os << '\n';
+}
+
+
+void
+write_json(std::ostream& os, Options const& opts, std::vector<Result> const& rs)
+{
+  std::string s;
+  ff::json::Writer w(s);
+  w.begin_object();
+  w.key("context").begin_object();
+  write_bench_context(w);
+  w.member("lookups", opts.lookups);
+  w.member("theta", opts.theta);
+  w.member("sample_period", opts.sample_period);
+  w.end_object();
+
+  w.key("results").begin_array();
+  for (Result const& r : rs) {
+    w.begin_object();
+    w.member("table", r.table);
+    w.member("flows", r.size);
+    w.member("build_seconds", r.build_seconds);
+    w.member("build_ns_per_flow", r.build_seconds * 1e9 / r.size);
+    w.member("bytes_per_flow", r.bytes_per_flow);
+    w.member("resident_bytes_per_flow", r.rss_bytes_per_flow);
+    w.member("load_factor", r.load_factor);
+    w.key("lookups").begin_array();
+    for (Lookup_result const& l : r.lookups) {
+      w.begin_object();
+      w.member("workload", l.workload);
+      w.member("readers", l.readers);
+      w.member("lookups", l.lookups);
+      w.member("mops", l.mops);
+      w.member("ns_per_lookup", l.ns_per_lookup);
+      w.key("latency_ns").begin_object();
+      w.member("samples", l.latency.count);
+      w.member("p50", cycles_to_ns(l.latency.p50));
+      w.member("p99", cycles_to_ns(l.latency.p99));
+      w.member("p999", cycles_to_ns(l.latency.p999));
+      w.member("max", cycles_to_ns(l.latency.max));
+      w.end_object();
+      w.end_object();
+    }
+    w.end_array();
+    if (r.churn) {
+      w.key("churn").begin_object();
+      w.member("operations", r.churn);
+      w.member("ns_per_operation", r.churn_ns);
+      w.end_object();
+    }
+    w.end_object();
+  }
+  w.end_array();
+  w.end_object();
+  os << s << '\n';
+}
+
+
+// -------------------------------------------------------------------------- //
+// Options
+
+// Split a comma separated list.
+std::vector<std::string>
+split(std::string const& s)
+{
+  std::vector<std::string> v;
+  std::stringstream ss(s);
+  std::string item;
+  while (std::getline(ss, item, ','))
+    v.push_back(item);
+  return v;
+}
+
+
+// Parse a count with an optional K or M suffix. Returns 0 if the
+// count is invalid.
+long
+parse_count(std::string const& s)
+{
+  char* end;
+  long n = std::strtol(s.c_str(), &end, 10);
+  if (*end == 'K' || *end == 'k')
+    n *= 1000, ++end;
+  else if (*end == 'M' || *end == 'm')
+    n *= 1000000, ++end;
+  return *end || n <= 0 ? 0 : n;
+}
+
+
+// Returns true if every item of a list is one of the choices.
+bool
+valid(std::vector<std::string> const& v, std::vector<std::string> const& choices)
+{
+  for (std::string const& s : v)
+    if (std::find(choices.begin(), choices.end(), s) == choices.end())
+      return false;
+  return !v.empty();
+}
+
+
+bool
+parse(int argc, char* argv[], Options& opts)
+{
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool more = i + 1 < argc;
+    if (arg == "--tables" && more) {
+      opts.tables = split(argv[++i]);
+      if (!valid(opts.tables, {"hash", "shared"}))
+        return false;
+    }
+    else if (arg == "--sizes" && more) {
+      opts.sizes.clear();
+      for (std::string const& s : split(argv[++i])) {
+        // Shared tables index slots with 32 bits.
+        long n = parse_count(s);
+        if (n <= 0 || n > (1L << 30))
+          return false;
+        opts.sizes.push_back(n);
+      }
+    }
+    else if (arg == "--workloads" && more) {
+      opts.workloads = split(argv[++i]);
+      if (!valid(opts.workloads, {"uniform", "zipf", "scan", "miss"}))
+        return false;
+    }
+    else if (arg == "--readers" && more) {
+      for (std::string const& s : split(argv[++i])) {
+        int n = std::atoi(s.c_str());
+        if (n <= 0 || n > max_thread_index)
+          return false;
+        opts.readers.push_back(n);
+      }
+    }
+    else if (arg == "--lookups" && more)
+      opts.lookups = parse_count(argv[++i]);
+    else if (arg == "--churn" && more)
+      opts.churn = std::atol(argv[++i]);
+    else if (arg == "--theta" && more)
+      opts.theta = std::atof(argv[++i]);
+    else if (arg == "--sample-period" && more)
+      opts.sample_period = std::atoi(argv[++i]);
+    else if (arg == "--json" && more)
+      opts.json = argv[++i];
+    else
+      return false;
+  }
+  return opts.lookups > 0 && opts.sample_period > 0 &&
+         opts.theta > 0 && opts.theta < 1;
+}
+
+
+int
+main(int argc, char* argv[])
+{
+  Options opts;
+  if (!parse(argc, argv, opts)) {
+    std::cerr << "usage: " << argv[0]
+              << " [--tables list] [--sizes list] [--workloads list]"
+              << " [--readers list] [--lookups n] [--churn n] [--theta x]"
+              << " [--sample-period n] [--json path]\n";
+    return EXIT_FAILURE;
+  }
+  if (opts.readers.empty()) {
+    int ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    opts.readers.push_back(1);
+    if (ncpus > 1)
+      opts.readers.push_back(std::min(ncpus, max_thread_index));
+  }
+
+  Cycles timer = timer_cost();
+  std::vector<Result> results;
+  for (std::string const& type : opts.tables) {
+    for (long n : opts.sizes) {
+      recalibrate_tsc();
+      results.push_back(run(opts, type, n, timer));
+      print_result(std::cout, results.back());
+    }
+  }
+
+  if (!opts.json.empty()) {
+    std::ofstream f(opts.json);
+    write_json(f, opts, results);
+    if (!f) {
+      std::cerr << "cannot write " << opts.json << '\n';
+      return EXIT_FAILURE;
+    }
+  }
+  return EXIT_SUCCESS;
+}
@@ -1,4 +1,5 @@
 #include "buffer.hpp"
+#include "dataplane.hpp"
 
 
 namespace fp
@@ -7,11 +8,11 @@ namespace fp
 namespace Buffer_pool
 {
 
-Pool& 
+// Returns the buffer pool of the given dataplane.
+Pool&
 get_pool(Dataplane* dp)
 {
-  static Pool p(1024 * 256 + 1024, dp);
-  return p;
+  return dp->pool();
 }
 
 
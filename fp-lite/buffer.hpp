@@ -4,9 +4,11 @@
 #include "types.hpp"
 #include "context.hpp"
 
+#include <atomic>
 #include <queue>
 #include <functional>
 #include <mutex>
+#include <stdexcept>
 #include <vector>
 
 namespace fp
@@ -62,9 +64,22 @@ public:
   // Returns the next free index from the min-heap.
   inline Buffer& alloc();
 
+  // Returns the next free buffer, or nullptr if the pool is empty.
+  inline Buffer* try_alloc();
+
   // Places the given index back into the min-heap.
   inline void dealloc(int);
 
+  // Returns the total number of buffers in the pool.
+  int capacity() const { return data_.size(); }
+
+  // Returns the number of free buffers. This is approximate when
+  // other threads are allocating or deallocating concurrently.
+  int available() const { return free_.load(std::memory_order_relaxed); }
+
+  // Returns true when no buffers are free.
+  bool empty() const { return available() == 0; }
+
 private:
   // The buffer data store.
   Store_type data_;
@@ -72,11 +87,14 @@ private:
   Heap_type  heap_;
   // Mutex for concurrency operations.
   Mutex_type mutex_;
+  // The number of free buffers, readable without the lock.
+  std::atomic<int> free_;
 };
 
 
 
 // Buffer pool default ctor.
+inline
 Pool::Pool(Dataplane* dp)
   : Pool(4096, dp)
 { }
@@ -84,8 +102,9 @@ Pool::Pool(Dataplane* dp)
 
 // Buffer pool sized ctor. Intializes the free-list (min-heap)
 // and the pool of buffers.
+inline
 Pool::Pool(int size, Dataplane* dp)
-  : data_(), heap_(), mutex_()
+  : data_(), heap_(), mutex_(), free_(size)
 { 
   for (int i = 0; i < size; i++) {
     heap_.push(i);
@@ -95,6 +114,7 @@ Pool::Pool(int size, Dataplane* dp)
 
 
 // Buffer pool dtor.
+inline
 Pool::~Pool()
 { }
 
@@ -108,24 +128,36 @@ Pool::operator[](int idx)
 
 
 // Returns a reference to the next free buffer using the min-heap.
+// Throws an exception if the pool is exhausted. Callers that can
+// recover from exhaustion should use try_alloc instead.
 inline Buffer&
 Pool::alloc()         
 { 
-  //while (heap_.empty()) { }
+  if (Buffer* buf = try_alloc())
+    return *buf;
+  throw std::runtime_error("buffer pool exhausted");
+}
+
+
+// Returns a pointer to the next free buffer using the min-heap,
+// or nullptr if there are no free buffers.
+inline Buffer*
+Pool::try_alloc()
+{
   // Lock the heap.
-  mutex_.lock();
+  std::lock_guard<Mutex_type> lock(mutex_);
+  if (heap_.empty())
+    return nullptr;
 
   // Get the next available index.
   int id(heap_.top());
 
   // Remove index from the heap.
   heap_.pop();
-  
-  // Unlock the heap.
-  mutex_.unlock();
+  free_.fetch_sub(1, std::memory_order_relaxed);
 
-  // Return a reference to the buffer at the index.
-  return data_[id];
+  // Return a pointer to the buffer at the index.
+  return &data_[id];
 }
 
 
@@ -138,6 +170,7 @@ Pool::dealloc(int id)
 
   // Return the index to the heap.
   heap_.push(id);
+  free_.fetch_add(1, std::memory_order_relaxed);
   
   // Unlock the heap.
   mutex_.unlock();
@@ -145,8 +178,8 @@ Pool::dealloc(int id)
 
 
 
-// The flowpath buffer pool singleton namespace. Used to
-// statically initialize a new instance of a buffer pool.
+// The flowpath buffer pool namespace. Each dataplane owns its
+// own pool, which is created the first time it is requested.
 namespace Buffer_pool
 {
 
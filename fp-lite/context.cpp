@@ -6,13 +6,13 @@ namespace fp
 {
 
 Context::Context(Packet const& p, Dataplane* dp, unsigned int in, unsigned int in_phy, int tunnelid)
-  : input_{in, in_phy, tunnelid}, ctrl_(), decode_(), packet_(p),
-    dp_(dp)
+  : input_{in, in_phy, tunnelid}, ctrl_(), decode_(), timing_(), packet_(p),
+    metadata_(), dp_(dp)
 { }
 
 Context::Context(Packet const& p, Dataplane* dp, Port* in, Port* in_phy, int tunnelid)
   : input_{in->id(), in_phy->id(), tunnelid}, ctrl_(), decode_(),
-    packet_(p), dp_(dp)
+    timing_(), packet_(p), metadata_(), dp_(dp)
 { }
 
 
@@ -56,9 +56,8 @@ apply(Context& cxt, Set_action a)
   Byte* val = a.value;
   int len = a.field.length;
 
-  // Convert native to network order after copying.
-  std::copy(val, val + len, p);
-  native_to_network_order(p, len);
+  // Convert native to network order while copying.
+  copy_native_to_network(p, val, len);
 }
 
 
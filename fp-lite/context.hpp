@@ -6,6 +6,7 @@
 #include "binding.hpp"
 #include "types.hpp"
 #include "dataplane.hpp"
+#include "profile.hpp"
 
 #include <cstdint>
 #include <utility>
@@ -56,6 +57,15 @@ struct Decoding_info
 };
 
 
+// Timestamps taken as a context moves through the pipeline, in
+// cycles. A timestamp of 0 was not taken. The ingress timestamp is
+// held by the packet.
+struct Timing_info
+{
+  uint64_t process; // Start of processing, if latency is sampled.
+};
+
+
 // Packet metadata. This is an unstructured blob
 // to be used as scratch data by the application.
 //
@@ -107,7 +117,8 @@ class Context
 {
 public:
   Context(Dataplane* dp, Packet const& p)
-    : input_(), ctrl_(), decode_(), packet_(p), dp_(dp)
+    : input_(), ctrl_(), decode_(), timing_(), packet_(p), metadata_(),
+      dp_(dp)
   { }
 
   Context(Packet const&, Dataplane*, unsigned int, unsigned int, int);
@@ -120,6 +131,10 @@ public:
   // Returns a pointer to the dataplane which created the context.
   Dataplane const* dataplane() const { return dp_; }
 
+  // Returns the pipeline timestamps of the context.
+  Timing_info const& timing() const { return timing_; }
+  Timing_info&       timing()       { return timing_; }
+
   // Returns the metadata owned by the context.
   Metadata const& metadata() const { return metadata_; }
   Metadata&       metadata()       { return metadata_; }
@@ -169,6 +184,7 @@ public:
   Ingress_info  input_;
   Control_info  ctrl_;
   Decoding_info decode_;
+  Timing_info   timing_;
 
   // Packet data and context local data.
   //
@@ -288,6 +304,7 @@ Context::write_action(Action a)
 inline void
 Context::apply_actions()
 {
+  FP_PROFILE_SCOPE(prof_apply);
   for (Action const& a : actions_)
     apply_action(a);
 }
@@ -0,0 +1,234 @@
+#include "cpu.hpp"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#if defined(__x86_64__) || defined(__i386__)
+#  include <cpuid.h>
+#endif
+
+
+namespace fp
+{
+
+// -------------------------------------------------------------------------- //
+// CPU features
+
+char const*
+to_string(Isa isa)
+{
+  switch (isa) {
+  case Isa::generic: return "generic";
+  case Isa::ssse3: return "ssse3";
+  case Isa::sse42: return "sse4.2";
+  case Isa::avx2: return "avx2";
+  case Isa::avx512: return "avx512";
+  }
+  return "unknown";
+}
+
+
+namespace
+{
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// Returns the extended control register 0, which records the
+// register state that the OS saves on context switch. A vector
+// extension is usable only if the OS saves its registers.
+inline std::uint64_t
+xgetbv0()
+{
+  unsigned lo, hi;
+  __asm__ volatile ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+  return ((std::uint64_t)hi << 32) | lo;
+}
+
+
+Cpu_features
+detect()
+{
+  Cpu_features f = {};
+  unsigned a, b, c, d;
+  if (!__get_cpuid(1, &a, &b, &c, &d))
+    return f;
+  f.ssse3 = c & bit_SSSE3;
+  f.sse42 = c & bit_SSE4_2;
+  f.popcnt = c & bit_POPCNT;
+
+  // AVX state (XMM and YMM) and AVX-512 state (opmask, ZMM0-15
+  // upper halves, ZMM16-31) must be enabled by the OS.
+  bool osxsave = c & bit_OSXSAVE;
+  std::uint64_t xcr0 = osxsave ? xgetbv0() : 0;
+  bool avx_state = (xcr0 & 0x06) == 0x06;
+  bool avx512_state = (xcr0 & 0xe6) == 0xe6;
+
+  if (__get_cpuid_count(7, 0, &a, &b, &c, &d)) {
+    f.avx2 = avx_state && (b & bit_AVX2);
+    f.bmi2 = b & bit_BMI2;
+    f.avx512f = avx512_state && (b & bit_AVX512F);
+    f.avx512bw = avx512_state && (b & bit_AVX512BW);
+  }
+  return f;
+}
+
+#else
+
+Cpu_features
+detect()
+{
+  return Cpu_features{};
+}
+
+#endif
+
+
+// Parse the name of an instruction set level. Returns false if
+// the name is not recognized.
+bool
+parse_isa(char const* s, Isa& isa)
+{
+  for (Isa i : {Isa::generic, Isa::ssse3, Isa::sse42, Isa::avx2, Isa::avx512}) {
+    if (!std::strcmp(s, to_string(i))) {
+      isa = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+
+// The kernel registry. This is a function-local static so that
+// kernels defined at namespace scope in any translation unit can
+// register themselves during static initialization.
+std::vector<Kernel_base*>&
+registry()
+{
+  static std::vector<Kernel_base*> ks;
+  return ks;
+}
+
+} // namespace
+
+
+// Returns the features of the host CPU. These are detected on
+// first use.
+Cpu_features const&
+cpu_features()
+{
+  static Cpu_features f = detect();
+  return f;
+}
+
+
+// Returns true if the host can execute code for the given level.
+bool
+isa_supported(Isa isa)
+{
+  Cpu_features const& f = cpu_features();
+  switch (isa) {
+  case Isa::generic: return true;
+  case Isa::ssse3: return f.ssse3;
+  case Isa::sse42: return f.ssse3 && f.sse42 && f.popcnt;
+  case Isa::avx2: return f.ssse3 && f.sse42 && f.popcnt && f.avx2 && f.bmi2;
+  case Isa::avx512: return isa_supported(Isa::avx2) && f.avx512f && f.avx512bw;
+  }
+  return false;
+}
+
+
+// Returns the highest level supported by the host.
+Isa
+host_isa()
+{
+  Isa best = Isa::generic;
+  for (Isa i : {Isa::ssse3, Isa::sse42, Isa::avx2, Isa::avx512})
+    if (isa_supported(i))
+      best = i;
+  return best;
+}
+
+
+// Returns the highest level that kernels may use. This is the host
+// level, unless lowered by the FP_ISA environment variable, which
+// names a level (e.g., FP_ISA=generic). A level above the host's
+// is ignored.
+Isa
+max_isa()
+{
+  static Isa max = []()
+  {
+    Isa host = host_isa();
+    char const* env = std::getenv("FP_ISA");
+    if (!env)
+      return host;
+    Isa isa;
+    if (!parse_isa(env, isa)) {
+      std::cerr << "[flowpath] unknown FP_ISA '" << env << "'\n";
+      return host;
+    }
+    return isa < host ? isa : host;
+  }();
+  return max;
+}
+
+
+// -------------------------------------------------------------------------- //
+// Kernels
+
+Kernel_base::Kernel_base(char const* n)
+  : name(n), active(Isa::generic)
+{
+  registry().push_back(this);
+}
+
+
+// Returns the registered kernels.
+std::vector<Kernel_base*> const&
+kernels()
+{
+  return registry();
+}
+
+
+// Rebind every kernel to the best variant no higher than the given
+// level. This is not thread safe; it is intended for tests and for
+// configuration before any dataplane thread starts.
+void
+bind_kernels(Isa cap)
+{
+  for (Kernel_base* k : registry())
+    k->bind(cap);
+}
+
+
+// Print the host's features and the active variant of each kernel.
+void
+print_cpu_dispatch(std::ostream& os)
+{
+  Cpu_features const& f = cpu_features();
+  os << "cpu:";
+  if (f.ssse3) os << " ssse3";
+  if (f.sse42) os << " sse4.2";
+  if (f.popcnt) os << " popcnt";
+  if (f.avx2) os << " avx2";
+  if (f.bmi2) os << " bmi2";
+  if (f.avx512f) os << " avx512f";
+  if (f.avx512bw) os << " avx512bw";
+  os << '\n';
+  os << "isa: " << to_string(host_isa()) << " (max " << to_string(max_isa()) << ")\n";
+  for (Kernel_base const* k : registry()) {
+    os << "kernel " << k->name << ": " << to_string(k->active) << " [";
+    char const* sep = "";
+    for (Isa i : k->isas()) {
+      os << sep << to_string(i);
+      sep = " ";
+    }
+    os << "]\n";
+  }
+}
+
+
+} // end namespace fp
@@ -0,0 +1,175 @@
+#ifndef FP_CPU_HPP
+#define FP_CPU_HPP
+
+// The cpu module detects the instruction set extensions supported
+// by the host and selects, once at startup, the best implementation
+// of each vectorized kernel. This lets a single binary use SSE4.2,
+// AVX2 or AVX-512 where available and fall back to portable code
+// elsewhere.
+//
+// A kernel is declared as a Kernel object that lists its variants.
+// Callers invoke the kernel through its bound function pointer,
+// which costs one indirect call.
+//
+// Key hashing is the only dispatched kernel. The dataplane computes
+// no checksums, compares each probed slot's 128 bit key in a single
+// operation, and writes JSON only for statistics, so checksum,
+// bucket probing and JSON scanning kernels are left until one of
+// them shows up in a profile.
+
+#include <initializer_list>
+#include <iosfwd>
+#include <vector>
+
+
+namespace fp
+{
+
+// -------------------------------------------------------------------------- //
+// CPU features
+
+// Instruction set levels, in increasing order of capability. A
+// kernel variant for a given level may use the extensions of that
+// level and of every level before it.
+enum class Isa
+{
+  generic, // Portable C++.
+  ssse3,   // SSSE3 (PSHUFB).
+  sse42,   // SSE4.2 (CRC32, PCMPESTRI) and POPCNT.
+  avx2,    // AVX2 and BMI2.
+  avx512,  // AVX-512 F and BW.
+};
+
+
+char const* to_string(Isa);
+
+
+// The set of extensions reported by CPUID that kernels care about.
+struct Cpu_features
+{
+  bool ssse3;
+  bool sse42;
+  bool popcnt;
+  bool avx2;
+  bool bmi2;
+  bool avx512f;
+  bool avx512bw;
+};
+
+
+Cpu_features const& cpu_features();
+
+bool isa_supported(Isa);
+Isa  host_isa();
+Isa  max_isa();
+
+
+// -------------------------------------------------------------------------- //
+// Kernels
+
+// The dispatch interface of a kernel, used to report and rebind
+// kernels without knowing their signatures.
+struct Kernel_base
+{
+  Kernel_base(char const*);
+  virtual ~Kernel_base() { }
+
+  // Returns the levels for which the kernel has a variant.
+  virtual std::vector<Isa> isas() const = 0;
+
+  // Bind the best variant no higher than the given level.
+  virtual void bind(Isa) = 0;
+
+  char const* name;   // The name of the kernel.
+  Isa         active; // The level of the bound variant.
+};
+
+
+// A kernel with one implementation per instruction set level. The
+// variants must compute the same results. There must be a generic
+// variant.
+template<typename F>
+struct Kernel : Kernel_base
+{
+  struct Variant
+  {
+    Isa isa;
+    F   fn;
+  };
+
+  Kernel(char const*, std::initializer_list<Variant>);
+
+  std::vector<Isa> isas() const override;
+  void             bind(Isa) override;
+
+  // Returns the variant for the given level, or nullptr if there
+  // is none.
+  F variant(Isa) const;
+
+  // Returns the bound variant.
+  F operator*() const { return fn; }
+
+  std::vector<Variant> variants;
+  F                    fn;
+};
+
+
+template<typename F>
+Kernel<F>::Kernel(char const* n, std::initializer_list<Variant> vs)
+  : Kernel_base(n), variants(vs), fn(nullptr)
+{
+  bind(max_isa());
+}
+
+
+template<typename F>
+std::vector<Isa>
+Kernel<F>::isas() const
+{
+  std::vector<Isa> v;
+  for (Variant const& x : variants)
+    v.push_back(x.isa);
+  return v;
+}
+
+
+// Select the highest variant that is supported by the host and
+// is no higher than the given level.
+template<typename F>
+void
+Kernel<F>::bind(Isa cap)
+{
+  Variant const* best = nullptr;
+  for (Variant const& x : variants) {
+    if (x.isa > cap || !isa_supported(x.isa))
+      continue;
+    if (!best || x.isa > best->isa)
+      best = &x;
+  }
+  if (best) {
+    fn = best->fn;
+    active = best->isa;
+  }
+}
+
+
+template<typename F>
+F
+Kernel<F>::variant(Isa isa) const
+{
+  for (Variant const& x : variants)
+    if (x.isa == isa)
+      return x.fn;
+  return nullptr;
+}
+
+
+std::vector<Kernel_base*> const& kernels();
+
+void bind_kernels(Isa);
+void print_cpu_dispatch(std::ostream&);
+
+
+} // end namespace fp
+
+#endif
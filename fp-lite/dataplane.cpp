@@ -3,6 +3,9 @@
 #include "port_drop.hpp"
 #include "port_flood.hpp"
 #include "application.hpp"
+#include "buffer.hpp"
+#include "table.hpp"
+#include "time.hpp"
 
 #include <cassert>
 #include <algorithm>
@@ -12,8 +15,11 @@
 namespace fp
 {
 
+// Stops the dataplane's threads before releasing its resources.
 Dataplane::~Dataplane()
 {
+  threads_.halt();
+  delete pool_.load();
   delete drop_;
   delete flood_;
 }
@@ -53,6 +59,39 @@ Dataplane::remove_port(Port* p)
 }
 
 
+// Returns the dataplane's buffer pool, creating it if needed. The
+// pool is published with release semantics for existing_pool().
+Pool&
+Dataplane::pool()
+{
+  std::call_once(pool_once_, [this]() {
+    pool_.store(new Pool(pool_size_, this), std::memory_order_release);
+  });
+  return *pool_.load(std::memory_order_relaxed);
+}
+
+
+void
+Dataplane::add_table(Table* t)
+{
+  std::lock_guard<std::mutex> lock(tables_mutex_);
+  tables_.insert({t->id(), t});
+}
+
+
+// Returns a snapshot of the dataplane's tables.
+std::vector<Table*>
+Dataplane::tables() const
+{
+  std::lock_guard<std::mutex> lock(tables_mutex_);
+  std::vector<Table*> v;
+  v.reserve(tables_.size());
+  for (auto const& entry : tables_)
+    v.push_back(entry.second);
+  return v;
+}
+
+
 // Load an application from the given path.
 void
 Dataplane::load_application(char const* path)
@@ -99,6 +138,9 @@ Dataplane::unload_application()
 void
 Dataplane::up()
 {
+  // Calibrate the packet clock before any packet is timestamped.
+  calibrate_tsc();
+
   // Start the application.
   if (app_)
     app_->start(*this);
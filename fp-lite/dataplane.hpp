@@ -1,9 +1,15 @@
 #ifndef FP_DATAPLANE_HPP
 #define FP_DATAPLANE_HPP
 
+#include "thread.hpp"
+#include "latency.hpp"
+
+#include <atomic>
 #include <string>
 #include <list>
+#include <mutex>
 #include <unordered_map>
+#include <vector>
 
 namespace fp
 {
@@ -11,11 +17,17 @@ namespace fp
 struct Table;
 class Application;
 class Port;
+class Pool;
+class Shared_region;
 
 
 // The flowpath data plane module. Contains an application, a name,
 // and the tables the application will use during decode/lookup.
 //
+// Each dataplane also owns its packet buffer pool and the group of
+// threads that process its packets, so that several dataplanes can
+// run independently in the same process.
+//
 // TODO: Rethink how the port table works. Who assigns ids?
 //
 // TODO: Support multuiple applications.
@@ -26,8 +38,12 @@ public:
   using Port_map  = std::unordered_map<uint32_t, Port*>;
   using Table_map = std::unordered_map<uint32_t, Table*>;
 
+  // The number of buffers in a pool unless otherwise configured.
+  static constexpr int default_pool_size = 1024 * 256 + 1024;
+
   Dataplane(char const* n)
-    : name_(n), drop_(nullptr), app_(nullptr)
+    : name_(n), drop_(nullptr), flood_(nullptr), app_(nullptr),
+      region_(nullptr), pool_(nullptr), pool_size_(default_pool_size)
   { }
 
   ~Dataplane();
@@ -56,6 +72,38 @@ public:
   Application* get_application() const { return app_; }
 
   // Table management.
+  //
+  // When the dataplane has a shared memory region, exact match
+  // tables are allocated in that region so that they are shared
+  // by all processes mapping it. The region must outlive the
+  // dataplane's tables.
+  void           set_shared_region(Shared_region* r) { region_ = r; }
+  Shared_region* shared_region() const { return region_; }
+
+  // Registers a table with the dataplane. Tables are never removed,
+  // so the list returned by tables() stays valid, and may be read by
+  // another thread while tables are added.
+  void                      add_table(Table*);
+  std::vector<Table*>       tables() const;
+
+  // Buffer management.
+  //
+  // The pool is created on first use. Its size must be set before
+  // then.
+  void  set_pool_size(int n) { pool_size_ = n; }
+  Pool& pool();
+
+  // Returns the pool, or nullptr if it has not been created yet.
+  // Unlike pool(), this never creates it.
+  Pool const* existing_pool() const { return pool_.load(std::memory_order_acquire); }
+
+  // Thread management.
+  Thread_group const& threads() const { return threads_; }
+  Thread_group&       threads()       { return threads_; }
+
+  // Latency statistics.
+  Latency_stats const& latency() const { return latency_; }
+  Latency_stats&       latency()       { return latency_; }
 
   // State management.
   void up();
@@ -73,8 +121,16 @@ public:
   Port*     drop_;
   Port*     flood_;
 
-  Table_map tables_;
+  Table_map          tables_;
+  mutable std::mutex tables_mutex_;
   Application* app_;
+  Shared_region* region_;
+
+  std::atomic<Pool*> pool_;
+  int                pool_size_;
+  std::once_flag     pool_once_;
+  Thread_group       threads_;
+  Latency_stats      latency_;
 };
 
 
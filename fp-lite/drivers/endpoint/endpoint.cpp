@@ -67,7 +67,7 @@ main(int argc, char* argv[])
 
   // Configure the dataplane. Ports must be added before
   // applications are loaded.
-  fp::Dataplane dp = "dp1";
+  fp::Dataplane dp("dp1");
   dp.add_port(&port1);
   dp.add_virtual_ports();
   dp.load_application(std::string(app_path + "endpoint.app").c_str());
@@ -141,7 +141,7 @@ main(int argc, char* argv[])
   {
     // Ingress the packet.
     Byte buf[2048];
-    Context cxt(buf, &dp);
+    Context cxt(&dp, buf);
     bool ok = port.recv(cxt);
 
     // Handle error or closure.
@@ -170,7 +170,7 @@ main(int argc, char* argv[])
     }
     else {
       ++npackets;
-      nbytes += cxt.packet().size();
+      nbytes += cxt.packet().length();
     }
 
     // Otherwise, process the application.
@@ -0,0 +1,333 @@
+// Only build this example on a linux machine, as epoll and CPU
+// affinity are not portable to Mac.
+
+#include "port.hpp"
+#include "port_tcp.hpp"
+#include "dataplane.hpp"
+#include "context.hpp"
+#include "application.hpp"
+#include "buffer.hpp"
+#include "system.hpp"
+#include "thread.hpp"
+#include "trace.hpp"
+#include "stats.hpp"
+
+#include <freeflow/socket.hpp>
+#include <freeflow/epoll.hpp>
+#include <freeflow/time.hpp>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <signal.h>
+#include <unistd.h>
+
+
+using namespace ff;
+using namespace fp;
+
+
+// Run two independent 2-port dataplanes in one process. Each
+// dataplane has its own application, buffer pool, and ports, and
+// its own thread group pinned to a disjoint set of CPUs. Each
+// dataplane accepts connections on its own TCP port.
+
+// Global Members.
+//
+
+// Running flag.
+static bool volatile running;
+
+// Per-dataplane state owned by the driver.
+//
+// A port's connection is attached by the main thread and detached by
+// the port's own thread, and the peer's thread sends on it. Each of
+// these holds the port's lock, so that a connection is never replaced
+// or closed while another thread uses it. Receiving takes no lock,
+// since only the port's own thread receives or detaches. Receiving
+// and sending may both take the link down, which is safe because the
+// link state is atomic.
+struct Instance
+{
+  Instance(std::string const& n, std::string const& a, int p)
+    : name(n), app(a), tcp_port(p), dp(nullptr), ports{{1}, {2}}, nports(0),
+      server(), last()
+  { }
+
+  std::string         name;
+  std::string         app;
+  int                 tcp_port;
+  Dataplane*          dp;
+  Port_eth_tcp        ports[2];
+  std::mutex          locks[2];
+  std::atomic<int>    nports;
+  Ipv4_stream_socket  server;
+  Port::Statistics    last[2];
+};
+
+// The number of buffers in each dataplane's pool.
+constexpr int pool_size = 4096;
+
+// Local recv buffer size.
+constexpr int local_buf_size = 2048;
+
+
+// Signal handling.
+//
+// TODO: Use sigaction
+void
+on_signal(int sig)
+{
+  running = false;
+}
+
+
+// The work function of a dataplane thread. Thread i receives from
+// port i and forwards to the peer port.
+void
+port_work(Thread_group& group, int id)
+{
+  Instance& inst = *(Instance*)group.data();
+  Port_eth_tcp& port = inst.ports[id];
+  Port_eth_tcp& peer = inst.ports[1 - id];
+  std::mutex& lock = inst.locks[id];
+  std::mutex& peer_lock = inst.locks[1 - id];
+  Pool& pool = inst.dp->pool();
+  Byte scratch[local_buf_size];
+  Context scratch_cxt(inst.dp, scratch);
+  // True if the pool was exhausted at the last receive.
+  bool exhausted = false;
+
+  Epoll_set local(1);
+  bool polling = false;
+  while (running) {
+    // Wait for the port to be connected.
+    if (!polling) {
+      int fd = -1;
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!port.is_link_down())
+          fd = port.fd();
+      }
+      if (fd < 0) {
+        usleep(10000);
+        continue;
+      }
+      local.add(fd);
+      polling = true;
+    }
+
+    int n = epoll(local, 10);
+    tick_coarse_clock();
+    if (n <= 0 || !local[0].can_read())
+      continue;
+
+    // Read into scratch space if the pool is exhausted, so that the
+    // port does not stall.
+    Buffer* buf = pool.try_alloc();
+    if (!buf && !exhausted)
+      trace(trace_pool_low, port.id(), 0);
+    exhausted = !buf;
+    Context& cxt = buf ? buf->context() : scratch_cxt;
+    bool received = port.recv(cxt);
+    if (received && !buf) {
+      port.count_drop(drop_no_buffer);
+    } else if (received) {
+      Latency_stats& lat = inst.dp->latency();
+      Cycles t = lat.sample() ? now_cycles() : 0;
+      inst.dp->get_application()->process(cxt);
+      cxt.apply_actions();
+      if (cxt.output_port() != &peer) {
+        port.count_drop(drop_app);
+      } else {
+        std::lock_guard<std::mutex> guard(peer_lock);
+        if (peer.is_link_down()) {
+          port.count_drop(drop_link_down);
+        } else {
+          peer.send(cxt);
+          if (t)
+            lat.record(port.id(), cxt.packet().timestamp(), t, now_cycles());
+        }
+      }
+    }
+    if (buf)
+      pool.dealloc(buf->id());
+
+    // Release the port when the peer closes the connection.
+    if (port.is_link_down()) {
+      local.del(port.fd());
+      polling = false;
+      std::lock_guard<std::mutex> guard(lock);
+      Ipv4_stream_socket client = port.detach();
+      inst.dp->get_application()->port_changed(port);
+      --inst.nports;
+    }
+  }
+}
+
+
+// Create and start the dataplane for the given instance. Its
+// threads run on the given CPUs.
+void
+start(Instance& inst, std::vector<int> const& cpus)
+{
+  inst.dp = create_dataplane(inst.name);
+  inst.dp->set_pool_size(pool_size);
+  for (Port_eth_tcp& port : inst.ports)
+    inst.dp->add_port(&port);
+  inst.dp->add_virtual_ports();
+  inst.dp->load_application(inst.app.c_str());
+  inst.dp->up();
+
+  Ipv4_socket_address addr(Ipv4_address::any(), inst.tcp_port);
+  set_option(inst.server.fd(), reuse_address(true));
+  set_option(inst.server.fd(), nonblocking(true));
+  if (!inst.server.listen(addr))
+    throw std::runtime_error("cannot listen on port " + std::to_string(inst.tcp_port));
+
+  inst.dp->threads().set_cpus(cpus);
+  inst.dp->threads().run(port_work, &inst);
+  std::cout << "[flowpath] " << inst.name << ": " << inst.app
+            << " on port " << inst.tcp_port << '\n';
+}
+
+
+// Accept a connection for the given instance.
+void
+accept(Instance& inst)
+{
+  Ipv4_socket_address addr;
+  Ipv4_stream_socket client = inst.server.accept(addr);
+  if (!client)
+    return;
+
+  // If we already have two endpoints, just return, which
+  // will cause the socket to be closed.
+  if (inst.nports == 2) {
+    std::cout << "[flowpath] " << inst.name << ": reject connection " << addr.port() << '\n';
+    return;
+  }
+  // Attach the connection to the first free port, and notify the
+  // application of the port change.
+  for (int i = 0; i < 2; ++i) {
+    std::lock_guard<std::mutex> guard(inst.locks[i]);
+    Port_tcp& port = inst.ports[i];
+    if (!port.is_link_down())
+      continue;
+    std::cout << "[flowpath] " << inst.name << ": accept connection " << addr.port() << '\n';
+    port.attach(std::move(client));
+    ++inst.nports;
+    inst.dp->get_application()->port_changed(port);
+    return;
+  }
+}
+
+
+// Report the packet rates of each port of the instance.
+void
+report(Instance& inst, double secs)
+{
+  for (int i = 0; i < 2; ++i) {
+    Port::Statistics s = inst.ports[i].stats();
+    Port::Statistics& l = inst.last[i];
+    double rx = s.packets_rx > l.packets_rx ? (s.packets_rx - l.packets_rx) / secs : 0;
+    double tx = s.packets_tx > l.packets_tx ? (s.packets_tx - l.packets_tx) / secs : 0;
+    std::cout << inst.name << " port[" << i << "] RX (Pkt/s): " << rx
+              << " TX (Pkt/s): " << tx << '\n';
+    l = s;
+  }
+  print_latency(std::cout, *inst.dp);
+}
+
+
+// The main driver for the multi-dataplane server.
+//
+// usage: fp-multi-dp [--stats-socket path] [app1 [app2]]
+//
+// The first dataplane runs app1 (apps/wire.app by default) and
+// accepts connections on port 5000. The second runs app2 (apps/nop.app
+// by default) and accepts connections on port 5001. Statistics of
+// both dataplanes, including their tables, are served on the given
+// UNIX socket (see stats.hpp and fp-stats).
+//
+// Note that an application loaded into two dataplanes is mapped only
+// once, so the two instances share its global variables.
+int
+main(int argc, char* argv[])
+{
+  std::unique_ptr<Stats_server> stats;
+  std::vector<std::string> apps;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--stats-socket" && i + 1 < argc)
+      stats.reset(new Stats_server(argv[++i]));
+    else
+      apps.push_back(arg);
+  }
+
+  Instance inst[2] = {
+    {"dp1", apps.size() >= 1 ? apps[0] : "apps/wire.app", 5000},
+    {"dp2", apps.size() >= 2 ? apps[1] : "apps/nop.app", 5001},
+  };
+
+  // TODO: Use sigaction.
+  signal(SIGINT, on_signal);
+  signal(SIGHUP, on_signal);
+  install_trace_signal(SIGUSR2);
+
+  // Give each dataplane its own pair of cores.
+  int ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+  running = true;
+  for (int i = 0; i < 2; ++i)
+    start(inst[i], {(2 * i) % ncpus, (2 * i + 1) % ncpus});
+
+  if (stats) {
+    for (Instance& in : inst)
+      stats->add_dataplane(*in.dp);
+    if (!stats->start())
+      stats.reset();
+  }
+
+  Epoll_set eps(2);
+  eps.add(inst[0].server.fd());
+  eps.add(inst[1].server.fd());
+
+  Time last = now();
+  while (running) {
+    int n = epoll(eps, 100);
+    for (int i = 0; i < n; ++i) {
+      if (!eps[i].can_read())
+        continue;
+      for (Instance& in : inst)
+        if (eps[i].fd() == in.server.fd())
+          accept(in);
+    }
+
+    serve_trace_dump_request();
+
+    Fp_seconds dur = now() - last;
+    if (dur.count() >= 2.0) {
+      for (Instance& in : inst)
+        report(in, dur.count());
+      std::cout << '\n';
+      recalibrate_tsc();
+      last = now();
+    }
+  }
+
+  // Stop serving statistics before the dataplanes go away.
+  stats.reset();
+
+  // Stop each dataplane's threads and release its resources.
+  for (Instance& in : inst) {
+    delete_dataplane(in.name);
+    for (Port_eth_tcp& port : in.ports)
+      if (!port.is_link_down())
+        port.detach();
+  }
+
+  return 0;
+}
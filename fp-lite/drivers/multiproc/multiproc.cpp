@@ -0,0 +1,406 @@
+// Only build this example on a linux machine, as epoll, SO_REUSEPORT,
+// and CPU affinity are not portable to Mac.
+
+#include "port.hpp"
+#include "port_tcp.hpp"
+#include "dataplane.hpp"
+#include "context.hpp"
+#include "application.hpp"
+#include "shm.hpp"
+#include "table_shared.hpp"
+
+#include <freeflow/socket.hpp>
+#include <freeflow/epoll.hpp>
+#include <freeflow/time.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <iostream>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+
+using namespace ff;
+using namespace fp;
+
+
+// Emulate a 2 port wire running over TCP ports with a process per
+// core. Each worker process listens on the same address using
+// SO_REUSEPORT, so the kernel distributes incoming connections
+// among the workers. A worker forwards between the first two
+// connections that it accepts, and shares nothing with the other
+// workers except for the dataplane's shared memory region, which
+// holds flow tables and statistics.
+//
+// A supervisor process spawns the workers, restarts any worker
+// that crashes, and reports statistics aggregated over all of
+// the workers.
+
+// Global Members.
+//
+
+// Running flag.
+static bool volatile running;
+
+// The address on which workers accept connections.
+Ipv4_socket_address addr(Ipv4_address::any(), 5000);
+
+// Pre-create all standard ports. Each worker has its own copy.
+Port_eth_tcp ports[2] =
+{
+  {1},
+  {2}
+};
+
+// Current number of ports.
+int nports = 0;
+
+// The data plane object. The application is loaded by the
+// supervisor, so its code is mapped at the same address in all
+// workers.
+Dataplane dp("dp1");
+
+// The maximum number of worker processes.
+constexpr int max_workers = 64;
+
+// Local recv buffer size.
+constexpr int local_buf_size = 2048;
+
+// The size of the shared memory region.
+constexpr std::size_t region_size = 64 << 20;
+
+// Counters published by a worker.
+struct Worker_counters
+{
+  pid_t    pid;
+  uint64_t restarts;
+  uint64_t packets_rx;
+  uint64_t packets_tx;
+  uint64_t bytes_rx;
+  uint64_t bytes_tx;
+};
+
+// Statistics published by a worker. Each block is written by a
+// single worker and read by the supervisor, and is aligned so that
+// workers never write to the same cache line.
+struct alignas(64) Worker_stats
+{
+  Seqlock         seq;
+  Worker_counters c;
+};
+
+// Worker statistics, allocated in the shared region.
+Worker_stats* worker_stats;
+
+
+// Signal handling.
+//
+// TODO: Use sigaction
+void
+on_signal(int sig)
+{
+  running = false;
+}
+
+
+// Pin the calling process to the given CPU.
+void
+pin(int cpu)
+{
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (sched_setaffinity(0, sizeof(set), &set) < 0)
+    std::cerr << "[flowpath] cannot pin to cpu " << cpu << '\n';
+}
+
+
+// Publish the port statistics of this worker.
+void
+publish(Worker_stats& ws)
+{
+  Port::Statistics s1 = ports[0].stats();
+  Port::Statistics s2 = ports[1].stats();
+  ws.seq.begin_write();
+  ws.c.packets_rx = s1.packets_rx + s2.packets_rx;
+  ws.c.packets_tx = s1.packets_tx + s2.packets_tx;
+  ws.c.bytes_rx = s1.bytes_rx + s2.bytes_rx;
+  ws.c.bytes_tx = s1.bytes_tx + s2.bytes_tx;
+  ws.seq.end_write();
+}
+
+
+// Returns a consistent copy of a worker's statistics.
+Worker_counters
+snapshot(Worker_stats const& ws)
+{
+  Worker_counters c;
+  unsigned seq;
+  do {
+    seq = ws.seq.begin_read();
+    c = ws.c;
+  } while (!ws.seq.end_read(seq));
+  return c;
+}
+
+
+// Detach the port from its socket and notify the application.
+void
+disconnect(Epoll_set& eps, Port_tcp& port)
+{
+  eps.del(port.fd());
+  Ipv4_stream_socket client = port.detach();
+  dp.get_application()->port_changed(port);
+  --nports;
+}
+
+
+// The main loop of a worker process. Returns the exit status of
+// the worker.
+int
+worker(int id)
+{
+  pin(id % sysconf(_SC_NPROCESSORS_ONLN));
+
+  Worker_stats& ws = worker_stats[id];
+
+  // Each worker has its own listening socket. The port must be
+  // reusable before it is bound.
+  Ipv4_stream_socket server;
+  set_option(server.fd(), reuse_address(true));
+  set_option(server.fd(), reuse_port(true));
+  set_option(server.fd(), nonblocking(true));
+  if (!server.listen(addr)) {
+    std::cerr << "[flowpath] worker " << id << ": cannot listen\n";
+    return 1;
+  }
+
+  Epoll_set eps(3);
+  eps.add(server.fd());
+
+  Byte buf[local_buf_size];
+
+  // Accept connections from the server socket.
+  auto accept = [&]()
+  {
+    Ipv4_socket_address peer;
+    Ipv4_stream_socket client = server.accept(peer);
+    if (!client)
+      return;
+
+    // If we already have two endpoints, just return, which
+    // will cause the socket to be closed.
+    if (nports == 2) {
+      std::cout << "[flowpath] worker " << id << ": reject connection " << peer.port() << '\n';
+      return;
+    }
+    std::cout << "[flowpath] worker " << id << ": accept connection " << peer.port() << '\n';
+    Port_tcp* port = ports[0].is_link_down() ? &ports[0] : &ports[1];
+    port->attach(std::move(client));
+    eps.add(port->fd());
+    ++nports;
+
+    // Notify the application of the port change.
+    dp.get_application()->port_changed(*port);
+  };
+
+  // Receive a packet on the port and forward it. Packets bound
+  // for anything other than a local port are dropped.
+  auto forward = [&](Port_tcp& port)
+  {
+    Context cxt(&dp, buf);
+    if (!port.recv(cxt)) {
+      if (port.is_link_down())
+        disconnect(eps, port);
+      return;
+    }
+    dp.get_application()->process(cxt);
+    cxt.apply_actions();
+    Port* out = cxt.output_port();
+    if (out == &ports[0] || out == &ports[1])
+      out->send(cxt);
+  };
+
+  Time last = now();
+  while (running) {
+    int n = epoll(eps, 100);
+    tick_coarse_clock();
+    for (int i = 0; i < n; ++i) {
+      int fd = eps[i].fd();
+      if (!eps[i].can_read())
+        continue;
+      if (fd == server.fd())
+        accept();
+      else if (fd == ports[0].fd())
+        forward(ports[0]);
+      else if (fd == ports[1].fd())
+        forward(ports[1]);
+    }
+
+    // Publish statistics a few times per second.
+    Fp_seconds dur = now() - last;
+    if (dur.count() >= 0.1) {
+      publish(ws);
+      last = now();
+    }
+  }
+
+  publish(ws);
+  for (Port_tcp& port : ports)
+    if (!port.is_link_down())
+      disconnect(eps, port);
+  return 0;
+}
+
+
+// Fork a new worker process with the given id.
+pid_t
+spawn(int id)
+{
+  // Don't let the worker inherit buffered output.
+  std::fflush(nullptr);
+  pid_t pid = fork();
+  if (pid < 0) {
+    std::cerr << "[flowpath] cannot fork worker " << id << ": " << std::strerror(errno) << '\n';
+    return pid;
+  }
+  if (pid == 0) {
+    // The worker is stopped by the supervisor.
+    signal(SIGINT, SIG_IGN);
+    signal(SIGTERM, on_signal);
+    int status = worker(id);
+    std::cout.flush();
+    std::_Exit(status);
+  }
+  worker_stats[id].c.pid = pid;
+  return pid;
+}
+
+
+// The main driver for the multi-process flowpath wire server.
+//
+// usage: fp-multiproc [workers]
+//
+// The optional argument gives the number of worker processes. By
+// default, one worker is run for each online CPU.
+int
+main(int argc, char* argv[])
+{
+  int nworkers = sysconf(_SC_NPROCESSORS_ONLN);
+  if (argc >= 2)
+    nworkers = std::atoi(argv[1]);
+  if (nworkers < 1 || nworkers > max_workers) {
+    std::cerr << "usage: " << argv[0] << " [workers]\n";
+    return 1;
+  }
+
+  // TODO: Use sigaction.
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+  signal(SIGHUP, on_signal);
+
+  // Create the shared region before the application is loaded so
+  // that its tables are allocated in shared memory.
+  Shared_region region(region_size);
+  worker_stats = (Worker_stats*)region.allocate(max_workers * sizeof(Worker_stats), alignof(Worker_stats));
+  for (int i = 0; i < max_workers; ++i)
+    new (&worker_stats[i]) Worker_stats();
+  dp.set_shared_region(&region);
+
+  // Configure the dataplane. Ports must be added before
+  // applications are loaded.
+  for (int i = 0; i < 2; i++)
+    dp.add_port(&ports[i]);
+  dp.add_virtual_ports();
+
+  dp.load_application("apps/wire.app");
+  dp.up();
+
+  running = true;
+  for (int i = 0; i < nworkers; ++i)
+    spawn(i);
+
+  // Report statistics aggregated over all workers.
+  Worker_counters last = {};
+  auto report = [&](double secs)
+  {
+    Worker_counters total = {};
+    for (int i = 0; i < nworkers; ++i) {
+      Worker_counters s = snapshot(worker_stats[i]);
+      total.restarts += s.restarts;
+      total.packets_rx += s.packets_rx;
+      total.packets_tx += s.packets_tx;
+      total.bytes_rx += s.bytes_rx;
+      total.bytes_tx += s.bytes_tx;
+    }
+    // Counters restart from zero when a worker is respawned, so
+    // the rate is clamped rather than reported as negative.
+    auto rate = [secs](uint64_t curr, uint64_t prev)
+    {
+      return curr > prev ? (curr - prev) / secs : 0.0;
+    };
+    std::cout << "Workers: " << nworkers << " Restarts: " << total.restarts << '\n';
+    std::cout << "Receive Rate  (Pkt/s): " << rate(total.packets_rx, last.packets_rx) << '\n';
+    std::cout << "Receive Rate   (Gb/s): " << rate(total.bytes_rx, last.bytes_rx) * 8.0 / (1 << 30) << '\n';
+    std::cout << "Transmit Rate (Pkt/s): " << rate(total.packets_tx, last.packets_tx) << '\n';
+    std::cout << "Transmit Rate  (Gb/s): " << rate(total.bytes_tx, last.bytes_tx) * 8.0 / (1 << 30) << "\n\n";
+    last = total;
+  };
+
+  // Supervise the workers.
+  Time prev = now();
+  while (running) {
+    // Restart any worker that has terminated.
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+      for (int i = 0; i < nworkers; ++i) {
+        if (worker_stats[i].c.pid != pid)
+          continue;
+        std::cerr << "[flowpath] worker " << i << " (" << pid << ") exited";
+        if (WIFSIGNALED(status))
+          std::cerr << " on signal " << WTERMSIG(status);
+        std::cerr << ", restarting\n";
+
+        // The worker may have died while updating a shared table
+        // or publishing its statistics. Lookups in the other
+        // workers wait until such an update is finished.
+        for (Table* t : dp.tables())
+          if (Shared_hash_table* st = dynamic_cast<Shared_hash_table*>(t))
+            st->recover();
+        worker_stats[i].seq.repair();
+        worker_stats[i].seq.begin_write();
+        ++worker_stats[i].c.restarts;
+        worker_stats[i].seq.end_write();
+        spawn(i);
+      }
+    }
+
+    usleep(100000);
+    Fp_seconds dur = now() - prev;
+    if (dur.count() >= 2.0) {
+      report(dur.count());
+      recalibrate_tsc();
+      prev = now();
+    }
+  }
+
+  // Stop the workers and wait for them to exit.
+  for (int i = 0; i < nworkers; ++i)
+    kill(worker_stats[i].c.pid, SIGTERM);
+  while (wait(nullptr) > 0)
+    ;
+  Fp_seconds dur = now() - prev;
+  report(dur.count());
+
+  // Take the dataplane down.
+  dp.down();
+  dp.unload_application();
+  dp.set_shared_region(nullptr);
+
+  return 0;
+}
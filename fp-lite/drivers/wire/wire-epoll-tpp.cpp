@@ -9,20 +9,23 @@
 #include "thread.hpp"
 #include "queue.hpp"
 #include "buffer.hpp"
+#include "admission.hpp"
+#include "trace.hpp"
+#include "stats.hpp"
 
 #include <freeflow/socket.hpp>
 #include <freeflow/epoll.hpp>
 #include <freeflow/time.hpp>
 
+#include <cstdlib>
+#include <memory>
 #include <string>
 #include <queue>
-#include <array>
 #include <vector>
 #include <iostream>
 #include <signal.h>
 #include <unistd.h>
-
-#include <boost/lockfree/queue.hpp>
+#include <sys/ioctl.h>
 
 
 using namespace ff;
@@ -40,9 +43,10 @@ using namespace fp;
 // Go figure.
 static bool volatile running;
 
-// A server socket that will accept network connections.
+// A server socket that will accept network connections. It is
+// bound in main, after the address is made reusable.
 Ipv4_socket_address addr(Ipv4_address::any(), 5000);
-Ipv4_stream_socket server(addr);
+Ipv4_stream_socket server;
 
 // Pre-create all standard ports.
 Port_eth_tcp ports[2] =
@@ -51,25 +55,49 @@ Port_eth_tcp ports[2] =
   {2}
 };
 
-// Port threads.
+// Port threads, and whether each has been started.
 Thread port_thread[2];
+bool   port_started[2];
 
 // Current number of ports.
 int nports = 0;
 
 // The data plane object.
-Dataplane dp = "dp1";
+Dataplane dp("dp1");
 
-// Local send/recv buffer size.
+// Local recv buffer size.
 constexpr int local_buf_size = 2048;
 
-// Port send queues.
-boost::lockfree::queue<std::array<int, local_buf_size>, boost::lockfree::capacity<2048>> send_queue[2];
+// The number of buffer indexes transferred between port threads
+// in a single queue operation.
+constexpr int batch_size = 64;
+
+// A batch of packet buffer indexes headed for the same port.
+struct Batch
+{
+  int size;
+  int ids[batch_size];
+};
+
+// Port send queues. Each holds batches of buffers to be sent
+// on the corresponding port.
+using Send_queue = Bounded_queue<Batch, 1024>;
+Send_queue send_queue[2];
 
 
 // The packet buffer pool.
 static Pool& buffer_pool = Buffer_pool::get_pool(&dp);
 
+// The overload policy for ingress. Set from the command line.
+static Admission::Policy policy = Admission::pause;
+
+// The polling loop statistics of each port thread.
+Loop_stats loop_stats[2] =
+{
+  {"port[0]"},
+  {"port[1]"}
+};
+
 // Set up the initial polling state.
 Epoll_set eps(3);
 
@@ -83,9 +111,65 @@ on_signal(int sig)
 }
 
 
+// Returns the index of the given port in the port array, or -1
+// if the port is not one of the standard ports (e.g., the drop
+// port).
+inline int
+port_index(Port* p)
+{
+  if (p == &ports[0])
+    return 0;
+  if (p == &ports[1])
+    return 1;
+  return -1;
+}
+
+
+// Attempt to move the pending batch into the send queue of the
+// given port. Returns true if the batch is empty afterwards.
+inline bool
+flush(Batch& batch, int out)
+{
+  if (batch.size == 0)
+    return true;
+  if (!send_queue[out].push(batch))
+    return false;
+  batch.size = 0;
+  return true;
+}
+
+
+// Returns true if data is waiting in the socket, so that the next
+// recv will not wait for a packet to arrive.
+inline bool
+readable(int fd)
+{
+  int n = 0;
+  return ::ioctl(fd, FIONREAD, &n) == 0 && n > 0;
+}
+
+
+// Release all buffers in the batch back to the pool.
+inline void
+discard(Batch& batch)
+{
+  for (int i = 0; i < batch.size; ++i)
+    buffer_pool.dealloc(batch.ids[i]);
+  batch.size = 0;
+}
+
+
 // Apply ingress and pipeline processing on a new packet (context).
 // After processing, the context will be copied to the egress queue.
 //
+// Ingress is subject to admission control. When the buffer pool
+// or the peer's send queue is past its watermark, the thread
+// either stops reading from its port or reads and drops packets,
+// according to the overload policy. A batch that cannot be queued
+// is held until the peer drains its queue (pause), or dropped
+// (drop). In either case, the thread continues to drain its own
+// send queue so that two threads can never wait on each other.
+//
 // FIXME: Currently we assume ingress processing happens on port2.
 // Maybe wrap ingress and egress calls into a different function
 // and use epoll to determine if you should send/recv?
@@ -96,62 +180,168 @@ port_work(void* arg)
   int id = *((int*)arg);
   // Port FD.
   int fd = ports[id].fd();
-  // Local recv/send buffers.
-  std::array<int, local_buf_size> recv_buf;
-  std::array<int, local_buf_size> send_buf;
-  // Iterator to fill local recv buffer.
-  auto recv_iter = recv_buf.begin();
+  // The port that receives our output.
+  int peer = 1 - id;
+  // Buffers processed, but not yet queued for the peer.
+  Batch pending;
+  pending.size = 0;
+  // Batch drained from the local send queue.
+  Batch sending;
+  // Scratch space for packets dropped on overload.
+  Byte scratch[local_buf_size];
+  Context scratch_cxt(&dp, scratch);
+  // Polling loop statistics.
+  Loop_stats& loop = loop_stats[id];
+  // Ingress admission control.
+  Admission admit(policy, default_watermarks(buffer_pool, Send_queue::capacity()));
+  // The number of packets received since the port was last found
+  // idle, and whether the pool was low at the last check. Both are
+  // traced when they change, rather than per packet.
+  int burst = 0;
+  bool pool_low = false;
+  // Each thread polls its own port. Note that the result of a
+  // poll that times out must not be used, since the event set
+  // still holds the previous events.
+  Epoll_set local(1);
+  local.add(fd);
   // TODO: Figure out a better conditional.
   while (running) {
-    // Check if the fd is able to read/recv.
-    if (eps.can_read(fd)) {
-      
-      // Get the next free buffer from the pool.
-      Buffer& buf = buffer_pool.alloc();
-
-      // Ingress the packet.
-      if (ports[id].recv(buf.context())) {
-        // TODO: This really just runs one step of the pipeline. This needs
-        // to be a loop that continues processing until there are no further
-        // table redirections.
-        Application* app = dp.get_application();
-
-        // NOTE: Have process return the number of redirections to indicate
-        // if further processing should happen? Something like...
-        //
-        // while (app->process(buf.cxt_)) { }
-        app->process(buf.context());
-
-        // Apply actions.
-        buf.context().apply_actions();
-
-        // Assuming there's an output send to it.
-        if (buf.context().output_port()) {
-          // If the buffer is full, push it into the send queue.
-          if (++recv_iter == recv_buf.end()) {
-            send_queue[buf.context().output_port()->id() - 1].push(recv_buf);
-            recv_iter = recv_buf.begin() + 1;
+    int n = epoll(local, 10);
+    tick_coarse_clock();
+    bool can_read = n > 0 && local[0].can_read();
+    bool can_write = n > 0 && local[0].can_write();
+    // The number of packets received and sent in this iteration.
+    int rx = 0;
+    int tx = 0;
+
+    // End the current burst when the port goes idle.
+    if (burst && !can_read) {
+      trace(trace_rx_burst, ports[id].id(), burst);
+      burst = 0;
+    }
+
+    // Queue any pending output. If that fails, the peer is
+    // congested and we can't accept more work.
+    bool blocked = !flush(pending, peer);
+    if (blocked && admit.policy() == Admission::drop) {
+      admit.on_drop(pending.size);
+      ports[id].count_drop(drop_ring_full, pending.size);
+      discard(pending);
+      blocked = false;
+    }
+
+    // Check if the fd is able to read/recv. Packets are received
+    // in bursts: while the socket holds more data, up to a batch of
+    // packets is read before the pending batch is queued for the
+    // peer. The batch is queued at the end of the burst, rather than
+    // held for more packets, since the next recv may block, which
+    // would strand a partially filled batch.
+    if (can_read) {
+      int avail = buffer_pool.available();
+      bool low = avail <= admit.watermarks().pool_low;
+      if (low && !pool_low)
+        trace(trace_pool_low, ports[id].id(), avail);
+      pool_low = low;
+
+      bool more = true;
+      while (more) {
+        Admission::Verdict v = admit.check(buffer_pool, send_queue[peer].depth());
+        if (blocked)
+          v = Admission::defer;
+
+        if (v == Admission::accept) {
+          // Get the next free buffer from the pool. This only fails
+          // when the pool is exhausted by other threads after the
+          // admission check.
+          Buffer* buf = buffer_pool.try_alloc();
+          if (!buf) {
+            admit.on_pause();
+            break;
+          }
+          // Ingress the packet.
+          if (!ports[id].recv(buf->context())) {
+            buffer_pool.dealloc(buf->id());
+            break;
+          }
+          ++rx;
+          if (++burst == batch_size) {
+            trace(trace_rx_burst, ports[id].id(), burst);
+            burst = 0;
+          }
+
+          // Mark the packet for latency recording on egress.
+          Timing_info& timing = buf->context().timing();
+          timing.process = dp.latency().sample() ? now_cycles() : 0;
+
+          // TODO: This really just runs one step of the pipeline. This needs
+          // to be a loop that continues processing until there are no further
+          // table redirections.
+          Application* app = dp.get_application();
+
+          // NOTE: Have process return the number of redirections to indicate
+          // if further processing should happen? Something like...
+          //
+          // while (app->process(buf.cxt_)) { }
+          app->process(buf->context());
+
+          // Apply actions.
+          buf->context().apply_actions();
+
+          // Assuming there's a standard output port, add the buffer
+          // to the pending batch. Otherwise, the packet is dropped.
+          int out = port_index(buf->context().output_port());
+          if (out == peer) {
+            pending.ids[pending.size++] = buf->id();
           }
-          // Add the packet buffer index to the local buffer.
-          *recv_iter = buf.id();
+          else {
+            ports[id].count_drop(drop_app);
+            buffer_pool.dealloc(buf->id());
+          }
+        }
+        else if (v == Admission::defer) {
+          // Leave the data in the socket.
+          admit.on_pause();
+          break;
+        }
+        else {
+          // Read the packet into scratch space and drop it.
+          if (!ports[id].recv(scratch_cxt))
+            break;
+          ++rx;
+          admit.on_drop();
+          ports[id].count_drop(pool_low ? drop_no_buffer : drop_ring_full);
         }
+        more = pending.size < batch_size && readable(fd);
       }
-      else
-        buffer_pool.dealloc(buf.id());
+
+      // Queue the burst. If that fails, the batch is held, and the
+      // next iteration applies the overload policy to it.
+      flush(pending, peer);
     } // end if-can-read
-  
+
     // Check if the fd is able to write/send.
-    if (eps.can_write(fd)) {
+    if (can_write) {
       // Drain the send queue.
-      while (send_queue[id].pop(send_buf)) {
-        for (int const& idx : send_buf) {
-          ports[id].send(buffer_pool[idx].context());
+      while (send_queue[id].pop(sending)) {
+        for (int i = 0; i < sending.size; ++i) {
+          int idx = sending.ids[i];
+          Context& cxt = buffer_pool[idx].context();
+          ports[id].send(cxt);
+          ++tx;
+          if (Cycles t = cxt.timing().process)
+            dp.latency().record(cxt.input_port_id(), cxt.packet().timestamp(), t, now_cycles());
           buffer_pool.dealloc(idx);
         }
       }
     } // end if-can-write
+
+    // The coarse clock was read when the poll returned.
+    loop.poll(rx, rx || tx ? now_cycles() - coarse_cycles : 0);
   } // end while-running
 
+  // Release any buffers that were never sent.
+  discard(pending);
+
   // Cleanup.
   //
   // Detach the socket.
@@ -165,24 +355,85 @@ port_work(void* arg)
   // Report.
   std::string stats = "port[" + std::to_string(id) + "] RX: " +
     std::to_string(ports[id].stats().packets_rx) + " TX: " + 
-    std::to_string(ports[id].stats().packets_tx) + "\n";
+    std::to_string(ports[id].stats().packets_tx) + 
+    " PAUSED: " + std::to_string(admit.paused()) +
+    " DROPPED: " + std::to_string(admit.dropped()) + "\n";
   std::cout << stats;
   return 0;
 }
 
 
 // The main driver for the flowpath wire server.
+//
+// usage: fp-wire-epoll-tpp [pause|drop] [--coarse-timestamps]
+//                          [--latency-sample n] [--profile]
+//                          [--perf-counters] [--no-trace]
+//                          [--stats-socket path] [--quiet]
+//
+// The optional arguments select the overload policy for ingress,
+// whether packets are timestamped once per burst rather than
+// individually, and the latency sampling period (one in every n
+// packets; 0 disables latency recording). With --profile, the
+// cycles spent per packet in each pipeline stage are reported; this
+// requires a build configured with -DFREEFLOW_PROFILE=ON. With
+// --perf-counters, the profile also includes hardware counter
+// events per packet for each stage.
+//
+// Events are traced into per-thread rings unless --no-trace is
+// given. Send SIGUSR2 to write the rings to a file, and decode it
+// with fp-trace.
+//
+// With --stats-socket, a JSON snapshot of the dataplane's statistics
+// is served on the given UNIX socket (see stats.hpp and fp-stats).
+// Rates are printed every 2 seconds unless --quiet is given.
 int
-main()
+main(int argc, char* argv[])
 {
+  std::unique_ptr<Stats_server> stats;
+  bool quiet = false;
+
+  // Parse command line arguments.
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "pause")
+      policy = Admission::pause;
+    else if (arg == "drop")
+      policy = Admission::drop;
+    else if (arg == "--coarse-timestamps")
+      for (Port_eth_tcp& port : ports)
+        port.set_timestamp_mode(Port::ts_coarse);
+    else if (arg == "--latency-sample" && i + 1 < argc)
+      dp.latency().set_sample_period(std::atoi(argv[++i]));
+    else if (arg == "--profile")
+      enable_profile(true);
+    else if (arg == "--perf-counters")
+      enable_profile_counters(true);
+    else if (arg == "--no-trace")
+      enable_trace(false);
+    else if (arg == "--stats-socket" && i + 1 < argc)
+      stats.reset(new Stats_server(argv[++i]));
+    else if (arg == "--quiet")
+      quiet = true;
+    else {
+      std::cerr << "usage: " << argv[0] << " [pause|drop] [--coarse-timestamps]"
+                << " [--latency-sample n] [--profile] [--perf-counters]"
+                << " [--no-trace] [--stats-socket path] [--quiet]\n";
+      return 1;
+    }
+  }
+
   // TODO: Use sigaction.
   signal(SIGINT, on_signal);
   signal(SIGKILL, on_signal);
   signal(SIGHUP, on_signal);
-
+  install_trace_signal(SIGUSR2);
 
   set_option(server.fd(), reuse_address(true));
   set_option(server.fd(), nonblocking(true));
+  if (!server.listen(addr)) {
+    std::cerr << "[flowpath] cannot listen on port " << addr.port() << '\n';
+    return 1;
+  }
 
   // Accept connections from the server socket.
   auto accept = [&](Ipv4_stream_socket& server)
@@ -201,7 +452,6 @@ main()
     }
     std::cout << "[flowpath] accept connection " << addr.port() << '\n';
     //set_option(client.fd(), nodelay(true));
-    eps.add(client.fd());
     // Bind the socket to a port.
     // TODO: Emit a port status change to the application. Does
     // that happen implicitly, or do we have to cause the dataplane
@@ -213,6 +463,7 @@ main()
       port = &ports[1];
     port->attach(std::move(client));
     port_thread[nports].run();
+    port_started[nports] = true;
     ++nports;
 
     // Notify the application of the port change.
@@ -240,6 +491,15 @@ main()
   // Add the server socket to the select set.
   eps.add(server.fd());
 
+  // Serve statistics.
+  if (stats) {
+    stats->add_dataplane(dp);
+    for (Loop_stats& l : loop_stats)
+      stats->add_loop(l);
+    if (!stats->start())
+      return 1;
+  }
+
   // Report statistics.
   auto report = [&]()
   {
@@ -250,12 +510,13 @@ main()
     uint64_t pkt_rx = (p2_curr.packets_rx - p2_stats.packets_rx) / 2;
     double bit_tx = ((p1_curr.bytes_tx - p1_stats.bytes_tx) * 8.0 / (1 << 30)) / 2.0;
     double bit_rx = ((p2_curr.bytes_rx - p2_stats.bytes_rx) * 8.0 / (1 << 30)) / 2.0;
-    // Clears the screen.
-    (void)system("clear");
     std::cout << "Receive Rate  (Pkt/s): " << pkt_rx << '\n';
     std::cout << "Receive Rate   (Gb/s): " << bit_rx << '\n';
     std::cout << "Transmit Rate (Pkt/s): " << pkt_tx << '\n';
     std::cout << "Transmit Rate  (Gb/s): " << bit_tx << "\n\n";
+    print_latency(std::cout, dp);
+    if (profile_enabled)
+      print_profile(std::cout);
     p1_stats = p1_curr;
     p2_stats = p2_curr;
   };
@@ -277,17 +538,25 @@ main()
     if (eps.can_read(server.fd()))
       accept(server);
 
+    serve_trace_dump_request();
+
     curr = now();
     Fp_seconds dur = curr - last;
     double duration = dur.count();
     if (duration >= 2.0) {
-      report();
+      if (!quiet)
+        report();
+      recalibrate_tsc();
       last = now();
     }
   }
 
-  port_thread[0].halt();
-  port_thread[1].halt();
+  for (int i = 0; i < 2; ++i)
+    if (port_started[i])
+      port_thread[i].halt();
+  if (profile_enabled)
+    print_profile(std::cout);
+  stats.reset();
   eps.clear();
   // Take the dataplane down.
   dp.down();
@@ -58,7 +58,7 @@ Thread port_thread[2];
 int nports = 0;
 
 // The data plane object.
-Dataplane dp = "dp1";
+Dataplane dp("dp1");
 
 // Local send/recv buffer size.
 constexpr int local_buf_size = 2048;
@@ -117,7 +117,7 @@ port_work(void* arg)
       // Ingress the packet.
       if (ports[id].recv(buf.context())) {
         ++npackets;
-        nbytes += buf.context().packet().size();
+        nbytes += buf.context().packet().length();
         // TODO: This really just runs one step of the pipeline. This needs
         // to be a loop that continues processing until there are no further
         // table redirections.
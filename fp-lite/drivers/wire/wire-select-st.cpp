@@ -70,7 +70,7 @@ main(int argc, char* argv[])
 
   // Configure the dataplane. Ports must be added before
   // applications are loaded.
-  fp::Dataplane dp = "dp1";
+  fp::Dataplane dp("dp1");
   dp.add_port(&port1);
   dp.add_port(&port2);
   dp.add_virtual_ports();
@@ -148,7 +148,7 @@ main(int argc, char* argv[])
   {
     // Ingress the packet.
     Byte buf[2048];
-    Context cxt(buf, &dp);
+    Context cxt(&dp, buf);
     bool ok = port.recv(cxt);
 
     // Handle error or closure.
@@ -177,7 +177,7 @@ main(int argc, char* argv[])
     }
     else {
       ++npackets;
-      nbytes += cxt.packet().size();
+      nbytes += cxt.packet().length();
     }
 
     // Otherwise, process the application.
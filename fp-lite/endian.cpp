@@ -0,0 +1,102 @@
+#include "endian.hpp"
+
+#if defined(__x86_64__)
+#  include <tmmintrin.h>
+#endif
+
+
+namespace fp
+{
+
+namespace
+{
+
+constexpr int gather_width = 16;
+
+
+void
+gather_key_generic(Byte* key, Key_field const* fs, int n)
+{
+  int j = 0;
+  for (int i = 0; i < n && j < gather_width; ++i) {
+    Key_field const& f = fs[i];
+    int len = std::min<int>(f.len, gather_width - j);
+    if (f.swap && f.len <= gather_width) {
+      // Only the leading bytes of the reversed field fit.
+      Byte tmp[gather_width];
+      copy_network_to_native(tmp, f.data, f.len);
+      std::memcpy(key + j, tmp, len);
+    } else if (f.swap) {
+      for (int k = 0; k < len; ++k)
+        key[j + k] = f.data[f.len - 1 - k];
+    } else {
+      std::memcpy(key + j, f.data, len);
+    }
+    j += len;
+  }
+  std::fill(key + j, key + gather_width, 0);
+}
+
+
+#if defined(__x86_64__)
+
+// Each field contributes a shuffle of its first 16 bytes into
+// position j of the key. For key byte i, the shuffle index is
+// i - j when copying, or j + len - 1 - i when reversing. Indexes
+// outside [0, len) select zero: negative indexes have their high
+// bit set, which PSHUFB maps to zero, and indexes of len or more
+// are forced negative by a comparison.
+__attribute__((target("ssse3"))) void
+gather_key_ssse3(Byte* key, Key_field const* fs, int n)
+{
+  __m128i const iota = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+  __m128i acc = _mm_setzero_si128();
+  int j = 0;
+  for (int i = 0; i < n && j < gather_width; ++i) {
+    Key_field const& f = fs[i];
+    if (f.len > gather_width) {
+      // Longer fields are rare; place them in a scalar pass.
+      Byte tmp[gather_width];
+      Byte part[gather_width];
+      _mm_storeu_si128((__m128i*)tmp, acc);
+      gather_key_generic(part, &f, 1);
+      std::memcpy(tmp + j, part, gather_width - j);
+      acc = _mm_loadu_si128((__m128i const*)tmp);
+      break;
+    }
+
+    __m128i src;
+    if (f.avail >= gather_width) {
+      src = _mm_loadu_si128((__m128i const*)f.data);
+    } else {
+      Byte tmp[gather_width] = {};
+      std::memcpy(tmp, f.data, f.len);
+      src = _mm_loadu_si128((__m128i const*)tmp);
+    }
+
+    __m128i idx;
+    if (f.swap)
+      idx = _mm_sub_epi8(_mm_set1_epi8(j + f.len - 1), iota);
+    else
+      idx = _mm_sub_epi8(iota, _mm_set1_epi8(j));
+    idx = _mm_or_si128(idx, _mm_cmpgt_epi8(idx, _mm_set1_epi8(f.len - 1)));
+    acc = _mm_or_si128(acc, _mm_shuffle_epi8(src, idx));
+    j += f.len;
+  }
+  _mm_storeu_si128((__m128i*)key, acc);
+}
+
+#endif
+
+} // namespace
+
+
+Kernel<Gather_key_fn> gather_key("gather_key", {
+  {Isa::generic, gather_key_generic},
+#if defined(__x86_64__) && !BOOST_BIG_ENDIAN
+  {Isa::ssse3, gather_key_ssse3},
+#endif
+});
+
+
+} // namespace fp
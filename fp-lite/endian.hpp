@@ -1,18 +1,103 @@
+#ifndef FP_ENDIAN_HPP
+#define FP_ENDIAN_HPP
+
 // Module for detecting native order endianess and converting to the
 // appropriate order.
 
 #include "types.hpp"
+#include "cpu.hpp"
 
 #include <algorithm>
+#include <cstring>
 
 // Includes Boost configuration macros for testing endiannes, so
-// we don't have to rely on 
+// we don't have to rely on
 #include <boost/endian/conversion.hpp>
 
 
 namespace fp
 {
 
+// -------------------------------------------------------------------------- //
+// Byte swapping
+
+inline std::uint16_t bswap(std::uint16_t n) { return __builtin_bswap16(n); }
+inline std::uint32_t bswap(std::uint32_t n) { return __builtin_bswap32(n); }
+inline std::uint64_t bswap(std::uint64_t n) { return __builtin_bswap64(n); }
+
+
+// Reverse the bytes of the buffer in place. Field sizes that fit a
+// register are swapped with a single load, bswap, and store.
+inline void
+reverse_bytes(Byte* buf, int len)
+{
+  switch (len) {
+  case 0:
+  case 1:
+    return;
+  case 2: {
+    std::uint16_t n;
+    std::memcpy(&n, buf, 2);
+    n = bswap(n);
+    std::memcpy(buf, &n, 2);
+    return;
+  }
+  case 4: {
+    std::uint32_t n;
+    std::memcpy(&n, buf, 4);
+    n = bswap(n);
+    std::memcpy(buf, &n, 4);
+    return;
+  }
+  case 8: {
+    std::uint64_t n;
+    std::memcpy(&n, buf, 8);
+    n = bswap(n);
+    std::memcpy(buf, &n, 8);
+    return;
+  }
+  case 16: {
+    std::uint64_t n[2];
+    std::memcpy(n, buf, 16);
+    std::uint64_t lo = bswap(n[1]);
+    std::uint64_t hi = bswap(n[0]);
+    std::memcpy(buf, &lo, 8);
+    std::memcpy(buf + 8, &hi, 8);
+    return;
+  }
+  default:
+    std::reverse(buf, buf + len);
+  }
+}
+
+
+// Copy len bytes from src to dst in reverse order. The buffers
+// must not overlap.
+inline void
+copy_reversed(Byte* dst, Byte const* src, int len)
+{
+  switch (len) {
+  case 0:
+    return;
+  case 1:
+    *dst = *src;
+    return;
+  case 2:
+  case 4:
+  case 8:
+  case 16:
+    std::memcpy(dst, src, len);
+    reverse_bytes(dst, len);
+    return;
+  default:
+    std::reverse_copy(src, src + len, dst);
+  }
+}
+
+
+// -------------------------------------------------------------------------- //
+// Network order conversion
+
 #if BOOST_BIG_ENDIAN
 
 // Big endian is network byte order so no reverse is necessary
@@ -26,22 +111,138 @@ native_to_network_order(fp::Byte* buf, int len)
 {
 }
 
+inline void
+copy_network_to_native(fp::Byte* dst, fp::Byte const* src, int len)
+{
+  std::memcpy(dst, src, len);
+}
+
+inline void
+copy_native_to_network(fp::Byte* dst, fp::Byte const* src, int len)
+{
+  std::memcpy(dst, src, len);
+}
+
+template<typename T>
+inline T
+network_to_native(T n)
+{
+  return n;
+}
+
 #else
 
 // Little endian requires a reversal of bytes.
 inline void
 network_to_native_order(fp::Byte* buf, int len)
 {
-  std::reverse(buf, buf + len);
+  reverse_bytes(buf, len);
 }
 
 
 inline void
 native_to_network_order(fp::Byte* buf, int len)
 {
-  std::reverse(buf, buf + len);
+  reverse_bytes(buf, len);
+}
+
+
+// Copy a field from a packet into native order.
+inline void
+copy_network_to_native(fp::Byte* dst, fp::Byte const* src, int len)
+{
+  copy_reversed(dst, src, len);
+}
+
+
+// Copy a native order value into a packet field.
+inline void
+copy_native_to_network(fp::Byte* dst, fp::Byte const* src, int len)
+{
+  copy_reversed(dst, src, len);
+}
+
+
+template<typename T>
+inline T
+network_to_native(T n)
+{
+  return bswap(n);
 }
 
 #endif
 
+
+template<typename T>
+inline T
+native_to_network(T n)
+{
+  return network_to_native(n);
+}
+
+
+// -------------------------------------------------------------------------- //
+// Batch conversion
+
+// Load the T-sized network order field at offset off of each of n
+// packets, and store its native order value in out.
+//
+// T must be one of std::uint16_t, std::uint32_t, or std::uint64_t.
+template<typename T>
+inline void
+load_network_batch(Byte const* const* pkts, int n, int off, T* out)
+{
+  for (int i = 0; i < n; ++i) {
+    T v;
+    std::memcpy(&v, pkts[i] + off, sizeof(T));
+    out[i] = network_to_native(v);
+  }
+}
+
+
+// Store the native order values in network order at offset off of
+// each of n packets.
+template<typename T>
+inline void
+store_network_batch(Byte* const* pkts, int n, int off, T const* in)
+{
+  for (int i = 0; i < n; ++i) {
+    T v = native_to_network(in[i]);
+    std::memcpy(pkts[i] + off, &v, sizeof(T));
+  }
+}
+
+
+// -------------------------------------------------------------------------- //
+// Key gathering
+
+// A field to be gathered into a key. Packet fields are in network
+// order and are reversed into native order. Other values (e.g., the
+// input port) are copied as is.
+struct Key_field
+{
+  Byte const*   data;  // The field's first byte.
+  std::uint16_t len;   // The length of the field.
+  std::uint16_t avail; // The number of readable bytes at data.
+  bool          swap;  // True if the field is in network order.
+};
+
+
+// The signature of a key gathering kernel.
+using Gather_key_fn = void (*)(Byte*, Key_field const*, int);
+
+
+// Gather n fields into a 16 byte key, in order, converting each to
+// native order as needed. The key is zero-filled after the last
+// field. Bytes of fields that extend past the end of the key are
+// dropped.
+//
+// The SSSE3 variant places and reverses each field with a single
+// PSHUFB. It reads 16 bytes at a field when avail allows, and so
+// never reads past the end of a packet buffer.
+extern Kernel<Gather_key_fn> gather_key;
+
+
 } // namespace fp
+
+#endif
@@ -0,0 +1,99 @@
+#include "hash.hpp"
+
+#include <cstring>
+
+#if defined(__x86_64__)
+#  include <nmmintrin.h>
+#endif
+
+
+namespace fp
+{
+
+namespace
+{
+
+// The initial values of the two CRC lanes.
+constexpr std::uint32_t seed_lo = 0xffffffff;
+constexpr std::uint32_t seed_hi = 0x9e3779b9;
+
+// The high lane hashes each 8 byte word of the key multiplied by this
+// odd constant. A CRC is affine in its input, so a lane over the same
+// bytes from another seed would differ from the low lane by a constant
+// and add no entropy. The product is not linear over GF(2), and since
+// the constant is odd, distinct words stay distinct.
+constexpr std::uint64_t mix_hi = 0x9e3779b97f4a7c15;
+
+
+// The CRC32C (Castagnoli) lookup table, for the reflected
+// polynomial 0x82f63b78.
+struct Crc32c_table
+{
+  Crc32c_table()
+  {
+    for (std::uint32_t i = 0; i < 256; ++i) {
+      std::uint32_t c = i;
+      for (int k = 0; k < 8; ++k)
+        c = (c >> 1) ^ (0x82f63b78 & -(c & 1));
+      t[i] = c;
+    }
+  }
+
+  std::uint32_t t[256];
+};
+
+
+Crc32c_table const crc32c_table;
+
+
+inline std::uint32_t
+crc32c(std::uint32_t crc, Byte const* p, std::size_t n)
+{
+  for (std::size_t i = 0; i < n; ++i)
+    crc = crc32c_table.t[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+  return crc;
+}
+
+
+std::uint64_t
+hash_key_generic(Key const& k)
+{
+  Byte const* p = reinterpret_cast<Byte const*>(&k);
+  std::uint64_t w[2];
+  std::memcpy(w, &k, sizeof(w));
+  w[0] *= mix_hi;
+  w[1] *= mix_hi;
+  std::uint64_t lo = crc32c(seed_lo, p, sizeof(k));
+  std::uint64_t hi = crc32c(seed_hi, reinterpret_cast<Byte const*>(w), sizeof(w));
+  return (hi << 32) | lo;
+}
+
+
+#if defined(__x86_64__)
+
+// The CRC32 instruction consumes 8 bytes in memory order, so this
+// matches the bytewise computation above.
+__attribute__((target("sse4.2"))) std::uint64_t
+hash_key_sse42(Key const& k)
+{
+  std::uint64_t w[2];
+  std::memcpy(w, &k, sizeof(w));
+  std::uint64_t lo = _mm_crc32_u64(_mm_crc32_u64(seed_lo, w[0]), w[1]);
+  std::uint64_t hi = _mm_crc32_u64(_mm_crc32_u64(seed_hi, w[0] * mix_hi), w[1] * mix_hi);
+  return (hi << 32) | lo;
+}
+
+#endif
+
+} // namespace
+
+
+Kernel<Key_hash_fn> hash_key("hash_key", {
+  {Isa::generic, hash_key_generic},
+#if defined(__x86_64__)
+  {Isa::sse42, hash_key_sse42},
+#endif
+});
+
+
+} // end namespace fp
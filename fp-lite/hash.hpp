@@ -0,0 +1,37 @@
+#ifndef FP_HASH_HPP
+#define FP_HASH_HPP
+
+// Hash functions for table keys.
+//
+// Keys are hashed with CRC32C, which the SSE4.2 CRC32 instruction
+// computes at one instruction per 8 bytes. A table-driven version
+// is used on hosts without SSE4.2. Both produce the same values, so
+// processes sharing a table may run on different hosts, or with
+// different FP_ISA settings.
+
+#include "types.hpp"
+#include "cpu.hpp"
+
+
+namespace fp
+{
+
+// TODO: This is not a portable type, but most systems that we're compiling
+// on support it.
+using Key = __uint128_t;
+
+
+// The signature of a key hashing kernel.
+using Key_hash_fn = std::uint64_t (*)(Key const&);
+
+
+// Computes a 64 bit hash of a key. The low 32 bits are the CRC32C
+// of the key's bytes. The high 32 bits are the CRC32C of the key's
+// 8 byte words, each multiplied by an odd constant, so that keys
+// whose low halves collide rarely collide in the high half too.
+extern Kernel<Key_hash_fn> hash_key;
+
+
+} // end namespace fp
+
+#endif
@@ -0,0 +1,205 @@
+#include "latency.hpp"
+#include "dataplane.hpp"
+#include "port.hpp"
+
+#include <iomanip>
+#include <iostream>
+
+
+namespace fp
+{
+
+namespace
+{
+
+// Identifies each set of statistics, so that a thread's cached
+// slot is never confused with that of a destroyed set allocated at
+// the same address.
+std::atomic<unsigned> next_id(1);
+
+
+// A thread's slots in the statistics it has recorded to. Threads
+// typically record to one or two sets.
+struct Cached_slot
+{
+  unsigned id;
+  void*    slot;
+};
+
+constexpr int cache_size = 4;
+
+thread_local Cached_slot cache[cache_size];
+thread_local int         cache_next;
+
+
+} // namespace
+
+
+char const*
+to_string(Latency_stage s)
+{
+  switch (s) {
+  case lat_ingress_to_process: return "ingress->process";
+  case lat_process_to_egress: return "process->egress";
+  case lat_dwell: return "dwell";
+  default: return "unknown";
+  }
+}
+
+
+Latency_stats::Thread_slot::Thread_slot()
+  : owner(std::this_thread::get_id()), countdown(1)
+{
+  for (std::atomic<Port_latency*>& p : ports)
+    p.store(nullptr, std::memory_order_relaxed);
+}
+
+
+Latency_stats::Thread_slot::~Thread_slot()
+{
+  for (std::atomic<Port_latency*>& p : ports)
+    delete p.load(std::memory_order_relaxed);
+}
+
+
+Latency_stats::Latency_stats()
+  : id_(next_id++), period_(default_sample_period)
+{ }
+
+
+Latency_stats::~Latency_stats()
+{
+  for (Thread_slot* s : slots_)
+    delete s;
+}
+
+
+// Returns the calling thread's slot, creating it on first use. A
+// thread that records to more sets than it caches finds its slot
+// again by its thread id, so it never has more than one. The id of
+// an exited thread may be reused, in which case the new thread
+// continues in the old one's slot.
+Latency_stats::Thread_slot&
+Latency_stats::local()
+{
+  for (Cached_slot const& c : cache)
+    if (c.id == id_)
+      return *(Thread_slot*)c.slot;
+
+  Thread_slot* s = nullptr;
+  {
+    std::thread::id self = std::this_thread::get_id();
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (Thread_slot* t : slots_)
+      if (t->owner == self)
+        s = t;
+    if (!s) {
+      s = new Thread_slot();
+      slots_.push_back(s);
+    }
+  }
+  cache[cache_next] = {id_, s};
+  cache_next = (cache_next + 1) % cache_size;
+  return *s;
+}
+
+
+// Record the latency of a packet received on the given port, given
+// its ingress timestamp and the times at which it was processed and
+// sent. Histograms are allocated for a port on its first sample, and
+// published to readers with a release store.
+void
+Latency_stats::record(unsigned port, Cycles ingress, Cycles process, Cycles egress)
+{
+  if (port >= max_ports)
+    return;
+  Thread_slot& s = local();
+  Port_latency* p = s.ports[port].load(std::memory_order_relaxed);
+  if (!p) {
+    p = new Port_latency();
+    s.ports[port].store(p, std::memory_order_release);
+  }
+
+  // Packets that were not timestamped count from processing.
+  if (!ingress)
+    ingress = process;
+  p->stages[lat_ingress_to_process].record(process - ingress);
+  p->stages[lat_process_to_egress].record(egress - process);
+  p->stages[lat_dwell].record(egress - ingress);
+}
+
+
+// Merge the given port's histogram for a stage over all threads.
+void
+Latency_stats::merge(unsigned port, Latency_stage stage, ff::Histogram& h) const
+{
+  if (port >= max_ports)
+    return;
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (Thread_slot const* s : slots_)
+    if (Port_latency const* p = s->ports[port].load(std::memory_order_acquire))
+      h.merge(p->stages[stage]);
+}
+
+
+// Merge the histograms for a stage over all ports and threads.
+void
+Latency_stats::merge(Latency_stage stage, ff::Histogram& h) const
+{
+  for (unsigned i = 0; i < max_ports; ++i)
+    merge(i, stage, h);
+}
+
+
+namespace
+{
+
+void
+print_summary(std::ostream& os, char const* stage, ff::Histogram const& h)
+{
+  ff::Histogram_summary s(h);
+  auto us = [](std::uint64_t c) { return cycles_to_ns(c) / 1000.0; };
+  os << "  " << std::left << std::setw(18) << stage << std::right
+     << " p50 " << std::setw(9) << us(s.p50)
+     << " p99 " << std::setw(9) << us(s.p99)
+     << " p99.9 " << std::setw(9) << us(s.p999)
+     << " max " << std::setw(9) << us(s.max)
+     << " (" << s.count << " samples)\n";
+}
+
+} // namespace
+
+
+// Print latency percentiles, in microseconds, for each port of the
+// dataplane that has samples, and for the dataplane's application
+// as a whole.
+void
+print_latency(std::ostream& os, Dataplane const& dp)
+{
+  Latency_stats const& stats = dp.latency();
+  auto flags = os.flags();
+  os << std::fixed << std::setprecision(2);
+  for (Port const* port : dp.ports()) {
+    ff::Histogram h[lat_stage_count];
+    for (int i = 0; i < lat_stage_count; ++i)
+      stats.merge(port->id(), (Latency_stage)i, h[i]);
+    if (!h[lat_dwell].count())
+      continue;
+    os << "Latency (us) port " << port->id() << ":\n";
+    for (int i = 0; i < lat_stage_count; ++i)
+      print_summary(os, to_string((Latency_stage)i), h[i]);
+  }
+
+  ff::Histogram h[lat_stage_count];
+  for (int i = 0; i < lat_stage_count; ++i)
+    stats.merge((Latency_stage)i, h[i]);
+  if (h[lat_dwell].count()) {
+    os << "Latency (us) app " << dp.name() << ":\n";
+    for (int i = 0; i < lat_stage_count; ++i)
+      print_summary(os, to_string((Latency_stage)i), h[i]);
+  }
+  os.flags(flags);
+}
+
+
+} // namespace fp
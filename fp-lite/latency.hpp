@@ -0,0 +1,116 @@
+#ifndef FP_LATENCY_HPP
+#define FP_LATENCY_HPP
+
+// Latency measurement. The time that each packet spends in the
+// dataplane is measured from its ingress timestamp and recorded in
+// log-linear histograms, in cycles of the time stamp counter.
+//
+// Each thread records into its own histograms, so recording needs
+// no locks. Readers merge the histograms of all threads. Recording
+// costs two counter reads and three histogram updates per packet,
+// so by default only one in every 32 packets is sampled.
+
+#include "time.hpp"
+
+#include <freeflow/histogram.hpp>
+
+#include <atomic>
+#include <iosfwd>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace fp
+{
+
+class Dataplane;
+
+
+// The measured spans of a packet's time in the dataplane.
+enum Latency_stage
+{
+  lat_ingress_to_process, // From the ingress timestamp to processing.
+  lat_process_to_egress,  // From processing to sending.
+  lat_dwell,              // From the ingress timestamp to sending.
+  lat_stage_count
+};
+
+
+char const* to_string(Latency_stage);
+
+
+// The latency histograms of a dataplane, per port and per thread.
+class Latency_stats
+{
+public:
+  // Latencies are recorded for ports whose ids are less than this.
+  static constexpr int max_ports = 64;
+
+  // The default sampling period.
+  static constexpr int default_sample_period = 32;
+
+  Latency_stats();
+  ~Latency_stats();
+
+  Latency_stats(Latency_stats const&) = delete;
+  Latency_stats& operator=(Latency_stats const&) = delete;
+
+  // Record one in every n packets. When n is 0, nothing is
+  // recorded.
+  void set_sample_period(int n) { period_ = n; }
+  int  sample_period() const    { return period_; }
+
+  bool sample();
+  void record(unsigned, Cycles, Cycles, Cycles);
+
+  void merge(unsigned, Latency_stage, ff::Histogram&) const;
+  void merge(Latency_stage, ff::Histogram&) const;
+
+private:
+  struct Port_latency
+  {
+    ff::Histogram stages[lat_stage_count];
+  };
+
+  struct Thread_slot
+  {
+    Thread_slot();
+    ~Thread_slot();
+
+    std::thread::id            owner;
+    std::atomic<Port_latency*> ports[max_ports];
+    int                        countdown;
+  };
+
+  Thread_slot& local();
+
+  unsigned                  id_;
+  std::atomic<int>          period_;
+  mutable std::mutex        mutex_;
+  std::vector<Thread_slot*> slots_;
+};
+
+
+// Returns true if the calling thread should record the latency of
+// its next packet. This is a per-thread countdown.
+inline bool
+Latency_stats::sample()
+{
+  int n = period_.load(std::memory_order_relaxed);
+  if (!n)
+    return false;
+  Thread_slot& s = local();
+  if (--s.countdown > 0)
+    return false;
+  s.countdown = n;
+  return true;
+}
+
+
+void print_latency(std::ostream&, Dataplane const&);
+
+
+} // namespace fp
+
+#endif
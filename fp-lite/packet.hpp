@@ -52,7 +52,10 @@ struct Packet
   // Returns the id of the packet. 
   int id()   const { return id_; }
 
+  // Returns the time stamp counter value at which the packet
+  // arrived. See time.hpp.
   uint64_t    timestamp() const { return ts_; }
+  void        set_timestamp(uint64_t t) { ts_ = t; }
 
   void limit(int n);
 
@@ -60,7 +63,7 @@ struct Packet
   Byte*     buf_;        // Packet buffer.
   int       cap_;        // Total buffer size.
   int       len_;        // Total bytes in the packet.
-  uint64_t  ts_;  // Time of packet arrival.
+  uint64_t  ts_;         // Time of packet arrival, in cycles.
   int       id_;         // The packet id.
 };
 
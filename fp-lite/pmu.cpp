@@ -0,0 +1,194 @@
+#include "pmu.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+#if defined(__linux__)
+#  include <linux/perf_event.h>
+#  include <sys/mman.h>
+#  include <sys/syscall.h>
+#  include <unistd.h>
+#endif
+
+
+namespace fp
+{
+
+char const*
+to_string(Pmu_event e)
+{
+  switch (e) {
+  case pmu_instructions: return "instructions";
+  case pmu_llc_misses: return "llc-misses";
+  case pmu_branch_misses: return "branch-misses";
+  case pmu_dtlb_misses: return "dtlb-misses";
+  default: return "unknown";
+  }
+}
+
+
+#if defined(__linux__)
+
+namespace
+{
+
+// Returns the perf event attributes for an event.
+perf_event_attr
+attributes(Pmu_event e)
+{
+  perf_event_attr a;
+  std::memset(&a, 0, sizeof(a));
+  a.size = sizeof(a);
+  a.exclude_kernel = 1;
+  a.exclude_hv = 1;
+  switch (e) {
+  case pmu_instructions:
+    a.type = PERF_TYPE_HARDWARE;
+    a.config = PERF_COUNT_HW_INSTRUCTIONS;
+    break;
+  case pmu_llc_misses:
+    a.type = PERF_TYPE_HARDWARE;
+    a.config = PERF_COUNT_HW_CACHE_MISSES;
+    break;
+  case pmu_branch_misses:
+    a.type = PERF_TYPE_HARDWARE;
+    a.config = PERF_COUNT_HW_BRANCH_MISSES;
+    break;
+  case pmu_dtlb_misses:
+    a.type = PERF_TYPE_HW_CACHE;
+    a.config = PERF_COUNT_HW_CACHE_DTLB
+             | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+             | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    break;
+  default:
+    break;
+  }
+  return a;
+}
+
+
+#if defined(__x86_64__) || defined(__i386__)
+inline std::uint64_t
+rdpmc(unsigned c)
+{
+  unsigned lo, hi;
+  __asm__ volatile ("rdpmc" : "=a"(lo), "=d"(hi) : "c"(c));
+  return ((std::uint64_t)hi << 32) | lo;
+}
+#endif
+
+} // namespace
+
+
+// Open the counters for the calling thread.
+Pmu_counters::Pmu_counters()
+  : nopen_(0)
+{
+  long page_size = sysconf(_SC_PAGESIZE);
+  for (int i = 0; i < pmu_event_count; ++i) {
+    Counter& c = ctr_[i];
+    c.page = nullptr;
+    perf_event_attr a = attributes((Pmu_event)i);
+    c.fd = syscall(SYS_perf_event_open, &a, 0, -1, -1, 0);
+    if (c.fd < 0) {
+      if (error_.empty())
+        error_ = std::string("perf_event_open: ") + std::strerror(errno);
+      continue;
+    }
+    ++nopen_;
+
+    // The first page of the mapping tells whether the counter can
+    // be read with RDPMC, and how.
+#if defined(__x86_64__) || defined(__i386__)
+    void* p = mmap(nullptr, page_size, PROT_READ, MAP_SHARED, c.fd, 0);
+    if (p != MAP_FAILED) {
+      if (((perf_event_mmap_page*)p)->cap_user_rdpmc)
+        c.page = p;
+      else
+        munmap(p, page_size);
+    }
+#endif
+  }
+}
+
+
+Pmu_counters::~Pmu_counters()
+{
+  long page_size = sysconf(_SC_PAGESIZE);
+  for (Counter& c : ctr_) {
+    if (c.page)
+      munmap(c.page, page_size);
+    if (c.fd >= 0)
+      close(c.fd);
+  }
+}
+
+
+// Read a counter. With RDPMC, the kernel's offset is added to the
+// hardware counter, which is sign-extended from its width. The page
+// is updated under a sequence lock when the thread is rescheduled.
+std::uint64_t
+Pmu_counters::read(Counter const& c) const
+{
+  if (c.fd < 0)
+    return 0;
+#if defined(__x86_64__) || defined(__i386__)
+  if (perf_event_mmap_page const* pc = (perf_event_mmap_page const*)c.page) {
+    std::uint32_t seq;
+    std::uint64_t count;
+    do {
+      seq = pc->lock;
+      __asm__ volatile ("" ::: "memory");
+      std::uint32_t idx = pc->index;
+      count = pc->offset;
+      if (idx) {
+        int shift = 64 - pc->pmc_width;
+        std::int64_t pmc = rdpmc(idx - 1);
+        count += (pmc << shift) >> shift;
+      }
+      __asm__ volatile ("" ::: "memory");
+    } while (pc->lock != seq);
+    return count;
+  }
+#endif
+  std::uint64_t count = 0;
+  if (::read(c.fd, &count, sizeof(count)) != sizeof(count))
+    return 0;
+  return count;
+}
+
+#else
+
+Pmu_counters::Pmu_counters()
+  : nopen_(0), error_("hardware counters require Linux")
+{
+  for (Counter& c : ctr_) {
+    c.fd = -1;
+    c.page = nullptr;
+  }
+}
+
+
+Pmu_counters::~Pmu_counters()
+{ }
+
+
+std::uint64_t
+Pmu_counters::read(Counter const&) const
+{
+  return 0;
+}
+
+#endif
+
+
+// Read every event into v, which has pmu_event_count elements.
+void
+Pmu_counters::read(std::uint64_t* v) const
+{
+  for (int i = 0; i < pmu_event_count; ++i)
+    v[i] = read(ctr_[i]);
+}
+
+
+} // namespace fp
@@ -0,0 +1,71 @@
+#ifndef FP_PMU_HPP
+#define FP_PMU_HPP
+
+// Hardware performance counters. A thread opens a group of counters
+// for itself with perf_event_open, and reads them from user space
+// with the RDPMC instruction when the kernel allows it, which costs
+// tens of cycles rather than a system call.
+//
+// Counters count user-space events of the opening thread only, so
+// they are usable with the default perf_event_paranoid setting.
+
+#include "types.hpp"
+
+#include <string>
+
+
+namespace fp
+{
+
+// The counted events.
+enum Pmu_event
+{
+  pmu_instructions,
+  pmu_llc_misses,
+  pmu_branch_misses,
+  pmu_dtlb_misses,
+  pmu_event_count
+};
+
+
+char const* to_string(Pmu_event);
+
+
+// The counters of a thread. Events that the host does not support
+// are not counted, and read as 0.
+class Pmu_counters
+{
+public:
+  Pmu_counters();
+  ~Pmu_counters();
+
+  Pmu_counters(Pmu_counters const&) = delete;
+  Pmu_counters& operator=(Pmu_counters const&) = delete;
+
+  // Returns true if at least one event is counted.
+  bool is_open() const { return nopen_ > 0; }
+  bool is_open(Pmu_event e) const { return ctr_[e].fd >= 0; }
+
+  // Returns the reason that counters could not be opened.
+  std::string const& error() const { return error_; }
+
+  void read(std::uint64_t*) const;
+
+private:
+  struct Counter
+  {
+    int   fd;
+    void* page; // The event's mmap page, or null if RDPMC is unusable.
+  };
+
+  std::uint64_t read(Counter const&) const;
+
+  Counter     ctr_[pmu_event_count];
+  int         nopen_;
+  std::string error_;
+};
+
+
+} // namespace fp
+
+#endif
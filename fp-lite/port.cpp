@@ -1 +1,121 @@
 #include "port.hpp"
+
+#include <cstdlib>
+#include <new>
+
+
+namespace fp
+{
+
+char const*
+to_string(Drop_reason r)
+{
+  switch (r) {
+  case drop_no_buffer: return "no_buffer";
+  case drop_ring_full: return "ring_full";
+  case drop_link_down: return "link_down";
+  case drop_app: return "app";
+  default: return "unknown";
+  }
+}
+
+
+std::uint64_t
+Port::Statistics::total_drops() const
+{
+  std::uint64_t n = 0;
+  for (std::uint64_t d : drops)
+    n += d;
+  return n;
+}
+
+
+// Returns the average number of packets received by each receive
+// system call, or 0 if none were made.
+double
+Port::Statistics::packets_per_syscall_rx() const
+{
+  return syscalls_rx ? (double)packets_rx / syscalls_rx : 0.0;
+}
+
+
+// Returns the average number of packets sent by each send system
+// call, or 0 if none were made.
+double
+Port::Statistics::packets_per_syscall_tx() const
+{
+  return syscalls_tx ? (double)packets_tx / syscalls_tx : 0.0;
+}
+
+
+// Port constructor that sets ID. The counter blocks are allocated
+// on cache line boundaries, which operator new does not guarantee
+// for over-aligned types before C++17. Value initialization zeroes
+// the counters.
+Port::Port(Port::Id id, std::string const& name)
+  : id_(id), name_(name), config_(), state_(), ts_mode_(ts_precise),
+    link_down_(false)
+{
+  void* p;
+  if (posix_memalign(&p, alignof(Port_counters), max_thread_index * sizeof(Port_counters)))
+    throw std::bad_alloc();
+  counters_ = (Port_counters*)p;
+  for (int i = 0; i < max_thread_index; ++i)
+    new (&counters_[i]) Port_counters();
+}
+
+
+// Port dtor.
+Port::~Port()
+{
+  for (int i = 0; i < max_thread_index; ++i)
+    counters_[i].~Port_counters();
+  std::free(counters_);
+}
+
+
+// Returns the sums of the counters of all threads. The sums are
+// read while threads are counting, and so are not a consistent
+// snapshot; e.g., bytes may include a packet not yet counted.
+Port::Statistics
+Port::stats() const
+{
+  auto load = [](Port_counters::Counter const& c) { return c.load(std::memory_order_relaxed); };
+  Statistics s = {};
+  for (int i = 0; i < max_thread_index; ++i) {
+    Port_counters const& c = counters_[i];
+    s.packets_rx += load(c.packets_rx);
+    s.packets_tx += load(c.packets_tx);
+    s.bytes_rx += load(c.bytes_rx);
+    s.bytes_tx += load(c.bytes_tx);
+    for (int r = 0; r < drop_reason_count; ++r)
+      s.drops[r] += load(c.drops[r]);
+    s.partial_writes += load(c.partial_writes);
+    s.syscalls_rx += load(c.syscalls_rx);
+    s.syscalls_tx += load(c.syscalls_tx);
+  }
+  return s;
+}
+
+
+// Reset all counters. Counts made concurrently may be lost.
+void
+Port::reset_stats()
+{
+  auto zero = [](Port_counters::Counter& c) { c.store(0, std::memory_order_relaxed); };
+  for (int i = 0; i < max_thread_index; ++i) {
+    Port_counters& c = counters_[i];
+    zero(c.packets_rx);
+    zero(c.packets_tx);
+    zero(c.bytes_rx);
+    zero(c.bytes_tx);
+    for (Port_counters::Counter& d : c.drops)
+      zero(d);
+    zero(c.partial_writes);
+    zero(c.syscalls_rx);
+    zero(c.syscalls_tx);
+  }
+}
+
+
+} // namespace fp
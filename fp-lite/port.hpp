@@ -3,7 +3,10 @@
 #define FP_PORT_HPP
 
 #include "context.hpp"
+#include "time.hpp"
+#include "thread.hpp"
 
+#include <atomic>
 #include <string>
 
 
@@ -13,6 +16,47 @@ namespace fp
 
 class Context;
 
+
+// The reasons that a packet received on a port is dropped.
+enum Drop_reason
+{
+  drop_no_buffer, // No packet buffer was free.
+  drop_ring_full, // The egress queue was full.
+  drop_link_down, // The output port's link was down.
+  drop_app,       // The application dropped the packet.
+  drop_reason_count
+};
+
+
+char const* to_string(Drop_reason);
+
+
+// A thread's counters for a port. Each block is written by only one
+// thread, using plain loads and stores, and occupies its own cache
+// lines so that threads sending and receiving on the same port do
+// not contend. The exception is the block of the shared thread
+// index, which is updated atomically.
+struct alignas(64) Port_counters
+{
+  using Counter = std::atomic<std::uint64_t>;
+
+  // Add n to a counter in the calling thread's block.
+  static void add(Counter& c, std::uint64_t n = 1)
+  {
+    add_thread_counter(c, n);
+  }
+
+  Counter packets_rx;
+  Counter packets_tx;
+  Counter bytes_rx;
+  Counter bytes_tx;
+  Counter drops[drop_reason_count];
+  Counter partial_writes; // Sends that wrote only part of a packet.
+  Counter syscalls_rx;    // System calls made to receive.
+  Counter syscalls_tx;    // System calls made to send.
+};
+
+
 // The base class for any port object. Contains methods for receiving,
 // sending, and dropping packets, as well as the ability to close the
 // port and modify its configuration.
@@ -39,26 +83,47 @@ public:
 
   // A port's current state. These describe the observable state
   // of the device and cannot be modified.
+  //
+  // The link state is kept apart, since the threads that receive
+  // and send on a port may both change it.
   struct State
   {
-    bool link_down : 1;
     bool blocked   : 1;
     bool live      : 1;
   };
 
-  // Port statistics.
+  // How received packets are timestamped. Precise timestamps read
+  // the time stamp counter for every packet. Coarse timestamps use
+  // the receiving thread's coarse clock, which the driver ticks once
+  // per burst, and are off by at most the time taken to receive the
+  // burst.
+  enum Timestamp_mode { ts_precise, ts_coarse, ts_none };
+
+  // Port statistics. These are the sums of the counters of all
+  // threads.
   struct Statistics
   {
     uint64_t packets_rx;
     uint64_t packets_tx;
     uint64_t bytes_rx;
     uint64_t bytes_tx;
+    uint64_t drops[drop_reason_count];
+    uint64_t partial_writes;
+    uint64_t syscalls_rx;
+    uint64_t syscalls_tx;
+
+    uint64_t total_drops() const;
+    double   packets_per_syscall_rx() const;
+    double   packets_per_syscall_tx() const;
   };
 
   // Ctor/Dtor.
   Port(Id, std::string const& = "");
   virtual ~Port();
 
+  Port(Port const&) = delete;
+  Port& operator=(Port const&) = delete;
+
   // The set of necessary port related functions that any port-type
   // must define.
   virtual bool open() = 0;
@@ -70,7 +135,7 @@ public:
   void up();
   void down();
 
-  bool is_link_down() const  { return state_.link_down; }
+  bool is_link_down() const  { return link_down_.load(std::memory_order_acquire); }
   bool is_admin_down() const { return config_.down; }
 
   // Returns true if the port is either administratively or
@@ -82,32 +147,51 @@ public:
   bool is_up() const   { return !is_down(); }
 
 
+  void           set_timestamp_mode(Timestamp_mode m) { ts_mode_ = m; }
+  Timestamp_mode timestamp_mode() const { return ts_mode_; }
+
   // Accessors.
   Id          id() const    { return id_; }
   Label       name() const  { return name_; }
-  Statistics  stats() const { return stats_; }
+  Statistics  stats() const;
 
-protected:
-  Id              id_;        // The internal port ID.
-  Address         addr_;      // The hardware address for the port.
-  Label           name_;      // The name of the port.
-  Statistics      stats_;     // Statistical information about the port.
-  Configuration   config_;    // The current port configuration.
-  State           state_;     // The runtime state of the port.
-};
+  // Returns the calling thread's counters for the port.
+  Port_counters& counters() { return counters_[thread_index()]; }
+
+  // Count packets received on this port that were dropped.
+  void count_drop(Drop_reason r, std::uint64_t n = 1)
+  {
+    Port_counters::add(counters().drops[r], n);
+  }
 
+  void reset_stats();
 
-// Port constructor that sets ID.
-inline
-Port::Port(Port::Id id, std::string const& name)
-  : id_(id), name_(name), stats_(), config_(), state_()
-{ }
+protected:
+  void stamp(Packet&) const;
+  void set_link_down(bool b) { link_down_.store(b, std::memory_order_release); }
+
+  Id                id_;        // The internal port ID.
+  Address           addr_;      // The hardware address for the port.
+  Label             name_;      // The name of the port.
+  Port_counters*    counters_;  // Per-thread counters, by thread index.
+  Configuration     config_;    // The current port configuration.
+  State             state_;     // The runtime state of the port.
+  Timestamp_mode    ts_mode_;   // How received packets are timestamped.
+  std::atomic<bool> link_down_; // True if the link is down.
+};
 
 
-// Port dtor.
-inline
-Port::~Port()
-{ }
+// Record the arrival time of a received packet. Ports call this
+// as soon as a packet has been read.
+inline void
+Port::stamp(Packet& p) const
+{
+  switch (ts_mode_) {
+  case ts_precise: p.set_timestamp(now_cycles()); break;
+  case ts_coarse: p.set_timestamp(coarse_cycles); break;
+  case ts_none: break;
+  }
+}
 
 
 // Changes the port configuration to 'up'.
@@ -117,7 +201,7 @@ Port::up()
   config_.down = false;
 
   // FIXME: Actually reset stats?
-  stats_ = Statistics();
+  reset_stats();
 }
 
 
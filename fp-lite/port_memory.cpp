@@ -0,0 +1,54 @@
+#include "port_memory.hpp"
+#include "context.hpp"
+
+#include <cstring>
+
+
+namespace fp
+{
+
+void
+Port_memory::add_frame(Byte const* p, int n)
+{
+  offsets_.push_back(data_.size());
+  lengths_.push_back(n);
+  data_.insert(data_.end(), p, p + n);
+}
+
+
+// Copy the next frame into the packet. The thread's count of
+// received packets selects the frame. Returns false if there are
+// no frames, or if the frame does not fit in the packet.
+bool
+Port_memory::recv(Context& cxt)
+{
+  if (offsets_.empty())
+    return false;
+  Port_counters& c = counters();
+  std::size_t i = c.packets_rx.load(std::memory_order_relaxed) % offsets_.size();
+  int n = lengths_[i];
+  Packet& p = cxt.packet();
+  if (n > p.capacity())
+    return false;
+  std::memcpy(p.data(), &data_[offsets_[i]], n);
+  p.limit(n);
+  stamp(p);
+  cxt.set_input(this, this, 0);
+  Port_counters::add(c.packets_rx);
+  Port_counters::add(c.bytes_rx, n);
+  return true;
+}
+
+
+// Count the packet and discard it.
+bool
+Port_memory::send(Context& cxt)
+{
+  Port_counters& c = counters();
+  Port_counters::add(c.packets_tx);
+  Port_counters::add(c.bytes_tx, cxt.packet().length());
+  return true;
+}
+
+
+} // namespace fp
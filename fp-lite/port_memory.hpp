@@ -0,0 +1,47 @@
+#ifndef FP_PORT_MEMORY_HPP
+#define FP_PORT_MEMORY_HPP
+
+#include "port.hpp"
+
+#include <vector>
+
+
+namespace fp
+{
+
+// A port that exchanges packets with memory rather than a device,
+// for benchmarks and tests that exercise the packet path without
+// the noise of sockets and the kernel.
+//
+// The port receives by copying the next of a set of preloaded
+// frames into the packet, cycling through the frames forever. Each
+// thread has its own position in the cycle, so threads receiving
+// on the same port do not contend. Sent packets are counted and
+// discarded.
+class Port_memory : public Port
+{
+public:
+  using Port::Port;
+
+  // Add a frame to the cycle. Frames must not be added while
+  // packets are being received.
+  void add_frame(Byte const*, int);
+
+  // Returns the number of frames in the cycle.
+  std::size_t frames() const { return offsets_.size(); }
+
+  bool open() override  { return true; }
+  bool close() override { return true; }
+  bool send(Context&) override;
+  bool recv(Context&) override;
+
+private:
+  std::vector<Byte>        data_;    // The frames, back to back.
+  std::vector<std::size_t> offsets_; // The offset of each frame.
+  std::vector<int>         lengths_; // The length of each frame.
+};
+
+
+} // namespace fp
+
+#endif
@@ -1,6 +1,8 @@
 
 #include "port_tcp.hpp"
 #include "context.hpp"
+#include "profile.hpp"
+#include "trace.hpp"
 #include "types.hpp"
 
 #include <cassert>
@@ -12,63 +14,128 @@
 namespace fp
 {
 
+namespace
+{
+
+// Receive exactly n bytes into buf. Returns n on success, 0 if the
+// peer closed the connection, and -1 on error. A stream socket may
+// return fewer bytes than requested, so this loops until the entire
+// frame has been read. Otherwise, the remainder of the frame would
+// be interpreted as the next header.
+//
+// If the socket is non-blocking, this spins on EAGAIN until the
+// rest of the frame arrives. If nothing of the frame has been read
+// yet, the EAGAIN is returned to the caller instead. The frame has
+// started if an earlier call read part of it, such as its header.
+//
+// Each system call is counted in c.
+int
+recv_all(Port_tcp::Socket& sock, Byte* buf, int n, Port_counters& c, bool started)
+{
+  int rem = n;
+  while (rem != 0) {
+    int k = sock.recv(buf, rem);
+    Port_counters::add(c.syscalls_rx);
+    if (k == 0)
+      return 0;
+    if (k < 0) {
+      if (errno == EINTR || (errno == EAGAIN && (started || rem != n)))
+        continue;
+      return -1;
+    }
+    rem -= k;
+    buf += k;
+  }
+  return n;
+}
+
+
+// Send exactly n bytes from buf. Returns n on success, and -1 on
+// error. A stream socket may accept fewer bytes than requested, so
+// this loops until the range has been written. Stopping early would
+// corrupt the framing of the stream.
+//
+// If the socket is non-blocking, this spins on EAGAIN once the frame
+// has started, since the rest of it must follow. If nothing of the
+// frame has been sent yet, the EAGAIN is returned to the caller.
+//
+// Each system call is counted in c and in calls.
+int
+send_all(Port_tcp::Socket& sock, Byte const* buf, int n, Port_counters& c,
+         bool started, int& calls)
+{
+  int rem = n;
+  while (rem != 0) {
+    int k = sock.send(buf, rem);
+    Port_counters::add(c.syscalls_tx);
+    ++calls;
+    if (k < 0 && (errno == EINTR || (errno == EAGAIN && (started || rem != n))))
+      continue;
+    if (k <= 0)
+      return -1;
+    rem -= k;
+    buf += k;
+  }
+  return n;
+}
+
+
+// Count a packet that could not be sent against the port that
+// received it.
+inline void
+drop_on_input(Context const& cxt, Drop_reason r)
+{
+  if (cxt.dataplane())
+    if (Port* p = cxt.input_port())
+      p->count_drop(r);
+}
+
+} // namespace
+
+
 // Read an ethernet frame from the stream. This recv function utilizes a
 // simple protocol to establish the length of the frame being received. We
 // establish the length with a 4-byte integer value, in network byte
-// order, at the head of the message. If there is not a 4-byte header present,
-// undefined behavior ensues.
+// order, at the head of the message. Frames that exceed the capacity
+// of the packet buffer cannot be recovered from, and cause the link
+// to go down.
 bool
 Port_eth_tcp::recv(Context& cxt)
 {
+  FP_PROFILE_SCOPE(prof_recv);
   Socket& sock = socket();
   Packet& p = cxt.packet();
+  Port_counters& c = counters();
 
   // Receive the 4-byte header and nativize it.
   // If we don't receive the 4-byte header, or if we encounter an error
-  // then just give up. It's not worth trying to capture more.
+  // then just give up. It's not worth trying to capture more. The
+  // link is down if the peer closed the connection.
   std::uint32_t hdr;
-  int k1 = sock.recv((Byte*)&hdr, 4);  
-  if (k1 <= 0 || k1 != 4)
+  int k1 = recv_all(sock, (Byte*)&hdr, 4, c, false);
+  if (k1 <= 0) {
+    if (k1 == 0 || errno != EAGAIN)
+      set_link_down(true);
     return false;
+  }
   hdr = ntohl(hdr);
 
-  // Read the rest of the message.
-  //
-  // TODO: Verify that the packet has capacity for the header.
-  int k2 = sock.recv(p.data(), hdr);
-  if (k2 <= 0) {
-    if (k2 == 0)
-      return false;
+  // The stream is no longer synchronized if the frame does not fit
+  // in the packet.
+  if (hdr > (std::uint32_t)p.capacity()) {
+    set_link_down(true);
+    return false;
+  }
 
-    // TODO: If we actually get an EAGAIN, then what should we 
-    // do? Continue receiving? Fail? Not quite sure.
-    if (k2 < 0 && errno != EAGAIN) {
-      state_.link_down = true;
-      return false;
-    }
+  // Read the rest of the message. The header has been consumed, so
+  // the body must be read even if it has not arrived yet.
+  int k2 = recv_all(sock, p.data(), hdr, c, true);
+  if (k2 <= 0 && hdr != 0) {
+    set_link_down(true);
+    return false;
   }
   p.limit(hdr);
- 
-  // // Receive until recv_size bytes have been read.
-  // Byte* ptr = p.data();
-  // int32_t rem = hdr;
-  // while (rem != 0) {
-  //   int k = sock.recv(ptr, rem);
-  //   if (k <= 0) {
-  //     if (k == 0)
-  //       return false;
-  //     if (k < 0 && errno != EAGAIN) {
-  //       state_.link_down = true;
-  //       return false;
-  //     }
-  //     else
-  //       continue;
-  //   }
-  //   rem -= k;
-  //   ptr += k;
-  // }
-  // p.set_size(hdr);
-
+  stamp(p);
 
   // Set up the input context.
   //
@@ -76,8 +143,8 @@ Port_eth_tcp::recv(Context& cxt)
   cxt.set_input(this, this, 0);
 
   // Update port stats.
-  stats_.packets_rx++;
-  stats_.bytes_rx += hdr;
+  Port_counters::add(c.packets_rx);
+  Port_counters::add(c.bytes_rx, hdr);
 
   return true;
 }
@@ -87,30 +154,49 @@ Port_eth_tcp::recv(Context& cxt)
 bool
 Port_eth_tcp::send(Context& cxt)
 {
+  FP_PROFILE_SCOPE(prof_send);
   // Get the ports socket.
   Socket& sock = socket();
   
   // Get the packet from the context.
   Packet const& p = cxt.packet();
+  Port_counters& c = counters();
 
-  // Send the header size.
-  std::uint32_t hdr = ntohl(p.length());
-  int k1 = sock.send((Byte*)&hdr, 4);
-  if (k1 <= 0) {
-    state_.link_down = true;
+  // Packets sent on a down link are dropped. Like every drop, they
+  // are counted against the port that received them.
+  if (is_link_down()) {
+    drop_on_input(cxt, drop_link_down);
     return false;
   }
 
-  // Send the remainder of the packet.
-  int k2 = sock.send(p.data(), p.length());
-  if (k2 <= 0) {
-    state_.link_down = true;
+  // Send the header and then the body. Once the header has been
+  // sent, the body must follow, however many writes that takes. A
+  // packet that cannot be started because the socket buffer is full
+  // is dropped without taking the link down.
+  std::uint32_t hdr = htonl(p.length());
+  int calls = 0;
+  if (send_all(sock, (Byte const*)&hdr, 4, c, false, calls) < 0) {
+    if (errno == EAGAIN) {
+      drop_on_input(cxt, drop_ring_full);
+      return false;
+    }
+    set_link_down(true);
+    drop_on_input(cxt, drop_link_down);
+    return false;
+  }
+  if (send_all(sock, p.data(), p.length(), c, true, calls) < 0) {
+    set_link_down(true);
+    drop_on_input(cxt, drop_link_down);
     return false;
   }
+  if (calls > 2) {
+    Port_counters::add(c.partial_writes);
+    trace(trace_tx_partial, id(), calls);
+  }
 
   // Update port stats.
-  stats_.packets_tx++;
-  stats_.bytes_tx += k2;
+  Port_counters::add(c.packets_tx);
+  Port_counters::add(c.bytes_tx, p.length());
 
   return true;
 }
@@ -54,7 +54,7 @@ inline
 Port_tcp::Port_tcp(int id)
   : Port(id), sock_(ff::uninitialized)
 {
-  state_.link_down = true;
+  set_link_down(true);
 }
 
 
@@ -64,8 +64,8 @@ inline void
 Port_tcp::attach(Socket&& s)
 {
   sock_ = std::move(s);
-  stats_ = {};              // Reset stats
-  state_.link_down = false; // Put the link in up state.
+  reset_stats();            // Reset stats
+  set_link_down(false); // Put the link in up state.
 }
 
 
@@ -74,7 +74,7 @@ Port_tcp::attach(Socket&& s)
 inline Port_tcp::Socket
 Port_tcp::detach()
 {
-  state_.link_down = true;
+  set_link_down(true);
   return std::move(sock_);
 }
 
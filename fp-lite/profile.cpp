@@ -0,0 +1,203 @@
+#include "profile.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+
+namespace fp
+{
+
+std::atomic<bool> profile_enabled(false);
+std::atomic<bool> profile_pmu_enabled(false);
+
+thread_local Thread_profile thread_profile;
+
+
+namespace
+{
+
+// The totals of a stage over a set of threads.
+struct Stage_totals
+{
+  std::uint64_t cycles;
+  std::uint64_t calls;
+  std::uint64_t events[pmu_event_count];
+};
+
+
+// The registered thread profiles, and the totals of threads that
+// have exited.
+std::mutex                   profile_mutex;
+std::vector<Thread_profile*> profiles;
+Stage_totals                 retired[prof_stage_count];
+
+// True if any thread has opened hardware counters.
+std::atomic<bool> pmu_opened(false);
+
+
+void
+accumulate(Stage_totals& t, Stage_counters const& c)
+{
+  t.cycles += c.cycles.load(std::memory_order_relaxed);
+  t.calls += c.calls.load(std::memory_order_relaxed);
+  for (int i = 0; i < pmu_event_count; ++i)
+    t.events[i] += c.events[i].load(std::memory_order_relaxed);
+}
+
+} // namespace
+
+
+char const*
+to_string(Profile_stage s)
+{
+  switch (s) {
+  case prof_recv: return "recv";
+  case prof_process: return "process";
+  case prof_lookup: return "lookup";
+  case prof_apply: return "apply";
+  case prof_send: return "send";
+  default: return "unknown";
+  }
+}
+
+
+Thread_profile::Thread_profile()
+  : pmu_(nullptr), pmu_tried_(false)
+{
+  for (Stage_counters& c : stages) {
+    c.cycles.store(0, std::memory_order_relaxed);
+    c.calls.store(0, std::memory_order_relaxed);
+    for (std::atomic<std::uint64_t>& e : c.events)
+      e.store(0, std::memory_order_relaxed);
+  }
+  std::lock_guard<std::mutex> lock(profile_mutex);
+  profiles.push_back(this);
+}
+
+
+// Keep the counts of exiting threads.
+Thread_profile::~Thread_profile()
+{
+  std::lock_guard<std::mutex> lock(profile_mutex);
+  for (int i = 0; i < prof_stage_count; ++i)
+    accumulate(retired[i], stages[i]);
+  profiles.erase(std::find(profiles.begin(), profiles.end(), this));
+  delete pmu_;
+}
+
+
+// Returns the thread's hardware counters, opening them on first
+// use. Returns null if no counter can be opened. The first failure
+// is reported, and profiling continues without counters.
+Pmu_counters*
+Thread_profile::pmu()
+{
+  if (!pmu_tried_) {
+    pmu_tried_ = true;
+    Pmu_counters* p = new Pmu_counters();
+    if (p->is_open()) {
+      pmu_ = p;
+      pmu_opened = true;
+    } else {
+      static std::once_flag reported;
+      std::call_once(reported, [p]() {
+        std::cerr << "[flowpath] hardware counters unavailable: " << p->error() << '\n';
+      });
+      delete p;
+    }
+  }
+  return pmu_;
+}
+
+
+// Start or stop profiling. This has no effect unless profiling is
+// compiled in.
+void
+enable_profile(bool b)
+{
+  if (!profile_supported() && b)
+    std::cerr << "[flowpath] profiling is not compiled in; configure with -DFREEFLOW_PROFILE=ON\n";
+  profile_enabled = profile_supported() && b;
+}
+
+
+// Start or stop reading hardware counters while profiling. This
+// also starts profiling.
+void
+enable_profile_counters(bool b)
+{
+  if (b)
+    enable_profile(true);
+  profile_pmu_enabled = b;
+}
+
+
+// Print the cycles per packet of each stage, summed over all
+// threads. The number of packets is the number of calls to the
+// application. Calls per packet show how often ports are polled
+// without data, or how many lookups each packet takes.
+//
+// With hardware counters, also print the instructions per cycle
+// and the events per packet of each stage.
+void
+print_profile(std::ostream& os)
+{
+  Stage_totals t[prof_stage_count];
+  {
+    std::lock_guard<std::mutex> lock(profile_mutex);
+    for (int i = 0; i < prof_stage_count; ++i) {
+      t[i] = retired[i];
+      for (Thread_profile const* p : profiles)
+        accumulate(t[i], p->stages[i]);
+    }
+  }
+
+  std::uint64_t packets = t[prof_process].calls;
+  if (!packets) {
+    os << "Profile: no packets processed\n";
+    return;
+  }
+
+  auto flags = os.flags();
+  os << std::fixed << std::setprecision(1);
+  os << "Profile (" << packets << " packets):\n";
+  os << "  stage      cycles/pkt    calls/pkt    cycles/call\n";
+  std::uint64_t total = 0;
+  for (int i = 0; i < prof_stage_count; ++i) {
+    // Lookups are nested within processing.
+    if (i != prof_lookup)
+      total += t[i].cycles;
+    os << "  " << std::left << std::setw(8) << to_string((Profile_stage)i) << std::right
+       << std::setw(13) << (double)t[i].cycles / packets
+       << std::setw(13) << (double)t[i].calls / packets
+       << std::setw(15) << (t[i].calls ? (double)t[i].cycles / t[i].calls : 0.0) << '\n';
+  }
+  os << "  " << std::left << std::setw(8) << "total" << std::right
+     << std::setw(13) << (double)total / packets
+     << "  (" << cycles_to_ns(total / packets) << " ns/pkt)\n";
+
+  if (profile_pmu_enabled && !pmu_opened) {
+    os << "  (hardware counters unavailable)\n";
+  } else if (profile_pmu_enabled) {
+    os << std::setprecision(3);
+    os << "  stage           ipc";
+    for (int e = 0; e < pmu_event_count; ++e)
+      os << std::setw(19) << (std::string(to_string((Pmu_event)e)) + "/pkt");
+    os << '\n';
+    for (int i = 0; i < prof_stage_count; ++i) {
+      double ipc = t[i].cycles ? (double)t[i].events[pmu_instructions] / t[i].cycles : 0.0;
+      os << "  " << std::left << std::setw(8) << to_string((Profile_stage)i) << std::right
+         << std::setw(12) << ipc;
+      for (int e = 0; e < pmu_event_count; ++e)
+        os << std::setw(19) << (double)t[i].events[e] / packets;
+      os << '\n';
+    }
+  }
+  os.flags(flags);
+}
+
+
+} // namespace fp
@@ -0,0 +1,152 @@
+#ifndef FP_PROFILE_HPP
+#define FP_PROFILE_HPP
+
+// Cycle accounting for the stages of the packet pipeline. Each
+// thread accumulates the cycles spent in, and the number of calls
+// to, each stage. print_profile() reports the totals over all
+// threads as cycles per packet.
+//
+// Instrumentation is compiled in only when FP_PROFILE is defined
+// (configure with -DFREEFLOW_PROFILE=ON). Otherwise the profiling
+// macros expand to nothing. When compiled in, profiling must also
+// be enabled at runtime with enable_profile(), so that builds with
+// profiling support pay only a predictable branch per stage until
+// it is requested.
+//
+// Profiling can also read hardware performance counters at each
+// instrumentation point (see pmu.hpp), to report instructions and
+// cache, branch and TLB misses per packet for each stage.
+
+#include "time.hpp"
+#include "pmu.hpp"
+
+#include <atomic>
+#include <iosfwd>
+
+
+namespace fp
+{
+
+// The instrumented stages. Table lookups happen within application
+// processing, so their cycles are included in both stages.
+enum Profile_stage
+{
+  prof_recv,    // Port receive.
+  prof_process, // Application processing.
+  prof_lookup,  // Table key gathering and search.
+  prof_apply,   // Action application.
+  prof_send,    // Port send.
+  prof_stage_count
+};
+
+
+char const* to_string(Profile_stage);
+
+
+// The counters accumulated for a stage by one thread.
+struct Stage_counters
+{
+  std::atomic<std::uint64_t> cycles;
+  std::atomic<std::uint64_t> calls;
+  std::atomic<std::uint64_t> events[pmu_event_count];
+};
+
+
+// A thread's counters for each stage.
+struct Thread_profile
+{
+  Thread_profile();
+  ~Thread_profile();
+
+  Pmu_counters* pmu();
+
+  Stage_counters stages[prof_stage_count];
+  Pmu_counters*  pmu_;
+  bool           pmu_tried_;
+};
+
+
+extern std::atomic<bool> profile_enabled;
+extern std::atomic<bool> profile_pmu_enabled;
+extern thread_local Thread_profile thread_profile;
+
+
+// Returns true if profiling is compiled in.
+constexpr bool
+profile_supported()
+{
+#ifdef FP_PROFILE
+  return true;
+#else
+  return false;
+#endif
+}
+
+
+void enable_profile(bool);
+void enable_profile_counters(bool);
+void print_profile(std::ostream&);
+
+
+// Charges the cycles from its construction to its destruction to
+// a stage of the calling thread, along with the hardware events
+// counted in that time if those are enabled. Counters have a single
+// writer, so they are updated with plain loads and stores.
+class Profile_scope
+{
+public:
+  Profile_scope(Profile_stage s)
+    : stage_(s), start_(0), pmu_(nullptr)
+  {
+    if (!profile_enabled.load(std::memory_order_relaxed))
+      return;
+    if (profile_pmu_enabled.load(std::memory_order_relaxed)) {
+      pmu_ = thread_profile.pmu();
+      if (pmu_)
+        pmu_->read(events_);
+    }
+    start_ = now_cycles();
+  }
+
+  ~Profile_scope()
+  {
+    if (!start_)
+      return;
+    Stage_counters& c = thread_profile.stages[stage_];
+    add(c.cycles, now_cycles() - start_);
+    add(c.calls, 1);
+    if (pmu_) {
+      std::uint64_t e[pmu_event_count];
+      pmu_->read(e);
+      for (int i = 0; i < pmu_event_count; ++i)
+        add(c.events[i], e[i] - events_[i]);
+    }
+  }
+
+private:
+  static void add(std::atomic<std::uint64_t>& c, std::uint64_t n)
+  {
+    c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+
+  Profile_stage stage_;
+  Cycles        start_;
+  Pmu_counters* pmu_;
+  std::uint64_t events_[pmu_event_count];
+};
+
+
+} // namespace fp
+
+
+// Profile the remainder of the enclosing block as the given stage.
+#ifdef FP_PROFILE
+#  define FP_PROFILE_CAT_(a, b) a##b
+#  define FP_PROFILE_CAT(a, b) FP_PROFILE_CAT_(a, b)
+#  define FP_PROFILE_SCOPE(stage) \
+     ::fp::Profile_scope FP_PROFILE_CAT(fp_profile_, __LINE__)(::fp::stage)
+#else
+#  define FP_PROFILE_SCOPE(stage) ((void)0)
+#endif
+
+#endif
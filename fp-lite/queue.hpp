@@ -2,10 +2,13 @@
 #define FP_QUEUE_HPP
 
 #include <queue>
+#include <atomic>
 #include <cassert>
 #include <mutex>
 #include <shared_mutex>
 
+#include <boost/lockfree/queue.hpp>
+
 namespace fp
 {
 
@@ -117,6 +120,63 @@ Locked_queue<T>::dequeue(T& v)
 }
 
 
+// The flowpath bounded queue. This is a fixed-capacity, lock-free
+// queue that can be shared by multiple producers and consumers. A
+// push into a full queue fails instead of blocking or allocating,
+// so producers can detect congestion and apply backpressure.
+//
+// The depth of the queue is approximate. It is updated after each
+// successful push or pop, so concurrent readers may observe a value
+// that is briefly stale. That is sufficient for watermark checks.
+template <typename T, int N>
+class Bounded_queue
+{
+public:
+  Bounded_queue()
+    : queue_(), depth_(0)
+  { }
+
+  bool push(T const&);
+  bool pop(T&);
+
+  // Returns the approximate number of elements in the queue.
+  int depth() const { return depth_.load(std::memory_order_relaxed); }
+
+  // Returns the maximum number of elements in the queue.
+  static constexpr int capacity() { return N; }
+
+private:
+  boost::lockfree::queue<T, boost::lockfree::capacity<N>> queue_;
+  std::atomic<int> depth_;
+};
+
+
+// Push a copy of v into the queue. Returns false if the queue
+// is full, in which case the queue is unchanged.
+template <typename T, int N>
+inline bool
+Bounded_queue<T, N>::push(T const& v)
+{
+  if (!queue_.bounded_push(v))
+    return false;
+  depth_.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+
+// Pop the next element into v. Returns false if the queue is
+// empty.
+template <typename T, int N>
+inline bool
+Bounded_queue<T, N>::pop(T& v)
+{
+  if (!queue_.pop(v))
+    return false;
+  depth_.fetch_sub(1, std::memory_order_relaxed);
+  return true;
+}
+
+
 } // end namespace fp
 
 #endif
@@ -0,0 +1,219 @@
+#include "shm.hpp"
+
+#include <cerrno>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace fp
+{
+
+// The header at the start of every region. The allocation offset
+// is shared so that any process may allocate from the region. The
+// creator stores the magic number last, so a process that opens the
+// region knows that the header is complete once the magic is set.
+struct Shared_region::Header
+{
+  std::atomic<std::uint64_t> magic;
+  std::uint64_t              size;
+  std::atomic<std::size_t>   offset;
+};
+
+
+namespace
+{
+
+constexpr std::uint64_t region_magic = 0x66702d73686d0001; // "fp-shm" v1
+
+// How long to wait for the creator of a named region to size and
+// initialize it, in attempts 1 ms apart.
+constexpr int open_attempts = 1000;
+
+
+// Round n up to the next multiple of a, which must be a power of 2.
+inline std::size_t
+align_up(std::size_t n, std::size_t a)
+{
+  return (n + a - 1) & ~(a - 1);
+}
+
+
+[[noreturn]] inline void
+throw_error()
+{
+  throw std::system_error(errno, std::system_category());
+}
+
+} // namespace
+
+
+// -------------------------------------------------------------------------- //
+// Shared mutex
+
+Shared_mutex::Shared_mutex()
+{
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+  pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+  int err = pthread_mutex_init(&mutex_, &attr);
+  pthread_mutexattr_destroy(&attr);
+  if (err)
+    throw std::system_error(err, std::system_category());
+}
+
+
+Shared_mutex::~Shared_mutex()
+{
+  pthread_mutex_destroy(&mutex_);
+}
+
+
+// Acquire the mutex. Returns false if its previous owner died while
+// holding it. The mutex is marked consistent again, so the caller
+// is trusted to repair the protected data before unlocking it.
+bool
+Shared_mutex::lock()
+{
+  int err = pthread_mutex_lock(&mutex_);
+  if (err == EOWNERDEAD) {
+    pthread_mutex_consistent(&mutex_);
+    return false;
+  }
+  if (err)
+    throw std::system_error(err, std::system_category());
+  return true;
+}
+
+
+void
+Shared_mutex::unlock()
+{
+  pthread_mutex_unlock(&mutex_);
+}
+
+
+// -------------------------------------------------------------------------- //
+// Shared regions
+
+// Create an anonymous region of n bytes. The region is shared
+// with all processes forked after this point.
+Shared_region::Shared_region(std::size_t n)
+  : name_(), base_(nullptr), size_(n), hdr_(nullptr), owner_(true)
+{
+  map(-1);
+}
+
+
+// Create or open the named region. If the region does not exist,
+// it is created with a size of n bytes. Otherwise, the existing
+// region is mapped, and n is ignored. The creator of the region
+// removes its name when the region is destroyed.
+Shared_region::Shared_region(std::string const& name, std::size_t n)
+  : name_(name), base_(nullptr), size_(n), hdr_(nullptr), owner_(true)
+{
+  int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0) {
+    if (errno != EEXIST)
+      throw_error();
+
+    // Open the existing region and determine its size. The creator
+    // may not have sized it yet, in which case its size is 0.
+    owner_ = false;
+    fd = ::shm_open(name.c_str(), O_RDWR, 0600);
+    if (fd < 0)
+      throw_error();
+    struct stat st;
+    for (int i = 0; ; ++i) {
+      if (::fstat(fd, &st) < 0) {
+        ::close(fd);
+        throw_error();
+      }
+      if (st.st_size)
+        break;
+      if (i == open_attempts) {
+        ::close(fd);
+        throw std::runtime_error("shared memory region was never sized");
+      }
+      ::usleep(1000);
+    }
+    size_ = st.st_size;
+  }
+  else if (::ftruncate(fd, n) < 0) {
+    ::close(fd);
+    ::shm_unlink(name.c_str());
+    throw_error();
+  }
+  map(fd);
+  ::close(fd);
+}
+
+
+Shared_region::~Shared_region()
+{
+  ::munmap(base_, size_);
+  if (owner_ && !name_.empty())
+    ::shm_unlink(name_.c_str());
+}
+
+
+// Map the region backed by the given descriptor, or an anonymous
+// mapping if fd is -1. The owner initializes the header.
+void
+Shared_region::map(int fd)
+{
+  int flags = MAP_SHARED;
+  if (fd < 0)
+    flags |= MAP_ANONYMOUS;
+  base_ = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, flags, fd, 0);
+  if (base_ == MAP_FAILED)
+    throw_error();
+
+  hdr_ = (Header*)base_;
+  if (owner_) {
+    hdr_->size = size_;
+    new (&hdr_->offset) std::atomic<std::size_t>(align_up(sizeof(Header), 64));
+    hdr_->magic.store(region_magic, std::memory_order_release);
+    return;
+  }
+
+  // Wait for the creator to initialize the header.
+  for (int i = 0; hdr_->magic.load(std::memory_order_acquire) != region_magic; ++i) {
+    if (i == open_attempts) {
+      ::munmap(base_, size_);
+      throw std::runtime_error("invalid shared memory region");
+    }
+    ::usleep(1000);
+  }
+}
+
+
+// Allocate n bytes with the given alignment from the region. Throws
+// std::bad_alloc if the region is exhausted.
+void*
+Shared_region::allocate(std::size_t n, std::size_t align)
+{
+  std::size_t cur = hdr_->offset.load(std::memory_order_relaxed);
+  std::size_t first;
+  do {
+    first = align_up(cur, align);
+    if (first + n > size_)
+      throw std::bad_alloc();
+  } while (!hdr_->offset.compare_exchange_weak(cur, first + n));
+  return (char*)base_ + first;
+}
+
+
+std::size_t
+Shared_region::used() const
+{
+  return hdr_->offset.load(std::memory_order_relaxed);
+}
+
+
+} // end namespace fp
@@ -0,0 +1,258 @@
+#ifndef FP_SHM_HPP
+#define FP_SHM_HPP
+
+// The shared memory module provides the facilities needed to share
+// state between dataplane processes: a shared memory region with a
+// simple bump allocator, pointers that remain valid regardless of
+// where the region is mapped, sequence locks that allow readers to
+// proceed without writing to shared cache lines, and a mutex that
+// survives the death of the process holding it.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <string>
+#include <utility>
+
+#include <pthread.h>
+
+
+namespace fp
+{
+
+// -------------------------------------------------------------------------- //
+// Offset pointers
+
+// An offset pointer stores the distance from itself to its target
+// rather than an absolute address. When both the pointer and its
+// target live in the same shared memory region, the pointer is
+// valid in every process that maps the region, no matter where
+// it is mapped.
+//
+// An offset of 0 denotes the null pointer, so an offset pointer
+// cannot point to itself.
+template<typename T>
+class Offset_ptr
+{
+public:
+  Offset_ptr()
+    : off_(0)
+  { }
+
+  Offset_ptr(T* p)
+  {
+    set(p);
+  }
+
+  Offset_ptr(Offset_ptr const& p)
+  {
+    set(p.get());
+  }
+
+  Offset_ptr& operator=(Offset_ptr const& p)
+  {
+    set(p.get());
+    return *this;
+  }
+
+  Offset_ptr& operator=(T* p)
+  {
+    set(p);
+    return *this;
+  }
+
+  // Returns the absolute address of the target.
+  T* get() const
+  {
+    if (!off_)
+      return nullptr;
+    // The address is computed as an integer: the target is not part
+    // of the object holding the pointer, which the compiler would
+    // otherwise assume when checking accesses through it.
+    return (T*)((std::uintptr_t)this + off_);
+  }
+
+  T& operator*() const  { return *get(); }
+  T* operator->() const { return get(); }
+  T& operator[](std::ptrdiff_t n) const { return get()[n]; }
+
+  explicit operator bool() const { return off_ != 0; }
+
+private:
+  void set(T* p)
+  {
+    off_ = p ? (char const*)p - (char const*)this : 0;
+  }
+
+  std::ptrdiff_t off_;
+};
+
+
+// -------------------------------------------------------------------------- //
+// Sequence locks
+
+// A sequence lock protects data that is read frequently and written
+// rarely. The writer increments the sequence number before and after
+// modifying the data, so the number is odd while a write is in
+// progress. A reader records the sequence number, copies the data,
+// and retries if the number changed in the meantime. Readers never
+// write to the lock, so they do not contend with each other.
+//
+// Writers must be serialized by other means.
+//
+// The lock-free operations on std::atomic<unsigned> are address-free,
+// so a sequence lock may be placed in shared memory.
+class Seqlock
+{
+public:
+  Seqlock()
+    : seq_(0)
+  { }
+
+  unsigned begin_read() const;
+  bool     end_read(unsigned) const;
+
+  void begin_write();
+  void end_write();
+  void repair();
+
+private:
+  std::atomic<unsigned> seq_;
+};
+
+
+// Returns the sequence number at the start of a read. Spins while
+// a write is in progress.
+inline unsigned
+Seqlock::begin_read() const
+{
+  unsigned s;
+  while ((s = seq_.load(std::memory_order_acquire)) & 1)
+    ;
+  return s;
+}
+
+
+// Returns true if no write occurred since the read began. Otherwise,
+// the data read is inconsistent, and the read must be retried.
+inline bool
+Seqlock::end_read(unsigned s) const
+{
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return seq_.load(std::memory_order_relaxed) == s;
+}
+
+
+inline void
+Seqlock::begin_write()
+{
+  seq_.store(seq_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+}
+
+
+inline void
+Seqlock::end_write()
+{
+  seq_.store(seq_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+
+// Ends a write left in progress by a writer that died. Readers spin
+// on the lock until this is done. The caller must hold the lock that
+// serializes writers.
+inline void
+Seqlock::repair()
+{
+  unsigned s = seq_.load(std::memory_order_relaxed);
+  if (s & 1)
+    seq_.store(s + 1, std::memory_order_release);
+}
+
+
+// A mutex that can be placed in shared memory. This serializes
+// writers of seqlock-protected data across processes.
+//
+// The mutex is robust: if a process dies while holding it, the next
+// call to lock() acquires it and returns false. The data it protects
+// may then be half updated, and the caller must repair it before
+// calling unlock().
+class Shared_mutex
+{
+public:
+  Shared_mutex();
+  ~Shared_mutex();
+
+  Shared_mutex(Shared_mutex const&) = delete;
+  Shared_mutex& operator=(Shared_mutex const&) = delete;
+
+  bool lock();
+  void unlock();
+
+private:
+  pthread_mutex_t mutex_;
+};
+
+
+// -------------------------------------------------------------------------- //
+// Shared memory regions
+
+// A shared memory region is a mapping that is visible to multiple
+// processes. An anonymous region is shared with processes forked
+// after its creation. A named region is backed by a POSIX shared
+// memory object, and can be opened by unrelated processes.
+//
+// Memory is allocated sequentially from the region and is never
+// reclaimed. Shared structures are expected to be created once,
+// when the dataplane is configured.
+class Shared_region
+{
+public:
+  struct Header;
+
+  Shared_region(std::size_t);
+  Shared_region(std::string const&, std::size_t);
+  ~Shared_region();
+
+  Shared_region(Shared_region const&) = delete;
+  Shared_region& operator=(Shared_region const&) = delete;
+
+  void* allocate(std::size_t, std::size_t = alignof(std::max_align_t));
+
+  template<typename T, typename... Args>
+  T* make(Args&&...);
+
+  // Returns the base address and size of the mapping.
+  void*       base() const { return base_; }
+  std::size_t size() const { return size_; }
+
+  // Returns the number of bytes allocated from the region.
+  std::size_t used() const;
+
+  // Returns the name of the region. Anonymous regions have no name.
+  std::string const& name() const { return name_; }
+
+private:
+  void map(int);
+
+  std::string name_;
+  void*       base_;
+  std::size_t size_;
+  Header*     hdr_;
+  bool        owner_;
+};
+
+
+// Construct an object of type T in the region.
+template<typename T, typename... Args>
+inline T*
+Shared_region::make(Args&&... args)
+{
+  return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+}
+
+
+} // end namespace fp
+
+#endif
@@ -0,0 +1,377 @@
+#include "stats.hpp"
+#include "dataplane.hpp"
+#include "port.hpp"
+#include "table.hpp"
+#include "buffer.hpp"
+#include "trace.hpp"
+
+#include <freeflow/unix.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+
+namespace fp
+{
+
+namespace
+{
+
+// The JSON names of the latency stages.
+char const*
+stage_key(Latency_stage s)
+{
+  switch (s) {
+  case lat_ingress_to_process: return "ingress_to_process";
+  case lat_process_to_egress: return "process_to_egress";
+  case lat_dwell: return "dwell";
+  default: return "unknown";
+  }
+}
+
+
+char const*
+table_type(Table::Type t)
+{
+  switch (t) {
+  case Table::EXACT: return "exact";
+  case Table::PREFIX: return "prefix";
+  case Table::WILDCARD: return "wildcard";
+  default: return "unknown";
+  }
+}
+
+
+// Write a latency histogram, in nanoseconds. Buckets are written
+// as [upper bound, count] pairs, omitting empty buckets.
+void
+write_histogram(ff::json::Writer& w, ff::Histogram const& h)
+{
+  ff::Histogram_summary s(h);
+  w.begin_object();
+  w.member("count", s.count);
+  w.member("min_ns", cycles_to_ns(s.min));
+  w.member("max_ns", cycles_to_ns(s.max));
+  w.member("mean_ns", (double)cycles_to_ns((Cycles)s.mean));
+  w.member("p50_ns", cycles_to_ns(s.p50));
+  w.member("p99_ns", cycles_to_ns(s.p99));
+  w.member("p999_ns", cycles_to_ns(s.p999));
+  w.key("buckets").begin_array();
+  for (int i = 0; i < ff::Histogram::size; ++i) {
+    if (std::uint64_t n = h.bucket_count(i)) {
+      w.begin_array();
+      w.value(cycles_to_ns(ff::Histogram::upper_bound(i)));
+      w.value(n);
+      w.end_array();
+    }
+  }
+  w.end_array();
+  w.end_object();
+}
+
+
+// Write the histograms of each stage, merged by the given function.
+template<typename F>
+void
+write_stages(ff::json::Writer& w, F merge)
+{
+  w.begin_object();
+  for (int i = 0; i < lat_stage_count; ++i) {
+    ff::Histogram h;
+    merge((Latency_stage)i, h);
+    w.key(stage_key((Latency_stage)i));
+    write_histogram(w, h);
+  }
+  w.end_object();
+}
+
+
+// The time a client has to read a reply before it is dropped.
+constexpr std::chrono::milliseconds send_timeout(1000);
+
+
+// Send the entire buffer, giving up if the client stops reading.
+// Sends do not block; the server waits for room in the socket
+// buffer until the timeout, so a stalled client cannot stop it.
+void
+send_all(int fd, std::string const& s)
+{
+  using Clock = std::chrono::steady_clock;
+  Clock::time_point deadline = Clock::now() + send_timeout;
+  char const* p = s.data();
+  std::size_t n = s.size();
+  while (n) {
+    int k = ::send(fd, p, n, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (k < 0 && errno == EINTR)
+      continue;
+    if (k < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now());
+      if (left.count() <= 0)
+        return;
+      pollfd pd = {fd, POLLOUT, 0};
+      int r = poll(&pd, 1, left.count());
+      if (r == 0 || (r < 0 && errno != EINTR))
+        return;
+      continue;
+    }
+    if (k <= 0)
+      return;
+    p += k;
+    n -= k;
+  }
+}
+
+} // namespace
+
+
+// Write the statistics of a dataplane.
+void
+write_stats(ff::json::Writer& w, Dataplane const& dp)
+{
+  w.begin_object();
+  w.member("name", dp.name());
+
+  w.key("ports").begin_array();
+  for (Port const* p : dp.ports()) {
+    Port::Statistics s = p->stats();
+    w.begin_object();
+    w.member("id", p->id());
+    w.member("name", p->name());
+    w.member("link_down", p->is_link_down());
+    w.member("packets_rx", s.packets_rx);
+    w.member("packets_tx", s.packets_tx);
+    w.member("bytes_rx", s.bytes_rx);
+    w.member("bytes_tx", s.bytes_tx);
+    w.key("drops").begin_object();
+    for (int r = 0; r < drop_reason_count; ++r)
+      w.member(to_string((Drop_reason)r), s.drops[r]);
+    w.end_object();
+    w.member("partial_writes", s.partial_writes);
+    w.member("syscalls_rx", s.syscalls_rx);
+    w.member("syscalls_tx", s.syscalls_tx);
+    w.member("packets_per_syscall_rx", s.packets_per_syscall_rx());
+    w.member("packets_per_syscall_tx", s.packets_per_syscall_tx());
+    w.end_object();
+  }
+  w.end_array();
+
+  // The pool is created on first use, which must not happen here.
+  if (Pool const* p = dp.existing_pool()) {
+    w.key("pool").begin_object();
+    w.member("capacity", p->capacity());
+    w.member("available", p->available());
+    w.member("in_use", p->capacity() - p->available());
+    w.end_object();
+  }
+
+  w.key("tables").begin_array();
+  for (Table const* t : dp.tables()) {
+    w.begin_object();
+    w.member("id", t->id());
+    w.member("type", table_type(t->type()));
+    w.member("key_size", t->key_size());
+    Table::Statistics s = t->stats();
+    w.member("flows", s.flows);
+    w.member("load_factor", s.load_factor);
+    w.member("memory_bytes", s.memory);
+    w.member("lookups", s.lookups);
+    w.member("hits", s.hits);
+    w.member("misses", s.misses);
+    w.member("hit_ratio", s.hit_ratio());
+    w.member("inserts", s.inserts);
+    w.member("erases", s.erases);
+    w.member("evictions", s.evictions);
+    w.member("insert_failures", s.insert_failures);
+    w.member("probe_sample_period", probe_sample_period);
+    w.member("mean_probe_length", s.mean_probe_length());
+    w.key("probe_lengths").begin_array();
+    for (std::uint64_t n : s.probes)
+      w.value(n);
+    w.end_array();
+    w.end_object();
+  }
+  w.end_array();
+
+  Latency_stats const& lat = dp.latency();
+  w.key("latency").begin_object();
+  w.member("sample_period", lat.sample_period());
+  w.key("ports").begin_array();
+  for (Port const* p : dp.ports()) {
+    w.begin_object();
+    w.member("port", p->id());
+    w.key("stages");
+    write_stages(w, [&](Latency_stage s, ff::Histogram& h) { lat.merge(p->id(), s, h); });
+    w.end_object();
+  }
+  w.end_array();
+  w.key("app");
+  write_stages(w, [&](Latency_stage s, ff::Histogram& h) { lat.merge(s, h); });
+  w.end_object();
+
+  w.end_object();
+}
+
+
+// Write the statistics of a polling loop.
+void
+write_stats(ff::json::Writer& w, Loop_stats const& l)
+{
+  auto load = [](Loop_stats::Counter const& c) { return c.load(std::memory_order_relaxed); };
+  w.begin_object();
+  w.member("name", l.name);
+  w.member("polls", load(l.polls));
+  w.member("idle_polls", load(l.idle_polls));
+  w.member("packets", load(l.packets));
+  w.member("busy_ns", cycles_to_ns(load(l.busy_cycles)));
+  w.end_object();
+}
+
+
+// -------------------------------------------------------------------------- //
+// Stats server
+
+Stats_server::Stats_server(std::string const& path)
+  : path_(path), running_(false)
+{ }
+
+
+Stats_server::~Stats_server()
+{
+  stop();
+}
+
+
+void
+Stats_server::add_dataplane(Dataplane& dp)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  dataplanes_.push_back(&dp);
+}
+
+
+void
+Stats_server::add_loop(Loop_stats& l)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  loops_.push_back(&l);
+}
+
+
+// Bind the socket and start serving. Any existing file at the path
+// is replaced. Returns false if the socket cannot be bound.
+bool
+Stats_server::start()
+{
+  ff::Unix_socket_address addr(path_);
+  ff::Unix_stream_socket sock;
+  ff::un::unlink(addr);
+  if (!sock.listen(addr)) {
+    std::cerr << "[flowpath] cannot serve stats on " << path_ << ": "
+              << std::strerror(errno) << '\n';
+    return false;
+  }
+  running_ = true;
+  thread_ = std::thread([this](ff::Unix_stream_socket s) { serve(s.fd()); }, std::move(sock));
+  return true;
+}
+
+
+// Stop serving and remove the socket.
+void
+Stats_server::stop()
+{
+  if (!running_)
+    return;
+  running_ = false;
+  thread_.join();
+  ff::un::unlink(ff::Unix_socket_address(path_));
+}
+
+
+// Returns a snapshot of all registered statistics.
+std::string
+Stats_server::snapshot() const
+{
+  std::string s;
+  s.reserve(1 << 14);
+  ff::json::Writer w(s);
+  std::lock_guard<std::mutex> lock(mutex_);
+  w.begin_object();
+  w.member("time_ns", cycles_to_monotonic_ns(now_cycles()));
+  w.member("tsc_hz", tsc_hz());
+  w.key("dataplanes").begin_array();
+  for (Dataplane const* dp : dataplanes_)
+    write_stats(w, *dp);
+  w.end_array();
+  w.key("threads").begin_array();
+  for (Loop_stats const* l : loops_)
+    write_stats(w, *l);
+  w.end_array();
+  w.end_object();
+  return s;
+}
+
+
+// Accept connections until stopped. The listening socket is polled
+// so that stop() takes effect promptly.
+void
+Stats_server::serve(int fd)
+{
+  while (running_) {
+    pollfd p = {fd, POLLIN, 0};
+    if (poll(&p, 1, 100) <= 0)
+      continue;
+    int cd = ::accept(fd, nullptr, nullptr);
+    if (cd < 0)
+      continue;
+    respond(cd);
+    ::close(cd);
+  }
+}
+
+
+// Answer a client. A client that sends nothing within 100ms gets
+// a snapshot.
+void
+Stats_server::respond(int fd) const
+{
+  std::string cmd;
+  pollfd p = {fd, POLLIN, 0};
+  if (poll(&p, 1, 100) > 0) {
+    char buf[64];
+    int n = ::recv(fd, buf, sizeof(buf), 0);
+    if (n > 0)
+      cmd.assign(buf, n);
+  }
+  cmd.erase(std::remove_if(cmd.begin(), cmd.end(), ::isspace), cmd.end());
+
+  std::string reply;
+  if (cmd.empty() || cmd == "stats") {
+    reply = snapshot();
+  } else if (cmd == "trace") {
+    ff::json::Writer w(reply);
+    std::string path = dump_traces();
+    w.begin_object();
+    if (path.empty())
+      w.member("error", "cannot write trace dump");
+    else
+      w.member("trace", path);
+    w.end_object();
+  } else {
+    ff::json::Writer w(reply);
+    w.begin_object().member("error", "unknown command '" + cmd + "'").end_object();
+  }
+  reply += '\n';
+  send_all(fd, reply);
+}
+
+
+} // namespace fp
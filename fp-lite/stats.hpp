@@ -0,0 +1,117 @@
+#ifndef FP_STATS_HPP
+#define FP_STATS_HPP
+
+// The statistics endpoint. A stats server listens on a UNIX socket
+// and answers each connection with a JSON snapshot of the dataplanes
+// and threads registered with it: port counters, buffer pool
+// occupancy, table sizes and lookups, latency histograms, and the
+// polling loop statistics of each thread.
+//
+// Snapshots are written on the server's own thread. Dataplane
+// threads are never blocked; the counters they write are read with
+// relaxed loads, and so a snapshot is not an atomic view of all
+// counters.
+//
+// A client may send a one line command before reading the reply:
+//
+//    stats   write a snapshot (the default)
+//    trace   write the trace rings to a file and reply with its path
+//
+// e.g., `fp-stats /tmp/fp.sock` or `socat - UNIX-CONNECT:/tmp/fp.sock`.
+
+#include "time.hpp"
+
+#include <freeflow/json.hpp>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace fp
+{
+
+class Dataplane;
+
+
+// The statistics of a thread's polling loop. They are written only
+// by the thread running the loop, with plain loads and stores.
+struct Loop_stats
+{
+  using Counter = std::atomic<std::uint64_t>;
+
+  Loop_stats(std::string const& n)
+    : name(n), polls(0), idle_polls(0), packets(0), busy_cycles(0)
+  { }
+
+  void poll(std::uint64_t, Cycles);
+
+  std::string name;
+  Counter     polls;       // Iterations of the loop.
+  Counter     idle_polls;  // Iterations that found no work.
+  Counter     packets;     // Packets received.
+  Counter     busy_cycles; // Cycles spent in iterations with work.
+};
+
+
+// Count an iteration of the loop that received n packets and spent
+// the given number of cycles doing work. An iteration with neither
+// packets nor work is idle.
+inline void
+Loop_stats::poll(std::uint64_t n, Cycles busy)
+{
+  auto add = [](Counter& c, std::uint64_t k) {
+    c.store(c.load(std::memory_order_relaxed) + k, std::memory_order_relaxed);
+  };
+  add(polls, 1);
+  if (!n && !busy)
+    add(idle_polls, 1);
+  add(packets, n);
+  add(busy_cycles, busy);
+}
+
+
+// Serves statistics snapshots on a UNIX socket.
+class Stats_server
+{
+public:
+  Stats_server(std::string const&);
+  ~Stats_server();
+
+  Stats_server(Stats_server const&) = delete;
+  Stats_server& operator=(Stats_server const&) = delete;
+
+  // Register a source of statistics. Sources must outlive the
+  // server, or at least its last snapshot.
+  void add_dataplane(Dataplane&);
+  void add_loop(Loop_stats&);
+
+  bool start();
+  void stop();
+
+  std::string snapshot() const;
+
+  std::string const& path() const { return path_; }
+
+private:
+  void serve(int);
+  void respond(int) const;
+
+  std::string              path_;
+  std::thread              thread_;
+  std::atomic<bool>        running_;
+  mutable std::mutex       mutex_;
+  std::vector<Dataplane*>  dataplanes_;
+  std::vector<Loop_stats*> loops_;
+};
+
+
+void write_stats(ff::json::Writer&, Dataplane const&);
+void write_stats(ff::json::Writer&, Loop_stats const&);
+
+
+} // namespace fp
+
+#endif
@@ -4,15 +4,22 @@
 #include "endian.hpp"
 #include "context.hpp"
 #include "dataplane.hpp"
+#include "profile.hpp"
+#include "table_shared.hpp"
+#include "trace.hpp"
 
+#include <algorithm>
 #include <cassert>
+#include <cstdarg>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 
 
 namespace fp
 {
 
 // Module_table     module_table;          // Flowpath module table.
-// Dataplane_table  dataplane_table;       // Flowpath data plane table.
 // Port_table       port_table;            // Flowpath port table.
 // Thread_pool      thread_pool(0, true);  // Flowpath thread pool.
 
@@ -39,34 +46,75 @@ namespace fp
 // }
 
 
-// // Creates a new data plane and returns a pointer to it. If the
-// // name already exists it throws an exception.
-// Dataplane*
-// create_dataplane(std::string const& name, std::string const& app)
-// {
-//   // Check if a dataplane with this name already exists.
-//   if (dataplane_table.find(name) != dataplane_table.end())
-//     throw std::string("Data plane name already exists");
-//
-//   // Allocate the new data plane in the master data plane table.
-//   dataplane_table.insert({name, new Dataplane(name, app)});
-//
-//   return dataplane_table.at(name);
-// }
-//
-//
-// // Deletes the given data plane from the system data plane table.
-// void
-// delete_dataplane(std::string const& name)
-// {
-//   auto __system_dp = dataplane_table.find(name);
-//   if (__system_dp != dataplane_table.end())
-//     dataplane_table.erase(__system_dp);
-//   else
-//     throw std::string("Data plane name not in use");
-// }
-//
-//
+// The data plane registry. Data planes are owned by the registry
+// and are looked up by name.
+namespace
+{
+
+using Dataplane_table = std::unordered_map<std::string, Dataplane*>;
+
+Dataplane_table dataplane_table;
+std::mutex      dataplane_mutex;
+
+} // namespace
+
+
+// Creates a new data plane and returns a pointer to it. If the
+// name already exists it throws an exception.
+Dataplane*
+create_dataplane(std::string const& name)
+{
+  std::lock_guard<std::mutex> lock(dataplane_mutex);
+
+  // Check if a dataplane with this name already exists.
+  if (dataplane_table.find(name) != dataplane_table.end())
+    throw std::string("Data plane name already exists");
+
+  // Allocate the new data plane in the master data plane table.
+  Dataplane* dp = new Dataplane(name.c_str());
+  dataplane_table.insert({name, dp});
+  return dp;
+}
+
+
+// Returns the data plane with the given name, or nullptr if no
+// such data plane exists.
+Dataplane*
+get_dataplane(std::string const& name)
+{
+  std::lock_guard<std::mutex> lock(dataplane_mutex);
+  auto iter = dataplane_table.find(name);
+  if (iter != dataplane_table.end())
+    return iter->second;
+  return nullptr;
+}
+
+
+// Deletes the given data plane from the system data plane table.
+// Its threads are stopped and its application, if any, is taken
+// down and unloaded.
+void
+delete_dataplane(std::string const& name)
+{
+  Dataplane* dp;
+  {
+    std::lock_guard<std::mutex> lock(dataplane_mutex);
+    auto iter = dataplane_table.find(name);
+    if (iter == dataplane_table.end())
+      throw std::string("Data plane name not in use");
+    dp = iter->second;
+    dataplane_table.erase(iter);
+  }
+
+  dp->threads().halt();
+  if (dp->get_application()) {
+    dp->down();
+    dp->unload_application();
+  }
+  delete dp;
+}
+
+
 // // Loads the application at the given path. If it exists, throws a message.
 // // If the application does not exist, it creates the module and adds it to
 // // the module table.
@@ -174,12 +222,17 @@ fp_clear(fp::Context* cxt)
 void
 fp_goto_table(fp::Context* cxt, fp::Table* tbl, int n, ...)
 {
-  va_list args;
-  va_start(args, n);
-  fp::Key key = fp_gather(cxt, tbl->key_size(), n, args);
-  va_end(args);
+  fp::Flow flow;
+  {
+    FP_PROFILE_SCOPE(prof_lookup);
+    va_list args;
+    va_start(args, n);
+    fp::Key key = fp_gather(cxt, tbl->key_size(), n, args);
+    va_end(args);
+    if (!tbl->lookup(key, flow))
+      fp::trace(fp::trace_table_miss, cxt->input_port_id(), tbl->id());
+  }
 
-  fp::Flow flow = tbl->search(key);
   // execute the flow function
   flow.instr_(&flow, tbl, cxt);
 }
@@ -189,6 +242,16 @@ fp_goto_table(fp::Context* cxt, fp::Table* tbl, int n, ...)
 // Port and table operations
 
 
+// Returns the data plane with the given name, or null if there
+// is no such data plane.
+fp::Dataplane*
+fp_get_dataplane(char const* name)
+{
+  assert(name);
+  return fp::get_dataplane(name);
+}
+
+
 // Returns the port matching the given id or error otherwise.
 //
 // FIXME: This currently just verifies that id is in fact a valid
@@ -204,7 +267,7 @@ fp_get_port_by_id(fp::Dataplane* dp, unsigned int id)
 }
 
 // Returns whether or not the port is up or down
-bool
+int
 fp_port_id_is_up(fp::Dataplane* dp, fp::Port::Id id)
 {
   assert(dp);
@@ -213,7 +276,7 @@ fp_port_id_is_up(fp::Dataplane* dp, fp::Port::Id id)
 }
 
 // Returns whether or not the given id exists.
-bool
+int
 fp_port_id_is_down(fp::Dataplane* dp, fp::Port::Id id)
 {
   assert(dp);
@@ -246,8 +309,9 @@ fp_port_is_down(fp::Port* p)
 }
 
 
-// Copies the values within 'n' fields into a byte buffer
-// and constructs a key from it.
+// Copies the values within 'n' fields into a key. Packet fields
+// are converted to native order; the special input port fields are
+// already native.
 //
 // TODO: I suspect that this is fundamentally broken. Why doesn't
 // the language assemble the key -- it knows where stuff is stored.
@@ -256,65 +320,51 @@ fp::Key
 fp_gather(fp::Context* cxt, int key_width, int n, va_list args)
 {
   assert(cxt);
-  
-  // FIXME: We're using a fixed size key of 128 bytes right now
-  // apparently. This should probably be dynamic.
-  fp::Byte buf[fp::key_size];
-  
-  // Iterate through the fields given in args and copy their
-  // values into a byte buffer.
-  int i = 0;
-  int j = 0;
+
+  // FIXME: Keys are fixed at 16 bytes, and bytes of fields beyond
+  // that are dropped. Since every non-empty field takes at least
+  // one byte, no more than 16 fields can contribute.
+  constexpr int max_fields = sizeof(fp::Key);
+  fp::Key_field fs[max_fields];
   int in_port;
   int in_phy_port;
-  while (i < n) {
-    int f = va_arg(args, int);
-    fp::Binding b;
-    fp::Byte* p = nullptr;
 
-    // Check for "Special fields"
+  // Describe each field, stopping once the key is full.
+  int m = 0;
+  int j = 0;
+  for (int i = 0; i < n && j < max_fields; ++i) {
+    int f = va_arg(args, int);
+    fp::Key_field& kf = fs[m];
     switch (f) {
       // Looking for "in_port"
       case 255:
         in_port = cxt->input_port_id();
-        p = reinterpret_cast<fp::Byte*>(&in_port);
-        // Copy the field into the buffer.
-        std::copy(p, p + sizeof(in_port), &buf[j]);
-        j += sizeof(in_port);
+        kf = {(fp::Byte const*)&in_port, sizeof(in_port), sizeof(in_port), false};
         break;
 
       // Looking for "in_phys_port"
       case 256:
         in_phy_port = cxt->input_physical_port_id();
-        p = reinterpret_cast<fp::Byte*>(&in_phy_port);
-
-        // Copy the field into the buffer.
-        std::copy(p, p + sizeof(in_phy_port), &buf[j]);
-        j += sizeof(in_phy_port);
+        kf = {(fp::Byte const*)&in_phy_port, sizeof(in_phy_port), sizeof(in_phy_port), false};
         break;
 
       // Regular fields
-      default:
+      default: {
         // Lookup the field in the context.
-        b = cxt->get_field_binding(f);
-        p = cxt->get_field(b.offset);
-        
-        // Copy the field into the buffer.
-        std::copy(p, p + b.length, &buf[j]);
-        
-        // Then reverse the field in place.
-        fp::network_to_native_order(&buf[j], b.length);
-        j += b.length;
+        fp::Binding b = cxt->get_field_binding(f);
+        int avail = std::max<int>(cxt->packet().capacity() - b.offset, 0);
+        kf = {cxt->get_field(b.offset), (std::uint16_t)b.length, (std::uint16_t)std::min(avail, 0xffff), true};
         break;
+      }
+    }
+    if (kf.len) {
+      j += kf.len;
+      ++m;
     }
-    ++i;
   }
 
-  // Copy the buffer into a key.
-  //
-  // FIXME: This deals only with fixed-size keys.
   fp::Key k;
-  std::memcpy(&k, buf, sizeof(k));
+  (*fp::gather_key)((fp::Byte*)&k, fs, m);
   return k;
 }
 
@@ -331,9 +381,13 @@ fp_create_table(fp::Dataplane* dp, int id, int key_width, int size, fp::Table::T
   switch (type)
   {
     case fp::Table::Type::EXACT:
-      // Make a new hash table.
-      tbl = new fp::Hash_table(id, size, key_width);
-      dp->tables_.insert({id, tbl});
+      // Make a new hash table, in shared memory if the dataplane
+      // is shared by multiple processes.
+      if (fp::Shared_region* r = dp->shared_region())
+        tbl = new fp::Shared_hash_table(*r, id, size, key_width);
+      else
+        tbl = new fp::Hash_table(id, size, key_width);
+      dp->add_table(tbl);
       break;
     
     case fp::Table::Type::PREFIX:
@@ -448,6 +502,43 @@ fp_del_miss(fp::Table* tbl)
 }
 
 
+// Copies the statistics of the given table into stats.
+void
+fp_get_table_stats(fp::Table* tbl, fp::Table::Statistics* stats)
+{
+  assert(tbl);
+  assert(stats);
+  *stats = tbl->stats();
+}
+
+
+// Returns the number of lookups in the given table.
+unsigned long long
+fp_table_lookups(fp::Table* tbl)
+{
+  assert(tbl);
+  return tbl->stats().lookups;
+}
+
+
+// Returns the number of lookups in the given table that missed.
+unsigned long long
+fp_table_misses(fp::Table* tbl)
+{
+  assert(tbl);
+  return tbl->stats().misses;
+}
+
+
+// Resets the counters of the given table.
+void
+fp_reset_table_stats(fp::Table* tbl)
+{
+  assert(tbl);
+  tbl->reset_stats();
+}
+
+
 // Raise an event.
 //
 // TODO: Make this asynchronous on another thread. 
@@ -460,6 +551,7 @@ fp_raise_event(fp::Context* cxt, void* handler)
   // Cast the handler back to its appropriate function type
   // of void (*)(Context*)
   void (*event)(fp::Context*) = (void (*)(fp::Context*))(handler);
+  fp::trace(fp::trace_event_raised, cxt->input_port_id());
   
   // Invoke the event.
   // FIXME: This should produce a copy of the context and process it
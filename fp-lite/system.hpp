@@ -21,12 +21,12 @@ void           fp_apply(fp::Context*, fp::Action);
 void           fp_write(fp::Context*, fp::Action);
 
 // System queries.
-// fp::Dataplane* fp_get_dataplane(std::string const&);
+fp::Dataplane* fp_get_dataplane(char const*);
 fp::Key        fp_gather(fp::Context*, int, int, va_list);
 fp::Port::Id   fp_get_flow_egress(fp::Flow*);
 fp::Port::Id   fp_get_port_by_id(fp::Dataplane*, unsigned int);
-bool           fp_port_id_is_up(fp::Dataplane*, fp::Port::Id);
-bool           fp_port_id_is_down(fp::Dataplane*, fp::Port::Id);
+int            fp_port_id_is_up(fp::Dataplane*, fp::Port::Id);
+int            fp_port_id_is_down(fp::Dataplane*, fp::Port::Id);
 int            fp_port_get_id(fp::Port*);
 int            fp_port_is_up(fp::Port*);
 int            fp_port_is_down(fp::Port*);
@@ -41,6 +41,12 @@ void           fp_add_miss(fp::Table*, void*, unsigned int, unsigned int);
 void           fp_del_flow(fp::Table*, void*);
 void           fp_del_miss(fp::Table*);
 
+// Table statistics.
+void               fp_get_table_stats(fp::Table*, fp::Table::Statistics*);
+unsigned long long fp_table_lookups(fp::Table*);
+unsigned long long fp_table_misses(fp::Table*);
+void               fp_reset_table_stats(fp::Table*);
+
 // Raising events
 void           fp_raise_event(fp::Context*, void*);
 
@@ -60,8 +66,9 @@ void 	delete_port(Port::Id);
 
 // Data plane management functions.
 //
-Dataplane* create_dataplane(std::string const&, std::string const&);
-void			 delete_dataplane(std::string const&);
+Dataplane* create_dataplane(std::string const&);
+Dataplane* get_dataplane(std::string const&);
+void       delete_dataplane(std::string const&);
 
 // Application management functions.
 //
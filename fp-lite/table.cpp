@@ -1,8 +1,133 @@
 #include "table.hpp"
 
+#include <cstdlib>
+#include <new>
+
+
 namespace fp
 {
 
+// -------------------------------------------------------------------------- //
+// Table
+
+// Returns the fraction of lookups that found a flow, or 0 if there
+// were none.
+double
+Table::Statistics::hit_ratio() const
+{
+  return lookups ? (double)hits / lookups : 0.0;
+}
+
+
+// Returns the mean probe length of the sampled lookups, or 0 if
+// none were sampled. Lookups in the last bucket are counted at its
+// lower bound.
+double
+Table::Statistics::mean_probe_length() const
+{
+  std::uint64_t n = 0;
+  std::uint64_t sum = 0;
+  for (int i = 0; i < probe_histogram_size; ++i) {
+    n += probes[i];
+    sum += i * probes[i];
+  }
+  return n ? (double)sum / n : 0.0;
+}
+
+
+// Table ctor. The counter blocks are allocated on cache line
+// boundaries, as for ports.
+Table::Table(Type t, int id, int k)
+  : type_(t), id_(id), key_size_(k), miss_()
+{
+  void* p;
+  if (posix_memalign(&p, alignof(Table_counters), max_thread_index * sizeof(Table_counters)))
+    throw std::bad_alloc();
+  counters_ = (Table_counters*)p;
+  for (int i = 0; i < max_thread_index; ++i)
+    new (&counters_[i]) Table_counters();
+}
+
+
+Table::~Table()
+{
+  for (int i = 0; i < max_thread_index; ++i)
+    counters_[i].~Table_counters();
+  std::free(counters_);
+}
+
+
+// Returns the sums of the counters of all threads. As with ports,
+// the sums are not a consistent snapshot while threads are counting.
+Table::Statistics
+Table::stats() const
+{
+  auto load = [](Table_counters::Counter const& c) { return c.load(std::memory_order_relaxed); };
+  Statistics s = {};
+  for (int i = 0; i < max_thread_index; ++i) {
+    Table_counters const& c = counters_[i];
+    s.hits += load(c.hits);
+    s.misses += load(c.misses);
+    s.inserts += load(c.inserts);
+    s.erases += load(c.erases);
+    s.evictions += load(c.evictions);
+    s.insert_failures += load(c.insert_failures);
+    for (int j = 0; j < probe_histogram_size; ++j)
+      s.probes[j] += load(c.probes[j]);
+  }
+  s.lookups = s.hits + s.misses;
+  s.flows = size();
+  s.load_factor = load_factor();
+  s.memory = memory_footprint();
+  return s;
+}
+
+
+// Reset all counters. Counts made concurrently may be lost.
+void
+Table::reset_stats()
+{
+  auto zero = [](Table_counters::Counter& c) { c.store(0, std::memory_order_relaxed); };
+  for (int i = 0; i < max_thread_index; ++i) {
+    Table_counters& c = counters_[i];
+    zero(c.hits);
+    zero(c.misses);
+    zero(c.inserts);
+    zero(c.erases);
+    zero(c.evictions);
+    zero(c.insert_failures);
+    for (Table_counters::Counter& p : c.probes)
+      zero(p);
+  }
+}
+
+
+// By default, the flow is copied from the result of search(), and
+// the search is counted as a single probe.
+bool
+Table::find(Key const& k, Flow& f, int* probes) const
+{
+  Flow const& r = search(k);
+  f = r;
+  if (probes)
+    *probes = 1;
+  return &r != &miss_;
+}
+
+
+int
+Table::probe_length(Key const& k) const
+{
+  Flow f;
+  int probes = 0;
+  find(k, f, &probes);
+  return probes;
+}
+
+
+// -------------------------------------------------------------------------- //
+// Hash table
+
 // FIXME: Key's can't be user defined types.
 //
 // // Initialize the first len bytes of the key with those
@@ -44,7 +169,8 @@ Hash_table::search(Key const& k) const
 void
 Hash_table::insert(Key const& k, Flow const& f)
 {
-  Map::insert({k, f});
+  if (Map::insert({k, f}).second)
+    Table_counters::add(counters().inserts);
 }
 
 
@@ -52,7 +178,41 @@ Hash_table::insert(Key const& k, Flow const& f)
 void
 Hash_table::erase(Key const& k)
 {
-  Map::erase(k);
+  if (Map::erase(k))
+    Table_counters::add(counters().erases);
+}
+
+
+// Returns an estimate of the memory used by the bucket array and
+// the nodes, each of which holds a flow, a link and a cached hash.
+std::size_t
+Hash_table::memory_footprint() const
+{
+  return bucket_count() * sizeof(void*) +
+         Map::size() * (sizeof(Map::value_type) + sizeof(void*) + sizeof(std::size_t));
+}
+
+
+// When probes are requested, the key's bucket is walked directly
+// to count the entries examined before the match.
+bool
+Hash_table::find(Key const& k, Flow& f, int* probes) const
+{
+  if (!probes)
+    return Table::find(k, f);
+  std::size_t b = bucket(k);
+  int n = 0;
+  for (auto iter = begin(b); iter != end(b); ++iter) {
+    ++n;
+    if (iter->first == k) {
+      *probes = n;
+      f = iter->second;
+      return true;
+    }
+  }
+  *probes = n;
+  f = miss_;
+  return false;
 }
 
 } // namespace fp
@@ -4,15 +4,14 @@
 
 #include "types.hpp"
 #include "flow.hpp"
+#include "hash.hpp"
+#include "thread.hpp"
 
+#include <atomic>
 #include <cstring>
 #include <algorithm>
 #include <unordered_map>
 
-// Used for boost::hash_combine in the key hash function. This is
-// not a particularly good implementation.
-#include <boost/functional/hash.hpp>
-
 
 namespace fp
 {
@@ -68,44 +67,119 @@ constexpr size_t key_size = 128;
 
 
 
-// TODO: This is not a portable type, but most systems that we're compiling
-// on support it.
-using Key = __uint128_t;
-
-
+// Hashes keys for unordered containers. Only the low bits of the
+// result are used to select buckets, which is fine since every bit
+// of the CRC depends on every bit of the key.
 struct Key_hash
 {
-  // TODO: Cast the buffer as integers and unroll the loop.
-  // Alternatively use SSE intrinsics to parallelize the
-  // hash function.
   std::size_t operator()(Key const& k) const
   {
-    Byte const *p = reinterpret_cast<Byte const*>(&k);
-    Byte const *e = p + sizeof(k);
-    std::size_t seed = 0;
-    for ( ; p !=e; ++p)
-      boost::hash_combine(seed, *p);
-    return seed;
+    return (*hash_key)(k);
   }
 };
 
 
+// -------------------------------------------------------------------------- //
+// Table counters
+
+// The number of buckets in a table's probe length histogram. The
+// last bucket counts all longer probes.
+constexpr int probe_histogram_size = 16;
+
+// The probe length of one lookup in every probe_sample_period is
+// recorded, per thread. This must be a power of 2.
+constexpr int probe_sample_period = 64;
+
+
+// The counters of one thread's use of a table. Each thread writes
+// only its own block, so counting needs no atomic read-modify-write
+// operations and no cache line is shared between writers. Threads
+// that share the last thread index update its block atomically.
+//
+// Tables in shared memory keep their counters in each process's own
+// memory, and so count only that process's operations.
+struct alignas(64) Table_counters
+{
+  using Counter = std::atomic<std::uint64_t>;
+
+  // Add n to a counter in the calling thread's block.
+  static void add(Counter& c, std::uint64_t n = 1)
+  {
+    add_thread_counter(c, n);
+  }
+
+  Counter hits;            // Searches that found a flow.
+  Counter misses;          // Searches that returned the miss flow.
+  Counter inserts;         // Flows added.
+  Counter erases;          // Flows removed by request.
+  Counter evictions;       // Flows removed by the table itself.
+  Counter insert_failures; // Inserts rejected because the table was full.
+  Counter probes[probe_histogram_size];
+};
+
+
+// -------------------------------------------------------------------------- //
+// Tables
+
 // The abstract table interface.
 struct Table
 {
   enum Type { EXACT, PREFIX, WILDCARD };
 
-  Table(Type t, int id, int k)
-    : type_(t), id_(id), key_size_(k), miss_()
-  { }
-
-  virtual ~Table() { }
+  // The sums of the counters of all threads, and the table's current
+  // occupancy.
+  //
+  // The probe histogram counts sampled lookups by the number of slots
+  // or chained entries examined.
+  struct Statistics
+  {
+    std::uint64_t lookups;
+    std::uint64_t hits;
+    std::uint64_t misses;
+    std::uint64_t inserts;
+    std::uint64_t erases;
+    std::uint64_t evictions;
+    std::uint64_t insert_failures;
+    std::uint64_t probes[probe_histogram_size];
+    std::size_t   flows;
+    double        load_factor;
+    std::size_t   memory;
+
+    double hit_ratio() const;
+    double mean_probe_length() const;
+  };
+
+  Table(Type, int, int);
+  virtual ~Table();
+
+  Table(Table const&) = delete;
+  Table& operator=(Table const&) = delete;
 
   virtual Flow&       search(Key const&)       = 0;
   virtual Flow const& search(Key const&) const = 0;
+
+  // Copies the flow matching the key into the given flow, or the
+  // table-miss flow if there is none. Returns true if a flow matched.
+  // Unlike search(), this is safe when the table is modified
+  // concurrently by another thread or process. If probes is not null,
+  // the number of buckets or slots examined is stored there.
+  virtual bool find(Key const&, Flow&, int* probes = nullptr) const;
   
   virtual void insert(Key const&, Flow const&) = 0;
   virtual void erase(Key const&) = 0;
+
+  // Returns the number of flows in the table.
+  virtual std::size_t size() const = 0;
+
+  // Returns the ratio of flows to buckets or slots.
+  virtual double load_factor() const = 0;
+
+  // Returns the approximate number of bytes used by the table.
+  virtual std::size_t memory_footprint() const = 0;
+
+  // Returns the number of buckets or slots examined by a search for
+  // the key.
+  int probe_length(Key const&) const;
   
   void insert_miss(Flow const& f) { miss_ = f; }
   void erase_miss() { miss_ = Flow(); }
@@ -115,6 +189,12 @@ struct Table
   Flow miss()const { return miss_; }
   int  id() const { return id_; }
 
+  // Statistics.
+  Statistics      stats() const;
+  Table_counters& counters() { return counters_[thread_index()]; }
+  bool            lookup(Key const&, Flow&);
+  void            reset_stats();
+
   Type type_;
   int id_;
   int key_size_;
@@ -125,9 +205,34 @@ struct Table
   // FIXME: Some tables (notably prefix and wildcard) can locate the
   // miss rule by an actual key.
   Flow miss_;
+
+  // One block of counters for each thread index.
+  Table_counters* counters_;
 };
 
 
+// Find the flow for the given key as find() does, and count the
+// search. The probe length of every probe_sample_period'th search
+// is taken from the search itself.
+inline bool
+Table::lookup(Key const& k, Flow& f)
+{
+  Table_counters& c = counters();
+  std::uint64_t n = c.hits.load(std::memory_order_relaxed) +
+                    c.misses.load(std::memory_order_relaxed) + 1;
+  bool hit;
+  if ((n & (probe_sample_period - 1)) == 0) {
+    int probes = 0;
+    hit = find(k, f, &probes);
+    Table_counters::add(c.probes[std::min(probes, probe_histogram_size - 1)]);
+  } else {
+    hit = find(k, f);
+  }
+  Table_counters::add(hit ? c.hits : c.misses);
+  return hit;
+}
+
+
 // An exact match table.
 //
 // TODO: Use an open-address table.
@@ -150,9 +255,14 @@ struct Hash_table : Table, private std::unordered_map<Key, Flow, Key_hash>
 
   Flow&       search(Key const&) override;
   Flow const& search(Key const&) const override;
+  bool        find(Key const&, Flow&, int* = nullptr) const override;
 
   void insert(Key const&, Flow const&) override;
   void erase(Key const&) override;
+
+  std::size_t size() const override { return Map::size(); }
+  double      load_factor() const override { return Map::load_factor(); }
+  std::size_t memory_footprint() const override;
 };
 
 
@@ -0,0 +1,342 @@
+#include "table_shared.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+
+namespace fp
+{
+
+namespace
+{
+
+// Returns the smallest power of 2 that is at least n.
+inline std::uint32_t
+round_up(std::uint32_t n)
+{
+  std::uint32_t p = 1;
+  while (p < n)
+    p <<= 1;
+  return p;
+}
+
+
+// Search for the flow with key k in the table, copying it into
+// out. Returns a pointer to the copy, or nullptr if no such flow
+// exists. The number of slots examined is stored in probes.
+//
+// A match is consistent on its own, but a miss is only reliable if
+// the table was not rehashed during the search.
+Flow*
+read_flow(Shared_hash_table::Header const* hdr, Key const& k, Flow& out, int& probes)
+{
+  using Slot = Shared_hash_table::Slot;
+
+  std::uint32_t mask = hdr->capacity - 1;
+  unsigned gen;
+  do {
+    gen = hdr->seq.begin_read();
+    std::uint32_t i = Key_hash()(k) & mask;
+    probes = 0;
+    for (std::uint32_t n = 0; n <= mask; ++n, i = (i + 1) & mask) {
+      Slot const& s = hdr->slots[i];
+      Shared_hash_table::Slot_state state;
+      ++probes;
+      bool match;
+      unsigned seq;
+      do {
+        seq = s.seq.begin_read();
+        state = s.state;
+        match = state == Shared_hash_table::FULL && s.key == k;
+        if (match)
+          out = s.flow;
+      } while (!s.seq.end_read(seq));
+
+      if (match)
+        return &out;
+      if (state == Shared_hash_table::EMPTY)
+        break;
+    }
+  } while (!hdr->seq.end_read(gen));
+  return nullptr;
+}
+
+
+// Returns the slot holding the flow with key k, or nullptr if no
+// such flow exists. The slots are read without their sequence locks.
+Shared_hash_table::Slot*
+locate(Shared_hash_table::Header const* hdr, Key const& k)
+{
+  using Slot = Shared_hash_table::Slot;
+
+  std::uint32_t mask = hdr->capacity - 1;
+  std::uint32_t i = Key_hash()(k) & mask;
+  for (std::uint32_t n = 0; n <= mask; ++n, i = (i + 1) & mask) {
+    Slot& s = hdr->slots[i];
+    if (s.state == Shared_hash_table::FULL && s.key == k)
+      return &s;
+    if (s.state == Shared_hash_table::EMPTY)
+      break;
+  }
+  return nullptr;
+}
+
+// Write a flow into a slot. The state is written last, so a slot
+// whose writer dies part way is only full if its flow is whole.
+void
+fill(Shared_hash_table::Slot& s, Key const& k, Flow const& f)
+{
+  s.seq.begin_write();
+  s.key = k;
+  s.flow = f;
+  std::atomic_thread_fence(std::memory_order_release);
+  s.state = Shared_hash_table::FULL;
+  s.seq.end_write();
+}
+
+
+void
+set_state(Shared_hash_table::Slot& s, Shared_hash_table::Slot_state state)
+{
+  s.seq.begin_write();
+  s.state = state;
+  s.seq.end_write();
+}
+
+} // namespace
+
+
+// Allocate the table in the given region. The table has at least
+// twice as many slots as the requested size.
+Shared_hash_table::Shared_hash_table(Shared_region& r, int id, int size, int k)
+  : Table(Table::EXACT, id, k), hdr_(r.make<Header>())
+{
+  std::uint32_t n = round_up(std::max(2 * size, 64));
+  Slot* slots = (Slot*)r.allocate(n * sizeof(Slot), alignof(Slot));
+  for (std::uint32_t i = 0; i < n; ++i) {
+    new (&slots[i]) Slot();
+    slots[i].state = EMPTY;
+  }
+  hdr_->capacity = n;
+  hdr_->size = 0;
+  hdr_->deleted = 0;
+  hdr_->slots = slots;
+}
+
+
+// Returns a reference to the flow in its slot. If no flow matches
+// the key, the table-miss flow is returned. The reference is not
+// protected by the slot's sequence lock, so this is only safe when
+// no other process updates the table; use find() otherwise.
+Flow&
+Shared_hash_table::search(Key const& k)
+{
+  if (Slot* s = locate(hdr_, k))
+    return s->flow;
+  return miss_;
+}
+
+
+Flow const&
+Shared_hash_table::search(Key const& k) const
+{
+  if (Slot const* s = locate(hdr_, k))
+    return s->flow;
+  return miss_;
+}
+
+
+// Copies the flow under the slot's sequence lock, since the slot may
+// be modified by another process as soon as the lock is released.
+bool
+Shared_hash_table::find(Key const& k, Flow& f, int* probes) const
+{
+  int n;
+  bool hit = read_flow(hdr_, k, f, n);
+  if (probes)
+    *probes = n;
+  if (!hit)
+    f = miss_;
+  return hit;
+}
+
+
+// If an equivalent flow entry exists, no action is taken. The
+// flow is written into the first deleted slot along the probe
+// sequence, or the empty slot that terminates it.
+void
+Shared_hash_table::insert(Key const& k, Flow const& f)
+{
+  std::lock_guard<Shared_hash_table> lock(*this);
+
+  // Leave one slot empty so that failed searches terminate.
+  if (hdr_->size + 1 >= hdr_->capacity) {
+    Table_counters::add(counters().insert_failures);
+    return;
+  }
+
+  // Rehash if deleted slots could leave none empty.
+  if (hdr_->deleted && hdr_->size + hdr_->deleted + 1 >= hdr_->capacity)
+    rehash();
+
+  std::uint32_t mask = hdr_->capacity - 1;
+  std::uint32_t i = Key_hash()(k) & mask;
+  Slot* target = nullptr;
+  for (std::uint32_t n = 0; n <= mask; ++n, i = (i + 1) & mask) {
+    Slot& s = hdr_->slots[i];
+    if (s.state == FULL && s.key == k)
+      return;
+    if (s.state == DELETED && !target)
+      target = &s;
+    if (s.state == EMPTY) {
+      if (!target)
+        target = &s;
+      break;
+    }
+  }
+  if (!target) {
+    Table_counters::add(counters().insert_failures);
+    return;
+  }
+
+  if (target->state == DELETED)
+    --hdr_->deleted;
+  fill(*target, k, f);
+  ++hdr_->size;
+  Table_counters::add(counters().inserts);
+}
+
+
+// If no such entry exists, no action is taken. Erased slots are
+// marked as deleted so that probe sequences through them are not
+// broken. Once a quarter of the slots are deleted, searches through
+// them cost more than rebuilding the table, which is rehashed.
+void
+Shared_hash_table::erase(Key const& k)
+{
+  std::lock_guard<Shared_hash_table> lock(*this);
+
+  std::uint32_t mask = hdr_->capacity - 1;
+  std::uint32_t i = Key_hash()(k) & mask;
+  for (std::uint32_t n = 0; n <= mask; ++n, i = (i + 1) & mask) {
+    Slot& s = hdr_->slots[i];
+    if (s.state == EMPTY)
+      return;
+    if (s.state == FULL && s.key == k) {
+      set_state(s, DELETED);
+      --hdr_->size;
+      Table_counters::add(counters().erases);
+      if (++hdr_->deleted > hdr_->capacity / 4)
+        rehash();
+      return;
+    }
+  }
+}
+
+
+// Rebuild the probe sequences so that no slot is deleted. The
+// caller must hold the table's lock. Lookups that miss during the
+// rehash retry after it.
+//
+// Deleted slots are emptied, which may leave flows beyond them
+// unreachable, and then each such flow is moved to the first empty
+// slot after its home slot until none is left. A flow is written to
+// its new slot before its old one is cleared, so a writer that dies
+// part way loses no flow. At worst a flow is left in two slots, and
+// repeating the rehash removes the later copy.
+void
+Shared_hash_table::rehash()
+{
+  std::uint32_t mask = hdr_->capacity - 1;
+  hdr_->seq.begin_write();
+  for (std::uint32_t i = 0; i <= mask; ++i) {
+    Slot& s = hdr_->slots[i];
+    if (s.state == DELETED)
+      set_state(s, EMPTY);
+  }
+  hdr_->deleted = 0;
+
+  bool moved;
+  do {
+    moved = false;
+    for (std::uint32_t i = 0; i <= mask; ++i) {
+      Slot& s = hdr_->slots[i];
+      if (s.state != FULL)
+        continue;
+
+      // Look for an empty slot, or another copy of the flow, on the
+      // way from its home slot.
+      std::uint32_t j = Key_hash()(s.key) & mask;
+      while (j != i && hdr_->slots[j].state == FULL && hdr_->slots[j].key != s.key)
+        j = (j + 1) & mask;
+      if (j == i)
+        continue;
+      Slot& t = hdr_->slots[j];
+      if (t.state == EMPTY)
+        fill(t, s.key, s.flow);
+      else
+        --hdr_->size;
+      set_state(s, EMPTY);
+      moved = true;
+    }
+  } while (moved);
+  hdr_->seq.end_write();
+}
+
+
+// Acquire the writers' lock. If the process holding it died, the
+// table is repaired first.
+void
+Shared_hash_table::lock()
+{
+  if (!hdr_->lock.lock())
+    repair();
+}
+
+
+void
+Shared_hash_table::unlock()
+{
+  hdr_->lock.unlock();
+}
+
+
+// Finish the update of a writer that died holding the lock. Its
+// slot writes are ended, the counts are taken again, and the table
+// is rehashed, which also completes a rehash that was interrupted.
+void
+Shared_hash_table::repair()
+{
+  std::uint32_t size = 0;
+  for (std::uint32_t i = 0; i < hdr_->capacity; ++i) {
+    Slot& s = hdr_->slots[i];
+    s.seq.repair();
+    size += s.state == FULL;
+  }
+  hdr_->size = size;
+  hdr_->seq.repair();
+  rehash();
+}
+
+
+// Repair the table if a process died while updating it. Lookups
+// that meet an unfinished update wait until it is repaired, so a
+// supervisor should call this when a process sharing the table
+// exits. Otherwise, the next insert or erase does it.
+void
+Shared_hash_table::recover()
+{
+  std::lock_guard<Shared_hash_table> lock(*this);
+}
+
+
+// Returns the size of the header and slots.
+std::size_t
+Shared_hash_table::memory_footprint() const
+{
+  return sizeof(Header) + hdr_->capacity * sizeof(Slot);
+}
+
+
+} // end namespace fp
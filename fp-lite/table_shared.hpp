@@ -0,0 +1,98 @@
+#ifndef FP_TABLE_SHARED_HPP
+#define FP_TABLE_SHARED_HPP
+
+#include "table.hpp"
+#include "shm.hpp"
+
+#include <cstdint>
+
+
+namespace fp
+{
+
+// An exact match table in shared memory. This allows dataplane
+// processes to share flow tables without sharing an address space.
+//
+// The table uses open addressing with linear probing over a fixed
+// number of slots. Each slot is protected by a sequence lock, so
+// lookups never write to shared memory and only retry when they
+// race with an update to the slot being read. Updates from all
+// processes are serialized by a robust mutex in the table header.
+// If a process dies while updating the table, the next writer, or
+// a supervisor calling recover(), repairs it.
+//
+// Erased slots are marked as deleted so that probe sequences through
+// them are not broken. When too many slots are deleted, the table
+// is rehashed in place. A lookup that misses while a rehash is in
+// progress waits for it and retries, since the flow it is looking
+// for may have moved.
+//
+// Flows contain pointers to instructions in the application. Those
+// are only meaningful if all processes map the application at the
+// same address, which is the case when they are forked from a common
+// parent after the application is loaded.
+//
+// TODO: Support resizing. A full table rejects inserts, which are
+// counted as insert failures.
+struct Shared_hash_table : Table
+{
+  enum Slot_state : std::uint32_t { EMPTY, FULL, DELETED };
+
+  struct alignas(64) Slot
+  {
+    Seqlock      seq;
+    Slot_state   state;
+    Key          key;
+    Flow         flow;
+  };
+
+  struct Header
+  {
+    Shared_mutex      lock;
+    std::uint32_t     capacity; // Always a power of 2.
+    std::uint32_t     size;     // Number of full slots.
+    std::uint32_t     deleted;  // Number of deleted slots.
+    Offset_ptr<Slot>  slots;
+
+    // Written around rehashes. This is read by every lookup, and so
+    // is kept off the cache line written by updates.
+    alignas(64) Seqlock seq;
+  };
+
+  Shared_hash_table(Shared_region&, int id, int size, int k);
+
+  Flow&       search(Key const&) override;
+  Flow const& search(Key const&) const override;
+  bool        find(Key const&, Flow&, int* = nullptr) const override;
+
+  void insert(Key const&, Flow const&) override;
+  void erase(Key const&) override;
+
+  // Returns the number of flows in the table.
+  std::size_t size() const override { return hdr_->size; }
+  double      load_factor() const override { return (double)hdr_->size / hdr_->capacity; }
+  std::size_t memory_footprint() const override;
+
+  // Returns the number of slots in the table.
+  std::uint32_t capacity() const { return hdr_->capacity; }
+
+  // Repairs the table if a process died while updating it.
+  void recover();
+
+  // The writers' lock, which repairs the table when acquired from a
+  // process that died holding it.
+  void lock();
+  void unlock();
+
+  // Rebuilds the probe sequences so that no slot is deleted. The
+  // caller must hold the lock; insert and erase do this as needed.
+  void rehash();
+  void repair();
+
+  Header* hdr_;
+};
+
+
+} // end namespace fp
+
+#endif
@@ -0,0 +1,154 @@
+// Checks that port counters kept per thread sum correctly, and that
+// thread indexes are unique among running threads.
+
+#include "port.hpp"
+#include "freeflow/test/check.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace fp;
+using ff::check;
+using ff::check_status;
+
+
+// A port that counts without doing any I/O.
+class Port_counting : public Port
+{
+public:
+  using Port::Port;
+
+  bool open() override  { return true; }
+  bool close() override { return true; }
+
+  bool recv(Context&) override
+  {
+    Port_counters& c = counters();
+    Port_counters::add(c.syscalls_rx);
+    Port_counters::add(c.packets_rx);
+    Port_counters::add(c.bytes_rx, 64);
+    return true;
+  }
+
+  bool send(Context&) override
+  {
+    Port_counters& c = counters();
+    Port_counters::add(c.syscalls_tx, 2);
+    Port_counters::add(c.packets_tx);
+    Port_counters::add(c.bytes_tx, 64);
+    return true;
+  }
+};
+
+
+// Running threads have distinct indexes, and indexes are reused
+// once their threads exit.
+void
+test_thread_index()
+{
+  constexpr int n = 8;
+  int self = thread_index();
+  std::vector<int> ids(n);
+  std::vector<std::thread> ts;
+  std::atomic<int> ready(0);
+  std::atomic<bool> done(false);
+  for (int i = 0; i < n; ++i) {
+    ts.emplace_back([&, i]() {
+      ids[i] = thread_index();
+      ++ready;
+      while (!done)
+        std::this_thread::yield();
+    });
+  }
+  while (ready < n)
+    std::this_thread::yield();
+  done = true;
+  for (std::thread& t : ts)
+    t.join();
+
+  std::set<int> distinct(ids.begin(), ids.end());
+  distinct.insert(self);
+  check(distinct.size() == n + 1, "running threads have distinct indexes");
+
+  int reused = -1;
+  std::thread t([&reused]() { reused = thread_index(); });
+  t.join();
+  check(reused >= 0 && reused <= n, "indexes of exited threads are reused");
+}
+
+
+// Counts from all threads are summed.
+void
+test_sums()
+{
+  Port_counting port(1);
+  constexpr int nthreads = 4;
+  constexpr int npackets = 100000;
+  std::vector<std::thread> ts;
+  for (int i = 0; i < nthreads; ++i) {
+    ts.emplace_back([&port]() {
+      Context* cxt = nullptr;
+      for (int j = 0; j < npackets; ++j) {
+        port.recv(*cxt);
+        port.send(*cxt);
+      }
+      port.count_drop(drop_app, 3);
+    });
+  }
+  for (std::thread& t : ts)
+    t.join();
+
+  Port::Statistics s = port.stats();
+  std::uint64_t total = nthreads * npackets;
+  check(s.packets_rx == total && s.packets_tx == total, "packet counts are summed");
+  check(s.bytes_rx == total * 64 && s.bytes_tx == total * 64, "byte counts are summed");
+  check(s.drops[drop_app] == nthreads * 3 && s.total_drops() == nthreads * 3, "drops are summed");
+  check(s.packets_per_syscall_rx() == 1.0, "packets per receive call");
+  check(s.packets_per_syscall_tx() == 0.5, "packets per send call");
+
+  port.reset_stats();
+  s = port.stats();
+  check(s.packets_rx == 0 && s.syscalls_tx == 0 && s.total_drops() == 0, "reset clears all counters");
+  check(s.packets_per_syscall_rx() == 0.0, "no calls, no rate");
+}
+
+
+// Threads beyond the last index share it, and lose no counts.
+void
+test_shared_index()
+{
+  Port_counting port(1);
+  constexpr int nthreads = max_thread_index + 8;
+  constexpr int npackets = 10000;
+  std::vector<std::thread> ts;
+  std::atomic<int> ready(0);
+  for (int i = 0; i < nthreads; ++i) {
+    ts.emplace_back([&]() {
+      thread_index();
+      ++ready;
+      while (ready < nthreads)
+        std::this_thread::yield();
+      Context* cxt = nullptr;
+      for (int j = 0; j < npackets; ++j)
+        port.recv(*cxt);
+    });
+  }
+  for (std::thread& t : ts)
+    t.join();
+
+  Port::Statistics s = port.stats();
+  check(s.packets_rx == (std::uint64_t)nthreads * npackets, "threads sharing an index lose no counts");
+}
+
+
+int
+main()
+{
+  test_thread_index();
+  test_sums();
+  test_shared_index();
+  return check_status();
+}
@@ -0,0 +1,199 @@
+// Checks that table counters kept per thread sum correctly, and that
+// tables report their occupancy and probe lengths.
+
+#include "table.hpp"
+#include "table_shared.hpp"
+#include "shm.hpp"
+#include "freeflow/test/check.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace fp;
+using ff::check;
+using ff::check_status;
+
+
+// Search the table as fp_goto_table does.
+bool
+lookup(Table& t, Key k)
+{
+  Flow f;
+  return t.lookup(k, f);
+}
+
+
+// Returns the number of sampled lookups.
+std::uint64_t
+sampled(Table::Statistics const& s)
+{
+  std::uint64_t n = 0;
+  for (std::uint64_t p : s.probes)
+    n += p;
+  return n;
+}
+
+
+// Inserts and erases are counted only when they change the table,
+// and lookups are summed across threads.
+void
+test_hash_table()
+{
+  Hash_table t(1, 1024, 16);
+  for (Key k = 0; k < 100; ++k)
+    t.insert(k, Flow());
+  t.insert(0, Flow());
+  t.erase(99);
+  t.erase(1000);
+
+  constexpr int nthreads = 4;
+  constexpr int nlookups = 1000;
+  std::vector<std::thread> ts;
+  for (int i = 0; i < nthreads; ++i) {
+    ts.emplace_back([&t]() {
+      for (int j = 0; j < nlookups; ++j)
+        lookup(t, j % 200);
+    });
+  }
+  for (std::thread& th : ts)
+    th.join();
+
+  Table::Statistics s = t.stats();
+  check(s.inserts == 100, "duplicate inserts are not counted");
+  check(s.erases == 1, "erases of missing keys are not counted");
+  check(s.flows == 99, "flows");
+  check(s.lookups == nthreads * nlookups, "lookups are summed");
+  check(s.hits == nthreads * 495 && s.misses == nthreads * 505, "hits and misses");
+  check(s.hit_ratio() == 0.495, "hit ratio");
+  check(sampled(s) == nthreads * nlookups / probe_sample_period, "one lookup in each period is sampled");
+  check(s.load_factor > 0 && s.load_factor < 1, "load factor");
+  check(s.memory >= 99 * sizeof(Flow), "memory covers the flows");
+
+  t.reset_stats();
+  s = t.stats();
+  check(s.lookups == 0 && s.inserts == 0 && sampled(s) == 0, "reset clears all counters");
+  check(s.flows == 99, "reset keeps the flows");
+}
+
+
+// A full shared table counts rejected inserts, and reports probe
+// lengths in slots.
+void
+test_shared_table()
+{
+  Shared_region r(1 << 20);
+  Shared_hash_table t(r, 1, 32, 16);
+  std::uint32_t n = t.capacity();
+  for (Key k = 0; k < n; ++k)
+    t.insert(k, Flow());
+
+  Table::Statistics s = t.stats();
+  check(s.inserts == n - 1, "a full table leaves one slot empty");
+  check(s.insert_failures == 1, "rejected inserts are counted");
+  check(s.memory >= n * sizeof(Shared_hash_table::Slot), "memory covers the slots");
+
+  // Misses probe up to the only empty slot, which is a long way from
+  // most keys' home slots.
+  Key worst = n;
+  for (Key k = n; k < 2 * n; ++k)
+    if (t.probe_length(k) > t.probe_length(worst))
+      worst = k;
+  int len = t.probe_length(worst);
+  check(len > probe_histogram_size && len <= (int)n, "misses in a full table probe to the empty slot");
+
+  for (int i = 0; i < probe_sample_period; ++i)
+    lookup(t, worst);
+  s = t.stats();
+  check(s.probes[probe_histogram_size - 1] == 1, "long probes are counted in the last bucket");
+}
+
+
+// Erasing and inserting flows reclaims deleted slots, so misses still
+// stop at an empty slot and no flow is lost.
+void
+test_shared_churn()
+{
+  Shared_region r(1 << 20);
+  Shared_hash_table t(r, 1, 32, 16);
+  Key n = t.capacity();
+  for (Key k = 0; k < n / 2; ++k)
+    t.insert(k, Flow());
+  for (Key k = n / 2; k < 100 * n; ++k) {
+    t.erase(k - n / 2);
+    t.insert(k, Flow());
+  }
+  check(t.hdr_->deleted <= n / 4, "deleted slots are reclaimed");
+  check(t.size() == n / 2, "churn keeps the table size");
+
+  bool all = true;
+  Flow f;
+  for (Key k = 100 * n - n / 2; k < 100 * n; ++k)
+    all &= t.find(k, f);
+  check(all, "churn keeps the live flows");
+
+  int worst = 0;
+  for (Key k = 100 * n; k < 101 * n; ++k)
+    worst = std::max(worst, t.probe_length(k));
+  check(worst < (int)n, "misses after churn stop at an empty slot");
+}
+
+
+// A writer that dies while updating a shared table leaves it locked,
+// a rehash unfinished and a slot half written. recover() repairs the
+// table without losing a flow.
+void
+test_shared_recovery()
+{
+  Shared_region r(1 << 20);
+  Shared_hash_table t(r, 1, 32, 16);
+  Key n = t.capacity();
+  for (Key k = 0; k < n / 2; ++k)
+    t.insert(k, Flow());
+  for (Key k = 0; k < n / 8; ++k)
+    t.erase(k);
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    t.hdr_->lock.lock();
+    t.hdr_->seq.begin_write();
+    std::uint32_t last = 0;
+    for (std::uint32_t i = 0; i < n; ++i) {
+      Shared_hash_table::Slot& s = t.hdr_->slots[i];
+      if (s.state == Shared_hash_table::DELETED)
+        s.state = Shared_hash_table::EMPTY;
+      if (s.state == Shared_hash_table::FULL)
+        last = i;
+    }
+    t.hdr_->slots[last].seq.begin_write();
+    _exit(0);
+  }
+  waitpid(pid, nullptr, 0);
+  t.recover();
+
+  bool all = true;
+  Flow f;
+  for (Key k = n / 8; k < n / 2; ++k)
+    all &= t.find(k, f);
+  check(all, "recovery keeps the flows");
+  check(t.size() == n / 2 - n / 8, "recovery counts the flows");
+  check(t.hdr_->deleted == 0, "recovery finishes the rehash");
+  t.insert(n, Flow());
+  check(t.find(n, f), "the table is writable after recovery");
+}
+
+
+int
+main()
+{
+  test_hash_table();
+  test_shared_table();
+  test_shared_churn();
+  test_shared_recovery();
+  return check_status();
+}
@@ -0,0 +1,185 @@
+// Runs every variant of each dispatched kernel that the host
+// supports, and checks that it agrees with the generic variant.
+
+#include "cpu.hpp"
+#include "hash.hpp"
+#include "endian.hpp"
+#include "freeflow/test/check.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace fp;
+using ff::check;
+using ff::check_status;
+
+
+void
+check(bool ok, char const* what, Isa isa)
+{
+  check(ok, (std::string(what) + " (" + to_string(isa) + ")").c_str());
+}
+
+
+// Returns the levels at which the kernel has a variant that the
+// host can run.
+template<typename F>
+std::vector<Isa>
+runnable(Kernel<F> const& k)
+{
+  std::vector<Isa> v;
+  for (Isa i : k.isas())
+    if (isa_supported(i))
+      v.push_back(i);
+  return v;
+}
+
+
+void
+test_hash_key()
+{
+  std::mt19937_64 rng(42);
+  std::vector<Key> keys = {0, 1, ~Key(0), Key(1) << 64, Key(1) << 127};
+  for (int i = 0; i < 10000; ++i)
+    keys.push_back((Key(rng()) << 64) | rng());
+
+  Key_hash_fn ref = hash_key.variant(Isa::generic);
+  check(ref != nullptr, "hash_key has a generic variant", Isa::generic);
+  for (Isa isa : runnable(hash_key)) {
+    std::cout << "hash_key: " << to_string(isa) << '\n';
+    Key_hash_fn fn = hash_key.variant(isa);
+    bool same = true;
+    for (Key const& k : keys)
+      same &= fn(k) == ref(k);
+    check(same, "hash_key matches generic", isa);
+  }
+
+  // Distinct keys should rarely collide in the low bits.
+  std::vector<int> buckets(1 << 12);
+  for (Key const& k : keys)
+    ++buckets[ref(k) & (buckets.size() - 1)];
+  int worst = 0;
+  for (int n : buckets)
+    worst = std::max(worst, n);
+  check(worst < 16, "hash_key distributes keys", Isa::generic);
+
+  // The high half is not the low half plus a constant, which would
+  // leave it no entropy of its own.
+  auto diff = [&](Key const& k) { return (ref(k) >> 32) ^ (ref(k) & 0xffffffff); };
+  bool independent = false;
+  for (Key const& k : keys)
+    independent |= diff(k) != diff(keys[0]);
+  check(independent, "hash_key halves are independent", Isa::generic);
+}
+
+
+// Byte reversal agrees with std::reverse for every length.
+void
+test_reverse_bytes()
+{
+  for (int len = 0; len <= 32; ++len) {
+    Byte src[32], want[32], a[32], b[32];
+    for (int i = 0; i < len; ++i)
+      src[i] = a[i] = i + 1;
+    std::reverse_copy(src, src + len, want);
+    reverse_bytes(a, len);
+    copy_reversed(b, src, len);
+    check(std::equal(a, a + len, want), "reverse_bytes", Isa::generic);
+    check(std::equal(b, b + len, want), "copy_reversed", Isa::generic);
+  }
+}
+
+
+// Batch conversion loads and stores the same field of each packet.
+void
+test_batch()
+{
+  Byte p1[8] = {0, 0, 0x08, 0x00, 0, 0, 0, 0};
+  Byte p2[8] = {0, 0, 0x86, 0xdd, 0, 0, 0, 0};
+  Byte* pkts[2] = {p1, p2};
+  std::uint16_t types[2];
+  load_network_batch(pkts, 2, 2, types);
+  check(types[0] == 0x0800 && types[1] == 0x86dd, "load_network_batch", Isa::generic);
+
+  std::uint32_t addrs[2] = {0x0a000001, 0xc0a80001};
+  store_network_batch(pkts, 2, 4, addrs);
+  check(p1[4] == 10 && p1[7] == 1 && p2[4] == 192 && p2[5] == 168, "store_network_batch", Isa::generic);
+}
+
+
+// Gather random fields from a random packet, including fields at
+// the end of the buffer, fields that overrun the key, and fields
+// longer than the key.
+void
+test_gather_key()
+{
+  std::mt19937 rng(7);
+  Byte pkt[128];
+  for (Byte& b : pkt)
+    b = rng();
+
+  Gather_key_fn ref = gather_key.variant(Isa::generic);
+  std::vector<Isa> isas = runnable(gather_key);
+  for (Isa isa : isas)
+    std::cout << "gather_key: " << to_string(isa) << '\n';
+
+  for (int t = 0; t < 10000; ++t) {
+    Key_field fs[8];
+    int n = 1 + rng() % 8;
+    for (int i = 0; i < n; ++i) {
+      int len = 1 + rng() % (t % 10 ? 8 : 20);
+      int off = rng() % (sizeof(pkt) - len + 1);
+      fs[i] = {pkt + off, (std::uint16_t)len, (std::uint16_t)(sizeof(pkt) - off), (bool)(rng() & 1)};
+    }
+    Byte want[16];
+    ref(want, fs, n);
+    for (Isa isa : isas) {
+      Byte got[16];
+      gather_key.variant(isa)(got, fs, n);
+      check(std::equal(got, got + 16, want), "gather_key matches generic", isa);
+    }
+  }
+
+  // A single reversed field lands in native order.
+  Byte ip[4] = {10, 0, 0, 1};
+  Key_field f = {ip, 4, 4, true};
+  for (Isa isa : isas) {
+    Key k;
+    gather_key.variant(isa)((Byte*)&k, &f, 1);
+    check(k == 0x0a000001, "gather_key converts to native order", isa);
+  }
+}
+
+
+// Binding is capped by the requested level, and never selects a
+// variant that the host cannot run.
+void
+test_bind()
+{
+  bind_kernels(Isa::generic);
+  for (Kernel_base const* k : kernels())
+    check(k->active == Isa::generic, k->name, Isa::generic);
+
+  bind_kernels(Isa::avx512);
+  for (Kernel_base const* k : kernels())
+    check(isa_supported(k->active), k->name, k->active);
+
+  bind_kernels(max_isa());
+}
+
+
+int
+main()
+{
+  print_cpu_dispatch(std::cout);
+  test_hash_key();
+  test_reverse_bytes();
+  test_batch();
+  test_gather_key();
+  test_bind();
+  return check_status();
+}
@@ -0,0 +1,79 @@
+// Checks the calibrated time stamp counter against the system's
+// monotonic clock.
+
+#include "time.hpp"
+#include "freeflow/test/check.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <unistd.h>
+
+using namespace fp;
+using ff::check;
+using ff::check_status;
+
+
+std::uint64_t
+monotonic_ns()
+{
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (std::uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+// A measured interval agrees with the monotonic clock. The bound
+// is loose since the test may be descheduled.
+void
+test_interval()
+{
+  std::uint64_t t0 = monotonic_ns();
+  Cycles c0 = now_cycles();
+  usleep(50000);
+  std::uint64_t t1 = monotonic_ns();
+  Cycles c1 = now_cycles();
+
+  double want = t1 - t0;
+  double got = cycles_to_ns(c1 - c0);
+  std::cout << "interval: " << got << " ns (monotonic " << want << " ns)\n";
+  check(got > want * 0.95 && got < want * 1.05, "cycles_to_ns matches the monotonic clock");
+}
+
+
+// Counter values map onto the monotonic clock, before and after
+// recalibration.
+void
+test_monotonic()
+{
+  for (int i = 0; i < 2; ++i) {
+    std::uint64_t t = monotonic_ns();
+    std::uint64_t got = cycles_to_monotonic_ns(now_cycles());
+    std::int64_t err = got - t;
+    std::cout << "monotonic error: " << err << " ns\n";
+    check(err > -1000000 && err < 1000000, "cycles_to_monotonic_ns is within 1ms");
+    usleep(150000);
+    recalibrate_tsc();
+  }
+}
+
+
+void
+test_conversion()
+{
+  for (std::uint64_t ns : {1000ull, 1000000ull, 60000000000ull}) {
+    std::uint64_t back = cycles_to_ns(ns_to_cycles(ns));
+    check(back <= ns && ns - back <= 1 + ns / 1000000, "ns_to_cycles inverts cycles_to_ns");
+  }
+}
+
+
+int
+main()
+{
+  std::cout << "tsc: " << tsc_hz() / 1e9 << " GHz"
+            << (tsc_is_invariant() ? " (invariant)" : "") << '\n';
+  test_interval();
+  test_monotonic();
+  test_conversion();
+  return check_status();
+}
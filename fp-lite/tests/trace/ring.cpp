@@ -0,0 +1,147 @@
+// Checks that trace rings keep the most recent records and that
+// dumps survive a round trip through a file.
+
+#include "trace.hpp"
+#include "freeflow/test/check.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <unistd.h>
+
+using namespace fp;
+using ff::check;
+using ff::check_status;
+
+
+// Returns the records of the thread with the given id, or null.
+Trace_thread const*
+find_thread(Trace_dump const& d, int tid)
+{
+  for (Trace_thread const& t : d.threads)
+    if (t.tid == tid)
+      return &t;
+  return nullptr;
+}
+
+
+// A full ring keeps the newest records, oldest first, and counts
+// the ones it overwrote.
+void
+test_overwrite()
+{
+  Trace_ring& r = thread_trace_ring();
+  std::uint64_t base = r.head.load();
+  int n = trace_ring_size + 100;
+  for (int i = 0; i < n; ++i)
+    trace(trace_rx_burst, 1, i);
+
+  Trace_dump d = snapshot_traces();
+  Trace_thread const* t = find_thread(d, r.tid);
+  check(t != nullptr, "snapshot includes the calling thread");
+  if (!t)
+    return;
+  check(t->records.size() == trace_ring_size - 1, "a full ring holds trace_ring_size - 1 records");
+  check(t->lost == base + n - trace_ring_size + 1, "overwritten records are counted as lost");
+  check(t->records.front().arg == 101, "the oldest record follows the overwritten ones");
+  check(t->records.back().arg == (std::uint32_t)n - 1, "the newest record is last");
+  bool ordered = true;
+  for (std::size_t i = 1; i < t->records.size(); ++i)
+    ordered &= t->records[i - 1].cycles <= t->records[i].cycles;
+  check(ordered, "records are in time order");
+}
+
+
+// Each thread records into its own ring.
+void
+test_threads()
+{
+  int tid = 0;
+  std::thread th([&tid]() {
+    trace(trace_pool_low, 0, 7);
+    tid = thread_trace_ring().tid;
+    Trace_dump d = snapshot_traces();
+    Trace_thread const* t = find_thread(d, tid);
+    check(t && t->records.size() == 1 && t->records[0].event == trace_pool_low,
+          "a new thread has its own ring");
+  });
+  th.join();
+
+  Trace_dump d = snapshot_traces();
+  check(find_thread(d, tid) == nullptr, "rings of exited threads are released");
+}
+
+
+// Disabled tracing records nothing.
+void
+test_disable()
+{
+  Trace_ring& r = thread_trace_ring();
+  std::uint64_t head = r.head.load();
+  enable_trace(false);
+  trace(trace_table_miss, 2, 3);
+  enable_trace(true);
+  check(r.head.load() == head, "disabled tracing records nothing");
+}
+
+
+// A dump reads back as written.
+void
+test_round_trip()
+{
+  trace(trace_tx_partial, 3, 1200);
+  Trace_dump d = snapshot_traces();
+  std::string path = "trace-ring-test-" + std::to_string(getpid()) + ".bin";
+  check(write_traces(path, d), "write_traces succeeds");
+
+  Trace_dump e;
+  check(read_traces(path, e), "read_traces succeeds");
+  std::remove(path.c_str());
+  check(e.hz == d.hz && e.anchor_cycles == d.anchor_cycles && e.anchor_ns == d.anchor_ns,
+        "the header is preserved");
+  check(e.threads.size() == d.threads.size(), "every thread is preserved");
+  if (e.threads.size() != d.threads.size())
+    return;
+  for (std::size_t i = 0; i < d.threads.size(); ++i) {
+    Trace_thread const& a = d.threads[i];
+    Trace_thread const& b = e.threads[i];
+    check(a.tid == b.tid && a.lost == b.lost && a.records.size() == b.records.size(),
+          "thread headers are preserved");
+    bool same = a.records.size() == b.records.size();
+    for (std::size_t j = 0; same && j < a.records.size(); ++j)
+      same = a.records[j].cycles == b.records[j].cycles &&
+             a.records[j].arg == b.records[j].arg &&
+             a.records[j].event == b.records[j].event &&
+             a.records[j].port == b.records[j].port;
+    check(same, "records are preserved");
+  }
+
+  Trace_dump f;
+  check(!read_traces("/nonexistent/trace.bin", f), "read_traces fails on a missing file");
+}
+
+
+// Recording costs a few nanoseconds.
+void
+test_cost()
+{
+  constexpr int n = 1000000;
+  Cycles c0 = now_cycles();
+  for (int i = 0; i < n; ++i)
+    trace(trace_rx_burst, 1, i);
+  Cycles c1 = now_cycles();
+  std::cout << "trace: " << (double)cycles_to_ns(c1 - c0) / n << " ns/record\n";
+}
+
+
+int
+main()
+{
+  test_overwrite();
+  test_threads();
+  test_disable();
+  test_round_trip();
+  test_cost();
+  return check_status();
+}
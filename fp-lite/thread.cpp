@@ -6,6 +6,8 @@
 #include <errno.h>
 #include <cassert>
 #include <algorithm>
+#include <bitset>
+#include <mutex>
 #include <string>
 
 namespace fp
@@ -90,6 +92,166 @@ Thread::assign(int id, Routine work, Barrier* barr, Attribute* attr)
 	attr_ = attr;
 }
 
+
+// -------------------------------------------------------------------------- //
+// Thread groups
+
+// The argument passed to each thread in a group.
+struct Thread_group::Member
+{
+	Thread_group* group;
+	int           index;
+	Routine       work;
+};
+
+
+// The entry point of a thread in a group. The work function runs
+// once every thread of the group has been created.
+void*
+Thread_group::start(void* arg)
+{
+	Member* m = (Member*)arg;
+	Thread_group& g = *m->group;
+	{
+		std::unique_lock<std::mutex> lock(g.start_mutex_);
+		g.start_cv_.wait(lock, [&g]() { return g.start_state_ != starting; });
+		if (g.start_state_ == aborted)
+			return nullptr;
+	}
+	m->work(g, m->index);
+	return nullptr;
+}
+
+
+Thread_group::Thread_group()
+	: data_(nullptr), start_state_(starting)
+{ }
+
+
+// Joins any threads that are still running.
+Thread_group::~Thread_group()
+{
+	halt();
+}
+
+
+void
+Thread_group::set_cpus(std::vector<int> const& cpus)
+{
+	assert(!running());
+	cpus_ = cpus;
+}
+
+
+// Start one thread per CPU, each running the given work function.
+// Threads are pinned to their CPU before they start. Throws an
+// exception if a thread cannot be created, in which case the threads
+// already created exit without running the work function.
+void
+Thread_group::run(Routine work, void* data)
+{
+	assert(!running());
+	data_ = data;
+	start_state_ = starting;
+	for (int i = 0; i < size(); ++i) {
+		Thread::Attribute attr;
+		Thread_attribute::init(&attr);
+#if !__APPLE__
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpus_[i], &set);
+		pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+#endif
+		Member* m = new Member{this, i, work};
+		pthread_t t;
+		int res = pthread_create(&t, &attr, start, m);
+		Thread_attribute::destroy(&attr);
+		if (res != 0) {
+			delete m;
+			release(aborted);
+			halt();
+			throw std::string("failed to create thread on cpu " + std::to_string(cpus_[i]));
+		}
+		threads_.push_back(t);
+		members_.push_back(m);
+	}
+	release(started);
+}
+
+
+// Let the threads waiting in start() run the work function, or
+// return without running it.
+void
+Thread_group::release(Start s)
+{
+	{
+		std::lock_guard<std::mutex> lock(start_mutex_);
+		start_state_ = s;
+	}
+	start_cv_.notify_all();
+}
+
+
+// Wait for all threads in the group to finish. The work function
+// is expected to return when the owner signals it to stop.
+void
+Thread_group::halt()
+{
+	for (pthread_t t : threads_)
+		pthread_join(t, nullptr);
+	for (Member* m : members_)
+		delete m;
+	threads_.clear();
+	members_.clear();
+}
+
+
+// -------------------------------------------------------------------------- //
+// Thread indexes
+
+namespace
+{
+
+std::mutex                    index_mutex;
+std::bitset<max_thread_index> index_used;
+
+
+// Releases a thread's index when the thread exits.
+struct Index_holder
+{
+	~Index_holder()
+	{
+		if (index < 0)
+			return;
+		std::lock_guard<std::mutex> lock(index_mutex);
+		index_used[index] = false;
+	}
+
+	int index = -1;
+};
+
+thread_local Index_holder index_holder;
+
+} // namespace
+
+
+// Assign the lowest free index to the calling thread, or the shared
+// index if there is none. The shared index is never released.
+int
+acquire_thread_index()
+{
+	std::lock_guard<std::mutex> lock(index_mutex);
+	for (int i = 0; i < shared_thread_index; ++i) {
+		if (!index_used[i]) {
+			index_used[i] = true;
+			index_holder.index = i;
+			return i;
+		}
+	}
+	return shared_thread_index;
+}
+
+
 // Disabling thread pool for now.
 #if 0
 
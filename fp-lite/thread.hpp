@@ -2,9 +2,12 @@
 #define FP_THREAD_HPP
 
 #include "queue.hpp"
-#include "application.hpp"
 
 #include <pthread.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
 #include <vector>
 
 
@@ -113,6 +116,98 @@ destroy(Thread::Attribute* attr)
 
 } // end namespace Thread_attribute
 
+
+// A group of threads that run the same work function, each pinned
+// to its own CPU. A dataplane owns a thread group so that several
+// dataplanes in one process can run on disjoint sets of cores.
+//
+// The work function receives the group and the index of the
+// calling thread within it. The group's data pointer is available
+// to the work function through data().
+class Thread_group
+{
+public:
+	using Routine = void (*)(Thread_group&, int);
+
+	struct Member;
+
+	Thread_group();
+	~Thread_group();
+
+	Thread_group(Thread_group const&) = delete;
+	Thread_group& operator=(Thread_group const&) = delete;
+
+	// Set the CPUs on which the group runs. There is one thread
+	// per CPU. This must not be called while the group is running.
+	void set_cpus(std::vector<int> const&);
+
+	void run(Routine, void* = nullptr);
+	void halt();
+
+	// Accessors.
+	int                     size() const    { return cpus_.size(); }
+	std::vector<int> const& cpus() const    { return cpus_; }
+	void*                   data() const    { return data_; }
+	bool                    running() const { return !threads_.empty(); }
+
+private:
+	// Threads wait for every member to be created before they run the
+	// work function, so that a failed run can stop them.
+	enum Start { starting, started, aborted };
+
+	static void* start(void*);
+	void         release(Start);
+
+	std::vector<int>       cpus_;
+	std::vector<pthread_t> threads_;
+	std::vector<Member*>   members_;
+	void*                  data_;
+
+	std::mutex              start_mutex_;
+	std::condition_variable start_cv_;
+	Start                   start_state_;
+};
+
+// -------------------------------------------------------------------------- //
+// Thread indexes
+
+// Each running thread that asks for one is given a small index,
+// which selects its block in per-thread counter arrays. Indexes are
+// reused after their thread exits.
+constexpr int max_thread_index = 64;
+
+// The last index is never given to a single thread. It is shared by
+// the threads that find every other index in use.
+constexpr int shared_thread_index = max_thread_index - 1;
+
+int acquire_thread_index();
+
+
+// Returns the calling thread's index.
+inline int
+thread_index()
+{
+	static thread_local int index = -1;
+	if (index < 0)
+		index = acquire_thread_index();
+	return index;
+}
+
+
+// Add n to a counter in the calling thread's block of a per-thread
+// counter array. A thread with an index of its own is the only writer
+// of its block, so it needs no atomic read-modify-write. Threads that
+// share the last index add atomically.
+inline void
+add_thread_counter(std::atomic<std::uint64_t>& c, std::uint64_t n)
+{
+	if (thread_index() == shared_thread_index)
+		c.fetch_add(n, std::memory_order_relaxed);
+	else
+		c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+
 // Disabling thread pool for now.
 #if 0
 
@@ -1,18 +1,230 @@
 #include "time.hpp"
+#include "shm.hpp"
 
-#include <chrono>
+#include <iostream>
+#include <mutex>
+
+#if defined(__x86_64__) || defined(__i386__)
+#  include <cpuid.h>
+#endif
 
 namespace fp
 {
 
-using namespace std::chrono;
+std::atomic<std::uint64_t> tsc_mult(0);
+
+thread_local Cycles coarse_cycles;
+
+
+namespace
+{
+
+// A simultaneous reading of both clocks.
+struct Sample
+{
+  Cycles        cycles;
+  std::uint64_t ns;
+};
+
+
+inline std::uint64_t
+monotonic_ns()
+{
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (std::uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+// Read both clocks. The counter is read before and after the
+// system clock, and the narrowest of several tries is kept, so
+// that an interrupt does not skew the sample.
+Sample
+sample()
+{
+  Sample s = {};
+  Cycles best = ~Cycles(0);
+  for (int i = 0; i < 8; ++i) {
+    Cycles c1 = now_cycles();
+    std::uint64_t ns = monotonic_ns();
+    Cycles c2 = now_cycles();
+    if (c2 - c1 < best) {
+      best = c2 - c1;
+      s.cycles = c1 + (c2 - c1) / 2;
+      s.ns = ns;
+    }
+  }
+  return s;
+}
+
+
+// The calibration state. The origin is the first sample, and the
+// anchor is the most recent one. The frequency is estimated over
+// the whole span since the origin, so it gets more precise with
+// each recalibration. The anchor, frequency and multiplier are
+// published together under a sequence lock.
+struct Calibration
+{
+  Calibration();
+
+  void update(Sample const&);
+
+  Sample     origin;
+  Sample     anchor;
+  double     hz;
+  bool       invariant;
+  Seqlock    seq;
+  std::mutex mutex;
+};
+
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// The invariant TSC flag is bit 8 of EDX in CPUID leaf 0x80000007.
+bool
+detect_invariant()
+{
+  unsigned a, b, c, d;
+  if (!__get_cpuid(0x80000007, &a, &b, &c, &d))
+    return false;
+  return d & (1u << 8);
+}
+
+
+// The initial calibration measures the counter over 10ms.
+Calibration::Calibration()
+  : invariant(detect_invariant())
+{
+  origin = sample();
+  Sample s;
+  do {
+    s = sample();
+  } while (s.ns - origin.ns < 10000000);
+  update(s);
+  if (!invariant)
+    std::cerr << "[flowpath] warning: TSC is not invariant; packet timestamps may be inaccurate\n";
+}
+
+
+void
+Calibration::update(Sample const& s)
+{
+  double secs = (s.ns - origin.ns) / 1e9;
+  double rate = (s.cycles - origin.cycles) / secs;
+  std::uint64_t m = (1e9 / rate) * (double)(1ull << tsc_shift);
+  seq.begin_write();
+  anchor = s;
+  hz = rate;
+  tsc_mult.store(m, std::memory_order_relaxed);
+  seq.end_write();
+}
+
+#else
+
+// Cycles are nanoseconds, so there is nothing to calibrate.
+Calibration::Calibration()
+  : hz(1e9), invariant(true)
+{
+  origin = anchor = sample();
+  tsc_mult.store(1ull << tsc_shift, std::memory_order_relaxed);
+}
+
+
+void
+Calibration::update(Sample const& s)
+{ }
+
+#endif
+
+
+Calibration&
+calibration()
+{
+  static Calibration cal;
+  return cal;
+}
+
+} // namespace
+
+
+// Calibrate the counter, if it has not been. The first calibration
+// measures the counter for 10ms, so Dataplane::up() calls this to
+// keep that wait out of the first conversion.
+void
+calibrate_tsc()
+{
+  calibration();
+}
+
+
+std::uint64_t
+ns_to_cycles(std::uint64_t ns)
+{
+  calibration();
+  std::uint64_t m = tsc_mult.load(std::memory_order_relaxed);
+  return ((__uint128_t)ns << tsc_shift) / m;
+}
+
+
+std::uint64_t
+cycles_to_monotonic_ns(Cycles c)
+{
+  Calibration const& cal = calibration();
+  Sample a;
+  unsigned seq;
+  do {
+    seq = cal.seq.begin_read();
+    a = cal.anchor;
+  } while (!cal.seq.end_read(seq));
+  if (c >= a.cycles)
+    return a.ns + cycles_to_ns(c - a.cycles);
+  else
+    return a.ns - cycles_to_ns(a.cycles - c);
+}
+
+
+double
+tsc_hz()
+{
+  Calibration const& cal = calibration();
+  double hz;
+  unsigned seq;
+  do {
+    seq = cal.seq.begin_read();
+    hz = cal.hz;
+  } while (!cal.seq.end_read(seq));
+  return hz;
+}
+
+
+bool
+tsc_is_invariant()
+{
+  return calibration().invariant;
+}
+
+
+// Re-estimate the counter frequency over the span since startup.
+// Calls more frequent than every 100ms are ignored, since they
+// would not improve the estimate.
+void
+recalibrate_tsc()
+{
+  Calibration& cal = calibration();
+  std::lock_guard<std::mutex> lock(cal.mutex);
+  Sample s = sample();
+  if (s.ns - cal.anchor.ns < 100000000)
+    return;
+  cal.update(s);
+}
 
 
-inline Timestamp
-Time::current() const
+// Returns the current time in milliseconds of the monotonic clock.
+Timestamp
+current_time()
 {
-	return (duration_cast<::milliseconds>(std::chrono::steady_clock::now()).count());
+  return cycles_to_monotonic_ns(now_cycles()) / 1000000;
 }
 
 
-}	// namespace fp
+} // namespace fp
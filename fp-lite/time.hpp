@@ -5,23 +5,119 @@
 // view of what 'time' is, and provides time relation functionality
 // such as timers...
 //
+// Packet timestamps are read from the CPU's time stamp counter,
+// which costs a few nanoseconds, rather than from the kernel. The
+// counter's frequency is calibrated against CLOCK_MONOTONIC when a
+// dataplane comes up, or on first use of a conversion if that is
+// sooner, and recalibrated over ever longer intervals by calling
+// recalibrate_tsc() periodically (e.g., from a driver's statistics
+// loop). This corrects for error in the initial, short calibration
+// and for drift between the two clocks.
+//
+// On hosts without a time stamp counter, cycles are nanoseconds
+// of CLOCK_MONOTONIC.
+//
 // TODO: Implement a flow timer.
 
 #include "types.hpp"
 
+#include <atomic>
+#include <ctime>
+
+#if defined(__x86_64__) || defined(__i386__)
+#  include <x86intrin.h>
+#endif
+
+
 namespace fp
 {
 
 using Timestamp = std::uint64_t;
 
+// A reading of the time stamp counter.
+using Cycles = std::uint64_t;
+
+
+// Returns the current value of the time stamp counter. This is not
+// a serializing instruction, so it may be reordered with nearby
+// loads and stores. That is fine for packet timestamps.
+inline Cycles
+now_cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (Cycles)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+
+// -------------------------------------------------------------------------- //
+// Calibration
+
+// The fixed point scale of the cycle to nanosecond multiplier.
+constexpr int tsc_shift = 32;
+
+// The number of nanoseconds per cycle, scaled by 2^tsc_shift, or 0
+// until the counter is calibrated.
+extern std::atomic<std::uint64_t> tsc_mult;
+
+void calibrate_tsc();
+
+
+// Returns the number of nanoseconds in a span of cycles. This is
+// a single widening multiply and shift.
+inline std::uint64_t
+cycles_to_ns(Cycles c)
+{
+  std::uint64_t m = tsc_mult.load(std::memory_order_relaxed);
+  if (__builtin_expect(m == 0, 0)) {
+    calibrate_tsc();
+    m = tsc_mult.load(std::memory_order_relaxed);
+  }
+  return ((__uint128_t)c * m) >> tsc_shift;
+}
+
+
+// Returns the number of cycles in the given number of nanoseconds.
+std::uint64_t ns_to_cycles(std::uint64_t);
+
+// Returns the CLOCK_MONOTONIC time, in nanoseconds, at which the
+// counter had the given value.
+std::uint64_t cycles_to_monotonic_ns(Cycles);
+
+// Returns the estimated frequency of the counter, in Hz.
+double tsc_hz();
+
+// Returns true if the counter is invariant, i.e., runs at a
+// constant rate in all power states and is synchronized across
+// cores.
+bool tsc_is_invariant();
+
+void recalibrate_tsc();
+
+
+// -------------------------------------------------------------------------- //
+// Coarse timestamps
+
+// A per-thread counter value that is refreshed once per burst of
+// received packets. Ports in coarse timestamp mode stamp packets
+// with this value rather than reading the counter for each packet.
+extern thread_local Cycles coarse_cycles;
+
 
-// FIXME: This namespace starts with a capital letter.
-namespace Time
+// Refresh the calling thread's coarse timestamp. Drivers call this
+// once per poll, before receiving a burst of packets.
+inline void
+tick_coarse_clock()
 {
+  coarse_cycles = now_cycles();
+}
 
-inline Timestamp current() const;
 
-} // namespace time
+Timestamp current_time();
 
 } // namespace fp
 
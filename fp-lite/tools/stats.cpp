@@ -0,0 +1,43 @@
+// Queries the statistics endpoint of a driver.
+//
+// usage: fp-stats <socket> [stats|trace]
+//
+// Sends the command (stats by default) to the stats server
+// listening on the given UNIX socket, and prints its reply.
+
+#include <freeflow/unix.hpp>
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include <sys/socket.h>
+
+using namespace ff;
+
+
+int
+main(int argc, char* argv[])
+{
+  if (argc < 2 || argc > 3) {
+    std::cerr << "usage: " << argv[0] << " <socket> [stats|trace]\n";
+    return 1;
+  }
+  std::string cmd = argc == 3 ? argv[2] : "stats";
+
+  Unix_stream_socket sock;
+  if (!sock.connect(Unix_socket_address(argv[1]))) {
+    std::cerr << "error: cannot connect to " << argv[1] << ": " << std::strerror(errno) << '\n';
+    return 1;
+  }
+  cmd += '\n';
+  sock.send(cmd.c_str(), cmd.size());
+  ::shutdown(sock.fd(), SHUT_WR);
+
+  char buf[4096];
+  int n;
+  while ((n = sock.recv(buf, sizeof(buf))) > 0)
+    std::cout.write(buf, n);
+  return n < 0;
+}
@@ -0,0 +1,119 @@
+// Renders an event trace dump as a timeline.
+//
+// usage: fp-trace <trace-file> [--stalls us]
+//
+// The records of all threads are merged in time order. Each line
+// shows the time of the record relative to the dump, the time since
+// the previous record of the same thread, and the record's fields.
+// With --stalls, only records that follow a silence of at least the
+// given number of microseconds on their thread are shown, which
+// points at the moments a thread stopped making progress.
+
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace fp;
+
+
+// A record with the index of its thread.
+struct Entry
+{
+  Trace_record const* rec;
+  int                 thread;
+  Cycles              gap; // Cycles since the thread's previous record.
+};
+
+
+int
+usage(char const* prog)
+{
+  std::cerr << "usage: " << prog << " <trace-file> [--stalls us]\n";
+  return 1;
+}
+
+
+int
+main(int argc, char* argv[])
+{
+  if (argc < 2)
+    return usage(argv[0]);
+  std::string path = argv[1];
+  double stall_us = 0;
+  for (int i = 2; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--stalls" && i + 1 < argc)
+      stall_us = std::atof(argv[++i]);
+    else
+      return usage(argv[0]);
+  }
+
+  Trace_dump d;
+  if (!read_traces(path, d)) {
+    std::cerr << "error: cannot read trace file '" << path << "'\n";
+    return 1;
+  }
+
+  // Convert cycles relative to the dump to microseconds.
+  auto to_us = [&d](double c) { return c * 1e6 / d.hz; };
+
+  std::vector<Entry> entries;
+  for (std::size_t t = 0; t < d.threads.size(); ++t) {
+    std::vector<Trace_record> const& rs = d.threads[t].records;
+    for (std::size_t i = 0; i < rs.size(); ++i) {
+      Cycles gap = i ? rs[i].cycles - rs[i - 1].cycles : 0;
+      entries.push_back({&rs[i], (int)t, gap});
+    }
+  }
+  std::stable_sort(entries.begin(), entries.end(), [](Entry const& a, Entry const& b) {
+    return a.rec->cycles < b.rec->cycles;
+  });
+
+  std::cout << std::fixed << std::setprecision(3);
+  std::cout << "# " << path << ": " << d.threads.size() << " threads, "
+            << entries.size() << " records, tsc " << d.hz / 1e9 << " GHz, "
+            << "dumped at " << d.anchor_ns / 1e9 << " s (monotonic)\n";
+  std::cout << "#     time (us)     +prev (us)      thread  event         port         arg\n";
+  for (Entry const& e : entries) {
+    double gap = to_us(e.gap);
+    if (gap < stall_us)
+      continue;
+    Trace_record const& r = *e.rec;
+    double t = -to_us((double)d.anchor_cycles - (double)r.cycles);
+    std::cout << std::setw(15) << t
+              << std::setw(15) << gap
+              << std::setw(12) << d.threads[e.thread].tid << "  "
+              << std::left << std::setw(14) << to_string((Trace_event)r.event) << std::right
+              << std::setw(4) << r.port
+              << std::setw(12) << r.arg << '\n';
+  }
+
+  // Summarize each thread.
+  std::cout << "#\n# thread      records       lost   max gap (us)";
+  for (int e = 0; e < trace_event_count; ++e)
+    std::cout << std::setw(14) << to_string((Trace_event)e);
+  std::cout << '\n';
+  for (Trace_thread const& t : d.threads) {
+    std::uint64_t counts[trace_event_count] = {};
+    Cycles max_gap = 0;
+    for (std::size_t i = 0; i < t.records.size(); ++i) {
+      if (t.records[i].event < trace_event_count)
+        ++counts[t.records[i].event];
+      if (i)
+        max_gap = std::max(max_gap, t.records[i].cycles - t.records[i - 1].cycles);
+    }
+    std::cout << "# " << std::setw(6) << t.tid
+              << std::setw(13) << t.records.size()
+              << std::setw(11) << t.lost
+              << std::setw(15) << to_us(max_gap);
+    for (std::uint64_t c : counts)
+      std::cout << std::setw(14) << c;
+    std::cout << '\n';
+  }
+  return 0;
+}
@@ -0,0 +1,286 @@
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+
+#include <signal.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+
+namespace fp
+{
+
+std::atomic<bool> trace_enabled(true);
+
+
+namespace
+{
+
+// The rings of running threads.
+std::mutex               trace_mutex;
+std::vector<Trace_ring*> rings;
+
+// Set by request_trace_dump(), which may be called from a signal
+// handler.
+std::atomic<bool> dump_requested(false);
+
+// The number of dumps written by dump_traces(), used to name them.
+std::atomic<int> dump_count(0);
+
+
+// The layout of a trace file. The file header is followed by each
+// thread's header and records.
+constexpr char          trace_magic[8] = {'F', 'P', 'T', 'R', 'A', 'C', 'E', 0};
+constexpr std::uint32_t trace_version = 1;
+
+struct File_header
+{
+  char          magic[8];
+  std::uint32_t version;
+  std::uint32_t threads;
+  double        hz;
+  std::uint64_t anchor_cycles;
+  std::uint64_t anchor_ns;
+};
+
+
+struct Thread_header
+{
+  std::int32_t  tid;
+  std::uint32_t count;
+  std::uint64_t lost;
+};
+
+
+// Copy the records of a ring that is being written concurrently.
+// Records whose slots were reused while copying are discarded. The
+// writer fills slot head % trace_ring_size before it advances the
+// head, so the record that slot held may be torn as well, and a
+// snapshot holds at most trace_ring_size - 1 records.
+Trace_thread
+copy_ring(Trace_ring const& r)
+{
+  Trace_thread t;
+  t.tid = r.tid;
+  std::uint64_t head = r.head.load(std::memory_order_acquire);
+  std::uint64_t first = head + 1 > trace_ring_size ? head + 1 - trace_ring_size : 0;
+  t.records.reserve(head - first);
+  for (std::uint64_t i = first; i != head; ++i)
+    t.records.push_back(r.records[i & (trace_ring_size - 1)]);
+
+  std::uint64_t now = r.head.load(std::memory_order_acquire);
+  std::uint64_t valid = now + 1 > trace_ring_size ? now + 1 - trace_ring_size : 0;
+  if (valid > first) {
+    std::uint64_t n = std::min(valid - first, (std::uint64_t)t.records.size());
+    t.records.erase(t.records.begin(), t.records.begin() + n);
+    first += n;
+  }
+  t.lost = first;
+  return t;
+}
+
+
+void
+on_trace_signal(int)
+{
+  request_trace_dump();
+}
+
+} // namespace
+
+
+char const*
+to_string(Trace_event e)
+{
+  switch (e) {
+  case trace_rx_burst: return "rx-burst";
+  case trace_table_miss: return "table-miss";
+  case trace_event_raised: return "event-raised";
+  case trace_tx_partial: return "tx-partial";
+  case trace_pool_low: return "pool-low";
+  default: return "unknown";
+  }
+}
+
+
+Trace_ring::Trace_ring()
+  : head(0), tid(syscall(SYS_gettid))
+{
+  std::lock_guard<std::mutex> lock(trace_mutex);
+  rings.push_back(this);
+}
+
+
+// The history of an exiting thread is discarded.
+Trace_ring::~Trace_ring()
+{
+  std::lock_guard<std::mutex> lock(trace_mutex);
+  rings.erase(std::find(rings.begin(), rings.end(), this));
+}
+
+
+// Allocate and register a ring for the calling thread.
+Trace_ring*
+new_trace_ring()
+{
+  return new Trace_ring();
+}
+
+
+// Start or stop recording events. Existing records are kept.
+void
+enable_trace(bool b)
+{
+  trace_enabled = b;
+}
+
+
+// -------------------------------------------------------------------------- //
+// Trace dumps
+
+// Returns a copy of the rings of all running threads.
+Trace_dump
+snapshot_traces()
+{
+  Trace_dump d;
+  d.hz = tsc_hz();
+  d.anchor_cycles = now_cycles();
+  d.anchor_ns = cycles_to_monotonic_ns(d.anchor_cycles);
+  std::lock_guard<std::mutex> lock(trace_mutex);
+  for (Trace_ring const* r : rings)
+    d.threads.push_back(copy_ring(*r));
+  return d;
+}
+
+
+// Write a dump to a file. Returns false if the file could not be
+// written.
+bool
+write_traces(std::string const& path, Trace_dump const& d)
+{
+  std::ofstream f(path, std::ios::binary | std::ios::trunc);
+  if (!f)
+    return false;
+  File_header h;
+  std::memcpy(h.magic, trace_magic, sizeof(h.magic));
+  h.version = trace_version;
+  h.threads = d.threads.size();
+  h.hz = d.hz;
+  h.anchor_cycles = d.anchor_cycles;
+  h.anchor_ns = d.anchor_ns;
+  f.write((char const*)&h, sizeof(h));
+  for (Trace_thread const& t : d.threads) {
+    Thread_header th;
+    th.tid = t.tid;
+    th.count = t.records.size();
+    th.lost = t.lost;
+    f.write((char const*)&th, sizeof(th));
+    f.write((char const*)t.records.data(), t.records.size() * sizeof(Trace_record));
+  }
+  return (bool)f.flush();
+}
+
+
+// Read a dump from a file. Returns false if the file could not be
+// read or is not a trace file.
+bool
+read_traces(std::string const& path, Trace_dump& d)
+{
+  std::ifstream f(path, std::ios::binary);
+  File_header h;
+  if (!f.read((char*)&h, sizeof(h)))
+    return false;
+  if (std::memcmp(h.magic, trace_magic, sizeof(h.magic)) || h.version != trace_version)
+    return false;
+  d.hz = h.hz;
+  d.anchor_cycles = h.anchor_cycles;
+  d.anchor_ns = h.anchor_ns;
+  d.threads.clear();
+  for (std::uint32_t i = 0; i < h.threads; ++i) {
+    Thread_header th;
+    if (!f.read((char*)&th, sizeof(th)) || th.count > trace_ring_size)
+      return false;
+    Trace_thread t;
+    t.tid = th.tid;
+    t.lost = th.lost;
+    t.records.resize(th.count);
+    if (!f.read((char*)t.records.data(), th.count * sizeof(Trace_record)))
+      return false;
+    d.threads.push_back(std::move(t));
+  }
+  return true;
+}
+
+
+// Write the rings of all running threads to a file.
+bool
+dump_traces(std::string const& path)
+{
+  return write_traces(path, snapshot_traces());
+}
+
+
+// Write the rings to fp-trace-<pid>-<n>.bin in the current
+// directory. Returns the path of the file, or the empty string
+// if it could not be written.
+std::string
+dump_traces()
+{
+  std::string path = "fp-trace-" + std::to_string(getpid()) +
+                     "-" + std::to_string(dump_count++) + ".bin";
+  if (!dump_traces(path))
+    return std::string();
+  return path;
+}
+
+
+// Request a dump. This is safe to call from a signal handler.
+void
+request_trace_dump()
+{
+  dump_requested.store(true, std::memory_order_relaxed);
+}
+
+
+// Returns true, once, if a dump has been requested since the last
+// call.
+bool
+trace_dump_requested()
+{
+  return dump_requested.exchange(false, std::memory_order_relaxed);
+}
+
+
+// Request a dump when the process receives the given signal.
+void
+install_trace_signal(int sig)
+{
+  struct sigaction sa;
+  std::memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_trace_signal;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  sigaction(sig, &sa, nullptr);
+}
+
+
+// Write a dump if one has been requested. Drivers call this from
+// their main loop.
+void
+serve_trace_dump_request()
+{
+  if (!trace_dump_requested())
+    return;
+  std::string path = dump_traces();
+  if (path.empty())
+    std::cerr << "[flowpath] cannot write trace dump\n";
+  else
+    std::cout << "[flowpath] wrote trace dump to " << path << '\n';
+}
+
+
+} // namespace fp
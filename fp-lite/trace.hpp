@@ -0,0 +1,166 @@
+#ifndef FP_TRACE_HPP
+#define FP_TRACE_HPP
+
+// Event tracing for diagnosing intermittent stalls. Each thread
+// records events into its own fixed-size ring of 16 byte records.
+// When the ring is full, new records overwrite the oldest, so the
+// ring always holds the most recent history of the thread. Recording
+// an event reads the time stamp counter and stores one record, which
+// costs a few nanoseconds, so tracing is enabled by default.
+//
+// dump_traces() writes the rings of all threads to a file, which
+// the fp-trace tool renders as a timeline. Drivers dump the rings
+// when they receive SIGUSR2 (see install_trace_signal()).
+
+#include "time.hpp"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+
+namespace fp
+{
+
+// The traced events. The meaning of a record's port and argument
+// depends on the event.
+enum Trace_event : std::uint16_t
+{
+  trace_rx_burst,     // A burst of arg packets was received on port.
+  trace_table_miss,   // A packet from port missed in table arg.
+  trace_event_raised, // A packet from port raised an event.
+  trace_tx_partial,   // A frame sent on port took arg writes.
+  trace_pool_low,     // The buffer pool fell to arg free buffers.
+  trace_event_count
+};
+
+
+char const* to_string(Trace_event);
+
+
+// A trace record.
+struct Trace_record
+{
+  Cycles        cycles; // The time stamp counter at the event.
+  std::uint32_t arg;
+  std::uint16_t event;
+  std::uint16_t port;
+};
+
+static_assert(sizeof(Trace_record) == 16, "trace records must be 16 bytes");
+
+
+// The number of records in each thread's ring, as a power of 2.
+constexpr int trace_ring_bits = 12;
+constexpr int trace_ring_size = 1 << trace_ring_bits;
+
+
+// A thread's trace ring. The head counts every record ever written;
+// the record at index head % trace_ring_size is overwritten next.
+// The writer publishes each record by advancing the head, so that a
+// reader can tell which records were overwritten while it copied
+// the ring.
+struct Trace_ring
+{
+  Trace_ring();
+  ~Trace_ring();
+
+  Trace_ring(Trace_ring const&) = delete;
+  Trace_ring& operator=(Trace_ring const&) = delete;
+
+  void record(Trace_event e, int port, std::uint32_t arg)
+  {
+    std::uint64_t n = head.load(std::memory_order_relaxed);
+    Trace_record& r = records[n & (trace_ring_size - 1)];
+    r.cycles = now_cycles();
+    r.arg = arg;
+    r.event = e;
+    r.port = port;
+    head.store(n + 1, std::memory_order_release);
+  }
+
+  std::atomic<std::uint64_t> head;
+  int                        tid; // The kernel's id of the owning thread.
+  Trace_record               records[trace_ring_size];
+};
+
+
+extern std::atomic<bool> trace_enabled;
+
+Trace_ring* new_trace_ring();
+
+
+// Returns the calling thread's trace ring, allocating it on first
+// use. Threads that never trace do not pay for a ring.
+inline Trace_ring&
+thread_trace_ring()
+{
+  struct Holder
+  {
+    ~Holder() { delete ring; }
+    Trace_ring* ring;
+  };
+  static thread_local Holder h;
+  if (!h.ring)
+    h.ring = new_trace_ring();
+  return *h.ring;
+}
+
+
+// Record an event in the calling thread's ring.
+inline void
+trace(Trace_event e, int port, std::uint32_t arg = 0)
+{
+  if (trace_enabled.load(std::memory_order_relaxed))
+    thread_trace_ring().record(e, port, arg);
+}
+
+
+void enable_trace(bool);
+
+
+// -------------------------------------------------------------------------- //
+// Trace dumps
+
+// The records of one thread, oldest first. Lost counts the records
+// that were overwritten before the dump.
+struct Trace_thread
+{
+  int                       tid;
+  std::uint64_t             lost;
+  std::vector<Trace_record> records;
+};
+
+
+// The contents of a trace dump. The anchor is a simultaneous reading
+// of the time stamp counter and CLOCK_MONOTONIC, which places the
+// records on the system's timeline.
+struct Trace_dump
+{
+  double                    hz;
+  Cycles                    anchor_cycles;
+  std::uint64_t             anchor_ns;
+  std::vector<Trace_thread> threads;
+};
+
+
+Trace_dump snapshot_traces();
+
+bool write_traces(std::string const&, Trace_dump const&);
+bool read_traces(std::string const&, Trace_dump&);
+
+bool        dump_traces(std::string const&);
+std::string dump_traces();
+
+
+// Dump requests from signal handlers. The handler only sets a flag;
+// the driver polls for it and writes the dump outside the handler.
+void request_trace_dump();
+bool trace_dump_requested();
+void install_trace_signal(int);
+void serve_trace_dump_request();
+
+
+} // namespace fp
+
+#endif
@@ -1,2 +1,350 @@
 
 #include "capture.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace ff
+{
+
+namespace cap
+{
+
+namespace
+{
+
+// Magic numbers of pcap files, as read in the host's byte order.
+constexpr std::uint32_t pcap_us = 0xa1b2c3d4;
+constexpr std::uint32_t pcap_ns = 0xa1b23c4d;
+constexpr std::uint32_t pcap_us_swapped = 0xd4c3b2a1;
+constexpr std::uint32_t pcap_ns_swapped = 0x4d3cb2a1;
+
+// Block types of pcapng files.
+constexpr std::uint32_t section_block = 0x0a0d0d0a;
+constexpr std::uint32_t interface_block = 1;
+constexpr std::uint32_t old_packet_block = 2;
+constexpr std::uint32_t simple_packet_block = 3;
+constexpr std::uint32_t enhanced_packet_block = 6;
+constexpr std::uint32_t byte_order_magic = 0x1a2b3c4d;
+
+// Interface options of pcapng files.
+constexpr int end_option = 0;
+constexpr int tsresol_option = 9;
+constexpr int tsoffset_option = 14;
+
+
+// Reads integers in the byte order of a capture.
+struct Reader
+{
+  std::uint16_t u16(std::uint8_t const* p) const
+  {
+    std::uint16_t x;
+    std::memcpy(&x, p, 2);
+    return swap ? __builtin_bswap16(x) : x;
+  }
+
+  std::uint32_t u32(std::uint8_t const* p) const
+  {
+    std::uint32_t x;
+    std::memcpy(&x, p, 4);
+    return swap ? __builtin_bswap32(x) : x;
+  }
+
+  std::uint64_t u64(std::uint8_t const* p) const
+  {
+    std::uint64_t x;
+    std::memcpy(&x, p, 8);
+    return swap ? __builtin_bswap64(x) : x;
+  }
+
+  bool swap;
+};
+
+
+// The timestamp resolution and offset of a pcapng interface.
+struct Interface
+{
+  // Returns a timestamp in nanoseconds.
+  std::uint64_t to_ns(std::uint64_t) const;
+
+  Link_type     link;
+  std::uint32_t snaplen;
+  bool          binary;   // Units of 2^-exp, not 10^-exp, seconds
+  int           exp;
+  std::int64_t  offset;   // Seconds
+};
+
+
+std::uint64_t
+Interface::to_ns(std::uint64_t ts) const
+{
+  static constexpr std::uint64_t powers[] = {
+    1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull,
+    100000000ull, 1000000000ull, 10000000000ull, 100000000000ull,
+    1000000000000ull, 10000000000000ull, 100000000000000ull,
+    1000000000000000ull, 10000000000000000ull, 100000000000000000ull,
+    1000000000000000000ull, 10000000000000000000ull,
+  };
+  std::uint64_t ns;
+  if (binary)
+    ns = std::ldexp((long double)ts * 1e9L, -exp);
+  else if (exp <= 9)
+    ns = ts * powers[9 - exp];
+  else if (exp - 9 < 20)
+    ns = ts / powers[exp - 9];
+  else
+    ns = 0;
+  return ns + offset * 1000000000;
+}
+
+
+[[noreturn]] void
+malformed(char const* what)
+{
+  throw std::runtime_error(std::string("malformed capture: ") + what);
+}
+
+} // namespace
+
+
+// Map and index the capture file at `path`.
+File::File(char const* path)
+  : data_(nullptr), size_(0), link_(null_link), truncated_(false)
+{
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error(std::string(path) + ": " + std::strerror(errno));
+  try {
+    map(fd, path);
+  } catch (...) {
+    ::close(fd);
+    throw;
+  }
+  ::close(fd);
+}
+
+
+// Map and index the capture in an open file, which is read from its
+// beginning.
+File::File(std::FILE* f)
+  : data_(nullptr), size_(0), link_(null_link), truncated_(false)
+{
+  map(fileno(f), "capture");
+}
+
+
+File::~File()
+{
+  if (data_)
+    ::munmap((void*)data_, size_);
+}
+
+
+// Map the file and build the index, throwing an exception on failure.
+void
+File::map(int fd, char const* path)
+{
+  struct stat st;
+  if (::fstat(fd, &st) < 0)
+    throw std::runtime_error(std::string(path) + ": " + std::strerror(errno));
+  size_ = st.st_size;
+  if (size_ < 4)
+    throw std::runtime_error(std::string(path) + ": not a pcap or pcapng file");
+
+  void* p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (p == MAP_FAILED)
+    throw std::runtime_error(std::string(path) + ": " + std::strerror(errno));
+  data_ = (std::uint8_t const*)p;
+
+  // The index is built in one pass, front to back.
+  ::madvise(p, size_, MADV_SEQUENTIAL);
+  try {
+    std::uint32_t magic;
+    std::memcpy(&magic, data_, 4);
+    if (magic == section_block)
+      index_pcapng();
+    else if (magic == pcap_us || magic == pcap_ns ||
+             magic == pcap_us_swapped || magic == pcap_ns_swapped)
+      index_pcap();
+    else
+      throw std::runtime_error(std::string(path) + ": not a pcap or pcapng file");
+  } catch (...) {
+    ::munmap(p, size_);
+    data_ = nullptr;
+    throw;
+  }
+  ::madvise(p, size_, MADV_NORMAL);
+}
+
+
+// Index a pcap file: a 24 byte header, then a 16 byte header before
+// each packet.
+void
+File::index_pcap()
+{
+  if (size_ < 24)
+    malformed("short pcap header");
+  std::uint32_t magic;
+  std::memcpy(&magic, data_, 4);
+  Reader r {magic == pcap_us_swapped || magic == pcap_ns_swapped};
+  std::uint32_t unit = magic == pcap_ns || magic == pcap_ns_swapped ? 1 : 1000;
+  link_ = (Link_type)(r.u32(data_ + 20) & 0xffff);
+
+  std::size_t off = 24;
+  while (off + 16 <= size_) {
+    std::uint8_t const* h = data_ + off;
+    Packet p;
+    p.caplen = r.u32(h + 8);
+    p.len = r.u32(h + 12);
+    if (p.caplen > size_ - off - 16)
+      break;
+    p.buf = h + 16;
+    p.ns = r.u32(h) * 1000000000ull + (std::uint64_t)r.u32(h + 4) * unit;
+    index_.push_back(p);
+    off += 16 + p.caplen;
+  }
+  truncated_ = off != size_;
+}
+
+
+// Index a pcapng file: a sequence of sections, each starting with a
+// section header block that gives its byte order, and holding blocks
+// that describe interfaces and the packets captured on them.
+void
+File::index_pcapng()
+{
+  Reader r {false};
+  std::vector<Interface> ifaces;
+  bool described = false;
+  std::size_t off = 0;
+  while (off + 12 <= size_) {
+    std::uint8_t const* b = data_ + off;
+
+    // A section header sets the byte order, which its type does not
+    // depend on, and starts a new list of interfaces.
+    std::uint32_t type;
+    std::memcpy(&type, b, 4);
+    if (type == section_block) {
+      std::uint32_t bom;
+      std::memcpy(&bom, b + 8, 4);
+      if (bom != byte_order_magic && bom != __builtin_bswap32(byte_order_magic))
+        malformed("bad byte order magic");
+      r.swap = bom != byte_order_magic;
+      ifaces.clear();
+    }
+    type = r.u32(b);
+    std::uint32_t len = r.u32(b + 4);
+    if (len < 12 || len % 4)
+      malformed("bad block length");
+    if (len > size_ - off)
+      break;
+    std::uint8_t const* body = b + 8;
+    std::uint32_t blen = len - 12;
+
+    Packet p;
+    std::uint32_t ifid = 0;
+    std::uint64_t ts = 0;
+    bool packet = false;
+    switch (type) {
+    case interface_block: {
+      if (blen < 8)
+        malformed("short interface block");
+      Interface i {(Link_type)r.u16(body), r.u32(body + 4), false, 6, 0};
+      for (std::uint32_t o = 8; o + 4 <= blen; ) {
+        int code = r.u16(body + o);
+        std::uint32_t olen = r.u16(body + o + 2);
+        if (code == end_option || o + 4 + olen > blen)
+          break;
+        std::uint8_t const* v = body + o + 4;
+        if (code == tsresol_option && olen >= 1) {
+          i.binary = *v & 0x80;
+          i.exp = *v & 0x7f;
+        } else if (code == tsoffset_option && olen >= 8) {
+          i.offset = r.u64(v);
+        }
+        o += 4 + (olen + 3) / 4 * 4;
+      }
+      if (!described)
+        link_ = i.link;
+      described = true;
+      ifaces.push_back(i);
+      break;
+    }
+
+    case enhanced_packet_block:
+      if (blen < 20)
+        malformed("short packet block");
+      ifid = r.u32(body);
+      ts = (std::uint64_t)r.u32(body + 4) << 32 | r.u32(body + 8);
+      p.caplen = r.u32(body + 12);
+      p.len = r.u32(body + 16);
+      p.buf = body + 20;
+      if (p.caplen > blen - 20)
+        malformed("packet exceeds its block");
+      packet = true;
+      break;
+
+    case old_packet_block:
+      if (blen < 20)
+        malformed("short packet block");
+      ifid = r.u16(body);
+      ts = (std::uint64_t)r.u32(body + 4) << 32 | r.u32(body + 8);
+      p.caplen = r.u32(body + 12);
+      p.len = r.u32(body + 16);
+      p.buf = body + 20;
+      if (p.caplen > blen - 20)
+        malformed("packet exceeds its block");
+      packet = true;
+      break;
+
+    case simple_packet_block:
+      // The captured size is implied by the original size, the
+      // block's size and the interface's snapshot length. There is
+      // no timestamp.
+      if (blen < 4 || ifaces.empty())
+        malformed("bad simple packet block");
+      p.len = r.u32(body);
+      p.caplen = std::min(p.len, blen - 4);
+      if (ifaces[0].snaplen)
+        p.caplen = std::min(p.caplen, ifaces[0].snaplen);
+      p.buf = body + 4;
+      index_.push_back(p);
+      break;
+
+    default:
+      // Other blocks are skipped.
+      break;
+    }
+
+    if (packet) {
+      if (ifid >= ifaces.size())
+        malformed("packet of an undescribed interface");
+      p.ns = ifaces[ifid].to_ns(ts);
+      index_.push_back(p);
+    }
+    off += len;
+  }
+  truncated_ = off != size_;
+}
+
+
+Range
+File::partition(int k, int n) const
+{
+  std::size_t m = index_.size();
+  return {m * k / n, m * (k + 1) / n};
+}
+
+
+} // namespace cap
+
+} // namespace ff
@@ -2,13 +2,18 @@
 #ifndef FREEFLOW_CAPTURE_HPP
 #define FREEFLOW_CAPTURE_HPP
 
-// The PCAP module provides an interface to working with packet
-// captures from tcpdump.
+// The capture module reads packet captures from tcpdump, Wireshark
+// and similar tools, in the pcap and pcapng formats. Captures are
+// mapped into memory and indexed in one pass, so packets are read in
+// place, in any order, and from any number of threads.
 
 #include <cstdint>
+#include <cstdio>
+#include <memory>
 #include <stdexcept>
+#include <vector>
 
-#include <pcap/pcap.h>
+#include <sys/time.h>
 
 
 namespace ff
@@ -24,37 +29,50 @@ namespace cap
 // A packet provides a view into captured data from the device.
 // In particular, the packet structure provides access to header
 // information about the packet and its raw data.
-//
-// TODO: This is not well developed.
 struct Packet
 {
   Packet()
-    : hdr(nullptr), buf(nullptr)
+    : buf(nullptr), caplen(0), len(0), ns(0)
   { }
 
   // Returns the total number of bytes in the packet. Note that
   // this may be larger than the number of bytes captured.
-  int total_size() const { return hdr->len; }
+  int total_size() const { return len; }
 
   // Returns the number of bytes actually captured. The captured
   // size is less than or equal to total size.
-  int captured_size() const { return hdr->caplen; }
+  int captured_size() const { return caplen; }
 
   // Returns true when the packet is fully captured.
   bool is_complete() const { return captured_size() == total_size(); }
 
   /* Returns the time stamp of the packet. This represents the time
      elapsed since the beginning of the capture. */
-  timeval timestamp() const { return hdr->ts; }
+  timeval timestamp() const;
+
+  // Returns the time stamp of the packet in nanoseconds.
+  std::uint64_t time() const { return ns; }
 
   // Returns the underlying packet data.
   uint8_t const* data() const { return buf; }
 
-  pcap_pkthdr*   hdr;
   uint8_t const* buf;
+  std::uint32_t  caplen;
+  std::uint32_t  len;
+  std::uint64_t  ns;
 };
 
 
+inline timeval
+Packet::timestamp() const
+{
+  timeval tv;
+  tv.tv_sec = ns / 1000000000;
+  tv.tv_usec = ns % 1000000000 / 1000;
+  return tv;
+}
+
+
 // -------------------------------------------------------------------------- //
 // Link types
 
@@ -63,14 +81,78 @@ struct Packet
 // capture can occur at any layer, so we need to provide a method
 // for an anlayzer to perform an initial decode.
 //
-// TODO: Where do the LINKTYPE_ names live?
+// The values are the LINKTYPE_ values stored in capture files,
+// which are listed at http://www.tcpdump.org/linktypes.html.
 enum Link_type
 {
-  null_link     = DLT_NULL,
-  ethernet_link = DLT_EN10MB,
-  cooked_link   = DLT_LINUX_SLL,
-  wifi_link     = DLT_IEEE802_11_RADIO,
-  ip_link       = DLT_RAW,
+  null_link     = 0,
+  ethernet_link = 1,
+  ip_link       = 101,
+  cooked_link   = 113,
+  wifi_link     = 127,
+};
+
+
+// -------------------------------------------------------------------------- //
+// Capture files
+
+// A contiguous range of the packets of a capture, [first, last).
+struct Range
+{
+  std::size_t size() const { return last - first; }
+
+  std::size_t first;
+  std::size_t last;
+};
+
+
+// A capture file, mapped into memory and indexed. Both pcap and
+// pcapng files are read, in either byte order, with microsecond,
+// nanosecond or (pcapng) any other timestamp resolution; times are
+// converted to nanoseconds.
+//
+// The link type of a pcapng file is that of its first interface.
+// A file that ends within a packet, as when tcpdump is killed, is
+// read up to the last complete packet.
+//
+// A file is not modified after it is opened, so it can be shared by
+// threads, each reading a range of its packets. Throws an exception
+// if the file cannot be read or is malformed.
+class File
+{
+public:
+  explicit File(char const*);
+  explicit File(std::FILE*);
+  ~File();
+
+  File(File const&) = delete;
+  File& operator=(File const&) = delete;
+
+  // Returns the link layer type of the capture.
+  Link_type link_type() const { return link_; }
+
+  // Returns the number of packets.
+  std::size_t size() const { return index_.size(); }
+
+  // Returns packet i.
+  Packet const& operator[](std::size_t i) const { return index_[i]; }
+
+  // Returns part k of n nearly equal ranges of the packets.
+  Range partition(int k, int n) const;
+
+  // Returns true if the file ends within a packet.
+  bool truncated() const { return truncated_; }
+
+private:
+  void map(int, char const*);
+  void index_pcap();
+  void index_pcapng();
+
+  std::uint8_t const* data_;      // The mapped file
+  std::size_t         size_;
+  Link_type           link_;
+  std::vector<Packet> index_;
+  bool                truncated_;
 };
 
 
@@ -107,26 +189,26 @@ offline(FILE* f)
 }
 
 
-// The capture class provides an interface to an offline or
-// active catpure.
+// The capture class provides an interface to an offline capture,
+// read in order.
 //
 // Note that the capture device models a non-caching stream.
 // This means that it is not possible to peek at the current
 // packet without consuming it.
 //
-// TODO: Support the creation of new captures.
+// A stream either opens its own file, or reads a range of the
+// packets of a shared file, so that several threads can each read
+// part of one capture.
 //
-// TODO: Make the error buffer global or thread local?
+// TODO: Support the creation of new captures.
 //
 // TODO: Allow capture streams to be used with the async module?
-//
-// FIXME: Make this move-only?
 class Stream
 {
 public:
   Stream(Offline_path);
   Stream(Offline_file);
-  ~Stream();
+  Stream(File const&, Range);
 
   // Observers
   bool ok() const { return status_ > 0; }
@@ -137,12 +219,14 @@ public:
   // Contextual conversion to bool.
   explicit operator bool() const { return ok(); }
 
-  Link_type link_type() const;
+  Link_type link_type() const { return file_->link_type(); }
 
 private:
-  char    error_[PCAP_ERRBUF_SIZE]; // An error message (256 bytes)
-  pcap_t* handle_;                  // The underlying device
-  int     status_;                  // Result of the last get.
+  std::unique_ptr<File> owned_;  // The file, if opened by the stream
+  File const*           file_;
+  std::size_t           pos_;    // The next packet
+  std::size_t           last_;
+  int                   status_; // Result of the last get.
 };
 
 
@@ -150,51 +234,40 @@ private:
 // an exception if the capture cannot be opened.
 inline
 Stream::Stream(Offline_path p)
-  : handle_(::pcap_open_offline(p.path, error_))
-{
-  if (!handle_)
-    throw std::runtime_error(error_);
-}
+  : owned_(new File(p.path)), file_(owned_.get()), pos_(0), last_(file_->size()),
+    status_(1)
+{ }
 
 
-// Open the offline capture indicated by the path `p`. Throws
-// an exception if the capture cannot be opened.
+// Open the offline capture in the file `f`, which remains open.
+// Throws an exception if the capture cannot be opened.
 inline
 Stream::Stream(Offline_file f)
-  : handle_(::pcap_fopen_offline(f.file, error_))
-{
-  if (!handle_)
-    throw std::runtime_error(error_);
-}
+  : owned_(new File(f.file)), file_(owned_.get()), pos_(0), last_(file_->size()),
+    status_(1)
+{ }
 
 
+// Read the range of packets of a file, which must outlive the
+// stream.
 inline
-Stream::~Stream()
-{
-  ::pcap_close(handle_);
-}
+Stream::Stream(File const& f, Range r)
+  : file_(&f), pos_(r.first), last_(r.last), status_(1)
+{ }
 
 
-// Returns the link layer type of the stream.
-inline Link_type
-Stream::link_type() const
-{
-  return (Link_type)pcap_datalink(handle_);
-}
-
-
-
-// Attempt to get the next packet from the stream. Returnsthis object.
+// Attempt to get the next packet from the stream. Returns this object.
 // If, after calling this function, the stream is not in a good state,
-// the packet `p` is partially formed.
-//
-// Note that this function blocks until a packet is read.
+// there were no more packets, and `p` is unchanged.
 inline Stream&
 Stream::get(Packet& p)
 {
-  do {
-    status_ = ::pcap_next_ex(handle_, &p.hdr, &p.buf);
-  } while (status_ == 0);
+  if (pos_ < last_) {
+    p = (*file_)[pos_++];
+    status_ = 1;
+  } else {
+    status_ = 0;
+  }
   return *this;
 }
 
@@ -20,7 +20,7 @@ int main(int argc, char* argv[])
   // Iterate over each packet and print some basic information.
   cap::Packet p;
   while (cap.get(p))
-    std::cout << "* packet with " << p.size() << '\n';
+    std::cout << "* packet with " << p.captured_size() << " bytes\n";
 
   return 0;
 }
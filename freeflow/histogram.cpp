@@ -0,0 +1,130 @@
+#include "histogram.hpp"
+
+#include <limits>
+
+namespace ff
+{
+
+Histogram::Histogram()
+{
+  clear();
+}
+
+
+// Reset the histogram. This must not race with a writer.
+void
+Histogram::clear()
+{
+  for (Counter& c : counts_)
+    c.store(0, std::memory_order_relaxed);
+  count_.store(0, std::memory_order_relaxed);
+  sum_.store(0, std::memory_order_relaxed);
+  min_.store(std::numeric_limits<std::uint64_t>::max(), std::memory_order_relaxed);
+  max_.store(0, std::memory_order_relaxed);
+}
+
+
+// Add the values recorded in h to this histogram. This histogram
+// must be owned by the calling thread. h may be concurrently
+// written by another thread.
+void
+Histogram::merge(Histogram const& h)
+{
+  for (int i = 0; i < size; ++i)
+    if (std::uint64_t n = load(h.counts_[i]))
+      add(counts_[i], n);
+  add(count_, h.count());
+  add(sum_, h.sum());
+  if (load(h.min_) < load(min_))
+    min_.store(load(h.min_), std::memory_order_relaxed);
+  if (h.max() > max())
+    max_.store(h.max(), std::memory_order_relaxed);
+}
+
+
+// Returns the smallest recorded value, or 0 if the histogram is
+// empty.
+std::uint64_t
+Histogram::min() const
+{
+  return count() ? load(min_) : 0;
+}
+
+
+double
+Histogram::mean() const
+{
+  std::uint64_t n = count();
+  return n ? (double)sum() / n : 0.0;
+}
+
+
+// Returns the value below which the fraction p (in [0, 1]) of the
+// recorded values fall. This is the midpoint of the bucket holding
+// that rank, clamped to the recorded minimum and maximum, so the
+// result is within the bucket's relative error of the true value.
+std::uint64_t
+Histogram::percentile(double p) const
+{
+  // Sum the buckets rather than using count_, which may be ahead
+  // of the buckets if a write is in progress.
+  std::uint64_t total = 0;
+  for (Counter const& c : counts_)
+    total += load(c);
+  if (!total)
+    return 0;
+
+  std::uint64_t rank = p * total;
+  if (rank >= total)
+    rank = total - 1;
+  std::uint64_t seen = 0;
+  for (int i = 0; i < size; ++i) {
+    seen += load(counts_[i]);
+    if (seen > rank) {
+      std::uint64_t lo = lower_bound(i);
+      std::uint64_t v = lo + (upper_bound(i) - lo) / 2;
+      if (v > max())
+        v = max();
+      if (v < min())
+        v = min();
+      return v;
+    }
+  }
+  return max();
+}
+
+
+// Returns the smallest value held by bucket i.
+std::uint64_t
+Histogram::lower_bound(int i)
+{
+  if (i < 2 * sub_count)
+    return i;
+  int shift = (i >> sub_bits) - 1;
+  std::uint64_t m = i - (shift << sub_bits);
+  return m << shift;
+}
+
+
+// Returns the largest value held by bucket i.
+std::uint64_t
+Histogram::upper_bound(int i)
+{
+  if (i == size - 1)
+    return std::numeric_limits<std::uint64_t>::max();
+  return lower_bound(i + 1) - 1;
+}
+
+
+Histogram_summary::Histogram_summary(Histogram const& h)
+  : count(h.count()),
+    min(h.min()),
+    max(h.max()),
+    mean(h.mean()),
+    p50(h.percentile(0.5)),
+    p99(h.percentile(0.99)),
+    p999(h.percentile(0.999))
+{ }
+
+
+} // namespace ff
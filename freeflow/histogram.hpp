@@ -0,0 +1,137 @@
+
+#ifndef FREEFLOW_HISTOGRAM_HPP
+#define FREEFLOW_HISTOGRAM_HPP
+
+// The histogram module provides log-linear histograms for recording
+// latency distributions. Values are grouped into power-of-two ranges,
+// each divided into 16 equal sub-buckets, so the relative error of
+// any reported value is at most 1/16. Small values (less than 32)
+// are recorded exactly.
+//
+// A histogram is written by a single thread without locks or atomic
+// read-modify-write operations. Other threads may read it at any
+// time, typically by merging several per-thread histograms into a
+// private one. A reader may see a recording partly applied (e.g.,
+// the count updated but not the sum), which is negligible in
+// aggregate.
+
+#include <atomic>
+#include <cstdint>
+
+
+namespace ff
+{
+
+class Histogram
+{
+public:
+  // The number of sub-buckets per power of two, as a power of 2.
+  static constexpr int sub_bits = 4;
+  static constexpr int sub_count = 1 << sub_bits;
+
+  // Values of 2^max_bits or more are recorded in the last bucket.
+  static constexpr int max_bits = 48;
+
+  // The number of buckets. The first 2 * sub_count buckets hold
+  // small values exactly, and each power of two from there up to
+  // 2^max_bits has sub_count buckets.
+  static constexpr int size = (max_bits - sub_bits + 1) * sub_count;
+
+  Histogram();
+
+  Histogram(Histogram const&) = delete;
+  Histogram& operator=(Histogram const&) = delete;
+
+  void record(std::uint64_t);
+  void merge(Histogram const&);
+  void clear();
+
+  std::uint64_t count() const { return load(count_); }
+  std::uint64_t sum() const   { return load(sum_); }
+  std::uint64_t min() const;
+  std::uint64_t max() const   { return load(max_); }
+  double        mean() const;
+
+  std::uint64_t percentile(double) const;
+
+  // Returns the number of values recorded in a bucket.
+  std::uint64_t bucket_count(int b) const { return load(counts_[b]); }
+
+  // Bucket indexing.
+  static int           bucket(std::uint64_t);
+  static std::uint64_t lower_bound(int);
+  static std::uint64_t upper_bound(int);
+
+private:
+  using Counter = std::atomic<std::uint64_t>;
+
+  static std::uint64_t load(Counter const& c)
+  {
+    return c.load(std::memory_order_relaxed);
+  }
+
+  // Increments a counter owned by the calling thread. This is a plain
+  // load and store rather than an atomic add.
+  static void add(Counter& c, std::uint64_t n)
+  {
+    c.store(load(c) + n, std::memory_order_relaxed);
+  }
+
+  Counter counts_[size];
+  Counter count_;
+  Counter sum_;
+  Counter min_;
+  Counter max_;
+};
+
+
+// Returns the index of the bucket holding the value. Values below
+// 2 * sub_count index their own bucket. Larger values are shifted
+// so that their leading sub_bits + 1 bits remain, which selects the
+// sub-bucket within the value's power of two.
+inline int
+Histogram::bucket(std::uint64_t v)
+{
+  if (v < 2 * sub_count)
+    return v;
+  int msb = 63 - __builtin_clzll(v);
+  if (msb >= max_bits)
+    return size - 1;
+  int shift = msb - sub_bits;
+  return (shift << sub_bits) + (v >> shift);
+}
+
+
+// Record a value.
+inline void
+Histogram::record(std::uint64_t v)
+{
+  add(counts_[bucket(v)], 1);
+  add(count_, 1);
+  add(sum_, v);
+  if (v < load(min_))
+    min_.store(v, std::memory_order_relaxed);
+  if (v > load(max_))
+    max_.store(v, std::memory_order_relaxed);
+}
+
+
+// A summary of a histogram's distribution.
+struct Histogram_summary
+{
+  Histogram_summary() = default;
+  Histogram_summary(Histogram const&);
+
+  std::uint64_t count;
+  std::uint64_t min;
+  std::uint64_t max;
+  double        mean;
+  std::uint64_t p50;
+  std::uint64_t p99;
+  std::uint64_t p999;
+};
+
+
+} // namespace ff
+
+#endif
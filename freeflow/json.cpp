@@ -4,6 +4,8 @@
 
 #include <cassert>
 #include <cctype>
+#include <cmath>
+#include <cstdio>
 #include <iostream>
 
 #include <boost/functional/hash.hpp>
@@ -467,6 +469,172 @@ Document::parse_object(char const*& first, char const* last)
 }
 
 
+// -------------------------------------------------------------------------- //
+//                                  Writing
+
+
+// Insert a comma before all but the first element of an array or
+// object. A value that follows a key is not separated.
+inline void
+Writer::separate()
+{
+  if (key_)
+    key_ = false;
+  else if (!first_)
+    *out_ += ',';
+  first_ = false;
+}
+
+
+// Append a quoted string, escaping quotes, backslashes and control
+// characters.
+void
+Writer::append_string(char const* s)
+{
+  static char const hex[] = "0123456789abcdef";
+  std::string& out = *out_;
+  out += '"';
+  for (; *s; ++s) {
+    unsigned char c = *s;
+    switch (c) {
+    case '"': out += "\\\""; break;
+    case '\\': out += "\\\\"; break;
+    case '\n': out += "\\n"; break;
+    case '\r': out += "\\r"; break;
+    case '\t': out += "\\t"; break;
+    default:
+      if (c < 0x20) {
+        out += "\\u00";
+        out += hex[c >> 4];
+        out += hex[c & 0xf];
+      } else {
+        out += c;
+      }
+    }
+  }
+  out += '"';
+}
+
+
+Writer&
+Writer::begin_object()
+{
+  separate();
+  *out_ += '{';
+  first_ = true;
+  return *this;
+}
+
+
+Writer&
+Writer::end_object()
+{
+  *out_ += '}';
+  first_ = false;
+  return *this;
+}
+
+
+Writer&
+Writer::begin_array()
+{
+  separate();
+  *out_ += '[';
+  first_ = true;
+  return *this;
+}
+
+
+Writer&
+Writer::end_array()
+{
+  *out_ += ']';
+  first_ = false;
+  return *this;
+}
+
+
+Writer&
+Writer::key(char const* k)
+{
+  separate();
+  append_string(k);
+  *out_ += ':';
+  key_ = true;
+  return *this;
+}
+
+
+// Format the digits of n from the end of the buffer.
+Writer&
+Writer::value(unsigned long long n)
+{
+  separate();
+  char buf[20];
+  char* p = buf + sizeof(buf);
+  do {
+    *--p = '0' + n % 10;
+    n /= 10;
+  } while (n);
+  out_->append(p, buf + sizeof(buf));
+  return *this;
+}
+
+
+Writer&
+Writer::value(long long n)
+{
+  if (n >= 0)
+    return value((unsigned long long)n);
+  separate();
+  *out_ += '-';
+  key_ = true; // Suppress the separator for the digits.
+  return value(0ull - (unsigned long long)n);
+}
+
+
+// Non-finite values cannot be represented in JSON, and are written
+// as null.
+Writer&
+Writer::value(double d)
+{
+  if (!std::isfinite(d))
+    return null();
+  separate();
+  char buf[32];
+  int n = std::snprintf(buf, sizeof(buf), "%.15g", d);
+  out_->append(buf, n);
+  return *this;
+}
+
+
+Writer&
+Writer::value(bool b)
+{
+  separate();
+  *out_ += b ? "true" : "false";
+  return *this;
+}
+
+
+Writer&
+Writer::value(char const* s)
+{
+  separate();
+  append_string(s);
+  return *this;
+}
+
+
+Writer&
+Writer::null()
+{
+  separate();
+  *out_ += "null";
+  return *this;
+}
+
+
 // -------------------------------------------------------------------------- //
 //                         Simplified construction
 
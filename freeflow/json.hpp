@@ -511,6 +511,66 @@ Document::parse(std::string& str)
 }
 
 
+// -------------------------------------------------------------------------- //
+//                                  Writing
+
+
+// A JSON writer appends a document to a string as it is built,
+// without constructing values. Separators are inserted as needed,
+// so a document is written as a sequence of begin/end, key, and
+// value calls. Integers are formatted directly into the string.
+// This makes writing large documents (e.g., statistics snapshots)
+// cheap enough to do on request.
+//
+// The writer does not check that the sequence of calls forms a
+// valid document.
+class Writer
+{
+public:
+  Writer(std::string& s)
+    : out_(&s), first_(true), key_(false)
+  { }
+
+  Writer& begin_object();
+  Writer& end_object();
+  Writer& begin_array();
+  Writer& end_array();
+
+  Writer& key(char const*);
+  Writer& key(std::string const& k) { return key(k.c_str()); }
+
+  Writer& value(long long);
+  Writer& value(unsigned long long);
+  Writer& value(int n)           { return value((long long)n); }
+  Writer& value(long n)          { return value((long long)n); }
+  Writer& value(unsigned n)      { return value((unsigned long long)n); }
+  Writer& value(unsigned long n) { return value((unsigned long long)n); }
+  Writer& value(double);
+  Writer& value(bool);
+  Writer& value(char const*);
+  Writer& value(std::string const& s) { return value(s.c_str()); }
+  Writer& null();
+
+  // Write a key and its value.
+  template<typename T>
+  Writer& member(char const* k, T const& v)
+  {
+    key(k);
+    return value(v);
+  }
+
+  std::string const& str() const { return *out_; }
+
+private:
+  void separate();
+  void append_string(char const*);
+
+  std::string* out_;
+  bool         first_; // True if the enclosing value has no elements.
+  bool         key_;   // True if the next value follows a key.
+};
+
+
 // -------------------------------------------------------------------------- //
 //                         Simplified construction
 
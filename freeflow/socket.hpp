@@ -283,6 +283,12 @@ struct reuse_address : boolean_option
 };
 
 
+struct reuse_port : boolean_option
+{
+  using boolean_option::boolean_option;
+};
+
+
 struct nonblocking : boolean_option
 {
   using boolean_option::boolean_option;
@@ -309,6 +315,19 @@ set_option(int sd, reuse_address opt)
 }
 
 
+// Allow multiple sockets to bind the same address. On Linux, the
+// kernel distributes incoming connections among the listeners.
+inline int
+set_option(int sd, reuse_port opt)
+{
+#ifdef SO_REUSEPORT
+  return ::setsockopt(sd, SOL_SOCKET, SO_REUSEPORT, &opt.value, sizeof(opt.value));
+#else
+  return 0;
+#endif
+}
+
+
 inline int
 set_option(int sd, nonblocking opt)
 {
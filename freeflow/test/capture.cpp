@@ -0,0 +1,291 @@
+
+#include "freeflow/capture.hpp"
+#include "freeflow/test/check.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace ff;
+
+
+// Builds a capture file in either byte order.
+struct Builder
+{
+  explicit Builder(bool big)
+    : big(big)
+  { }
+
+  void u8(int x) { bytes.push_back(x); }
+
+  void u16(std::uint16_t x)
+  {
+    for (int i = 0; i < 2; ++i)
+      u8(x >> (big ? 8 - 8 * i : 8 * i));
+  }
+
+  void u32(std::uint32_t x)
+  {
+    for (int i = 0; i < 4; ++i)
+      u8(x >> (big ? 24 - 8 * i : 8 * i));
+  }
+
+  void u64(std::uint64_t x)
+  {
+    for (int i = 0; i < 8; ++i)
+      u8(x >> (big ? 56 - 8 * i : 8 * i));
+  }
+
+  // Append n bytes of packet data, numbered from k, padded to 4.
+  void data(int n, int k, bool pad)
+  {
+    for (int i = 0; i < n; ++i)
+      u8(k + i);
+    while (pad && bytes.size() % 4)
+      u8(0);
+  }
+
+  // Write the bytes to a temporary file, returning its path.
+  std::string write(std::size_t n = -1) const
+  {
+    char path[] = "/tmp/capture-test-XXXXXX";
+    int fd = mkstemp(path);
+    n = std::min(n, bytes.size());
+    check(fd >= 0 && ::write(fd, bytes.data(), n) == (ssize_t)n, "write file");
+    ::close(fd);
+    return path;
+  }
+
+  bool                      big;
+  std::vector<std::uint8_t> bytes;
+};
+
+
+// Append a pcap file header and n packets of sizes 60, 61, ...,
+// captured at seconds 1, 2, ... and the given fraction.
+void
+pcap(Builder& b, std::uint32_t magic, int n, std::uint32_t frac)
+{
+  b.u32(magic);
+  b.u16(2);
+  b.u16(4);
+  b.u32(0);
+  b.u32(0);
+  b.u32(65535);
+  b.u32(cap::ethernet_link);
+  for (int i = 0; i < n; ++i) {
+    b.u32(i + 1);
+    b.u32(frac);
+    b.u32(60 + i);
+    b.u32(60 + i);
+    b.data(60 + i, i, false);
+  }
+}
+
+
+bool
+packet_is(cap::Packet const& p, int size, int k, std::uint64_t ns)
+{
+  if (p.captured_size() != size || p.time() != ns)
+    return false;
+  for (int i = 0; i < size; ++i)
+    if (p.data()[i] != std::uint8_t(k + i))
+      return false;
+  return true;
+}
+
+
+// Pcap files are read in both byte orders, with microsecond and
+// nanosecond timestamps.
+void
+test_pcap()
+{
+  for (bool big : {false, true}) {
+    for (std::uint32_t magic : {0xa1b2c3d4u, 0xa1b23c4du}) {
+      Builder b(big);
+      pcap(b, magic, 3, 250);
+      std::string path = b.write();
+      cap::File f(path.c_str());
+      std::uint64_t frac = magic == 0xa1b2c3d4u ? 250000 : 250;
+      check(f.link_type() == cap::ethernet_link, "pcap link type");
+      check(f.size() == 3, "pcap packets");
+      check(!f.truncated(), "pcap not truncated");
+      for (int i = 0; i < 3; ++i)
+        check(packet_is(f[i], 60 + i, i, (i + 1) * 1000000000ull + frac), "pcap packet");
+      check(f[0].timestamp().tv_sec == 1, "timeval seconds");
+      check(f[0].timestamp().tv_usec == long(frac / 1000), "timeval microseconds");
+      unlink(path.c_str());
+    }
+  }
+}
+
+
+// A file that ends within a packet is read up to that packet.
+void
+test_truncated()
+{
+  Builder b(false);
+  pcap(b, 0xa1b2c3d4, 3, 0);
+  std::string path = b.write(b.bytes.size() - 10);
+  cap::File f(path.c_str());
+  check(f.size() == 2, "truncated packets");
+  check(f.truncated(), "truncated");
+  unlink(path.c_str());
+
+  Builder c(false);
+  c.u32(0x12345678);
+  path = c.write();
+  bool threw = false;
+  try {
+    cap::File g(path.c_str());
+  } catch (std::runtime_error&) {
+    threw = true;
+  }
+  check(threw, "not a capture");
+  unlink(path.c_str());
+}
+
+
+// Append a pcapng section with one interface of the given timestamp
+// resolution, an enhanced, a simple and an obsolete packet block, and
+// a block of an unknown type.
+void
+pcapng_section(Builder& b, int tsresol)
+{
+  b.u32(0x0a0d0d0a);
+  b.u32(28);
+  b.u32(0x1a2b3c4d);
+  b.u16(1);
+  b.u16(0);
+  b.u64(-1);
+  b.u32(28);
+
+  // Interface, with if_tsresol and if_tsoffset.
+  b.u32(1);
+  b.u32(16 + 8 + 12 + 4 + 4);
+  b.u16(cap::ethernet_link);
+  b.u16(0);
+  b.u32(0);
+  b.u16(9);
+  b.u16(1);
+  b.u8(tsresol);
+  b.data(0, 0, true);
+  b.u16(14);
+  b.u16(8);
+  b.u64(5);
+  b.u16(0);
+  b.u16(0);
+  b.u32(16 + 8 + 12 + 4 + 4);
+
+  // Enhanced packet of 61 bytes at time 1024 units.
+  b.u32(6);
+  b.u32(32 + 64);
+  b.u32(0);
+  b.u32(0);
+  b.u32(1024);
+  b.u32(61);
+  b.u32(100);
+  b.data(61, 1, true);
+  b.u32(32 + 64);
+
+  // Simple packet of 40 bytes.
+  b.u32(3);
+  b.u32(16 + 40);
+  b.u32(40);
+  b.data(40, 2, true);
+  b.u32(16 + 40);
+
+  // Unknown block.
+  b.u32(0x0bad);
+  b.u32(16);
+  b.u32(0);
+  b.u32(16);
+
+  // Obsolete packet of 10 bytes at time 2048 units.
+  b.u32(2);
+  b.u32(32 + 12);
+  b.u16(0);
+  b.u16(0);
+  b.u32(0);
+  b.u32(2048);
+  b.u32(10);
+  b.u32(10);
+  b.data(10, 3, true);
+  b.u32(32 + 12);
+}
+
+
+// Pcapng files are read across sections of either byte order, with
+// decimal and binary timestamp resolutions and offsets.
+void
+test_pcapng()
+{
+  Builder b(false);
+  pcapng_section(b, 9);
+  Builder big(true);
+  pcapng_section(big, 0x80 | 10);
+  b.bytes.insert(b.bytes.end(), big.bytes.begin(), big.bytes.end());
+  std::string path = b.write();
+
+  cap::File f(path.c_str());
+  std::uint64_t offset = 5000000000ull;
+  check(f.link_type() == cap::ethernet_link, "pcapng link type");
+  check(f.size() == 6, "pcapng packets");
+  check(!f.truncated(), "pcapng not truncated");
+  check(packet_is(f[0], 61, 1, offset + 1024), "enhanced packet");
+  check(f[0].total_size() == 100, "enhanced packet size");
+  check(packet_is(f[1], 40, 2, 0), "simple packet");
+  check(packet_is(f[2], 10, 3, offset + 2048), "obsolete packet");
+  check(packet_is(f[3], 61, 1, offset + 1000000000), "binary resolution");
+  check(packet_is(f[5], 10, 3, offset + 2000000000), "big-endian section");
+  unlink(path.c_str());
+}
+
+
+// The partitions of a file cover its packets, and streams read them
+// in order.
+void
+test_partition()
+{
+  Builder b(false);
+  pcap(b, 0xa1b2c3d4, 10, 0);
+  std::string path = b.write();
+  cap::File f(path.c_str());
+
+  std::size_t next = 0;
+  for (int k = 0; k < 3; ++k) {
+    cap::Range r = f.partition(k, 3);
+    check(r.first == next && r.size() >= 3, "partition bounds");
+    cap::Stream s(f, r);
+    cap::Packet p;
+    while (s.get(p)) {
+      check(packet_is(p, 60 + next, next, (next + 1) * 1000000000ull), "stream order");
+      ++next;
+    }
+  }
+  check(next == 10, "partitions cover the file");
+
+  int n = 0;
+  cap::Stream s(cap::offline(path.c_str()));
+  cap::Packet p;
+  while (s.get(p))
+    ++n;
+  check(n == 10 && s.link_type() == cap::ethernet_link, "offline stream");
+  unlink(path.c_str());
+}
+
+
+int
+main()
+{
+  test_pcap();
+  test_truncated();
+  test_pcapng();
+  test_partition();
+  return check_status();
+}
@@ -0,0 +1,49 @@
+#ifndef FREEFLOW_TEST_CHECK_HPP
+#define FREEFLOW_TEST_CHECK_HPP
+
+// Checks for test programs. Unlike assert, a check is made in
+// release builds, and a failed check is reported without stopping
+// the program, so that one run reports every failure.
+
+#include <cstdlib>
+#include <iostream>
+
+
+namespace ff
+{
+
+// Returns the number of failed checks.
+inline int&
+check_failures()
+{
+  static int n = 0;
+  return n;
+}
+
+
+// Report a failure, described by what, unless ok is true.
+inline void
+check(bool ok, char const* what)
+{
+  if (!ok) {
+    std::cerr << "FAIL: " << what << '\n';
+    ++check_failures();
+  }
+}
+
+
+// Returns the exit status of a test program, reporting the number
+// of failed checks if there were any.
+inline int
+check_status()
+{
+  if (int n = check_failures()) {
+    std::cerr << n << " failures\n";
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+} // namespace ff
+
+#endif
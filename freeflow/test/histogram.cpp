@@ -0,0 +1,85 @@
+
+#include "freeflow/histogram.hpp"
+#include "freeflow/test/check.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+using namespace ff;
+
+
+// Every value falls within the bounds of its bucket, and the
+// buckets tile the value range.
+void
+test_buckets()
+{
+  for (std::uint64_t v = 0; v < 100000; ++v) {
+    int i = Histogram::bucket(v);
+    check(Histogram::lower_bound(i) <= v && v <= Histogram::upper_bound(i), "bucket bounds");
+  }
+  for (int i = 1; i < Histogram::size; ++i)
+    check(Histogram::lower_bound(i) == Histogram::upper_bound(i - 1) + 1, "buckets are contiguous");
+  check(Histogram::bucket(~0ull) == Histogram::size - 1, "large values");
+}
+
+
+// Percentiles agree with the exact values within the relative
+// error of a bucket.
+void
+test_percentiles()
+{
+  std::mt19937_64 rng(1);
+  std::lognormal_distribution<double> dist(8.0, 1.5);
+  std::vector<std::uint64_t> vs;
+  Histogram h;
+  for (int i = 0; i < 100000; ++i) {
+    std::uint64_t v = dist(rng);
+    vs.push_back(v);
+    h.record(v);
+  }
+  std::sort(vs.begin(), vs.end());
+
+  for (double p : {0.5, 0.9, 0.99, 0.999}) {
+    double want = vs[p * vs.size()];
+    double got = h.percentile(p);
+    std::cout << "p" << p * 100 << ": " << got << " (exact " << want << ")\n";
+    check(std::abs(got - want) <= want / Histogram::sub_count + 1, "percentile error");
+  }
+  check(h.count() == vs.size(), "count");
+  check(h.min() == vs.front() && h.max() == vs.back(), "min and max");
+}
+
+
+// Merging per-thread histograms gives the histogram of all values.
+void
+test_merge()
+{
+  Histogram a, b, all, m;
+  for (std::uint64_t v = 0; v < 5000; ++v) {
+    (v % 3 ? a : b).record(v * 7);
+    all.record(v * 7);
+  }
+  m.merge(a);
+  m.merge(b);
+  Histogram_summary s1(m), s2(all);
+  check(s1.count == s2.count && s1.p50 == s2.p50 && s1.p99 == s2.p99 &&
+        s1.p999 == s2.p999 && s1.min == s2.min && s1.max == s2.max, "merge");
+
+  Histogram empty;
+  Histogram_summary s3(empty);
+  check(s3.count == 0 && s3.min == 0 && s3.max == 0 && s3.p99 == 0, "empty");
+}
+
+
+int
+main()
+{
+  test_buckets();
+  test_percentiles();
+  test_merge();
+  return check_status();
+}
@@ -0,0 +1,106 @@
+
+#include "freeflow/json.hpp"
+#include "freeflow/test/check.hpp"
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+
+using namespace ff;
+using namespace ff::json;
+
+
+void
+check_eq(std::string const& got, char const* want, char const* what)
+{
+  if (got != want)
+    std::cerr << "  got:  " << got << "\n  want: " << want << '\n';
+  check(got == want, what);
+}
+
+
+// Separators are placed between elements at every depth.
+void
+test_structure()
+{
+  std::string s;
+  Writer w(s);
+  w.begin_object()
+     .member("a", 1)
+     .key("b").begin_array().value(1).value(2).begin_object().end_object().end_array()
+     .key("c").begin_object().member("d", "x").end_object()
+     .key("e").begin_array().end_array()
+   .end_object();
+  check_eq(s, R"({"a":1,"b":[1,2,{}],"c":{"d":"x"},"e":[]})", "nesting");
+
+  std::string t;
+  Writer v(t);
+  v.begin_array().begin_array().end_array().begin_array().value(true).end_array().end_array();
+  check_eq(t, "[[],[true]]", "nested arrays");
+}
+
+
+// Numbers and literals.
+void
+test_values()
+{
+  std::string s;
+  Writer w(s);
+  w.begin_array()
+     .value(0)
+     .value(-1)
+     .value(std::numeric_limits<long long>::min())
+     .value(std::numeric_limits<std::uint64_t>::max())
+     .value(0.5)
+     .value(std::numeric_limits<double>::infinity())
+     .value(false)
+     .null()
+   .end_array();
+  check_eq(s, "[0,-1,-9223372036854775808,18446744073709551615,0.5,null,false,null]", "values");
+}
+
+
+// Strings are escaped.
+void
+test_strings()
+{
+  std::string s;
+  Writer w(s);
+  w.value("a\"b\\c\nd\x01");
+  check_eq(s, R"("a\"b\\c\nd\u0001")", "escapes");
+}
+
+
+// The output can be read back.
+void
+test_parse()
+{
+  std::string s;
+  Writer w(s);
+  w.begin_object().member("x", 42).member("y", "z").end_object();
+
+  char buf[1024];
+  Buffer_allocator alloc(buf, sizeof(buf));
+  Document doc(alloc);
+  char const* str = s.c_str();
+  Object* o = as<Object>(doc.parse(str));
+  check(o != nullptr, "parses as an object");
+  if (!o)
+    return;
+  Value* x = (*o)["x"];
+  Value* y = (*o)["y"];
+  check(x && *cast<Number>(x) == "42", "number member");
+  check(y && *cast<String>(y) == "z", "string member");
+}
+
+
+int
+main()
+{
+  test_structure();
+  test_values();
+  test_strings();
+  test_parse();
+  return check_status();
+}
@@ -58,12 +58,11 @@ now()
 }
 
 
-// Convert a timeval structure to a microsecond duration..
+// Convert a timeval structure to a microsecond duration.
 inline Microseconds
 to_duration(timeval ts)
 {
-  Nanoseconds ns(ts.tv_sec * 1000000 + ts.tv_usec);
-  return duration_cast<Microseconds>(ns);
+  return Microseconds(ts.tv_sec * 1000000 + ts.tv_usec);
 }
 
 
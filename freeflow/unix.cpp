@@ -1,7 +1,2 @@
 
 #include "unix.hpp"
-
-int main()
-{
-  
-}
@@ -28,6 +28,8 @@ struct Socket_address : sockaddr_un
   Socket_address(char const*);
   Socket_address(std::string const&);
 
+  static constexpr Family address_family() { return AF_UNIX; }
+
   Family      family() const { return sun_family; }
   char const* path() const   { return sun_path; }
 };
@@ -85,6 +87,7 @@ unlink(Socket_address const& addr)
 
 // Convenience names.
 using Unix_socket_address = un::Socket_address;
+using Unix_stream_socket  = Stream_socket<Unix_socket_address>;
 
 } // namespace ff
 
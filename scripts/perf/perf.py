@@ -0,0 +1,440 @@
+#!/usr/bin/env python3
+#
+# Performance regression tracking.
+#
+# Runs the benchmarks of a build several times, stores the results
+# as JSON keyed by git commit and CPU model, and compares a result
+# with a stored baseline. A metric regresses when its median is worse
+# than the baseline's by more than the threshold and the confidence
+# interval of the difference (Mann-Whitney) excludes zero.
+#
+# usage: perf.py run [--build DIR] [--repetitions N] [--no-drivers]
+#                    [--filter TEXT] [--compare]
+#        perf.py compare [--baseline REF] [--threshold PCT]
+#                        [--confidence C] [RESULT]
+#        perf.py baseline [REF]
+#        perf.py list
+#
+# A REF is a stored commit (or a prefix of one) or a path to a
+# result file. Results are stored in perf-results/<cpu>/<commit>.json
+# in the source tree unless --store or PERF_STORE says otherwise;
+# a commit with uncommitted changes is stored as <commit>-dirty.
+# The baseline of each CPU model is perf-results/<cpu>/baseline.json.
+#
+# The benchmarks are:
+#
+#   fp-bench-runtime   Runtime primitives, in ns/op.
+#   fp-bench-forward   In-process forwarding of the wire and nop
+#                      applications: Mpps, cycles/packet and p99.
+#   json-bench         freeflow JSON parsing of a generated document.
+#   driver             The TCP wire driver (fp-wire-epoll-tpp) under
+#                      traffic.py, in Mpps. This goes through loopback
+#                      TCP and is the noisiest metric; --no-drivers
+#                      skips it.
+#
+# compare exits with status 1 if any metric regressed, so it can
+# gate a CI job.
+
+import argparse
+import functools
+import json
+import math
+import os
+import platform
+import re
+import shutil
+import signal
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+
+src = os.path.abspath(os.path.join(os.path.dirname(__file__), '..', '..'))
+traffic = os.path.join(src, 'scripts', 'pgo', 'traffic.py')
+
+
+# -------------------------------------------------------------------------- #
+# Host and commit
+
+def cpu_model():
+  try:
+    with open('/proc/cpuinfo') as f:
+      for line in f:
+        if line.startswith('model name'):
+          return line.split(':', 1)[1].strip()
+  except OSError:
+    pass
+  return platform.processor() or platform.machine()
+
+
+# Returns a file name friendly version of the CPU model.
+def cpu_key(model):
+  return re.sub(r'[^a-z0-9]+', '-', model.lower()).strip('-')
+
+
+def git(*args):
+  return subprocess.run(['git', '-C', src] + list(args), check=True,
+                        stdout=subprocess.PIPE, universal_newlines=True).stdout.strip()
+
+
+def commit():
+  head = git('rev-parse', 'HEAD')
+  dirty = subprocess.run(['git', '-C', src, 'diff', '--quiet', 'HEAD']).returncode != 0
+  return head, dirty
+
+
+# Returns the name under which the results of a commit are stored.
+def result_name(head, dirty):
+  return head + ('-dirty' if dirty else '')
+
+
+# -------------------------------------------------------------------------- #
+# Metrics
+#
+# A metric is a list of samples, one per repetition, with a unit and
+# a direction.
+
+def add(metrics, name, value, unit, better):
+  m = metrics.setdefault(name, {'unit': unit, 'better': better, 'samples': []})
+  m['samples'].append(value)
+
+
+def environment(build):
+  env = dict(os.environ)
+  env['LD_LIBRARY_PATH'] = '%s/fp-lite:%s/freeflow' % (build, build)
+  return env
+
+
+def run_json(build, args, cwd):
+  with tempfile.NamedTemporaryFile(suffix='.json') as out:
+    subprocess.run(args + ['--json', out.name], cwd=cwd, env=environment(build),
+                   check=True, stdout=subprocess.DEVNULL)
+    with open(out.name) as f:
+      return json.load(f)
+
+
+def bench_runtime(build, metrics, filter):
+  args = ['./bench/fp-bench-runtime', '--repetitions', '3', '--min-time', '0.1']
+  if filter:
+    args += ['--filter', filter]
+  doc = run_json(build, args, os.path.join(build, 'fp-lite'))
+  for b in doc['benchmarks']:
+    add(metrics, 'runtime/' + b['name'], b['median_ns'], 'ns', 'lower')
+
+
+def bench_forward(build, metrics):
+  for app in ['wire', 'nop']:
+    doc = run_json(build, ['./bench/fp-bench-forward', 'apps/%s.app' % app,
+                           '--packets', '5000000'],
+                   os.path.join(build, 'fp-lite'))
+    for r in doc['results']:
+      name = 'forward/%s/%dt/' % (app, r['threads'])
+      add(metrics, name + 'mpps', r['mpps'], 'Mpps', 'higher')
+      add(metrics, name + 'cycles_per_packet', r['cycles_per_packet'], 'cycles', 'lower')
+      if r['latency_ns']['samples']:
+        add(metrics, name + 'p99', r['latency_ns']['p99'], 'ns', 'lower')
+
+
+# Write a JSON document of about n bytes that resembles a statistics
+# snapshot: an array of objects with numbers, strings and arrays.
+def make_json(path, n):
+  items = []
+  size = 0
+  i = 0
+  while size < n:
+    item = {'id': i, 'name': 'port-%d' % i, 'link_down': i % 7 == 0,
+            'packets': i * 7919, 'ratio': i / 3.0,
+            'buckets': [[j * 64, j * i] for j in range(8)]}
+    size += len(json.dumps(item))
+    items.append(item)
+    i += 1
+  with open(path, 'w') as f:
+    json.dump({'ports': items}, f)
+
+
+def bench_json(build, metrics, doc):
+  out = subprocess.run([os.path.join(build, 'freeflow', 'test', 'json-bench'), doc],
+                       env=environment(build), check=True,
+                       stdout=subprocess.PIPE, universal_newlines=True).stdout
+  m = re.search(r'Average parse time: ([0-9.e+-]+)ms', out)
+  if m:
+    add(metrics, 'json/parse', float(m.group(1)), 'ms', 'lower')
+
+
+def bench_driver(build, metrics, packets):
+  cwd = os.path.join(build, 'fp-lite')
+  driver = subprocess.Popen(['./drivers/wire/fp-wire-epoll-tpp', '--quiet'], cwd=cwd,
+                            env=environment(build), stdout=subprocess.DEVNULL,
+                            stderr=subprocess.DEVNULL)
+  try:
+    out = subprocess.run([sys.executable, traffic, '--packets', str(packets)],
+                         check=True, stdout=subprocess.PIPE,
+                         universal_newlines=True, timeout=300).stdout
+  finally:
+    driver.send_signal(signal.SIGINT)
+    try:
+      driver.wait(10)
+    except subprocess.TimeoutExpired:
+      driver.kill()
+      driver.wait()
+  m = re.search(r'mpps=([0-9.]+)', out)
+  if m:
+    add(metrics, 'driver/tpp/mpps', float(m.group(1)), 'Mpps', 'higher')
+
+
+# -------------------------------------------------------------------------- #
+# Storage
+
+def store_dir(args):
+  return args.store or os.environ.get('PERF_STORE') or os.path.join(src, 'perf-results')
+
+
+# Splits a result name into its commit and whether the tree was
+# dirty.
+def split_name(name):
+  if name.endswith('-dirty'):
+    return name[:-len('-dirty')], True
+  return name, False
+
+
+# Returns true if a stored result name matches a ref: a prefix of
+# its commit, with a -dirty suffix if the result has one.
+def matches(name, ref):
+  head, dirty = split_name(name)
+  prefix, want = split_name(ref)
+  return head.startswith(prefix) and dirty == want
+
+
+# Find a stored result by path or commit prefix. Results for the
+# host's CPU are preferred.
+def resolve(args, ref):
+  if os.path.isfile(ref):
+    return ref
+  store = store_dir(args)
+  cpus = [cpu_key(cpu_model())]
+  if os.path.isdir(store):
+    cpus += sorted(d for d in os.listdir(store) if d not in cpus)
+  for cpu in cpus:
+    d = os.path.join(store, cpu)
+    if not os.path.isdir(d):
+      continue
+    names = [f[:-5] for f in os.listdir(d) if f.endswith('.json')]
+    if ref in names:
+      found = [ref]
+    else:
+      found = sorted(f for f in names if matches(f, ref))
+    if len(found) > 1:
+      sys.exit('perf: %s is ambiguous: %s' % (ref, ', '.join(found)))
+    if found:
+      return os.path.join(d, found[0] + '.json')
+  sys.exit('perf: no stored result for %s' % ref)
+
+
+def load(path):
+  with open(path) as f:
+    return json.load(f)
+
+
+# -------------------------------------------------------------------------- #
+# Statistics
+
+# Returns the number of orderings of m samples of one group and n of
+# another for each value u of the Mann-Whitney statistic, the number
+# of pairs in which the first group's sample is the larger.
+@functools.lru_cache(maxsize=None)
+def u_counts(m, n):
+  if m == 0 or n == 0:
+    return (1,)
+  counts = [0] * (m * n + 1)
+  # The largest sample is either from the first group, which then
+  # exceeds all n of the second, or from the second.
+  for u, c in enumerate(u_counts(m - 1, n)):
+    counts[u + n] += c
+  for u, c in enumerate(u_counts(m, n - 1)):
+    counts[u] += c
+  return tuple(counts)
+
+
+# Compare the samples of a metric. Returns the relative change of
+# the median and the confidence interval of that change, or None for
+# the interval when there are too few samples to reach the requested
+# confidence.
+#
+# The interval is the distribution-free one for a shift between the
+# two distributions: the range of the pairwise differences that
+# excludes, in each tail, as many as the Mann-Whitney test allows.
+# Unlike an interval on the mean, a single outlying run does not
+# move it far.
+def compare_samples(base, new, confidence):
+  mb, mn = statistics.median(base), statistics.median(new)
+  change = (mn - mb) / mb if mb else 0.0
+  if not mb:
+    return change, None
+  counts = u_counts(len(base), len(new))
+  limit = (1 - confidence) / 2 * math.comb(len(base) + len(new), len(base))
+  k, tail = 0, counts[0]
+  while tail <= limit:
+    k += 1
+    tail += counts[k]
+  if k == 0:
+    return change, None
+  diffs = sorted(y - x for x in base for y in new)
+  return change, (diffs[k - 1] / mb, diffs[-k] / mb)
+
+
+# Compare two results. Returns the number of regressions.
+def report(base, new, threshold, confidence):
+  print('baseline: %s%s (%s)' % (base['commit'][:12], '-dirty' if base['dirty'] else '',
+                                 base['date']))
+  print('result:   %s%s (%s)' % (new['commit'][:12], '-dirty' if new['dirty'] else '',
+                                 new['date']))
+  if base['cpu'] != new['cpu']:
+    print('warning: results are from different CPUs: %s, %s' % (base['cpu'], new['cpu']))
+  print('%-44s %12s %12s %8s %19s  %s' % ('metric', 'baseline', 'result', 'change',
+                                         '%d%% interval' % round(confidence * 100), ''))
+  regressions = 0
+  for name in sorted(set(base['metrics']) & set(new['metrics'])):
+    b, n = base['metrics'][name], new['metrics'][name]
+    change, ci = compare_samples(b['samples'], n['samples'], confidence)
+    worse = change > 0 if b['better'] == 'lower' else change < 0
+    significant = ci is not None and (ci[0] > 0 or ci[1] < 0)
+    verdict = ''
+    if abs(change) * 100 > threshold and significant:
+      verdict = 'REGRESSION' if worse else 'improved'
+      regressions += worse
+    interval = '[%+6.1f%%, %+6.1f%%]' % (ci[0] * 100, ci[1] * 100) if ci else 'n/a'
+    print('%-44s %12.4g %12.4g %+7.1f%% %19s  %s' % (
+      name, statistics.median(b['samples']), statistics.median(n['samples']),
+      change * 100, interval, verdict))
+  for name in sorted(set(base['metrics']) ^ set(new['metrics'])):
+    print('%-44s only in the %s' % (name, 'baseline' if name in base['metrics'] else 'result'))
+  print('%d regression%s over %g%%' % (regressions, '' if regressions == 1 else 's', threshold))
+  return regressions
+
+
+# -------------------------------------------------------------------------- #
+# Commands
+
+def cmd_run(args):
+  build = os.path.abspath(args.build)
+  head, dirty = commit()
+  model = cpu_model()
+  metrics = {}
+  with tempfile.TemporaryDirectory() as tmp:
+    doc = os.path.join(tmp, 'bench.json')
+    make_json(doc, 8 << 20)
+    for i in range(args.repetitions):
+      print('[perf] repetition %d of %d' % (i + 1, args.repetitions), flush=True)
+      bench_runtime(build, metrics, args.filter)
+      bench_forward(build, metrics)
+      bench_json(build, metrics, doc)
+      if not args.no_drivers:
+        bench_driver(build, metrics, args.packets)
+
+  result = {
+    'commit': head,
+    'dirty': dirty,
+    'cpu': model,
+    'host': platform.node(),
+    'date': time.strftime('%Y-%m-%dT%H:%M:%S%z'),
+    'repetitions': args.repetitions,
+    'metrics': metrics,
+  }
+  d = os.path.join(store_dir(args), cpu_key(model))
+  os.makedirs(d, exist_ok=True)
+  path = os.path.join(d, result_name(head, dirty) + '.json')
+  with open(path, 'w') as f:
+    json.dump(result, f, indent=1)
+  print('[perf] wrote %s' % path)
+
+  if args.compare:
+    baseline = os.path.join(d, 'baseline.json')
+    if not os.path.isfile(baseline):
+      print('[perf] no baseline for %s; use "perf.py baseline" to set one' % model)
+      return 0
+    return 1 if report(load(baseline), result, args.threshold, args.confidence) else 0
+  return 0
+
+
+def cmd_compare(args):
+  if args.result:
+    new_path = resolve(args, args.result)
+  else:
+    new_path = resolve(args, result_name(*commit()))
+  new = load(new_path)
+  if args.baseline:
+    base_path = resolve(args, args.baseline)
+  else:
+    base_path = os.path.join(store_dir(args), cpu_key(new['cpu']), 'baseline.json')
+    if not os.path.isfile(base_path):
+      sys.exit('perf: no baseline for %s' % new['cpu'])
+  return 1 if report(load(base_path), new, args.threshold, args.confidence) else 0
+
+
+def cmd_baseline(args):
+  path = resolve(args, args.ref) if args.ref else resolve(args, result_name(*commit()))
+  r = load(path)
+  dst = os.path.join(store_dir(args), cpu_key(r['cpu']), 'baseline.json')
+  os.makedirs(os.path.dirname(dst), exist_ok=True)
+  shutil.copyfile(path, dst)
+  print('[perf] baseline for %s is %s' % (r['cpu'], r['commit'][:12]))
+  return 0
+
+
+def cmd_list(args):
+  store = store_dir(args)
+  if not os.path.isdir(store):
+    return 0
+  for cpu in sorted(os.listdir(store)):
+    print(cpu)
+    d = os.path.join(store, cpu)
+    rs = [(f, load(os.path.join(d, f))) for f in os.listdir(d) if f.endswith('.json')]
+    for f, r in sorted(rs, key=lambda x: x[1]['date']):
+      print('  %-48s %s  %d metrics' % (f, r['date'], len(r['metrics'])))
+  return 0
+
+
+def main():
+  parser = argparse.ArgumentParser(description='Performance regression tracking.')
+  parser.add_argument('--store', help='result directory (default perf-results)')
+  sub = parser.add_subparsers(dest='command')
+  sub.required = True
+
+  def comparison(p):
+    p.add_argument('--threshold', type=float, default=5.0,
+                   help='smallest change, in percent, that is flagged')
+    p.add_argument('--confidence', type=float, default=0.95)
+
+  p = sub.add_parser('run', help='run the benchmarks and store the result')
+  p.add_argument('--build', default=os.path.join(src, 'build'))
+  p.add_argument('--repetitions', type=int, default=5)
+  p.add_argument('--no-drivers', action='store_true')
+  p.add_argument('--packets', type=int, default=1000000,
+                 help='packets per driver run')
+  p.add_argument('--filter', help='select runtime benchmarks by name')
+  p.add_argument('--compare', action='store_true',
+                 help='compare with the baseline after running')
+  comparison(p)
+  p.set_defaults(func=cmd_run)
+
+  p = sub.add_parser('compare', help='compare a result with a baseline')
+  p.add_argument('--baseline', help='baseline result (default: the stored baseline)')
+  p.add_argument('result', nargs='?', help='result (default: the current commit)')
+  comparison(p)
+  p.set_defaults(func=cmd_compare)
+
+  p = sub.add_parser('baseline', help='make a stored result the baseline')
+  p.add_argument('ref', nargs='?', help='result (default: the current commit)')
+  p.set_defaults(func=cmd_baseline)
+
+  p = sub.add_parser('list', help='list stored results')
+  p.set_defaults(func=cmd_list)
+
+  args = parser.parse_args()
+  sys.exit(args.func(args))
+
+
+if __name__ == '__main__':
+  main()
@@ -0,0 +1,207 @@
+#!/bin/bash
+#
+# Profile-guided optimization pipeline for the runtime, drivers and
+# applications.
+#
+#   1. Build the default (Release) configuration.
+#   2. Build with instrumentation and run the training workload.
+#   3. Rebuild in the same directory using the recorded profile.
+#   4. Optionally, relink with relocations and apply BOLT to the
+#      driver and runtime using a perf profile of the training run.
+#   5. Measure each build and write a report.
+#
+# usage: scripts/pgo/pgo.sh [output-dir]
+#
+# Environment:
+#
+#   PACKETS           Packets per traffic run (default 2000000).
+#   BOLT              Set to 1 to run the BOLT step. Requires perf,
+#                     perf2bolt and llvm-bolt.
+#   FIREWALL_APP_DIR  Directory containing firewall.app. When set,
+#                     the firewall driver is trained and measured too.
+#
+# The training workload is synthetic: traffic.py pushes framed
+# packets through the TCP wire driver, and fp-bench-app runs the
+# wire and nop applications in a tight loop.
+
+set -e
+
+src=$(cd "$(dirname "$0")/../.." && pwd)
+out=${1:-$src/build-pgo}
+traffic=$src/scripts/pgo/traffic.py
+packets=${PACKETS:-2000000}
+jobs=$(nproc)
+
+base=$out/base
+pgo=$out/pgo
+profile=$out/profile
+report=$out/report.txt
+
+targets="fp-lite-rt fp-wire-epoll-tpp fp-bench-app wire nop"
+if [ -n "$FIREWALL_APP_DIR" ]; then
+  targets="$targets fp-firewall"
+fi
+
+have() {
+  command -v "$1" > /dev/null 2>&1
+}
+
+
+# build <dir> [cmake options...]
+build() {
+  local dir=$1
+  shift
+  cmake -S "$src" -B "$dir" \
+    -DCMAKE_BUILD_TYPE=Release \
+    -DFREEFLOW_PGO_DIR="$profile" \
+    "$@" > /dev/null
+  cmake --build "$dir" -j"$jobs" --target $targets
+}
+
+
+# Runs a driver, pushes traffic through it, and stops it. Prints the
+# output of traffic.py. If a perf command is given, it is attached
+# to the driver for the duration of the traffic.
+#
+# drive <build-dir> <driver> <sinks> [perf args...]
+drive() {
+  local dir=$1 driver=$2 sinks=$3
+  shift 3
+  (
+    cd "$dir/fp-lite"
+    export LD_LIBRARY_PATH="$dir/fp-lite:$dir/freeflow"
+    $driver > "$out/driver.log" 2>&1 &
+    local dpid=$!
+    trap "kill -INT $dpid 2> /dev/null" EXIT
+    local ppid=
+    if [ $# -gt 0 ]; then
+      perf "$@" -p $dpid > /dev/null 2>&1 &
+      ppid=$!
+    fi
+    python3 "$traffic" --packets "$packets" --sinks "$sinks"
+    if [ -n "$ppid" ]; then
+      kill -INT $ppid
+      wait $ppid || true
+    fi
+    kill -INT $dpid
+    wait $dpid || true
+    trap - EXIT
+  )
+}
+
+
+# Run the application microbenchmark. Prints its Mpps.
+#
+# bench <build-dir> <app>
+bench() {
+  (
+    cd "$1/fp-lite"
+    export LD_LIBRARY_PATH="$1/fp-lite:$1/freeflow"
+    ./bench/fp-bench-app apps/$2.app 50000000 | sed -n -e 's/.*Mpps: \([^ ]*\).*/\1/p'
+  )
+}
+
+
+# Train the instrumented build.
+train() {
+  local dir=$1
+  (cd "$dir/fp-lite" && ./bench/fp-bench-app apps/wire.app 20000000 > /dev/null)
+  (cd "$dir/fp-lite" && ./bench/fp-bench-app apps/nop.app 20000000 > /dev/null)
+  drive "$dir" drivers/wire/fp-wire-epoll-tpp 1 > /dev/null
+  if [ -n "$FIREWALL_APP_DIR" ]; then
+    drive "$dir" "drivers/firewall/fp-firewall once $FIREWALL_APP_DIR/" 2 > /dev/null
+  fi
+}
+
+
+# Measure a build and append a line to the report.
+#
+# measure <label> <build-dir> [driver sinks]
+measure() {
+  local label=$1 dir=$2 driver=${3:-drivers/wire/fp-wire-epoll-tpp} sinks=${4:-1}
+  local wire nop mpps icache="n/a"
+  wire=$(bench "$dir" wire)
+  nop=$(bench "$dir" nop)
+  if have perf; then
+    drive "$dir" "$driver" $sinks stat -x, -o "$out/perf-$label.csv" \
+      -e L1-icache-load-misses,instructions > "$out/traffic-$label.txt"
+    icache=$(awk -F, '
+      /L1-icache-load-misses/ { m = $1 }
+      /instructions/          { i = $1 }
+      END { if (i > 0) printf "%.3f", m * 1000 / i; else print "n/a" }
+    ' "$out/perf-$label.csv")
+  else
+    drive "$dir" "$driver" $sinks > "$out/traffic-$label.txt"
+  fi
+  mpps=$(sed -e 's/.*mpps=\([^ ]*\).*/\1/' "$out/traffic-$label.txt")
+  printf "%-8s %14s %14s %14s %16s\n" "$label" "$mpps" "$wire" "$nop" "$icache" >> "$report"
+}
+
+
+mkdir -p "$out"
+
+echo "[pgo] building baseline"
+build "$base"
+
+echo "[pgo] building instrumented"
+rm -rf "$profile"
+mkdir -p "$profile"
+build "$pgo" -DFREEFLOW_PGO=generate
+
+echo "[pgo] training"
+train "$pgo"
+if have llvm-profdata && ls "$profile"/*.profraw > /dev/null 2>&1; then
+  llvm-profdata merge -o "$profile/default.profdata" "$profile"/*.profraw
+fi
+
+# BOLT needs relocations in the final binaries.
+bolt_opt=OFF
+if [ "$BOLT" = 1 ]; then
+  bolt_opt=ON
+fi
+
+echo "[pgo] building with profile"
+cmake --build "$pgo" --target clean
+build "$pgo" -DFREEFLOW_PGO=use -DFREEFLOW_BOLT=$bolt_opt
+
+labels="base pgo"
+if [ "$BOLT" = 1 ]; then
+  if have perf && have perf2bolt && have llvm-bolt; then
+    # Optimize a copy of the PGO build. The copied binaries still
+    # refer to the PGO build's libraries, so drive and bench put
+    # the copy's libraries first on the search path.
+    echo "[pgo] applying BOLT"
+    bolt=$out/bolt
+    rm -rf "$bolt"
+    cp -a "$pgo" "$bolt"
+    drive "$bolt" drivers/wire/fp-wire-epoll-tpp 1 \
+      record -e cycles:u -j any,u -o "$out/perf.data" > /dev/null
+    for bin in drivers/wire/fp-wire-epoll-tpp libfp-lite-rt.so; do
+      perf2bolt -p "$out/perf.data" -o "$out/$(basename $bin).fdata" "$bolt/fp-lite/$bin"
+      llvm-bolt "$bolt/fp-lite/$bin" -o "$bolt/fp-lite/$bin.bolt" \
+        -data="$out/$(basename $bin).fdata" \
+        -reorder-blocks=ext-tsp -reorder-functions=hfsort \
+        -split-functions -split-all-cold -dyno-stats
+      mv "$bolt/fp-lite/$bin.bolt" "$bolt/fp-lite/$bin"
+    done
+    labels="$labels bolt"
+  else
+    echo "[pgo] skipping BOLT: perf, perf2bolt or llvm-bolt not found"
+  fi
+fi
+
+echo "[pgo] measuring"
+printf "%-8s %14s %14s %14s %16s\n" \
+  "build" "tpp (Mpps)" "wire (Mpps)" "nop (Mpps)" "icache MPKI" > "$report"
+for label in $labels; do
+  measure $label "$out/$label"
+done
+if [ -n "$FIREWALL_APP_DIR" ]; then
+  echo >> "$report"
+  echo "firewall" >> "$report"
+  for label in $labels; do
+    measure $label "$out/$label" "drivers/firewall/fp-firewall once $FIREWALL_APP_DIR/" 2
+  done
+fi
+
+cat "$report"
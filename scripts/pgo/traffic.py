@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+#
+# Synthetic traffic for a TCP wire driver.
+#
+# Connects a source and one or more sinks to the driver, sends
+# framed packets (a 4-byte length in network order, then the
+# payload) on the source, and counts the bytes that arrive on the
+# sinks. Prints the forwarding rate as a single line:
+#
+#   packets=<sent> received=<packets> seconds=<s> mpps=<rate>
+#
+# usage: traffic.py [--host H] [--port P] [--packets N] [--size S]
+#                   [--sinks K]
+
+import argparse
+import socket
+import struct
+import threading
+import time
+
+
+def sink(conn, frame, counts, i, done):
+  total = 0
+  conn.settimeout(1.0)
+  while not done.is_set():
+    try:
+      data = conn.recv(1 << 20)
+    except socket.timeout:
+      continue
+    if not data:
+      break
+    total += len(data)
+    counts[i] = (total // frame, time.monotonic())
+
+
+# Connect to the driver, waiting for it to start listening.
+def connect(host, port, timeout=30.0):
+  deadline = time.monotonic() + timeout
+  while True:
+    try:
+      return socket.create_connection((host, port))
+    except ConnectionRefusedError:
+      if time.monotonic() > deadline:
+        raise
+      time.sleep(0.1)
+
+
+def main():
+  parser = argparse.ArgumentParser()
+  parser.add_argument('--host', default='127.0.0.1')
+  parser.add_argument('--port', type=int, default=5000)
+  parser.add_argument('--packets', type=int, default=1000000)
+  parser.add_argument('--size', type=int, default=64)
+  parser.add_argument('--sinks', type=int, default=1)
+  args = parser.parse_args()
+
+  # The driver binds ports in the order that connections arrive,
+  # so connect one at a time.
+  source = connect(args.host, args.port)
+  time.sleep(0.2)
+  sinks = []
+  for _ in range(args.sinks):
+    sinks.append(connect(args.host, args.port))
+    time.sleep(0.2)
+
+  frame = 4 + args.size
+  counts = [(0, 0.0)] * args.sinks
+  done = threading.Event()
+  threads = [threading.Thread(target=sink, args=(s, frame, counts, i, done))
+             for i, s in enumerate(sinks)]
+  for t in threads:
+    t.start()
+
+  # Send in large writes so that the generator is not the bottleneck.
+  pkt = struct.pack('!I', args.size) + bytes(args.size)
+  batch = 1024
+  start = time.monotonic()
+  sent = 0
+  while sent < args.packets:
+    n = min(batch, args.packets - sent)
+    source.sendall(pkt * n)
+    sent += n
+
+  # Wait until every packet arrives, or the sinks go idle.
+  while True:
+    received = sum(c for c, _ in counts)
+    last = max([t for _, t in counts] + [start])
+    if received >= sent or time.monotonic() - last > 2.0:
+      break
+    time.sleep(0.05)
+
+  done.set()
+  for t in threads:
+    t.join()
+  source.close()
+  for s in sinks:
+    s.close()
+
+  secs = max(last - start, 1e-9)
+  print('packets=%d received=%d seconds=%.3f mpps=%.4f'
+        % (sent, received, secs, received / secs / 1e6))
+
+
+if __name__ == '__main__':
+  main()